@@ -0,0 +1,22 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Bump allocator for data that lives and dies together (e.g. everything parsed from
+   one command line): allocation is a pointer increment, and arena_destroy() frees it
+   all at once. Blocks grow geometrically and never move. Not thread-safe. */
+typedef struct Arena Arena;
+
+/* first_block: bytes in the first block (0 = a small default) */
+Arena *arena_create(size_t first_block);
+void arena_destroy(Arena *a);
+
+/* zeroed, aligned for any type; NULL when out of memory */
+void *arena_alloc(Arena *a, size_t n);
+char *arena_strndup(Arena *a, const char *s, size_t n);
+
+/* bytes handed out so far */
+size_t arena_used(const Arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,39 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+/* Commands run inside the terminal instead of as a child process. A builtin that
+   forms a whole command runs on the calling (main) thread; one that is a pipeline
+   stage runs on a short-lived thread of its own, writing into the stage's pipe. */
+
+typedef struct BuiltinIO
+{
+    int tab_idx;
+    int fd_out; /* -1: append to the tab's scrollback */
+    int fd_err; /* -1: append to the tab's scrollback */
+} BuiltinIO;
+
+/* returns the exit status (0..255) */
+typedef int (*builtin_fn)(int argc, char **argv, const BuiltinIO *io);
+
+/* changes or reads the terminal's own state (cwd, environment, history, tabs), so it
+   only runs as a whole command */
+#define BUILTIN_SPECIAL 1
+
+typedef struct Builtin
+{
+    const char *name;
+    builtin_fn fn;
+    int flags;
+} Builtin;
+
+/* perfect-hash lookup; NULL if name is not a builtin */
+const Builtin *builtin_lookup(const char *name);
+
+/* run b as a pipeline stage on its own thread. argv is copied; out_fd and err_fd are
+   owned by the stage from here on and closed when it ends, after which done() is
+   called on that thread with a waitpid()-style status. Returns 0 if the thread started
+   (on failure the fds are closed and done() is not called). */
+int builtin_start_stage(const Builtin *b, char **argv, int tab_idx, int out_fd, int err_fd,
+                        void (*done)(int status, void *arg), void *arg);
+
+#endif /* BUILTINS_H */
@@ -1,16 +1,79 @@
 #ifndef CMD_EXEC_H
 #define CMD_EXEC_H
 
-/* Run a command line (supports pipes, redirs, quoted tokens) in tab `tab_idx`.
- * Implementation will capture stdout/stderr and append into the tab's output. */
+#include <stddef.h>
+
+/* Run a command line in tab `tab_idx`: lists (;), and-or chains (&& ||), pipelines,
+ * subshells and redirections, see shell_parse.h. Captures stdout/stderr and appends
+ * them to the tab's output. A stage written `batch [-j N] cmd ... pattern...` runs cmd
+ * xargs-style, in as many execs as it takes to stay under ARG_MAX; one written
+ * `parallel [-j N] [-u] [-t] cmd word... [::: input...]` runs cmd once per input (or
+ * stdin line) on a pool of one worker per CPU, output kept in input order unless -u.
+ * A pipeline written
+ * `pprof a | b | c` runs with a relay in every stage's output pipe and ends with a
+ * per-stage throughput and backpressure table, see pipe_prof.h. Returns -1 if the
+ * line could not be parsed. */
 int cmd_exec_run_in_tab(int tab_idx, const char *cmdline);
 
+/* Carry on with command lists whose running pipeline has ended (a && b waits for a).
+ * Main thread; call it whenever the notify pipe wakes the main loop. */
+void cmd_exec_dispatch(void);
+
+/* Peephole pass run on every pipeline before it starts (on by default): `cat FILE | cmd`
+ * becomes `cmd < FILE`, `cat` stages that only copy their input are dropped and
+ * redirections that change nothing are merged away. cmd_exec_peephole() returns
+ * whether it is on and how many pipelines/stages it has shortened. Main thread. */
+void cmd_exec_set_peephole(int on);
+int cmd_exec_peephole(unsigned long *pipelines, unsigned long *stages);
+
+/* Resource usage (wall time, user/sys CPU, max RSS, context switches, from wait4())
+ * is recorded in the history entry of every command line. It is also printed after
+ * the exit lines of pipelines written `time cmd ...`, or of all of them while timing
+ * is on (MYTERM_TIME=1, or the `timing` builtin). Main thread. */
+void cmd_exec_set_timing(int on);
+int cmd_exec_timing(void);
+
+/* Job table: pipelines started with `&`, and foreground ones stopped by Ctrl+Z, are
+ * numbered per tab (%1, %2, ...) until they end. id 0 names the current job, the
+ * highest numbered one. The functions below return the job's id, or -1 with errno set
+ * (ESRCH: no such job). */
+
+/* call fn for each numbered job of the tab, in order; returns how many there were */
+int cmd_exec_jobs(int tab_idx, void (*fn)(int id, int current, int stopped, const char *cmd, void *arg), void *arg);
+
+/* SIGCONT the job, making it the tab's foreground job (fg) or not (bg); its command
+ * text is copied to cmd */
+int cmd_exec_job_continue(int tab_idx, int id, int foreground, char *cmd, size_t cmdlen);
+
+/* send sig to the job's process group (a stopped job is continued to receive it) */
+int cmd_exec_job_kill(int tab_idx, int id, int sig);
+
+/* Typed input: a pipeline started in the foreground gets a pipe as its first stage's
+ * stdin (unless redirected). cmd_exec_send_input() queues bytes for the tab's
+ * foreground job without blocking (the main loop writes the rest as the pipe drains,
+ * see tabs_get_write_fd); cmd_exec_end_input() closes the pipe once the queue is
+ * written, which the job reads as EOF (Ctrl+D). Both return -1 if there is no
+ * foreground job reading such a pipe. Main thread. */
+int cmd_exec_send_input(int tab_idx, const char *buf, size_t len);
+int cmd_exec_end_input(int tab_idx);
+
 /* Send SIGINT to the foreground job (process group) running in tab_idx.
  * Returns 0 on success, -1 if no foreground job or on error. */
 int cmd_exec_interrupt_tab(int tab_idx);
 
 /* Send SIGTSTP to the foreground job (process group) running in tab_idx
- * (user pressed Ctrl+Z) - returns 0 on success, -1 otherwise. */
+ * (user pressed Ctrl+Z) - returns 0 on success, -1 otherwise. Once it has stopped the
+ * job is reported as "[n] Stopped" and can be resumed with fg or bg. */
 int cmd_exec_suspend_tab(int tab_idx);
 
+/* Returns 1 if a foreground job is running in tab_idx, 0 otherwise. */
+int cmd_exec_has_foreground(int tab_idx);
+
+/* Tab tab_idx is about to be closed (tabs_close() then moves later tabs down one):
+ * its jobs are sent SIGHUP and forgotten, its running command list stops, and
+ * everything kept for later tabs (typed-input attachments included) follows them to
+ * their new index; the indices running work writes output to follow in tabs_close()
+ * itself. Main thread. */
+void cmd_exec_on_tab_closed(int tab_idx);
+
 #endif /* CMD_EXEC_H */
@@ -0,0 +1,32 @@
+#ifndef CMD_HASH_H
+#define CMD_HASH_H
+
+#include <stddef.h>
+
+/* what execvp() searches when PATH is unset */
+#define CMD_HASH_DEFAULT_PATH "/bin:/usr/bin"
+
+/* Command hash table, like the shell's `hash`: command names resolved through PATH
+   are remembered as absolute paths, so spawning does not search PATH again. An entry
+   is trusted only while the modification times of the PATH directories up to and
+   including the one it was found in are unchanged (a new or removed file changes the
+   directory's mtime); any change, or a different PATH, empties the table.
+   Names containing '/' and matches in relative PATH entries are never cached.
+   Thread-safe. */
+
+/* resolve name (no '/') against path_var (NULL: $PATH) into out. Relative PATH entries
+   (and empty ones, meaning ".") are looked up under dirfd (AT_FDCWD: our cwd), and the
+   result is then relative to it too. Returns out, or NULL with errno set: EACCES if
+   the only matches were not executable, ENOENT if there was none, as for execvp(). */
+const char *cmd_hash_lookup(const char *name, const char *path_var, int dirfd, char *out, size_t outlen);
+
+/* drop name's entry (e.g. after exec of the cached path failed) */
+void cmd_hash_forget(const char *name);
+
+/* `hash -r` */
+void cmd_hash_clear(void);
+
+/* call fn for every entry; returns the number of entries */
+int cmd_hash_each(void (*fn)(const char *name, const char *path, unsigned hits, void *arg), void *arg);
+
+#endif /* CMD_HASH_H */
@@ -0,0 +1,28 @@
+#ifndef GLOB_EXPAND_H
+#define GLOB_EXPAND_H
+
+#include <stddef.h>
+
+/* Pathname expansion for unquoted words, in place of glob(3):
+     {a,b,c}  brace alternatives, nested, expanded first and kept in their order
+     *  ?  [..]  within one path component; a leading '.' must be matched explicitly
+     **       as a whole component: zero or more directories (hidden ones and
+              symlinks to directories are not descended into); as the last
+              component, everything below
+     ~, ~user at the start
+     \c      c itself, for any c (the parser escapes quoted characters this way);
+              the backslashes are removed from the words that come out
+   A trailing '/' matches directories only. Each brace alternative's matches come out
+   sorted byte-wise; an alternative that matches nothing (or has no wildcards) comes
+   out as written. Directories are read with getdents64 by a pool of threads that
+   steal from each other's queues, so a deep tree is walked on every core; a walk
+   that never fans out stays on the calling thread. Thread-safe (expansions take
+   turns on the pool). */
+
+typedef void (*glob_emit_fn)(const char *path, size_t len, void *arg);
+
+/* expand word relative to dirfd (AT_FDCWD for ours), calling emit once per resulting
+   word in order. Returns the number of words emitted, or -1 when out of memory. */
+long glob_expand(const char *word, int dirfd, glob_emit_fn emit, void *arg);
+
+#endif /* GLOB_EXPAND_H */
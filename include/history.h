@@ -12,8 +12,25 @@ int history_init(const char *path);
 /* Flush history to disk (call on exit). */
 void history_save(void);
 
-/* Add a command to history (skips empty/whitespace-only). */
-void history_add(const char *cmd);
+/* Add a command to history (skips empty/whitespace-only).
+ * Returns the entry's serial number for history_add_usage(), or 0 if it was skipped. */
+unsigned long history_add(const char *cmd);
+
+/* Resources used by the pipelines a command line ran, kept with its history entry
+ * and saved next to the history file (<path>.usage), one record per entry keyed by
+ * the entry's hash; a usage file that does not match the history is ignored. */
+typedef struct HistUsage {
+    double real, user, sys; /* seconds, summed over the pipelines */
+    long maxrss_kb;         /* largest of any process */
+    long nvcsw, nivcsw;     /* voluntary / involuntary context switches */
+    int runs;               /* pipelines recorded */
+} HistUsage;
+
+/* Add u to entry `serial` (ignored once the entry has rotated out). Thread-safe. */
+void history_add_usage(unsigned long serial, const HistUsage *u);
+
+/* Like history_show_recent(), with each entry's recorded usage in front. */
+void history_show_usage(int tab_idx, int max);
 
 /* Show most recent `max` commands in the given tab (uses tabs_append_output). */
 void history_show_recent(int tab_idx, int max);
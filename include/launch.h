@@ -0,0 +1,28 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+
+/* How one child is started. fd_in/fd_out/fd_err become the child's 0/1/2
+   (-1 = inherit). Descriptors that must not leak into the child should be
+   O_CLOEXEC; the launcher does not close anything itself. */
+typedef struct
+{
+    char *const *argv; /* argv[0] is looked up in PATH, through the command hash */
+    int fd_in;
+    int fd_out;
+    int fd_err;
+    pid_t pgid;        /* process group to join; 0 = lead a new group, -1 = stay in ours */
+    const char *cwd;   /* working directory, NULL = ours */
+    int cwd_fd;        /* working directory as a directory fd (O_PATH will do); takes
+                          precedence over cwd; negative (-1, AT_FDCWD) = use cwd */
+    char *const *envp; /* environment, NULL = ours */
+} LaunchSpec;
+
+/* Start a child as described by spec, without copying the caller's address space
+   (posix_spawn: vfork-style clone + exec). The child starts with default signal
+   dispositions and an empty signal mask. Returns the pid, or -1 with errno set
+   (including exec failures such as ENOENT). Thread-safe. */
+pid_t launch_spawn(const LaunchSpec *spec);
+
+#endif /* LAUNCH_H */
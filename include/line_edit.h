@@ -3,7 +3,6 @@
 
 #include <stddef.h>
 
-#define LE_MAX_INPUT 4096
 #define LE_MAX_PROMPT 128
 
 typedef struct LineEditor LineEditor;
@@ -19,12 +18,27 @@ void le_set_prompt(LineEditor *le, const char *prompt);
 void le_feed_byte(LineEditor *le, unsigned char b);
 void le_feed_bytes(LineEditor *le, const char *buf, size_t n);
 
-/* get buffer / lengths */
+/* get buffer / lengths.
+   The editor is a growable gap buffer with no size limit. le_get_buffer() returns a
+   contiguous NUL-terminated view (closing the gap, valid until the next edit);
+   le_dup_buffer() returns a malloc'd copy the caller frees. */
 const char *le_get_buffer(LineEditor *le);
+char *le_dup_buffer(LineEditor *le);
+/* bytes [off, off+n) as at most two contiguous spans (a, then b) without moving the gap.
+   Returns the number of spans filled (0..2). */
+int le_get_spans(LineEditor *le, size_t off, size_t n,
+                 const char **a, size_t *alen, const char **b, size_t *blen);
 size_t le_get_length(LineEditor *le);
 size_t le_get_cursor(LineEditor *le);
 
-/* reset/clear current input */
+/* cached layout, updated incrementally by every edit:
+   number of '\n'-separated lines (>= 1), byte length of a line (without its '\n'),
+   and the cursor position as row + byte column within that row. */
+size_t le_get_line_count(LineEditor *le);
+size_t le_get_line_length(LineEditor *le, size_t row);
+void le_get_cursor_rowcol(LineEditor *le, size_t *row, size_t *col);
+
+/* reset/clear current input (and give back what a large paste made the buffers grow to) */
 void le_reset(LineEditor *le);
 
 /* In terminal mode this prints the prompt + buffer and positions cursor.
@@ -37,4 +51,9 @@ void le_set_term_mode(LineEditor *le, int enabled); /* 1 = terminal mode (writes
 void le_replace_last_word(LineEditor *le, const char *s);
 void le_backspace(LineEditor *le);
 
+/* UTF-8 aware cursor movement / forward delete (one code point) */
+void le_move_left(LineEditor *le);
+void le_move_right(LineEditor *le);
+void le_delete_forward(LineEditor *le);
+
 #endif /* LINE_EDIT_H */
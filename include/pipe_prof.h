@@ -0,0 +1,43 @@
+#ifndef PIPE_PROF_H
+#define PIPE_PROF_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Pipeline profiler, for `pprof a | b | c`. Each stage's output pipe gets a relay
+   thread spliced into it (stage -> relay pipe -> splice() -> original pipe -> reader),
+   which counts the bytes through and times how long it sat waiting for the stage to
+   write (the reader is starved) and inside splice() with the reader's pipe full (the
+   stage is held back). A sampler thread reads /proc/<pid>/stat of every stage process
+   to see how often it is on a CPU. The relays add one pipe's worth of buffering per
+   link; nothing else changes for the stages. */
+
+typedef struct PipeProf PipeProf;
+
+/* a profile for a pipeline of n stages, names[i] being stage i's command */
+PipeProf *pipeprof_new(int n, char *const *names);
+
+/* put stage i's relay into the pipe fds (pipe2 order): fds[1] is replaced with the
+   write end of a new pipe, the stage's stdout from now on; the relay keeps the old
+   write end and the new read end. 0, or -1 with errno set and fds unchanged. */
+int pipeprof_splice_in(PipeProf *p, int i, int fds[2]);
+
+/* stage i is process pid (builtin stages have none) */
+void pipeprof_set_pid(PipeProf *p, int i, pid_t pid);
+
+/* start the relays and the sampler. done(arg) is called once, on the last of their
+   threads to finish (every relay has seen EOF, every stage process has exited), or
+   right here if none started. Returns -1 with errno set if some relay could not
+   start: its descriptors are closed, so its stage and reader see EPIPE / EOF. */
+int pipeprof_start(PipeProf *p, void (*done)(void *arg), void *arg);
+
+/* stage process pid was reaped with usage ru (reactor thread) */
+void pipeprof_add_usage(PipeProf *p, pid_t pid, const struct rusage *ru);
+
+/* append the per-stage throughput / backpressure table to the tab; real is the
+   pipeline's wall time. Free p only once done has been called, or if start was
+   never attempted. */
+void pipeprof_report(PipeProf *p, int tab_idx, double real);
+void pipeprof_free(PipeProf *p);
+
+#endif /* PIPE_PROF_H */
@@ -0,0 +1,86 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* One I/O thread for all background work: capture pipes of running commands,
+   child reaping and periodic timers. Callbacks run on the reactor thread, one at a
+   time, so state that is only touched from callbacks needs no locking. */
+
+/* Start the reactor thread. Call from main() before any other thread exists:
+   SIGCHLD is blocked here and delivered through a signalfd instead. Returns 0 on success. */
+int reactor_start(void);
+
+/* "io_uring" or "epoll": how capture pipes are read. epoll is the default;
+   MYTERM_INGEST=uring selects io_uring at reactor_start() when the kernel supports
+   it. It is opt-in because it is slower in the common cases: epoll readers readv()
+   straight into the tab's scrollback, while io_uring chunks land in the reactor's
+   buffers and are copied again. ingest_bench, `head -c` from /dev/zero, io_uring
+   vs epoll: 4 tabs ~510 vs ~750 MB/s, 1 tab ~0.99 vs ~1.08 GB/s. Since hidden tabs
+   are no longer indexed on the reactor thread, epoll leads by more (4 tabs ~500 vs
+   ~1110 MB/s, 8 tabs ~780 vs ~840-1040 MB/s). */
+const char *reactor_backend(void);
+
+/* run fn(arg) on the reactor thread (FIFO order). Safe from any thread. */
+int reactor_post(void (*fn)(void *), void *arg);
+
+/* Stream reader: data_cb gets every chunk read from fd, eof_cb is called once at
+   EOF or on a read error, after which the reactor closes fd. The reactor owns fd
+   from here on. group is the ingest group the bytes are charged to (a tab index,
+   0 .. REACTOR_MAX_GROUPS-1), or -1 for an unmetered reader. Safe from any thread. */
+typedef void (*reactor_data_cb)(const char *buf, size_t len, void *arg);
+typedef void (*reactor_eof_cb)(void *arg);
+int reactor_add_reader(int fd, int group, reactor_data_cb data_cb, reactor_eof_cb eof_cb, void *arg);
+
+/* Like reactor_add_reader, but drain_cb does the reading itself (e.g. straight into
+   its own buffer) and returns what read() would: bytes, 0 at EOF, -1 with errno.
+   Always served through epoll. */
+typedef ssize_t (*reactor_drain_cb)(int fd, void *arg);
+int reactor_add_drain(int fd, int group, reactor_drain_cb drain_cb, reactor_eof_cb eof_cb, void *arg);
+
+/* Ingest scheduling. Every group may consume a byte budget per REACTOR_TICK_MS; a
+   group that used it up while other groups have output too has its readers parked
+   (taken out of the poll set, so the producers block on full pipes) until the next
+   tick. The foreground group gets a larger budget and is served first in every batch. */
+#define REACTOR_MAX_GROUPS 16
+#define REACTOR_TICK_MS 16
+#define REACTOR_BUDGET_FG ((size_t)16 << 20)
+#define REACTOR_BUDGET_BG ((size_t)1 << 20)
+
+/* the group the user is looking at (-1: none). Safe from any thread. */
+void reactor_set_foreground(int group);
+/* per-tick budgets in bytes; 0 keeps the current value. Call before readers are added. */
+void reactor_set_budgets(size_t fg_bytes, size_t bg_bytes);
+/* flow control: while a group is held its readers stay parked whatever the budget
+   says (at most one more chunk is read after the hold). Safe from any thread. */
+void reactor_hold_group(int group, int hold);
+
+typedef struct ReactorIngestStats
+{
+    uint64_t bytes;        /* total charged to the group */
+    double bytes_per_sec;  /* over the last full second */
+    unsigned lag_ms;       /* longest time output sat parked during the last second */
+    int parked;            /* readers currently parked */
+    int held;              /* reactor_hold_group() in effect */
+} ReactorIngestStats;
+/* snapshot of a group's counters. Safe from any thread. Returns -1 for a bad group. */
+int reactor_ingest_stats(int group, ReactorIngestStats *out);
+
+/* Child watch: cb gets every wait4() status of pid (stops and continues
+   included) with the rusage wait4() returned alongside; the watch ends after an exit
+   or a fatal signal, whose ru is the child's total. Safe from any thread, even if the
+   child has already exited. */
+typedef void (*reactor_child_cb)(pid_t pid, int status, const struct rusage *ru, void *arg);
+int reactor_watch_child(pid_t pid, reactor_child_cb cb, void *arg);
+
+/* Periodic timer. Reactor thread only (use reactor_post from elsewhere);
+   after reactor_cancel_timer() the callback never runs again. */
+typedef struct ReactorTimer ReactorTimer;
+typedef void (*reactor_timer_cb)(void *arg);
+ReactorTimer *reactor_add_timer(unsigned interval_ms, reactor_timer_cb cb, void *arg);
+void reactor_cancel_timer(ReactorTimer *t);
+
+#endif /* REACTOR_H */
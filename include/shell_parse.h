@@ -0,0 +1,72 @@
+#ifndef SHELL_PARSE_H
+#define SHELL_PARSE_H
+
+#include "arena.h"
+
+/* Command line parser. One pass over the text builds an AST for
+       list     := and_or ((';' | '&' | newline) and_or)* [';' | '&']
+       and_or   := pipeline (('&&' | '||') pipeline)*      (left-associative)
+       pipeline := ['time'] command ('|' command)*
+       command  := '(' list ')' redirect* | (word | redirect)+
+       redirect := [n]'<' word | [n]'>' word | [n]'>>' word | [n]'>&' m | [n]'<&' m
+   Quoting: '...' is literal; "..." and bare words take backslash escapes (\n and \t
+   give newline and tab, any other escaped character stands for itself). '#' at the
+   start of a word comments out the rest of the line. Every node and string comes
+   from the caller's arena; nothing has a fixed size limit. */
+
+typedef enum
+{
+    SH_PIPELINE,
+    SH_AND, /* left && right */
+    SH_OR,  /* left || right */
+    SH_SEQ  /* left ; right */
+} ShKind;
+
+typedef enum
+{
+    SH_REDIR_IN,     /* fd < target */
+    SH_REDIR_OUT,    /* fd > target */
+    SH_REDIR_APPEND, /* fd >> target */
+    SH_REDIR_DUP     /* fd >& dup_fd, fd <& dup_fd */
+} ShRedirKind;
+
+typedef struct ShRedir
+{
+    ShRedirKind kind;
+    int fd;
+    int dup_fd;
+    const char *target;
+    struct ShRedir *next; /* in source order */
+} ShRedir;
+
+struct ShNode;
+
+/* one pipeline stage: a simple command, or a subshell */
+typedef struct ShCommand
+{
+    int argc;
+    char **argv;         /* NULL-terminated; argc == 0 for a subshell */
+    unsigned char *glob; /* glob[i]: argv[i] has an unquoted *, ?, [ or {, and is to go
+                            through glob_expand(); its quoted or escaped characters
+                            that are special there carry a backslash */
+    ShRedir *redirs;
+    struct ShNode *body; /* ( list ): the parsed list... */
+    const char *source;  /* ...and its text */
+} ShCommand;
+
+typedef struct ShNode
+{
+    ShKind kind;
+    struct ShNode *left, *right; /* SH_AND, SH_OR, SH_SEQ */
+    int ncmds;                   /* SH_PIPELINE */
+    ShCommand *cmds;
+    int background;              /* SH_PIPELINE followed by '&'; an and-or chain
+                                    followed by '&' is wrapped in a subshell stage */
+    int timed;                   /* SH_PIPELINE after the `time` keyword */
+} ShNode;
+
+/* Parse src into a. Returns the root; NULL with *err == NULL for a line with nothing
+   to run, NULL with *err set (a message in a) on a syntax error. */
+ShNode *sh_parse(Arena *a, const char *src, const char **err);
+
+#endif /* SHELL_PARSE_H */
@@ -2,11 +2,30 @@
 #define SHELL_TAB_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 #include <stddef.h>
 #include "line_edit.h"
 
-#define INPUT_MAX 8192
+#define TABS_WRITE_CHUNK (64 * 1024)
+/* scrollback size limit per tab: its address space is reserved up front and the
+   memfd behind it grows with the output up to that size, after which further output
+   is discarded (with one notice in the tab). Default, and the range accepted by
+   tabs_set_scrollback_max() / MYTERM_SCROLLBACK (MB) */
+#define TABS_SCROLLBACK_DEFAULT ((size_t)1 << 30)
+#define TABS_SCROLLBACK_MIN ((size_t)1 << 20)
+#define TABS_SCROLLBACK_MAX ((size_t)16 << 30)
+/* default and maximum capture pipe size */
+#define TABS_PIPE_SIZE (1024 * 1024)
+#define TABS_PIPE_SIZE_MAX (1024 * 1024)
+/* flow control defaults: once a tab has TABS_FLOW_HIGH bytes of output the UI has
+   not processed (indexed) yet, its capture pipes are no longer read, so the kernel
+   pipe blocks the producer; reading resumes at TABS_FLOW_LOW. Hidden tabs are not
+   indexed, so they stay held until they are shown. */
+#define TABS_FLOW_HIGH ((size_t)32 << 20)
+#define TABS_FLOW_LOW ((size_t)8 << 20)
+/* output the UI indexes per frame (tabs_catch_up) */
+#define TABS_INDEX_PER_FRAME ((size_t)8 << 20)
 
 /* forward declare the LineEditor type (if you added line_edit.c) */
 typedef struct LineEditor LineEditor;
@@ -16,20 +35,58 @@ typedef struct Tab {
     pid_t pid;
     int to_child_fd;
     int from_child_fd;
+    int job_in_fd;       /* write end of the foreground job's stdin pipe, or -1 */
+    int job_in_eof;      /* close job_in_fd once the outbound queue has drained */
 
-    char input[INPUT_MAX];
-    int input_len;
-    int input_pos;
-
-    char *out_buf;
+    /* scrollback: a memfd written with splice()/pwrite() and mapped read-only at
+       out_buf. The mapping reserves out_cap bytes up front, so out_buf never moves;
+       only [0, out_len) is backed. Not NUL-terminated. */
+    const char *out_buf;
     size_t out_len;
     size_t out_cap;
+    int sb_fd;
+    int sb_full;         /* the limit was reached and the notice appended (under lock) */
+
+    /* line index over out_buf[0, indexed_len), under lock: line i starts at byte
+       offset line_starts[i]; line_starts[0] == 0. Only the UI extends it, for the
+       active tab (tabs_catch_up); a hidden tab is indexed once it is shown again. */
+    size_t *line_starts;
+    size_t nlines;
+    size_t lines_cap;
+    size_t indexed_len;
+
+    /* flow control watermarks on out_len - indexed_len (under lock) */
+    size_t flow_high;
+    size_t flow_low;
+    int flow_held;      /* capture reads are paused until the backlog drops to flow_low */
+
+    /* view state (main thread): how many lines the output view is scrolled back */
+    size_t view_scroll;
+
+    /* outbound queue towards the foreground job's stdin, only while job_in_fd is set
+       (main thread only); it never drains into the shell's stdin. tabs_write() appends,
+       tabs_flush_input() writes at most one chunk whenever the fd is writable. */
+    char *inq;
+    size_t inq_len;      /* bytes stored in inq */
+    size_t inq_off;      /* bytes of inq already written */
+    size_t inq_cap;
+    size_t inq_total;    /* bytes queued since the queue was last empty (progress) */
 
     int alive;
 
+    /* execution context: commands, builtins, globs and completion in this tab resolve
+       relative paths against cwd_fd (O_PATH; -1 if unknown: the process cwd), and
+       children get env instead of our environment. Only the main thread changes them,
+       under lock; cwd is the directory's path, for display. */
+    int cwd_fd;
+    char *cwd;
+    char **env;          /* NULL-terminated "NAME=value" strings */
+    size_t env_len;
+    size_t env_cap;
+
     pthread_mutex_t lock;
 
-    /* optional pointer to LineEditor if you created it; may be NULL */
+    /* line editor holding the tab's input line (always present for a live tab) */
     LineEditor *editor;
 
     /* autocomplete state */
@@ -48,9 +105,83 @@ int tabs_count(void);
 Tab* tabs_get(int idx);
 int tabs_get_fd(int idx);
 void tabs_set_notify_fd(int fd);
+/* wake the main loop through the notify pipe (any thread) */
+void tabs_wake_main(void);
+/* the tab on screen: only its output wakes the UI and is indexed (tabs_catch_up) */
+void tabs_set_active(int idx);
+/* UI side of flow control (main thread): index up to max_bytes of tab idx's new
+   output and resume its capture pipes once the backlog is down to the low mark.
+   Returns 1 while a backlog remains. */
+int tabs_catch_up(int idx, size_t max_bytes);
+/* watermarks in bytes: defaults for new tabs, or one tab's (low is clamped to high) */
+void tabs_set_flow_defaults(size_t high, size_t low);
+int tabs_set_flow(int idx, size_t high, size_t low);
+int tabs_flow_info(int idx, size_t *high, size_t *low, size_t *backlog, int *held);
+/* Any thread: the index is resolved and the tab used under the tab array's lock,
+   which tabs_close() takes to free a tab and move the later ones down. */
 void tabs_append_output(int idx, const char *buf, ssize_t n);
+/* Tab indices kept by work on other threads: tabs_close() moves every registered
+   index along with its tab, in the same step (-1 for the closed tab itself). The
+   _at variants read such an index under the array lock, so the bytes cannot land in
+   a tab that took over the slot in between. */
+typedef struct TabLink {
+    atomic_int *idx;
+    struct TabLink *prev, *next; /* next == NULL: not linked */
+} TabLink;
+void tabs_link(TabLink *l, atomic_int *idx);
+void tabs_unlink(TabLink *l);
+void tabs_append_output_at(const atomic_int *idx, const char *buf, ssize_t n);
+/* line index queries over the indexed part of the output; caller holds t->lock.
+   tabs_line_count_locked() excludes the empty line after a trailing '\n'.
+   tabs_line_span_locked() gives line i as [*start, *end), end excluding its '\n'. */
+size_t tabs_line_count_locked(Tab *t);
+int tabs_line_span_locked(Tab *t, size_t i, size_t *start, size_t *end);
+/* line containing byte offset off; caller holds t->lock */
+size_t tabs_line_of_offset_locked(Tab *t, size_t off);
 void tabs_read_once(int idx);
+/* move what fd has into tab idx's scrollback: splice() for pipes, so the bytes never
+   pass through user space (data is dropped if the tab is gone or its scrollback is
+   full). Returns bytes consumed, 0 at EOF, -1 with errno (EAGAIN when drained). Any thread. */
+ssize_t tabs_ingest_fd(int idx, int fd);
+ssize_t tabs_ingest_fd_at(const atomic_int *idx, int fd);
+/* capture pipe capacity: tabs_tune_pipe() applies it to a pipe (best effort),
+   tabs_set_pipe_size() configures it (clamped to 4 KB .. TABS_PIPE_SIZE_MAX) */
+void tabs_tune_pipe(int fd);
+void tabs_set_pipe_size(size_t bytes);
+/* scrollback limit for tabs created from now on (clamped to TABS_SCROLLBACK_MIN ..
+   TABS_SCROLLBACK_MAX, rounded to whole pages); existing tabs keep theirs */
+void tabs_set_scrollback_max(size_t bytes);
+/* queue bytes for the foreground job's stdin (see tabs_set_job_input); -1 if there
+   is none. User data is never written to the tab's own shell. */
 ssize_t tabs_write(int idx, const char *buf, size_t len);
+/* outbound queue: fd to watch for writability (-1 if nothing queued or no job pipe),
+   flush one chunk, progress (sent/total bytes; returns 1 while a transfer is pending),
+   cancel (returns bytes dropped) and the per-write chunk size (default TABS_WRITE_CHUNK) */
+int tabs_get_write_fd(int idx);
+void tabs_flush_input(int idx);
+/* foreground job stdin (main thread): while fd is set, tabs_write() and the queue feed
+   it; with none set they do nothing. The tab owns fd (a non-blocking pipe write end) and
+   closes it when it is replaced, on tabs_set_job_input(idx, -1), when the job stops
+   reading (EPIPE), or after tabs_end_job_input() once the queue has drained (EOF). */
+void tabs_set_job_input(int idx, int fd);
+int tabs_job_input(int idx);
+void tabs_end_job_input(int idx);
+int tabs_input_progress(int idx, size_t *sent, size_t *total);
+size_t tabs_cancel_input(int idx);
+void tabs_set_write_chunk(size_t bytes);
+/* execution context. tabs_cwd_fd() and tabs_env() are for the main thread, which is
+   the only one that changes them: the cwd fd (AT_FDCWD if the tab has none) and the
+   environment block for children (NULL: ours). tabs_chdir() moves the tab only, never
+   the process, and updates PWD/OLDPWD; it returns 0 or -1 with errno.
+   tabs_getcwd() and tabs_getenv() may be called from any thread; tabs_getenv()
+   returns a malloc'd copy of the value, NULL if unset. tabs_setenv() with a NULL value
+   unsets name. */
+int tabs_cwd_fd(int idx);
+char *const *tabs_env(int idx);
+int tabs_chdir(int idx, const char *path);
+int tabs_getcwd(int idx, char *buf, size_t len);
+char *tabs_getenv(int idx, const char *name);
+int tabs_setenv(int idx, const char *name, const char *value);
 void tabs_close(int idx);
 void tabs_cleanup(void);
 
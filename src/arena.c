@@ -0,0 +1,100 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_DEFAULT_BLOCK 1024
+#define ARENA_ALIGN alignof(max_align_t)
+
+typedef struct Block
+{
+    struct Block *next;
+    size_t cap;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+} Block;
+
+struct Arena
+{
+    Block *head; /* block being filled; older ones follow */
+    size_t total;
+};
+
+static Block *block_new(size_t cap)
+{
+    Block *b = malloc(sizeof(Block) + cap);
+    if (!b)
+        return NULL;
+    b->next = NULL;
+    b->cap = cap;
+    b->used = 0;
+    return b;
+}
+
+Arena *arena_create(size_t first_block)
+{
+    Arena *a = malloc(sizeof(*a));
+    if (!a)
+        return NULL;
+    a->head = block_new(first_block ? first_block : ARENA_DEFAULT_BLOCK);
+    a->total = 0;
+    if (!a->head)
+    {
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+void arena_destroy(Arena *a)
+{
+    if (!a)
+        return;
+    for (Block *b = a->head, *n; b; b = n)
+    {
+        n = b->next;
+        free(b);
+    }
+    free(a);
+}
+
+void *arena_alloc(Arena *a, size_t n)
+{
+    size_t size = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size < n)
+        return NULL;
+    Block *b = a->head;
+    if (b->cap - b->used < size)
+    {
+        /* double the last block, or fit one oversized request exactly */
+        size_t cap = b->cap * 2;
+        if (cap < size)
+            cap = size;
+        Block *nb = block_new(cap);
+        if (!nb)
+            return NULL;
+        nb->next = b;
+        a->head = b = nb;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    a->total += size;
+    memset(p, 0, n);
+    return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n)
+{
+    char *d = arena_alloc(a, n + 1);
+    if (!d)
+        return NULL;
+    memcpy(d, s, n);
+    d[n] = '\0';
+    return d;
+}
+
+size_t arena_used(const Arena *a)
+{
+    return a->total;
+}
@@ -13,6 +13,7 @@
 #include <ctype.h>
 #include <pthread.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <signal.h>
 
@@ -36,43 +37,30 @@ static size_t longest_common_prefix_len(char **arr, int n) {
     return idx;
 }
 
-/* Helper: replace token in buffer (for editor or plain input) */
+/* Helper: replace token in the tab's editor buffer */
 static void replace_token_in_tab(Tab *t, int token_start, int token_len, const char *replacement) {
-    if (!t || !replacement) return;
+    if (!t || !t->editor || !replacement) return;
 
-    if (t->editor) {
-        /* build new full buffer and reset editor */
-        const char *old = le_get_buffer(t->editor);
-        size_t oldlen = le_get_length(t->editor);
-        size_t rep_len = strlen(replacement);
-        size_t newlen = token_start + rep_len + (oldlen - (token_start + token_len));
-        char *newbuf = malloc(newlen + 1);
-        if (!newbuf) return;
-        /* prefix */
-        if (token_start > 0) memcpy(newbuf, old, token_start);
-        /* replacement */
-        memcpy(newbuf + token_start, replacement, rep_len);
-        /* suffix */
-        if (oldlen > (size_t)token_start + token_len)
-            memcpy(newbuf + token_start + rep_len, old + token_start + token_len, oldlen - (token_start + token_len));
-        newbuf[newlen] = '\0';
-        le_reset(t->editor);
-        le_feed_bytes(t->editor, newbuf, newlen);
-        free(newbuf);
-    } else {
-        /* modify t->input in place */
-        int oldlen = t->input_len;
-        int rep_len = (int)strlen(replacement);
-        int newlen = token_start + rep_len + (oldlen - (token_start + token_len));
-        if (newlen >= INPUT_MAX - 1) return; /* protect */
-        memmove(t->input + token_start + rep_len,
-                t->input + token_start + token_len,
-                oldlen - (token_start + token_len) + 1);
-        memcpy(t->input + token_start, replacement, rep_len);
-        t->input_len = newlen;
-        t->input[t->input_len] = '\0';
-        t->input_pos = token_start + rep_len;
-    }
+    /* build new full buffer and reset editor */
+    char *old = le_dup_buffer(t->editor);
+    if (!old) return;
+    size_t oldlen = le_get_length(t->editor);
+    size_t rep_len = strlen(replacement);
+    size_t newlen = token_start + rep_len + (oldlen - (token_start + token_len));
+    char *newbuf = malloc(newlen + 1);
+    if (!newbuf) { free(old); return; }
+    /* prefix */
+    if (token_start > 0) memcpy(newbuf, old, token_start);
+    /* replacement */
+    memcpy(newbuf + token_start, replacement, rep_len);
+    /* suffix */
+    if (oldlen > (size_t)token_start + token_len)
+        memcpy(newbuf + token_start + rep_len, old + token_start + token_len, oldlen - (token_start + token_len));
+    newbuf[newlen] = '\0';
+    le_reset(t->editor);
+    le_feed_bytes(t->editor, newbuf, newlen);
+    free(newbuf);
+    free(old);
 }
 
 /* Helper: free stored pending match state in tab (caller must hold lock) */
@@ -104,21 +92,11 @@ void autocomplete_clear(int tab_idx) {
 /* Main try function */
 int autocomplete_try(int tab_idx) {
     Tab *t = tabs_get(tab_idx);
-    if (!t) return 0;
+    if (!t || !t->editor) return 0;
 
-    /* get current buffer & token start/len depending on editor vs raw input */
-    const char *buf = NULL;
-    size_t buflen __attribute__((unused)) = 0;
-    size_t cursor = 0;
-    if (t->editor) {
-        buf = le_get_buffer(t->editor);
-        buflen = le_get_length(t->editor);
-        cursor = le_get_cursor(t->editor);
-    } else {
-        buf = t->input;
-        buflen = (size_t)t->input_len;
-        cursor = (size_t)t->input_pos;
-    }
+    /* get current buffer & token start/len */
+    const char *buf = le_get_buffer(t->editor);
+    size_t cursor = le_get_cursor(t->editor);
     if (!buf) buf = "";
 
     /* find start of last token (byte index) before cursor */
@@ -131,8 +109,8 @@ int autocomplete_try(int tab_idx) {
     size_t token_len = 0;
     if (cursor > token_start) token_len = cursor - token_start;
 
-    /* token text */
-    char token[INPUT_MAX];
+    /* token text (a file name token longer than PATH_MAX can never match) */
+    char token[PATH_MAX];
     if (token_len >= sizeof(token)) token_len = sizeof(token)-1;
     memcpy(token, buf + token_start, token_len);
     token[token_len] = '\0';
@@ -141,7 +119,7 @@ int autocomplete_try(int tab_idx) {
 
     /* Support path prefix: if token contains a slash, split directory and base.
        If no slash typed, dirprefix = "" and comp_dir will be NULL. */
-    char dirprefix[INPUT_MAX];
+    char dirprefix[PATH_MAX];
     dirprefix[0] = '\0';
     const char *base = token;
     char *last_slash = strrchr(token, '/');
@@ -170,8 +148,11 @@ int autocomplete_try(int tab_idx) {
         }
     }
 
-    DIR *d = opendir(opendir_path);
-    if (!d) return 0;
+    /* relative to the tab's directory, not the process cwd */
+    int dfd = openat(tabs_cwd_fd(tab_idx), opendir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return 0;
+    DIR *d = fdopendir(dfd);
+    if (!d) { close(dfd); return 0; }
 
     struct dirent *ent;
     char *matches[256];
@@ -190,7 +171,7 @@ int autocomplete_try(int tab_idx) {
         return 0;
     } else if (mcount == 1) {
         /* single match: build insertion string = dirprefix + match (only prepend if user typed a dir) */
-        char ins[INPUT_MAX];
+        char ins[PATH_MAX];
         if (last_slash) {
             /* user typed a directory component; preserve it */
             snprintf(ins, sizeof(ins), "%s%s", dirprefix, matches[0]);
@@ -199,11 +180,7 @@ int autocomplete_try(int tab_idx) {
             snprintf(ins, sizeof(ins), "%s", matches[0]);
         }
 
-        if (t->editor) {
-            le_replace_last_word(t->editor, ins);
-        } else {
-            replace_token_in_tab(t, (int)token_start, (int)token_len, ins);
-        }
+        le_replace_last_word(t->editor, ins);
         free(matches[0]);
         return 1;
     }
@@ -213,21 +190,20 @@ int autocomplete_try(int tab_idx) {
     size_t baselen = strlen(base);
     if (common > baselen) {
         /* extend partially to the common prefix */
-        char ext[INPUT_MAX];
+        char ext[PATH_MAX];
         size_t ext_len = common;
         if (ext_len >= sizeof(ext)) ext_len = sizeof(ext)-1;
         memcpy(ext, matches[0], ext_len);
         ext[ext_len] = '\0';
 
-        char ins[INPUT_MAX];
+        char ins[PATH_MAX];
         if (last_slash) {
             snprintf(ins, sizeof(ins), "%s%s", dirprefix, ext);
         } else {
             snprintf(ins, sizeof(ins), "%s", ext);
         }
 
-        if (t->editor) le_replace_last_word(t->editor, ins);
-        else replace_token_in_tab(t, (int)token_start, (int)token_len, ins);
+        le_replace_last_word(t->editor, ins);
         /* note: we still show the list below after partial extension */
     }
 
@@ -0,0 +1,1143 @@
+#define _GNU_SOURCE
+#include "builtins.h"
+#include "cmd_hash.h"
+#include "cmd_exec.h"
+#include "shell_tab.h"
+#include "history.h"
+#include "reactor.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* stack for pipeline stage threads; builtins only format short strings */
+#define BUILTIN_STAGE_STACK (256 * 1024)
+
+/* -------------------- output -------------------- */
+
+static void bi_write(const BuiltinIO *io, int err, const char *buf, size_t len)
+{
+    int fd = err ? io->fd_err : io->fd_out;
+    if (fd < 0)
+    {
+        tabs_append_output(io->tab_idx, buf, (ssize_t)len);
+        return;
+    }
+    while (len > 0)
+    {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return; /* reader gone (EPIPE): the output is simply dropped */
+        buf += w;
+        len -= (size_t)w;
+    }
+}
+
+static void bi_printf(const BuiltinIO *io, int err, const char *fmt, ...)
+{
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n < sizeof(buf))
+    {
+        bi_write(io, err, buf, (size_t)n);
+        return;
+    }
+    char *big = malloc((size_t)n + 1);
+    if (!big)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(big, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    bi_write(io, err, big, (size_t)n);
+    free(big);
+}
+
+/* growable output buffer, so a builtin's output goes out in one write */
+typedef struct
+{
+    char *p;
+    size_t len, cap;
+} Buf;
+
+static void buf_put(Buf *b, const char *s, size_t n)
+{
+    if (b->len + n > b->cap)
+    {
+        size_t nc = b->cap ? b->cap * 2 : 256;
+        while (nc < b->len + n)
+            nc *= 2;
+        char *np = realloc(b->p, nc);
+        if (!np)
+            return;
+        b->p = np;
+        b->cap = nc;
+    }
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+}
+
+static void buf_putc(Buf *b, char c)
+{
+    buf_put(b, &c, 1);
+}
+
+static void buf_flush(Buf *b, const BuiltinIO *io)
+{
+    if (b->len)
+        bi_write(io, 0, b->p, b->len);
+    free(b->p);
+    b->p = NULL;
+    b->len = b->cap = 0;
+}
+
+/* one backslash escape at s (just after the '\'); appends it to b and returns the
+   bytes consumed. octal_zero: %b / echo -e style \0NNN. Sets *stop on \c. */
+static size_t put_escape(Buf *b, const char *s, int octal_zero, int *stop)
+{
+    switch (*s)
+    {
+    case 'a': buf_putc(b, '\a'); return 1;
+    case 'b': buf_putc(b, '\b'); return 1;
+    case 'e': buf_putc(b, 27); return 1;
+    case 'f': buf_putc(b, '\f'); return 1;
+    case 'n': buf_putc(b, '\n'); return 1;
+    case 'r': buf_putc(b, '\r'); return 1;
+    case 't': buf_putc(b, '\t'); return 1;
+    case 'v': buf_putc(b, '\v'); return 1;
+    case '\\': buf_putc(b, '\\'); return 1;
+    case 'c':
+        if (stop)
+        {
+            *stop = 1;
+            return 1;
+        }
+        break;
+    case 'x':
+        if (isxdigit((unsigned char)s[1]))
+        {
+            size_t i = 1;
+            int v = 0;
+            while (i <= 2 && isxdigit((unsigned char)s[i]))
+            {
+                v = v * 16 + (isdigit((unsigned char)s[i]) ? s[i] - '0' : (tolower((unsigned char)s[i]) - 'a' + 10));
+                ++i;
+            }
+            buf_putc(b, (char)v);
+            return i;
+        }
+        break;
+    default:
+        if (*s >= '0' && *s <= '7')
+        {
+            size_t i = (octal_zero && *s == '0') ? 1 : 0;
+            size_t start = i;
+            int v = 0;
+            while (i - start < 3 && s[i] >= '0' && s[i] <= '7')
+                v = v * 8 + (s[i++] - '0');
+            buf_putc(b, (char)v);
+            return i;
+        }
+        break;
+    }
+    /* unknown escape: keep it as written */
+    buf_putc(b, '\\');
+    if (*s)
+    {
+        buf_putc(b, *s);
+        return 1;
+    }
+    return 0;
+}
+
+/* -------------------- state-changing builtins (whole command only) -------------------- */
+
+static int bi_cd(int argc, char **argv, const BuiltinIO *io)
+{
+    const char *target = argc >= 2 ? argv[1] : NULL;
+    char *home = NULL;
+    if (!target || strlen(target) == 0)
+        target = home = tabs_getenv(io->tab_idx, "HOME");
+    if (!target)
+    {
+        bi_printf(io, 1, "cd: no $HOME set\n");
+        return 1;
+    }
+    /* only this tab moves: the GUI process keeps its own cwd */
+    int rc = 0;
+    if (tabs_chdir(io->tab_idx, target) != 0)
+    {
+        bi_printf(io, 1, "cd: %s: %s\n", target, strerror(errno));
+        rc = 1;
+    }
+    else
+        bi_printf(io, 0, "changed directory to %s\n", target);
+    free(home);
+    return rc;
+}
+
+static int valid_name(const char *s, size_t len)
+{
+    if (len == 0 || !(isalpha((unsigned char)s[0]) || s[0] == '_'))
+        return 0;
+    for (size_t i = 1; i < len; ++i)
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_'))
+            return 0;
+    return 1;
+}
+
+static int bi_export(int argc, char **argv, const BuiltinIO *io)
+{
+    if (argc < 2)
+    {
+        Buf b = {0};
+        for (char *const *e = tabs_env(io->tab_idx); e && *e; ++e)
+        {
+            buf_put(&b, "export ", 7);
+            buf_put(&b, *e, strlen(*e));
+            buf_putc(&b, '\n');
+        }
+        buf_flush(&b, io);
+        return 0;
+    }
+    int rc = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *eq = strchr(argv[i], '=');
+        size_t nlen = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!valid_name(argv[i], nlen))
+        {
+            bi_printf(io, 1, "export: `%s': not a valid identifier\n", argv[i]);
+            rc = 1;
+            continue;
+        }
+        /* without a value there is nothing to do: every variable we know is exported */
+        if (!eq)
+            continue;
+        char *name = strndup(argv[i], nlen);
+        if (!name || tabs_setenv(io->tab_idx, name, eq + 1) != 0)
+            rc = 1;
+        free(name);
+    }
+    return rc;
+}
+
+static int bi_unset(int argc, char **argv, const BuiltinIO *io)
+{
+    int rc = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-v") == 0)
+            continue;
+        if (!valid_name(argv[i], strlen(argv[i])))
+        {
+            bi_printf(io, 1, "unset: `%s': not a valid identifier\n", argv[i]);
+            rc = 1;
+            continue;
+        }
+        tabs_setenv(io->tab_idx, argv[i], NULL);
+    }
+    return rc;
+}
+
+/* history [-t]: -t puts each command line's recorded resource usage in front */
+static int bi_history(int argc, char **argv, const BuiltinIO *io)
+{
+    if (argc >= 2 && strcmp(argv[1], "-t") == 0)
+        history_show_usage(io->tab_idx, 1000);
+    else
+        history_show_recent(io->tab_idx, 1000);
+    return 0;
+}
+
+/* per-tab capture throughput and how long output waited on the scheduler */
+static int bi_ingest(int argc, char **argv, const BuiltinIO *io)
+{
+    (void)argc;
+    (void)argv;
+    bi_printf(io, 0, "ingest backend: %s\n", reactor_backend());
+    for (int i = 0; i < tabs_count(); ++i)
+    {
+        ReactorIngestStats st;
+        if (reactor_ingest_stats(i, &st) != 0)
+            continue;
+        bi_printf(io, 0, "tab %d%s: %.1f MB total, %.1f MB/s, lag %u ms%s%s\n", i + 1,
+                  i == io->tab_idx ? "*" : "", st.bytes / 1048576.0, st.bytes_per_sec / 1048576.0,
+                  st.lag_ms, st.parked ? ", parked" : "", st.held ? ", held" : "");
+    }
+    return 0;
+}
+
+/* flow [HIGH_KB [LOW_KB]]: show or set this tab's flow control watermarks */
+static int bi_flow(int argc, char **argv, const BuiltinIO *io)
+{
+    if (argc >= 2)
+    {
+        char *end;
+        unsigned long high = strtoul(argv[1], &end, 10);
+        unsigned long low = high / 4;
+        if (*end == '\0' && argc >= 3)
+            low = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || high == 0 || tabs_set_flow(io->tab_idx, (size_t)high * 1024, (size_t)low * 1024) != 0)
+        {
+            bi_printf(io, 1, "usage: flow [HIGH_KB [LOW_KB]]\n");
+            return 2;
+        }
+    }
+    size_t high, low, backlog;
+    int held;
+    if (tabs_flow_info(io->tab_idx, &high, &low, &backlog, &held) != 0)
+        return 1;
+    bi_printf(io, 0, "flow: high %zu KB, low %zu KB, backlog %zu KB%s\n", high / 1024, low / 1024,
+              backlog / 1024, held ? " (reading paused)" : "");
+    return 0;
+}
+
+/* peephole [on|off]: switch the pipeline rewrite pass, show what it has saved */
+static int bi_peephole(int argc, char **argv, const BuiltinIO *io)
+{
+    if (argc >= 2)
+    {
+        if (strcmp(argv[1], "on") != 0 && strcmp(argv[1], "off") != 0)
+        {
+            bi_printf(io, 1, "usage: peephole [on|off]\n");
+            return 2;
+        }
+        cmd_exec_set_peephole(strcmp(argv[1], "on") == 0);
+    }
+    unsigned long pipelines, stages;
+    int on = cmd_exec_peephole(&pipelines, &stages);
+    bi_printf(io, 0, "peephole: %s, %lu stage%s removed from %lu pipeline%s\n", on ? "on" : "off", stages,
+              stages == 1 ? "" : "s", pipelines, pipelines == 1 ? "" : "s");
+    return 0;
+}
+
+/* timing [on|off]: report every pipeline's resource usage, not just `time` ones */
+static int bi_timing(int argc, char **argv, const BuiltinIO *io)
+{
+    if (argc >= 2)
+    {
+        if (strcmp(argv[1], "on") != 0 && strcmp(argv[1], "off") != 0)
+        {
+            bi_printf(io, 1, "usage: timing [on|off]\n");
+            return 2;
+        }
+        cmd_exec_set_timing(strcmp(argv[1], "on") == 0);
+    }
+    bi_printf(io, 0, "timing: %s\n", cmd_exec_timing() ? "on" : "off");
+    return 0;
+}
+
+/* -------------------- job control -------------------- */
+
+/* %n, %% / %+ / % (the current job) -> n or 0; -1 if spec is not a job spec */
+static int job_spec(const char *spec)
+{
+    if (spec[0] != '%')
+        return -1;
+    if (!spec[1] || strcmp(spec + 1, "%") == 0 || strcmp(spec + 1, "+") == 0)
+        return 0;
+    char *end;
+    long id = strtol(spec + 1, &end, 10);
+    return (*end || id <= 0 || id > INT_MAX) ? -1 : (int)id;
+}
+
+static void jobs_row(int id, int current, int stopped, const char *cmd, void *arg)
+{
+    bi_printf(arg, 0, "[%d]%c  %-22s  %s\n", id, current ? '+' : ' ', stopped ? "Stopped" : "Running", cmd);
+}
+
+static int bi_jobs(int argc, char **argv, const BuiltinIO *io)
+{
+    (void)argc;
+    (void)argv;
+    cmd_exec_jobs(io->tab_idx, jobs_row, (void *)io);
+    return 0;
+}
+
+/* fg [%n] / bg [%n...]: continue a job in the foreground or the background */
+static int bi_fg_bg(int argc, char **argv, const BuiltinIO *io)
+{
+    int fg = argv[0][0] == 'f', rc = 0;
+    for (int i = 1; i < argc || i == 1; ++i)
+    {
+        int id = i < argc ? job_spec(argv[i]) : 0;
+        char cmd[256];
+        if (id < 0 || (id = cmd_exec_job_continue(io->tab_idx, id, fg, cmd, sizeof(cmd))) < 0)
+        {
+            bi_printf(io, 1, "%s: %s: no such job\n", argv[0], i < argc ? argv[i] : "current");
+            rc = 1;
+        }
+        else if (fg)
+            bi_printf(io, 0, "%s\n", cmd);
+        else
+            bi_printf(io, 0, "[%d] %s &\n", id, cmd);
+        if (fg)
+            break;
+    }
+    return rc;
+}
+
+static const struct
+{
+    const char *name;
+    int sig;
+} signal_names[] = {
+    {"HUP", SIGHUP},   {"INT", SIGINT},   {"QUIT", SIGQUIT}, {"KILL", SIGKILL}, {"USR1", SIGUSR1},
+    {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM}, {"TERM", SIGTERM}, {"CONT", SIGCONT},
+    {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {"WINCH", SIGWINCH},
+};
+
+/* TERM, SIGTERM or 15 -> 15; -1 if unknown */
+static int signal_number(const char *s)
+{
+    if (isdigit((unsigned char)s[0]))
+    {
+        char *end;
+        long n = strtol(s, &end, 10);
+        return (*end || n < 0 || n >= NSIG) ? -1 : (int)n;
+    }
+    if (strncasecmp(s, "SIG", 3) == 0)
+        s += 3;
+    for (size_t k = 0; k < sizeof(signal_names) / sizeof(signal_names[0]); ++k)
+        if (strcasecmp(s, signal_names[k].name) == 0)
+            return signal_names[k].sig;
+    return -1;
+}
+
+/* kill [-s SIG | -SIG] %n|pid...; kill -l */
+static int bi_kill(int argc, char **argv, const BuiltinIO *io)
+{
+    int sig = SIGTERM, i = 1;
+    if (i < argc && strcmp(argv[i], "-l") == 0)
+    {
+        for (size_t k = 0; k < sizeof(signal_names) / sizeof(signal_names[0]); ++k)
+            bi_printf(io, 0, "%2d) SIG%s\n", signal_names[k].sig, signal_names[k].name);
+        return 0;
+    }
+    if (i < argc && argv[i][0] == '-' && argv[i][1])
+    {
+        const char *name = argv[i] + 1;
+        if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-n") == 0)
+            name = ++i < argc ? argv[i] : "";
+        if ((sig = signal_number(name)) < 0)
+        {
+            bi_printf(io, 1, "kill: %s: invalid signal specification\n", name);
+            return 2;
+        }
+        ++i;
+    }
+    if (i >= argc)
+    {
+        bi_printf(io, 1, "usage: kill [-s SIG | -SIG] %%n|pid...\n");
+        return 2;
+    }
+    int rc = 0;
+    for (; i < argc; ++i)
+    {
+        int id = job_spec(argv[i]);
+        char *end;
+        long pid = id < 0 ? strtol(argv[i], &end, 10) : 0;
+        if (id < 0 && (*end || end == argv[i]))
+        {
+            bi_printf(io, 1, "kill: %s: arguments must be process or job IDs\n", argv[i]);
+            rc = 1;
+            continue;
+        }
+        if ((id >= 0 ? cmd_exec_job_kill(io->tab_idx, id, sig) : kill((pid_t)pid, sig)) < 0)
+        {
+            bi_printf(io, 1, "kill: %s: %s\n", argv[i], errno == ESRCH && id >= 0 ? "no such job" : strerror(errno));
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+/* -------------------- pure builtins (also pipeline stages) -------------------- */
+
+static int bi_true(int argc, char **argv, const BuiltinIO *io)
+{
+    (void)argc;
+    (void)argv;
+    (void)io;
+    return 0;
+}
+
+static int bi_false(int argc, char **argv, const BuiltinIO *io)
+{
+    (void)argc;
+    (void)argv;
+    (void)io;
+    return 1;
+}
+
+static int bi_pwd(int argc, char **argv, const BuiltinIO *io)
+{
+    (void)argc;
+    (void)argv;
+    char cwd[PATH_MAX];
+    if (tabs_getcwd(io->tab_idx, cwd, sizeof(cwd)) != 0)
+    {
+        bi_printf(io, 1, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    bi_printf(io, 0, "%s\n", cwd);
+    return 0;
+}
+
+/* echo [-neE] ARG...: -n drops the newline, -e expands backslash escapes */
+static int bi_echo(int argc, char **argv, const BuiltinIO *io)
+{
+    int newline = 1, escapes = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; ++i)
+    {
+        const char *f = argv[i] + 1;
+        if (strspn(f, "neE") != strlen(f))
+            break; /* not an option: printed as is */
+        for (; *f; ++f)
+        {
+            if (*f == 'n')
+                newline = 0;
+            else if (*f == 'e')
+                escapes = 1;
+            else
+                escapes = 0;
+        }
+    }
+    Buf b = {0};
+    int stop = 0;
+    for (int first = i; i < argc && !stop; ++i)
+    {
+        if (i > first)
+            buf_putc(&b, ' ');
+        if (!escapes)
+        {
+            buf_put(&b, argv[i], strlen(argv[i]));
+            continue;
+        }
+        for (const char *p = argv[i]; *p && !stop;)
+        {
+            if (*p == '\\' && p[1])
+                p += 1 + put_escape(&b, p + 1, 1, &stop);
+            else
+                buf_putc(&b, *p++);
+        }
+    }
+    if (newline && !stop)
+        buf_putc(&b, '\n');
+    buf_flush(&b, io);
+    return 0;
+}
+
+/* numeric printf argument: 'c / "c give the character's code */
+static int printf_number(const char *s, long long *out, const BuiltinIO *io)
+{
+    if (!s || !*s)
+    {
+        *out = 0;
+        return 0;
+    }
+    if (s[0] == '\'' || s[0] == '"')
+    {
+        *out = (unsigned char)s[1];
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    *out = strtoll(s, &end, 0);
+    if (*end || errno)
+    {
+        bi_printf(io, 1, "printf: %s: invalid number\n", s);
+        return 1;
+    }
+    return 0;
+}
+
+/* printf FORMAT [ARG]...: the format is reused while arguments remain */
+static int bi_printf_cmd(int argc, char **argv, const BuiltinIO *io)
+{
+    if (argc < 2)
+    {
+        bi_printf(io, 1, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    const char *fmt = argv[1];
+    char **args = argv + 2;
+    int nargs = argc - 2, ai = 0, rc = 0, stop = 0;
+    Buf b = {0};
+    do
+    {
+        int used_before = ai;
+        for (const char *p = fmt; *p && !stop;)
+        {
+            if (*p == '\\')
+            {
+                p += 1 + put_escape(&b, p + 1, 0, NULL);
+                continue;
+            }
+            if (*p != '%')
+            {
+                buf_putc(&b, *p++);
+                continue;
+            }
+            if (p[1] == '%')
+            {
+                buf_putc(&b, '%');
+                p += 2;
+                continue;
+            }
+            /* %[flags][width][.precision]conv, with * taking a number from the arguments */
+            char spec[48];
+            size_t sl = 0;
+            spec[sl++] = '%';
+            ++p;
+            while (*p && strchr("-+ #0", *p) && sl < 8)
+                spec[sl++] = *p++;
+            for (int part = 0; part < 2; ++part)
+            {
+                if (part == 1)
+                {
+                    if (*p != '.')
+                        break;
+                    spec[sl++] = *p++;
+                }
+                if (*p == '*')
+                {
+                    long long v = 0;
+                    rc |= printf_number(ai < nargs ? args[ai++] : NULL, &v, io);
+                    sl += (size_t)snprintf(spec + sl, sizeof(spec) - sl - 4, "%d", (int)v);
+                    ++p;
+                }
+                else
+                    while (isdigit((unsigned char)*p) && sl < sizeof(spec) - 8)
+                        spec[sl++] = *p++;
+            }
+            char conv = *p ? *p++ : '\0';
+            const char *arg = ai < nargs ? args[ai++] : NULL;
+            char tmp[512];
+            int n = -1;
+            switch (conv)
+            {
+            case 'd':
+            case 'i':
+            {
+                long long v;
+                rc |= printf_number(arg, &v, io);
+                memcpy(spec + sl, "lld", 4);
+                n = snprintf(tmp, sizeof(tmp), spec, v);
+                break;
+            }
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            {
+                long long v;
+                rc |= printf_number(arg, &v, io);
+                spec[sl] = 'l';
+                spec[sl + 1] = 'l';
+                spec[sl + 2] = conv;
+                spec[sl + 3] = '\0';
+                n = snprintf(tmp, sizeof(tmp), spec, (unsigned long long)v);
+                break;
+            }
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            {
+                double v = 0;
+                if (arg && *arg)
+                {
+                    char *end;
+                    v = strtod(arg, &end);
+                    if (*end)
+                    {
+                        bi_printf(io, 1, "printf: %s: invalid number\n", arg);
+                        rc = 1;
+                    }
+                }
+                spec[sl] = conv;
+                spec[sl + 1] = '\0';
+                n = snprintf(tmp, sizeof(tmp), spec, v);
+                break;
+            }
+            case 'c':
+                if (arg && *arg)
+                    buf_putc(&b, arg[0]);
+                break;
+            case 's':
+            case 'b':
+            {
+                const char *s = arg ? arg : "";
+                if (conv == 'b')
+                {
+                    Buf e = {0};
+                    for (const char *q = s; *q && !stop;)
+                    {
+                        if (*q == '\\' && q[1])
+                            q += 1 + put_escape(&e, q + 1, 1, &stop);
+                        else
+                            buf_putc(&e, *q++);
+                    }
+                    buf_putc(&e, '\0');
+                    s = e.p ? e.p : "";
+                    spec[sl] = 's';
+                    spec[sl + 1] = '\0';
+                    int m = snprintf(NULL, 0, spec, s);
+                    char *out = m >= 0 ? malloc((size_t)m + 1) : NULL;
+                    if (out)
+                    {
+                        snprintf(out, (size_t)m + 1, spec, s);
+                        buf_put(&b, out, (size_t)m);
+                        free(out);
+                    }
+                    free(e.p);
+                    break;
+                }
+                spec[sl] = 's';
+                spec[sl + 1] = '\0';
+                int m = snprintf(NULL, 0, spec, s);
+                char *out = m >= 0 ? malloc((size_t)m + 1) : NULL;
+                if (out)
+                {
+                    snprintf(out, (size_t)m + 1, spec, s);
+                    buf_put(&b, out, (size_t)m);
+                    free(out);
+                }
+                break;
+            }
+            default:
+                bi_printf(io, 1, "printf: %%%c: invalid directive\n", conv ? conv : ' ');
+                buf_flush(&b, io);
+                return 1;
+            }
+            if (n > 0)
+                buf_put(&b, tmp, (size_t)n < sizeof(tmp) ? (size_t)n : sizeof(tmp) - 1);
+        }
+        if (ai == used_before)
+            break; /* the format takes no arguments */
+    } while (ai < nargs && !stop);
+    buf_flush(&b, io);
+    return rc;
+}
+
+/* -------------------- test / [ -------------------- */
+
+typedef struct
+{
+    char **av;
+    int n, i;
+    int err;
+    const BuiltinIO *io;
+} TestParse;
+
+static int test_unary(const char *op, const char *a, int *res)
+{
+    struct stat st;
+    if (op[0] != '-' || !op[1] || op[2])
+        return 0;
+    switch (op[1])
+    {
+    case 'z': *res = a[0] == '\0'; return 1;
+    case 'n': *res = a[0] != '\0'; return 1;
+    case 'e': *res = stat(a, &st) == 0; return 1;
+    case 'f': *res = stat(a, &st) == 0 && S_ISREG(st.st_mode); return 1;
+    case 'd': *res = stat(a, &st) == 0 && S_ISDIR(st.st_mode); return 1;
+    case 'p': *res = stat(a, &st) == 0 && S_ISFIFO(st.st_mode); return 1;
+    case 's': *res = stat(a, &st) == 0 && st.st_size > 0; return 1;
+    case 'h':
+    case 'L': *res = lstat(a, &st) == 0 && S_ISLNK(st.st_mode); return 1;
+    case 'r': *res = access(a, R_OK) == 0; return 1;
+    case 'w': *res = access(a, W_OK) == 0; return 1;
+    case 'x': *res = access(a, X_OK) == 0; return 1;
+    case 't': *res = isatty(atoi(a)); return 1;
+    }
+    return 0;
+}
+
+static int test_int(TestParse *tp, const char *s, long long *v)
+{
+    char *end;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end))
+        ++end;
+    if (!*s || *end || errno)
+    {
+        bi_printf(tp->io, 1, "test: %s: integer expected\n", s);
+        tp->err = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int test_binary(TestParse *tp, const char *a, const char *op, const char *b, int *res)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        *res = strcmp(a, b) == 0;
+    else if (strcmp(op, "!=") == 0)
+        *res = strcmp(a, b) != 0;
+    else if (strcmp(op, "<") == 0)
+        *res = strcmp(a, b) < 0;
+    else if (strcmp(op, ">") == 0)
+        *res = strcmp(a, b) > 0;
+    else
+    {
+        static const char *ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        int k = 0;
+        while (k < 6 && strcmp(op, ops[k]) != 0)
+            ++k;
+        if (k == 6)
+            return 0;
+        long long x, y;
+        if (!test_int(tp, a, &x) || !test_int(tp, b, &y))
+        {
+            *res = 0;
+            return 1;
+        }
+        int r[] = {x == y, x != y, x < y, x <= y, x > y, x >= y};
+        *res = r[k];
+    }
+    return 1;
+}
+
+static int test_or(TestParse *tp);
+
+static int test_primary(TestParse *tp)
+{
+    if (tp->i >= tp->n)
+    {
+        tp->err = 1;
+        return 0;
+    }
+    char **av = tp->av;
+    int left = tp->n - tp->i;
+    int res;
+    /* a binary expression takes precedence: `test -n = -n` compares strings */
+    if (left >= 3 && test_binary(tp, av[tp->i], av[tp->i + 1], av[tp->i + 2], &res))
+    {
+        tp->i += 3;
+        return res;
+    }
+    if (strcmp(av[tp->i], "(") == 0)
+    {
+        tp->i++;
+        res = test_or(tp);
+        if (tp->i >= tp->n || strcmp(av[tp->i], ")") != 0)
+        {
+            tp->err = 1;
+            return 0;
+        }
+        tp->i++;
+        return res;
+    }
+    if (left >= 2 && test_unary(av[tp->i], av[tp->i + 1], &res))
+    {
+        tp->i += 2;
+        return res;
+    }
+    return av[tp->i++][0] != '\0';
+}
+
+static int test_not(TestParse *tp)
+{
+    if (tp->i < tp->n && strcmp(tp->av[tp->i], "!") == 0 && tp->n - tp->i > 1)
+    {
+        tp->i++;
+        return !test_not(tp);
+    }
+    return test_primary(tp);
+}
+
+static int test_and(TestParse *tp)
+{
+    int r = test_not(tp);
+    while (!tp->err && tp->i < tp->n && strcmp(tp->av[tp->i], "-a") == 0)
+    {
+        tp->i++;
+        int r2 = test_not(tp);
+        r = r && r2;
+    }
+    return r;
+}
+
+static int test_or(TestParse *tp)
+{
+    int r = test_and(tp);
+    while (!tp->err && tp->i < tp->n && strcmp(tp->av[tp->i], "-o") == 0)
+    {
+        tp->i++;
+        int r2 = test_and(tp);
+        r = r || r2;
+    }
+    return r;
+}
+
+/* test EXPR / [ EXPR ]: 0 true, 1 false, 2 on a malformed expression */
+static int bi_test(int argc, char **argv, const BuiltinIO *io)
+{
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (strcmp(argv[argc - 1], "]") != 0)
+        {
+            bi_printf(io, 1, "[: missing `]'\n");
+            return 2;
+        }
+        --argc;
+    }
+    TestParse tp = {argv + 1, argc - 1, 0, 0, io};
+    if (tp.n == 0)
+        return 1;
+    int r = test_or(&tp);
+    if (!tp.err && tp.i != tp.n)
+    {
+        bi_printf(io, 1, "%s: %s: unexpected argument\n", argv[0], argv[tp.i + 1]);
+        return 2;
+    }
+    if (tp.err)
+        return 2;
+    return r ? 0 : 1;
+}
+
+/* type NAME...: builtin, or where PATH (through the command hash) finds it */
+static int bi_type(int argc, char **argv, const BuiltinIO *io)
+{
+    int rc = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *name = argv[i];
+        if (builtin_lookup(name))
+        {
+            bi_printf(io, 0, "%s is a shell builtin\n", name);
+            continue;
+        }
+        if (strchr(name, '/'))
+        {
+            if (faccessat(tabs_cwd_fd(io->tab_idx), name, X_OK, 0) == 0)
+                bi_printf(io, 0, "%s is %s\n", name, name);
+            else
+            {
+                bi_printf(io, 1, "type: %s: not found\n", name);
+                rc = 1;
+            }
+            continue;
+        }
+        char full[PATH_MAX];
+        char *path = tabs_getenv(io->tab_idx, "PATH");
+        int found = cmd_hash_lookup(name, path ? path : CMD_HASH_DEFAULT_PATH, tabs_cwd_fd(io->tab_idx), full,
+                                    sizeof(full)) != NULL;
+        free(path);
+        if (found)
+            bi_printf(io, 0, "%s is %s\n", name, full);
+        else
+        {
+            bi_printf(io, 1, "type: %s: not found\n", name);
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+typedef struct
+{
+    const BuiltinIO *io;
+    int rows;
+} HashList;
+
+static void hash_row(const char *name, const char *path, unsigned hits, void *arg)
+{
+    HashList *hl = arg;
+    (void)name;
+    if (hl->rows++ == 0)
+        bi_printf(hl->io, 0, "hits\tcommand\n");
+    bi_printf(hl->io, 0, "%4u\t%s\n", hits, path);
+}
+
+/* hash [-r] [NAME...]: list, empty or fill the command hash */
+static int bi_hash(int argc, char **argv, const BuiltinIO *io)
+{
+    int i = 1;
+    if (i < argc && strcmp(argv[i], "-r") == 0)
+    {
+        cmd_hash_clear();
+        ++i;
+    }
+    else if (i < argc && argv[i][0] == '-')
+    {
+        bi_printf(io, 1, "hash: %s: invalid option\nhash: usage: hash [-r] [name ...]\n", argv[i]);
+        return 2;
+    }
+    if (argc == 1)
+    {
+        HashList hl = {io, 0};
+        if (cmd_hash_each(hash_row, &hl) == 0)
+            bi_printf(io, 0, "hash: hash table empty\n");
+        return 0;
+    }
+    int rc = 0;
+    char *path = tabs_getenv(io->tab_idx, "PATH");
+    for (; i < argc; ++i)
+    {
+        char full[PATH_MAX];
+        if (builtin_lookup(argv[i]))
+            continue;
+        if (strchr(argv[i], '/') ||
+            !cmd_hash_lookup(argv[i], path ? path : CMD_HASH_DEFAULT_PATH, tabs_cwd_fd(io->tab_idx), full,
+                             sizeof(full)))
+        {
+            bi_printf(io, 1, "hash: %s: not found\n", argv[i]);
+            rc = 1;
+        }
+    }
+    free(path);
+    return rc;
+}
+
+/* -------------------- dispatch -------------------- */
+
+/* Perfect hash over the builtin names: first, second and last byte plus the length
+   (name[1] is the terminating NUL for "[") put each of them in its own slot. Adding a
+   builtin means checking that its slot is still free. */
+#define BUILTIN_SLOTS 64
+
+static unsigned builtin_hash(const char *name, size_t len)
+{
+    unsigned h = (unsigned char)name[0] + (unsigned char)name[1] * 10u +
+                 (unsigned char)name[len - 1] * 14u + (unsigned)len;
+    return h % BUILTIN_SLOTS;
+}
+
+static const Builtin builtin_table[BUILTIN_SLOTS] = {
+    [2] = {"test", bi_test, 0},
+    [5] = {"cd", bi_cd, BUILTIN_SPECIAL},
+    [12] = {"bg", bi_fg_bg, BUILTIN_SPECIAL},
+    [14] = {"jobs", bi_jobs, BUILTIN_SPECIAL},
+    [16] = {"fg", bi_fg_bg, BUILTIN_SPECIAL},
+    [17] = {"pwd", bi_pwd, 0},
+    [19] = {"ingest", bi_ingest, BUILTIN_SPECIAL},
+    [22] = {"[", bi_test, 0},
+    [25] = {"echo", bi_echo, 0},
+    [30] = {"unset", bi_unset, BUILTIN_SPECIAL},
+    [36] = {"flow", bi_flow, BUILTIN_SPECIAL},
+    [38] = {"hash", bi_hash, BUILTIN_SPECIAL},
+    [39] = {"history", bi_history, BUILTIN_SPECIAL},
+    [48] = {"peephole", bi_peephole, BUILTIN_SPECIAL},
+    [49] = {"kill", bi_kill, BUILTIN_SPECIAL},
+    [50] = {"true", bi_true, 0},
+    [51] = {"export", bi_export, BUILTIN_SPECIAL},
+    [54] = {"timing", bi_timing, BUILTIN_SPECIAL},
+    [56] = {"type", bi_type, 0},
+    [59] = {"false", bi_false, 0},
+    [62] = {"printf", bi_printf_cmd, 0},
+};
+
+const Builtin *builtin_lookup(const char *name)
+{
+    if (!name || !name[0])
+        return NULL;
+    size_t len = strlen(name);
+    const Builtin *b = &builtin_table[builtin_hash(name, len)];
+    return (b->name && strcmp(b->name, name) == 0) ? b : NULL;
+}
+
+/* -------------------- pipeline stages -------------------- */
+
+typedef struct Stage
+{
+    const Builtin *b;
+    int argc;
+    char **argv;
+    BuiltinIO io;
+    void (*done)(int status, void *arg);
+    void *arg;
+} Stage;
+
+static void stage_free(Stage *st)
+{
+    for (int i = 0; i < st->argc; ++i)
+        free(st->argv[i]);
+    free(st->argv);
+    free(st);
+}
+
+static void *stage_main(void *p)
+{
+    Stage *st = p;
+    /* signals are for the GUI thread; SIGPIPE is ignored process-wide, so a reader
+       that went away shows up as EPIPE */
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    int rc = st->b->fn(st->argc, st->argv, &st->io);
+    close(st->io.fd_out);
+    if (st->io.fd_err != st->io.fd_out)
+        close(st->io.fd_err);
+    /* exit status in waitpid() form, so jobs report stages uniformly */
+    st->done((rc & 0xff) << 8, st->arg);
+    stage_free(st);
+    return NULL;
+}
+
+int builtin_start_stage(const Builtin *b, char **argv, int tab_idx, int out_fd, int err_fd,
+                        void (*done)(int status, void *arg), void *arg)
+{
+    Stage *st = calloc(1, sizeof(*st));
+    int argc = 0;
+    while (argv[argc])
+        ++argc;
+    if (st)
+        st->argv = calloc((size_t)argc + 1, sizeof(char *));
+    if (!st || !st->argv)
+        goto fail;
+    for (; st->argc < argc; ++st->argc)
+        if (!(st->argv[st->argc] = strdup(argv[st->argc])))
+            goto fail;
+    st->b = b;
+    st->io.tab_idx = tab_idx;
+    st->io.fd_out = out_fd;
+    st->io.fd_err = err_fd;
+    st->done = done;
+    st->arg = arg;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, BUILTIN_STAGE_STACK);
+    pthread_t thr;
+    int rc = pthread_create(&thr, &attr, stage_main, st);
+    pthread_attr_destroy(&attr);
+    if (rc == 0)
+        return 0;
+
+fail:
+    if (st)
+    {
+        if (st->argv)
+            stage_free(st);
+        else
+            free(st);
+    }
+    close(out_fd);
+    if (err_fd != out_fd)
+        close(err_fd);
+    return -1;
+}
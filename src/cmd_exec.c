@@ -1,22 +1,40 @@
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #include "cmd_exec.h"
 #include "shell_tab.h"
 #include "history.h"
 #include "multiwatch.h"
-
+#include "launch.h"
+#include "reactor.h"
+#include "builtins.h"
+#include "arena.h"
+#include "shell_parse.h"
+#include "glob_expand.h"
+#include "pipe_prof.h"
+
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <ctype.h>
-#include <glob.h>
+#include <fnmatch.h>
 #include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/syscall.h>
 
 
 
@@ -25,10 +43,6 @@
 #define CMD_MAX_TABS 64
 #endif
 
-#ifndef GLOB_TILDE
-#define GLOB_TILDE 0
-#endif
-
 
 /* -------------------- PGID tracking -------------------- */
 /* Per-tab foreground process group id. Protected by pgid_lock. */
@@ -63,466 +77,2546 @@ static void clear_tab_pgid(int tab_idx)
     set_tab_pgid(tab_idx, 0);
 }
 
-/* -------------------- reader thread + execution code -------------------- */
+/* -------------------- tab indices held by running work -------------------- */
+/* Command lists, jobs and threaded stages name their tab by index, and tabs_close()
+   moves every later tab down one. Each registers its tab_idx field with tabs_link(),
+   so tabs_close() moves it along under the tab array's lock, or sets it to -1
+   (nowhere: output is dropped) for work of the closed tab. The fields are atomic_int
+   because stage threads and the reactor read them while the main thread updates
+   them; output from those threads goes through tabs_*_at(), which reads the field
+   under the same lock. */
+
+/* -------------------- job table -------------------- */
+
+/* Jobs a tab can name with %n: pipelines started with `&`, and foreground ones once
+   they have been stopped. A process pipeline gets an entry when it starts (id 0 until
+   it needs a number); the reactor updates it as its children stop, continue and exit,
+   and frees it when the job ends. Protected by jobs_lock. */
+typedef enum
+{
+    JOB_RUNNING,
+    JOB_STOPPED
+} JobState;
 
-/* Reader thread args can wait for multiple children */
-struct reader_args
+typedef struct TabJob
 {
     int tab_idx;
-    int fd;          /* read end to capture */
-    pid_t *children; /* array of child pids */
-    int child_count;
-};
+    int id;         /* %id; 0 = not numbered yet */
+    pid_t pgid;
+    JobState state;
+    int foreground; /* the tab's foreground group is this job's */
+    char *cmd;
+    struct TabJob *next;
+} TabJob;
+
+static TabJob *jobs_head;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* next free number in the tab, as in other shells one past the highest (jobs_lock held) */
+static int next_job_id(int tab_idx)
+{
+    int id = 0;
+    for (TabJob *tj = jobs_head; tj; tj = tj->next)
+        if (tj->tab_idx == tab_idx && tj->id > id)
+            id = tj->id;
+    return id + 1;
+}
 
-/* reader thread: read everything from fd and then wait for children.
-   After children finish (or stop), it reports statuses and clears tab PGID. */
-static void *reader_thread(void *v)
+/* the job %id of the tab, id 0 for the current (highest numbered) one (jobs_lock held) */
+static TabJob *find_job(int tab_idx, int id)
 {
-    struct reader_args *a = v;
-    int tab = a->tab_idx;
-    int fd = a->fd;
-    pid_t *kids = a->children;
-    int n = a->child_count;
+    TabJob *found = NULL;
+    for (TabJob *tj = jobs_head; tj; tj = tj->next)
+    {
+        if (tj->tab_idx != tab_idx || tj->id == 0)
+            continue;
+        if (id > 0 ? tj->id == id : (!found || tj->id > found->id))
+            found = tj;
+    }
+    return found;
+}
 
-    char buf[4096];
-    ssize_t r;
-    /* read all available output until EOF */
-    while ((r = read(fd, buf, sizeof(buf))) > 0)
+static TabJob *tabjob_new(int tab_idx, pid_t pgid, int background, char *cmd)
+{
+    TabJob *tj = calloc(1, sizeof(*tj));
+    if (!tj)
     {
-        tabs_append_output(tab, buf, r);
+        free(cmd);
+        return NULL;
     }
-    /* close the read end (children still exist) */
-    if (fd >= 0)
-        close(fd);
+    tj->tab_idx = tab_idx;
+    tj->pgid = pgid;
+    tj->state = JOB_RUNNING;
+    tj->foreground = !background;
+    tj->cmd = cmd;
+    pthread_mutex_lock(&jobs_lock);
+    if (background)
+        tj->id = next_job_id(tab_idx);
+    tj->next = jobs_head;
+    jobs_head = tj;
+    pthread_mutex_unlock(&jobs_lock);
+    return tj;
+}
 
-    /* wait for each child (detect stopped/exited). We'll first use WUNTRACED
-       to learn if a child was stopped (SIGTSTP). Then, if stopped, we still
-       wait for its final exit (blocking wait) to report eventual exit. */
-    for (int i = 0; i < n; ++i)
+static void tabjob_message(int tab_idx, int id, const char *state, const char *cmd)
+{
+    char msg[512];
+    int m = snprintf(msg, sizeof(msg), "\n[%d]  %-22s  %s\n", id, state, cmd ? cmd : "");
+    if (m >= (int)sizeof(msg))
+        m = (int)sizeof(msg) - 1;
+    tabs_append_output(tab_idx, msg, m);
+}
+
+/* reactor thread: every process of the job has stopped. Returns whether it was in the
+   foreground until now (the first time only). */
+static int tabjob_stopped(TabJob *tj)
+{
+    char cmd[256];
+    pthread_mutex_lock(&jobs_lock);
+    if (tj->state == JOB_STOPPED)
     {
-        int status = 0;
-        pid_t w = waitpid(kids[i], &status, WUNTRACED);
-        if (w <= 0)
-            continue;
-        if (WIFEXITED(status))
-        {
-            int code = WEXITSTATUS(status);
-            char msg[128];
-            int m = snprintf(msg, sizeof(msg), "\n[process %d exited with status %d]\n", (int)kids[i], code);
-            tabs_append_output(tab, msg, m);
-        }
-        else if (WIFSIGNALED(status))
+        pthread_mutex_unlock(&jobs_lock);
+        return 0;
+    }
+    tj->state = JOB_STOPPED;
+    if (tj->id == 0)
+        tj->id = next_job_id(tj->tab_idx);
+    int fg = tj->foreground, id = tj->id;
+    tj->foreground = 0;
+    snprintf(cmd, sizeof(cmd), "%s", tj->cmd ? tj->cmd : "");
+    pthread_mutex_unlock(&jobs_lock);
+    tabjob_message(tj->tab_idx, id, "Stopped", cmd);
+    return fg;
+}
+
+/* reactor thread: a SIGCONT from anywhere (fg and bg have already said where to) */
+static void tabjob_continued(TabJob *tj)
+{
+    pthread_mutex_lock(&jobs_lock);
+    tj->state = JOB_RUNNING;
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+/* reactor thread: the job is over; report numbered jobs, free the entry. Returns
+   whether it was in the foreground. */
+static int tabjob_done(TabJob *tj, int code)
+{
+    pthread_mutex_lock(&jobs_lock);
+    for (TabJob **pp = &jobs_head; *pp; pp = &(*pp)->next)
+        if (*pp == tj)
         {
-            int sig = WTERMSIG(status);
-            char msg[128];
-            int m = snprintf(msg, sizeof(msg), "\n[process %d killed by signal %d]\n", (int)kids[i], sig);
-            tabs_append_output(tab, msg, m);
+            *pp = tj->next;
+            break;
         }
-        else if (WIFSTOPPED(status))
+    pthread_mutex_unlock(&jobs_lock);
+    int fg = tj->foreground;
+    if (tj->id > 0)
+    {
+        char state[32];
+        if (code == 0)
+            snprintf(state, sizeof(state), "Done");
+        else
+            snprintf(state, sizeof(state), "Exit %d", code);
+        tabjob_message(tj->tab_idx, tj->id, state, tj->cmd);
+    }
+    free(tj->cmd);
+    free(tj);
+    return fg;
+}
+
+int cmd_exec_jobs(int tab_idx, void (*fn)(int id, int current, int stopped, const char *cmd, void *arg), void *arg)
+{
+    /* copied out first: fn may write to a pipe, and the reactor needs the lock */
+    typedef struct
+    {
+        int id, stopped;
+        char *cmd;
+    } Row;
+    Row *rows = NULL;
+    int n = 0, cap = 0, current = 0;
+    pthread_mutex_lock(&jobs_lock);
+    TabJob *cur = find_job(tab_idx, 0);
+    current = cur ? cur->id : 0;
+    for (TabJob *tj = jobs_head; tj; tj = tj->next)
+    {
+        if (tj->tab_idx != tab_idx || tj->id == 0)
+            continue;
+        if (n == cap)
         {
-            int sig = WSTOPSIG(status);
-            char msg[128];
-            int m = snprintf(msg, sizeof(msg), "\n[process %d stopped by signal %d]\n", (int)kids[i], sig);
-            tabs_append_output(tab, msg, m);
-            /* now wait for eventual termination (block) and then report that too */
-            int status2 = 0;
-            waitpid(kids[i], &status2, 0);
-            if (WIFEXITED(status2))
-            {
-                int code = WEXITSTATUS(status2);
-                int m2 = snprintf(msg, sizeof(msg), "\n[process %d exited with status %d]\n", (int)kids[i], code);
-                tabs_append_output(tab, msg, m2);
-            }
-            else if (WIFSIGNALED(status2))
-            {
-                int sig2 = WTERMSIG(status2);
-                int m2 = snprintf(msg, sizeof(msg), "\n[process %d killed by signal %d]\n", (int)kids[i], sig2);
-                tabs_append_output(tab, msg, m2);
-            }
+            cap = cap ? cap * 2 : 8;
+            Row *nr = realloc(rows, (size_t)cap * sizeof(Row));
+            if (!nr)
+                break;
+            rows = nr;
         }
-        else
+        rows[n].id = tj->id;
+        rows[n].stopped = tj->state == JOB_STOPPED;
+        rows[n].cmd = strdup(tj->cmd ? tj->cmd : "");
+        ++n;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    /* the list is newest first; print in job order */
+    for (int k = 0; k < n; ++k)
+    {
+        int lo = k;
+        for (int m = k + 1; m < n; ++m)
+            if (rows[m].id < rows[lo].id)
+                lo = m;
+        Row t = rows[k];
+        rows[k] = rows[lo];
+        rows[lo] = t;
+        fn(rows[k].id, rows[k].id == current, rows[k].stopped, rows[k].cmd ? rows[k].cmd : "", arg);
+    }
+    for (int k = 0; k < n; ++k)
+        free(rows[k].cmd);
+    free(rows);
+    return n;
+}
+
+int cmd_exec_job_continue(int tab_idx, int id, int foreground, char *cmd, size_t cmdlen)
+{
+    pthread_mutex_lock(&jobs_lock);
+    TabJob *tj = find_job(tab_idx, id);
+    if (!tj)
+    {
+        pthread_mutex_unlock(&jobs_lock);
+        errno = ESRCH;
+        return -1;
+    }
+    pid_t pgid = tj->pgid;
+    id = tj->id;
+    tj->state = JOB_RUNNING;
+    tj->foreground = foreground;
+    if (cmd && cmdlen)
+        snprintf(cmd, cmdlen, "%s", tj->cmd ? tj->cmd : "");
+    pthread_mutex_unlock(&jobs_lock);
+    if (foreground)
+        set_tab_pgid(tab_idx, pgid);
+    if (kill(-pgid, SIGCONT) < 0)
+        return -1;
+    return id;
+}
+
+int cmd_exec_job_kill(int tab_idx, int id, int sig)
+{
+    pthread_mutex_lock(&jobs_lock);
+    TabJob *tj = find_job(tab_idx, id);
+    pid_t pgid = tj ? tj->pgid : 0;
+    int stopped = tj && tj->state == JOB_STOPPED;
+    if (tj)
+        id = tj->id;
+    pthread_mutex_unlock(&jobs_lock);
+    if (!pgid)
+    {
+        errno = ESRCH;
+        return -1;
+    }
+    if (kill(-pgid, sig) < 0)
+        return -1;
+    /* a stopped job would only see the signal once continued */
+    if (stopped && sig != SIGCONT && sig != SIGSTOP && sig != SIGTSTP)
+        kill(-pgid, SIGCONT);
+    return id;
+}
+
+/* -------------------- foreground job stdin (main thread) -------------------- */
+
+/* A pipeline started in the foreground reads a pipe instead of our own stdin; the
+   tab holds its write end (tabs_set_job_input) and this is the job it belongs to.
+   A stopped job keeps it for when it is brought back with fg, unless another
+   foreground pipeline has started in the tab since. */
+static pid_t tab_input_pgid[CMD_MAX_TABS];
+
+/* the job is still the tab's foreground job, or in its job table */
+static int job_pgid_alive(int tab_idx, pid_t pgid)
+{
+    if (get_tab_pgid(tab_idx) == pgid)
+        return 1;
+    pthread_mutex_lock(&jobs_lock);
+    const TabJob *tj = jobs_head;
+    while (tj && !(tj->tab_idx == tab_idx && tj->pgid == pgid))
+        tj = tj->next;
+    pthread_mutex_unlock(&jobs_lock);
+    return tj != NULL;
+}
+
+/* close the stdin of jobs that have ended */
+static void input_reap(void)
+{
+    for (int i = 0; i < CMD_MAX_TABS && i < tabs_count(); ++i)
+    {
+        if (tab_input_pgid[i] <= 0)
+            continue;
+        if (tabs_job_input(i) >= 0 && job_pgid_alive(i, tab_input_pgid[i]))
+            continue;
+        tabs_set_job_input(i, -1);
+        tab_input_pgid[i] = 0;
+    }
+}
+
+/* the foreground job of the tab reads the pipe the tab holds */
+static int input_attached(int tab_idx)
+{
+    if (tab_idx < 0 || tab_idx >= CMD_MAX_TABS || tab_input_pgid[tab_idx] <= 0)
+        return 0;
+    return get_tab_pgid(tab_idx) == tab_input_pgid[tab_idx] && tabs_job_input(tab_idx) >= 0;
+}
+
+int cmd_exec_send_input(int tab_idx, const char *buf, size_t len)
+{
+    if (!input_attached(tab_idx))
+        return -1;
+    return tabs_write(tab_idx, buf, len) < 0 ? -1 : 0;
+}
+
+int cmd_exec_end_input(int tab_idx)
+{
+    if (!input_attached(tab_idx))
+        return -1;
+    tabs_end_job_input(tab_idx);
+    return 0;
+}
+
+/* -------------------- running jobs (driven by the reactor) -------------------- */
+
+typedef struct Run Run;
+static void run_post(Run *r, int code);
+
+/* a pipeline's exit code, from its last stage's waitpid() status */
+static int exit_code(int wstatus)
+{
+    if (WIFEXITED(wstatus))
+        return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus))
+        return 128 + WTERMSIG(wstatus);
+    return 1;
+}
+
+/* One launched pipeline. Its capture pipe and its children are watched by the reactor;
+   all fields are only touched from reactor callbacks. Exit statuses are held back until
+   the pipe reaches EOF so they are printed after the output, as before. */
+typedef struct Job
+{
+    atomic_int tab_idx;
+    TabLink link;
+    pid_t *children; /* 0 for a builtin stage */
+    char **names;    /* builtin stage names (NULL for processes) */
+    int *status;   /* final waitpid status per child */
+    int child_count;
+    int live;      /* children not yet exited */
+    int eof;       /* capture pipe drained */
+    Run *run;      /* command list waiting for this job, or NULL */
+    int last;      /* slot of the pipeline's last stage, -1 if it did not start... */
+    int last_status; /* ...in which case this is the pipeline's exit code */
+    int background;  /* started with & */
+    TabJob *tj;      /* the job table entry, NULL if no process started */
+    char *stopped;   /* per child: stopped now */
+    int procs_live;  /* processes (not builtin stages) not yet exited */
+    int nstopped;
+    int timed;            /* `time` in front, or timing always on */
+    unsigned long hist;   /* history entry to charge, 0 for none */
+    struct timespec start;
+    struct rusage ru;     /* processes that have exited, summed (maxrss: largest) */
+    PipeProf *prof;       /* `pprof` in front: the profile, reported at the end... */
+    int prof_live;        /* ...once its relays and sampler are done */
+} Job;
+
+/* report every pipeline's resource usage, as if each had `time` in front (main thread) */
+static int timing_all;
+
+void cmd_exec_set_timing(int on)
+{
+    timing_all = on;
+}
+
+int cmd_exec_timing(void)
+{
+    return timing_all;
+}
+
+static double tv_sec(struct timeval tv)
+{
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void report_usage(const atomic_int *tab_idx, const HistUsage *u)
+{
+    char msg[256];
+    int m = snprintf(msg, sizeof(msg),
+                     "[time: real %.3fs  user %.3fs  sys %.3fs  maxrss %ld KB  ctxsw %ld vol / %ld invol]\n",
+                     u->real, u->user, u->sys, u->maxrss_kb, u->nvcsw, u->nivcsw);
+    tabs_append_output_at(tab_idx, msg, m);
+}
+
+static double job_elapsed(const Job *j)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - j->start.tv_sec) + (double)(now.tv_nsec - j->start.tv_nsec) / 1e9;
+}
+
+/* the job's usage goes after its exit lines, and into its command line's history entry */
+static void job_report_usage(Job *j)
+{
+    HistUsage u;
+    u.real = job_elapsed(j);
+    u.user = tv_sec(j->ru.ru_utime);
+    u.sys = tv_sec(j->ru.ru_stime);
+    u.maxrss_kb = j->ru.ru_maxrss;
+    u.nvcsw = j->ru.ru_nvcsw;
+    u.nivcsw = j->ru.ru_nivcsw;
+    u.runs = 1;
+    /* nothing ran if every stage failed to start */
+    for (int i = 0; i < j->child_count; ++i)
+        if (j->children[i] > 0)
         {
-            char msg[128];
-            int m = snprintf(msg, sizeof(msg), "\n[process %d ended]\n", (int)kids[i]);
-            tabs_append_output(tab, msg, m);
+            history_add_usage(j->hist, &u);
+            break;
         }
+    if (j->timed)
+        report_usage(&j->tab_idx, &u);
+}
+
+static void job_report_status(Job *j, int i)
+{
+    int status = j->status[i];
+    char msg[128];
+    int m;
+    if (j->names[i])
+        m = snprintf(msg, sizeof(msg), "\n[builtin %s exited with status %d]\n", j->names[i], WEXITSTATUS(status));
+    else if (WIFEXITED(status))
+        m = snprintf(msg, sizeof(msg), "\n[process %d exited with status %d]\n", (int)j->children[i], WEXITSTATUS(status));
+    else if (WIFSIGNALED(status))
+        m = snprintf(msg, sizeof(msg), "\n[process %d killed by signal %d]\n", (int)j->children[i], WTERMSIG(status));
+    else
+        m = snprintf(msg, sizeof(msg), "\n[process %d ended]\n", (int)j->children[i]);
+    tabs_append_output_at(&j->tab_idx, msg, m);
+}
+
+/* after EOF and the last exit: report, clear the tab's PGID (foreground job done) */
+static void job_maybe_finish(Job *j)
+{
+    if (!j->eof || j->live > 0 || j->prof_live)
+        return;
+    for (int i = 0; i < j->child_count; ++i)
+        job_report_status(j, i);
+    job_report_usage(j);
+    if (j->prof)
+    {
+        pipeprof_report(j->prof, j->tab_idx, job_elapsed(j));
+        pipeprof_free(j->prof);
     }
+    int code = j->last >= 0 ? exit_code(j->status[j->last]) : j->last_status;
+    if (j->tj ? tabjob_done(j->tj, code) : !j->background)
+        clear_tab_pgid(j->tab_idx);
+    if (j->run)
+        run_post(j->run, code);
+    tabs_unlink(&j->link);
+    for (int i = 0; i < j->child_count; ++i)
+        free(j->names[i]);
+    free(j->names);
+    free(j->stopped);
+    free(j->children);
+    free(j->status);
+    free(j);
+}
+
+/* io_uring backend: chunks arrive in the reactor's provided buffers */
+static void job_on_data(const char *buf, size_t len, void *arg)
+{
+    Job *j = arg;
+    tabs_append_output_at(&j->tab_idx, buf, (ssize_t)len);
+}
 
-    /* clear PGID mapping for this tab (foreground job done/stopped) */
-    clear_tab_pgid(tab);
+/* epoll backend: readv from the capture pipe straight into the tab's scrollback */
+static ssize_t job_on_readable(int fd, void *arg)
+{
+    Job *j = arg;
+    return tabs_ingest_fd_at(&j->tab_idx, fd);
+}
 
-    free(kids);
-    free(a);
-    return NULL;
+static void job_on_eof(void *arg)
+{
+    Job *j = arg;
+    j->eof = 1;
+    job_maybe_finish(j);
 }
 
-/* -------------------- tokenization / quoting / glob helpers -------------------- */
-/* (I reuse tokenizer + glob expansion logic similar to your prior implementation) */
+/* a builtin pipeline stage finished (posted from its thread) */
+typedef struct StageDone
+{
+    Job *job;
+    int idx;
+    int status;
+} StageDone;
 
-/* Preprocess: insert spaces around '|' outside quotes so tokenizer sees '|' as separate token */
-static char *preprocess_pipes(const char *in)
+/* a builtin stage between spawning and job registration */
+typedef struct PendingStage
 {
-    size_t n = strlen(in);
-    char *out = malloc(n * 3 + 1); /* generous */
-    if (!out)
-        return NULL;
-    const char *p = in;
-    char *q = out;
-    int in_single = 0, in_double = 0;
-    while (*p)
+    const Builtin *b;
+    char **argv;
+    int fd_out, fd_err;
+    struct Batch *batch; /* a batch stage instead */
+    struct Parallel *par; /* ...or a parallel one */
+    StageDone *done;  /* NULL: not a builtin stage */
+} PendingStage;
+
+static void job_on_stage_done(void *arg)
+{
+    StageDone *sd = arg;
+    Job *j = sd->job;
+    j->status[sd->idx] = sd->status;
+    free(sd);
+    j->live--;
+    job_maybe_finish(j);
+}
+
+static void stage_thread_done(int status, void *arg)
+{
+    StageDone *sd = arg;
+    sd->status = status;
+    reactor_post(job_on_stage_done, sd);
+}
+
+static void job_on_prof_done(void *arg)
+{
+    Job *j = arg;
+    j->prof_live = 0;
+    job_maybe_finish(j);
+}
+
+/* the profile's relays and sampler are done (posted from the last of them) */
+static void prof_threads_done(void *arg)
+{
+    reactor_post(job_on_prof_done, arg);
+}
+
+/* ...for a profile with no job to report to */
+static void prof_discard(void *arg)
+{
+    pipeprof_free(arg);
+}
+
+/* Ctrl+Z: once every process left has stopped, the job leaves the foreground and
+   a command list waiting for it moves on, as in other shells */
+static void job_check_stopped(Job *j)
+{
+    if (j->procs_live == 0 || j->nstopped < j->procs_live)
+        return;
+    if (j->run)
+    {
+        run_post(j->run, 128 + SIGTSTP);
+        j->run = NULL;
+    }
+    if (j->tj ? tabjob_stopped(j->tj) : !j->background)
+        clear_tab_pgid(j->tab_idx);
+}
+
+static void job_on_child(pid_t pid, int status, const struct rusage *ru, void *arg)
+{
+    Job *j = arg;
+    int i = 0;
+    while (i < j->child_count && j->children[i] != pid)
+        ++i;
+    if (i == j->child_count)
+        return;
+    if (WIFSTOPPED(status) || WIFCONTINUED(status))
     {
-        if (*p == '\'' && !in_double)
+        int stop = WIFSTOPPED(status);
+        if (j->stopped[i] != stop)
         {
-            in_single = !in_single;
-            *q++ = *p++;
-            continue;
+            j->stopped[i] = (char)stop;
+            j->nstopped += stop ? 1 : -1;
         }
-        if (*p == '"' && !in_single)
+        if (stop)
+            job_check_stopped(j);
+        else if (j->tj)
+            tabjob_continued(j->tj);
+        return;
+    }
+    if (j->stopped[i])
+    {
+        j->stopped[i] = 0;
+        j->nstopped--;
+    }
+    j->status[i] = status;
+    j->live--;
+    j->procs_live--;
+    timeradd(&j->ru.ru_utime, &ru->ru_utime, &j->ru.ru_utime);
+    timeradd(&j->ru.ru_stime, &ru->ru_stime, &j->ru.ru_stime);
+    if (ru->ru_maxrss > j->ru.ru_maxrss)
+        j->ru.ru_maxrss = ru->ru_maxrss;
+    j->ru.ru_nvcsw += ru->ru_nvcsw;
+    j->ru.ru_nivcsw += ru->ru_nivcsw;
+    if (j->prof)
+        pipeprof_add_usage(j->prof, pid, ru);
+    job_check_stopped(j);
+    job_maybe_finish(j);
+}
+
+/* -------------------- pathname expansion -------------------- */
+
+typedef struct
+{
+    Arena *a;
+    char **out;
+    size_t n, cap;
+    int oom;
+} ArgvBuild;
+
+static void argv_push(ArgvBuild *ab, char *word)
+{
+    if (ab->n + 2 > ab->cap)
+    {
+        /* the old array stays in the arena; at most half of what was handed out */
+        size_t ncap = ab->cap * 2 + 16;
+        char **grown = arena_alloc(ab->a, ncap * sizeof(char *));
+        if (!grown)
         {
-            in_double = !in_double;
-            *q++ = *p++;
-            continue;
+            ab->oom = 1;
+            return;
         }
-        if (!in_single && !in_double && *p == '|')
+        memcpy(grown, ab->out, ab->n * sizeof(char *));
+        ab->out = grown;
+        ab->cap = ncap;
+    }
+    ab->out[ab->n++] = word;
+}
+
+static void argv_emit(const char *path, size_t len, void *arg)
+{
+    ArgvBuild *ab = arg;
+    char *w = arena_strndup(ab->a, path, len);
+    if (w)
+        argv_push(ab, w);
+    else
+        ab->oom = 1;
+}
+
+/* c's argv with unquoted patterns and braces expanded (see glob_expand.h); allocated
+   from a, or c->argv itself if there is nothing to expand */
+static char **expand_argv(Arena *a, const ShCommand *c, int dirfd)
+{
+    int i = 0;
+    while (i < c->argc && !c->glob[i])
+        ++i;
+    if (i == c->argc)
+        return c->argv;
+
+    ArgvBuild ab = {a, NULL, 0, 0, 0};
+    for (i = 0; i < c->argc && !ab.oom; ++i)
+    {
+        if (!c->glob[i])
+            argv_push(&ab, c->argv[i]);
+        else if (glob_expand(c->argv[i], dirfd, argv_emit, &ab) < 0)
+            ab.oom = 1;
+    }
+    if (ab.oom || !ab.out)
+        return NULL;
+    ab.out[ab.n] = NULL;
+    return ab.out;
+}
+
+/* -------------------- command lists (main thread) -------------------- */
+
+/* A parsed command line being run: its pipelines in source order, each with the
+   operator joining it to the one before. A pipeline that launches a job suspends the
+   run; the job's end brings it back to the main thread (cmd_exec_dispatch), where
+   && / || decide whether the next pipeline runs. The AST and everything expanded
+   from it live in one arena, freed with the run. */
+typedef struct RunStep
+{
+    ShKind op; /* SH_SEQ for the first */
+    ShNode *pipeline;
+    int profile; /* written `pprof pipeline` */
+} RunStep;
+
+struct Run
+{
+    atomic_int tab_idx;
+    TabLink link;
+    Arena *arena;
+    RunStep *steps;
+    int nsteps;
+    int next;        /* steps[next] is the next to consider */
+    int status;      /* exit status of the last pipeline that ran */
+    int interrupted; /* Ctrl+C: start nothing more */
+    unsigned long hist; /* history entry the jobs' resource usage goes to */
+    Run *ready_next;
+};
+
+/* the run most recently started in each tab, for Ctrl+C (main thread) */
+static Run *tab_run[CMD_MAX_TABS];
+
+/* runs whose job has ended, waiting for the main thread */
+static Run *ready_head, **ready_tail = &ready_head;
+static pthread_mutex_t ready_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int count_pipelines(const ShNode *n)
+{
+    return n->kind == SH_PIPELINE ? 1 : count_pipelines(n->left) + count_pipelines(n->right);
+}
+
+/* and-or chains are left-associative, so source order with "skip the next pipeline
+   after && on failure / || on success" is their meaning */
+static void flatten(ShNode *n, ShKind op, RunStep *steps, int *k)
+{
+    if (n->kind == SH_PIPELINE)
+    {
+        steps[*k].op = op;
+        steps[*k].pipeline = n;
+        ++*k;
+        return;
+    }
+    flatten(n->left, op, steps, k);
+    flatten(n->right, n->kind, steps, k);
+}
+
+static void run_free(Run *r)
+{
+    int idx = r->tab_idx;
+    if (idx >= 0 && idx < CMD_MAX_TABS && tab_run[idx] == r)
+        tab_run[idx] = NULL;
+    tabs_unlink(&r->link);
+    arena_destroy(r->arena);
+    free(r);
+}
+
+/* reactor thread: a job of r ended with exit code `code` */
+static void run_post(Run *r, int code)
+{
+    r->status = code;
+    pthread_mutex_lock(&ready_lock);
+    r->ready_next = NULL;
+    *ready_tail = r;
+    ready_tail = &r->ready_next;
+    pthread_mutex_unlock(&ready_lock);
+    tabs_wake_main();
+}
+
+static void report(int tab_idx, const char *fmt, ...)
+{
+    char msg[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int m = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (m >= (int)sizeof(msg))
+        m = (int)sizeof(msg) - 1;
+    if (m > 0)
+        tabs_append_output(tab_idx, msg, m);
+}
+
+/* report() from a stage thread or the reactor, to the tab a linked index names */
+static void report_at(const atomic_int *tab_idx, const char *fmt, ...)
+{
+    char msg[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int m = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (m >= (int)sizeof(msg))
+        m = (int)sizeof(msg) - 1;
+    if (m > 0)
+        tabs_append_output_at(tab_idx, msg, m);
+}
+
+/* -------------------- peephole pass over pipelines (main thread) -------------------- */
+
+static int peephole_on = 1;
+static unsigned long peephole_pipelines; /* pipelines that lost stages */
+static unsigned long peephole_stages;    /* stages removed */
+
+void cmd_exec_set_peephole(int on)
+{
+    peephole_on = on;
+}
+
+int cmd_exec_peephole(unsigned long *pipelines, unsigned long *stages)
+{
+    if (pipelines)
+        *pipelines = peephole_pipelines;
+    if (stages)
+        *stages = peephole_stages;
+    return peephole_on;
+}
+
+/* c runs `name` itself, not a subshell or a pattern */
+static int runs(const ShCommand *c, const char *name)
+{
+    return !c->body && c->argc > 0 && !c->glob[0] && strcmp(c->argv[0], name) == 0;
+}
+
+/* drop redirections that change nothing: n>&n, and a repeat of the one before */
+static void merge_redirs(ShCommand *c)
+{
+    ShRedir **pp = &c->redirs, *prev = NULL;
+    while (*pp)
+    {
+        ShRedir *r = *pp;
+        int self = r->kind == SH_REDIR_DUP && r->dup_fd == r->fd;
+        int repeat = prev && prev->kind == r->kind && prev->fd == r->fd &&
+                     (r->kind == SH_REDIR_DUP ? prev->dup_fd == r->dup_fd : strcmp(prev->target, r->target) == 0);
+        if (self || repeat)
         {
-            *q++ = ' ';
-            *q++ = '|';
-            *q++ = ' ';
-            ++p;
+            *pp = r->next;
             continue;
         }
-        *q++ = *p++;
+        prev = r;
+        pp = &r->next;
     }
-    *q = '\0';
-    return out;
 }
 
-/* simple quoted tokenizer (strdup's tokens) */
-static int tokenize_quoted(const char *input, char **argv, int max_args)
+static void drop_stage(ShNode *pl, int i)
 {
-    int argc = 0;
-    const char *p = input;
-    while (*p && argc < max_args - 1)
+    memmove(&pl->cmds[i], &pl->cmds[i + 1], (size_t)(pl->ncmds - i - 1) * sizeof(ShCommand));
+    pl->ncmds--;
+}
+
+/* Rewrite pl without the stages that only copy bytes:
+     cat FILE | cmd ...   ->  cmd < FILE ...
+     ... | cat | ...      ->  ... | ...
+     ... | cat            ->  ...   (the capture pipe collects the output either way;
+                                     kept when && / || will look at cat's status)
+   Returns the number of stages removed. */
+static int peephole(Arena *a, ShNode *pl, int status_used)
+{
+    int removed = 0;
+    for (int i = 0; i < pl->ncmds; ++i)
+        merge_redirs(&pl->cmds[i]);
+
+    /* a leading bare cat reads the terminal's stdin, so it stays */
+    for (int i = pl->ncmds - 1; i >= 1; --i)
     {
-        while (*p && (*p == ' ' || *p == '\t' || *p == '\n'))
-            ++p;
-        if (!*p)
-            break;
-        int in_single = 0, in_double = 0;
-        char tmp[8192];
-        int ti = 0;
-        while (*p)
+        const ShCommand *c = &pl->cmds[i];
+        if (!runs(c, "cat") || c->argc != 1 || c->redirs || (i == pl->ncmds - 1 && status_used))
+            continue;
+        drop_stage(pl, i);
+        ++removed;
+    }
+    if (pl->ncmds >= 2)
+    {
+        ShCommand *c0 = &pl->cmds[0], *c1 = &pl->cmds[1];
+        int c1_reads = 0;
+        for (const ShRedir *r = c1->redirs; r; r = r->next)
+            c1_reads |= r->fd == 0;
+        if (runs(c0, "cat") && c0->argc == 2 && !c0->glob[1] && c0->argv[1][0] && c0->argv[1][0] != '-' &&
+            !c0->redirs && !c1_reads)
         {
-            if (!in_single && *p == '"')
-            {
-                in_double = !in_double;
-                ++p;
-                continue;
-            }
-            if (!in_double && *p == '\'')
+            ShRedir *in = arena_alloc(a, sizeof(*in));
+            if (in)
             {
-                in_single = !in_single;
-                ++p;
-                continue;
-            }
-            if (!in_single && !in_double && (*p == ' ' || *p == '\t' || *p == '\n'))
-                break;
-            if (*p == '\\')
-            {
-                ++p;
-                if (!*p)
-                    break;
-                if (*p == 'n')
-                    tmp[ti++] = '\n';
-                else if (*p == 't')
-                    tmp[ti++] = '\t';
-                else if (*p == '\\')
-                    tmp[ti++] = '\\';
-                else if (*p == '"')
-                    tmp[ti++] = '"';
-                else if (*p == '\'')
-                    tmp[ti++] = '\'';
-                else
-                    tmp[ti++] = *p;
-                ++p;
-                continue;
+                in->kind = SH_REDIR_IN;
+                in->fd = 0;
+                in->target = c0->argv[1];
+                in->next = c1->redirs;
+                c1->redirs = in;
+                drop_stage(pl, 0);
+                ++removed;
             }
-            tmp[ti++] = *p++;
-            if (ti >= (int)sizeof(tmp) - 2)
-                break;
-        }
-        tmp[ti] = '\0';
-        argv[argc] = strdup(tmp);
-        if (!argv[argc])
-        {
-            for (int i = 0; i < argc; ++i)
-                free(argv[i]);
-            return -1;
         }
-        argc++;
     }
-    argv[argc] = NULL;
-    return argc;
+    return removed;
 }
 
-/* glob helpers */
-static int is_operator_token(const char *tok)
+/* `pprof cmd ...` in front of a pipeline: take the word off and profile it, as typed
+   (the peephole pass leaves it alone) */
+static int profile_prefix(ShNode *pl)
 {
-    if (!tok)
+    ShCommand *c0 = &pl->cmds[0];
+    if (!runs(c0, "pprof") || c0->argc < 2)
         return 0;
-    if (strcmp(tok, "|") == 0)
-        return 1;
-    if (strcmp(tok, "<") == 0)
-        return 1;
-    if (strcmp(tok, ">") == 0)
-        return 1;
-    if (strcmp(tok, ">>") == 0)
-        return 1;
-    if (tok[0] == '<' || tok[0] == '>')
-        return 1;
+    c0->argv++;
+    c0->glob++;
+    c0->argc--;
+    return 1;
+}
+
+/* -------------------- stages that start processes of their own -------------------- */
+
+/* the CPUs we may run on: what `batch -j 0` and `parallel -j 0` size themselves by */
+static int cpus_usable(void)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        return CPU_COUNT(&set);
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* The tab's environment copied into a, for a stage thread that outlives the command
+   line's arena; *bytes grows by what it takes of an exec's ARG_MAX. NULL in *envp
+   means our own. 0, or -1 when out of memory. */
+static int copy_env(Arena *a, int tab_idx, char ***envp, size_t *bytes)
+{
+    char *const *env = tabs_env(tab_idx);
+    size_t env_n = 0;
+    *envp = NULL;
+    if (!env)
+        return 0;
+    while (env[env_n])
+        ++env_n;
+    char **out = arena_alloc(a, (env_n + 1) * sizeof(char *));
+    if (!out)
+        return -1;
+    for (size_t k = 0; k < env_n; ++k)
+    {
+        if (!(out[k] = arena_strndup(a, env[k], strlen(env[k]))))
+            return -1;
+        *bytes += strlen(env[k]) + 1 + sizeof(char *);
+    }
+    out[env_n] = NULL;
+    *envp = out;
     return 0;
 }
-static int contains_glob_chars(const char *s)
+
+/* Start one of a stage's children in the pipeline's process group pgid, or in the
+   group we lead already (*leader). With neither (the pipeline had no process before
+   this stage, or its leader has been reaped) the child leads a new group, which
+   becomes the tab's foreground group so Ctrl+C reaches it. */
+static pid_t group_spawn(LaunchSpec *ls, pid_t pgid, pid_t *leader, int tab_idx, int background)
+{
+    ls->pgid = *leader ? *leader : pgid;
+    pid_t pid = launch_spawn(ls);
+    if (pid < 0 && ls->pgid > 0 && !*leader)
+    {
+        /* the pipeline's group is gone: lead our own */
+        ls->pgid = 0;
+        pid = launch_spawn(ls);
+    }
+    if (pid >= 0 && ls->pgid == 0)
+    {
+        *leader = pid;
+        if (!background)
+            set_tab_pgid(tab_idx, pid);
+    }
+    return pid;
+}
+
+/* wait for one child; the group leader is left a zombie until the stage ends so
+   later children can still join its group. Returns the wait status. */
+static int group_reap(pid_t pid, pid_t leader, int *leader_done)
+{
+    if (pid == leader)
+    {
+        siginfo_t si;
+        memset(&si, 0, sizeof(si));
+        while (waitid(P_PID, (id_t)pid, &si, WEXITED | WNOWAIT) < 0 && errno == EINTR)
+            ;
+        *leader_done = 1;
+        return si.si_code == CLD_EXITED ? (si.si_status & 0xff) << 8 : si.si_status & 0x7f;
+    }
+    int st = 0;
+    while (waitpid(pid, &st, 0) < 0)
+        if (errno != EINTR)
+            break;
+    return st;
+}
+
+/* -------------------- batch: argument lists split to fit ARG_MAX -------------------- */
+
+/* `batch [-j N] cmd word... pattern...` runs cmd over everything from its first unquoted
+   pattern on, as many times as it takes for each argv to fit in ARG_MAX, like xargs.
+   Matches go straight into the batch being filled instead of being collected first,
+   so a directory of half a million files costs one batch of memory. Batches run one
+   after the other, or up to N at once with -j N (0 = one per CPU). A batch killed by
+   a signal stops the rest. The stage runs on a thread of its own; everything it needs
+   is copied into its own arena, since the command line's arena may go first. */
+typedef struct Batch
+{
+    Arena *arena;
+    atomic_int tab_idx;
+    TabLink link;
+    int jobs;
+    char **argv;         /* command words, then the words to split */
+    unsigned char *glob; /* per argv word, as in ShCommand */
+    int argc;
+    int prefix;          /* argv[0..prefix) start every batch */
+    char **envp;
+    int fds[3];          /* -1 = inherit */
+    int cwd_fd;
+    pid_t pgid;          /* the pipeline's process group, 0 if it has none */
+    int background;      /* started with & */
+    StageDone *done;
+
+    /* the batch being filled: strings packed in buf, offsets in off */
+    char *buf;
+    size_t len, buf_cap;
+    size_t *off;
+    size_t n, off_cap;
+    size_t limit;        /* bytes the variable part may take */
+
+    pid_t *running;      /* FIFO of up to jobs children */
+    int nrun;
+    pid_t leader;        /* our first child when we lead the group ourselves */
+    int leader_done;     /* the leader has exited (it is reaped last, to keep the group) */
+    int launched;        /* batches started */
+    int status;          /* exit code so far */
+    int stop;
+} Batch;
+
+static void batch_free(Batch *b)
+{
+    for (int k = 0; k < 3; ++k)
+        if (b->fds[k] >= 0)
+            close(b->fds[k]);
+    if (b->cwd_fd >= 0)
+        close(b->cwd_fd);
+    free(b->buf);
+    free(b->off);
+    free(b->running);
+    tabs_unlink(&b->link);
+    arena_destroy(b->arena);
+    free(b);
+}
+
+static char *batch_strdup(Arena *a, const char *s)
+{
+    return arena_strndup(a, s, strlen(s));
+}
+
+/* c is `batch [-j N] cmd ...`; fds are the stage's 0-2 (duplicated here) */
+static Batch *batch_new(int tab_idx, const ShCommand *c, const int *fds, const char **err)
+{
+    int i = 1, jobs = 1;
+    *err = NULL;
+    for (; i < c->argc && !c->glob[i] && c->argv[i][0] == '-'; ++i)
+    {
+        const char *opt = c->argv[i];
+        if (strcmp(opt, "--") == 0)
+        {
+            ++i;
+            break;
+        }
+        if (strncmp(opt, "-j", 2) != 0)
+        {
+            *err = "usage: batch [-j N] command [word...] pattern...";
+            return NULL;
+        }
+        const char *num = opt[2] ? opt + 2 : (i + 1 < c->argc ? c->argv[++i] : "");
+        char *end;
+        long v = strtol(num, &end, 10);
+        if (!num[0] || *end || v < 0 || v > 1024)
+        {
+            *err = "-j takes a number of batches from 0 to 1024";
+            return NULL;
+        }
+        jobs = v > 0 ? (int)v : cpus_usable();
+    }
+    if (i >= c->argc)
+    {
+        *err = "usage: batch [-j N] command [word...] pattern...";
+        return NULL;
+    }
+
+    Batch *b = calloc(1, sizeof(*b));
+    if (!b)
+        return NULL;
+    b->fds[0] = b->fds[1] = b->fds[2] = b->cwd_fd = -1;
+    b->arena = arena_create(4096);
+    b->tab_idx = tab_idx;
+    tabs_link(&b->link, &b->tab_idx);
+    b->jobs = jobs > 0 ? jobs : 1;
+    b->argc = c->argc - i;
+    b->running = calloc((size_t)b->jobs, sizeof(pid_t));
+    if (!b->arena || !b->running)
+        goto fail;
+    b->argv = arena_alloc(b->arena, ((size_t)b->argc + 1) * sizeof(char *));
+    b->glob = arena_alloc(b->arena, (size_t)b->argc + 1);
+    if (!b->argv || !b->glob)
+        goto fail;
+    b->prefix = b->argc;
+    for (int k = 0; k < b->argc; ++k)
+    {
+        if (!(b->argv[k] = batch_strdup(b->arena, c->argv[i + k])))
+            goto fail;
+        b->glob[k] = c->glob[i + k];
+        if (b->glob[k] && b->prefix == b->argc && k > 0)
+            b->prefix = k;
+    }
+
+    /* the split part gets what ARG_MAX leaves after the environment, the command words
+       and xargs' 2 KiB of headroom */
+    size_t used = 2048;
+    if (copy_env(b->arena, tab_idx, &b->envp, &used) < 0)
+        goto fail;
+    for (int k = 0; k < b->prefix; ++k)
+        used += strlen(b->argv[k]) + 1 + sizeof(char *);
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0)
+        arg_max = 128 * 1024;
+    b->limit = (size_t)arg_max > used + 4096 ? (size_t)arg_max - used : 4096;
+
+    for (int k = 0; k < 3; ++k)
+        if (fds[k] >= 0 && (b->fds[k] = fcntl(fds[k], F_DUPFD_CLOEXEC, 0)) < 0)
+            goto fail;
+    int cwd = tabs_cwd_fd(tab_idx);
+    if (cwd != AT_FDCWD && (b->cwd_fd = fcntl(cwd, F_DUPFD_CLOEXEC, 0)) < 0)
+        goto fail;
+    return b;
+
+fail:
+    batch_free(b);
+    return NULL;
+}
+
+/* fold one child's end into the batch's exit code, xargs-style */
+static void batch_account(Batch *b, int wstatus)
+{
+    if (WIFSIGNALED(wstatus))
+    {
+        b->status = 125;
+        b->stop = 1;
+    }
+    else if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 255)
+    {
+        b->status = 124;
+        b->stop = 1;
+    }
+    else if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) != 0 && b->status == 0)
+        b->status = 123;
+}
+
+/* wait for the oldest running batch */
+static void batch_reap_one(Batch *b)
+{
+    pid_t pid = b->running[0];
+    memmove(b->running, b->running + 1, (size_t)(b->nrun - 1) * sizeof(pid_t));
+    b->nrun--;
+    batch_account(b, group_reap(pid, b->leader, &b->leader_done));
+}
+
+/* exec the command over the words collected so far */
+static void batch_flush(Batch *b)
+{
+    if (b->stop)
+        return;
+    char **argv = malloc(((size_t)b->prefix + b->n + 1) * sizeof(char *));
+    if (!argv)
+    {
+        b->status = 125;
+        b->stop = 1;
+        return;
+    }
+    memcpy(argv, b->argv, (size_t)b->prefix * sizeof(char *));
+    for (size_t k = 0; k < b->n; ++k)
+        argv[b->prefix + k] = b->buf + b->off[k];
+    argv[b->prefix + b->n] = NULL;
+
+    while (b->nrun >= b->jobs)
+        batch_reap_one(b);
+    LaunchSpec ls;
+    memset(&ls, 0, sizeof(ls));
+    ls.argv = argv;
+    ls.fd_in = b->fds[0];
+    ls.fd_out = b->fds[1];
+    ls.fd_err = b->fds[2];
+    ls.cwd_fd = b->cwd_fd;
+    ls.envp = b->envp;
+    pid_t pid = group_spawn(&ls, b->pgid, &b->leader, b->tab_idx, b->background);
+    if (pid < 0)
+    {
+        int e = errno;
+        report_at(&b->tab_idx, "batch: %s: %s\n", argv[0], e == ENOENT ? "command not found" : strerror(e));
+        b->status = e == ENOENT ? 127 : 126;
+        b->stop = 1;
+    }
+    else
+    {
+        b->running[b->nrun++] = pid;
+        b->launched++;
+    }
+    free(argv);
+    b->len = 0;
+    b->n = 0;
+}
+
+/* add the word a followed by s (either may be empty) to the batch being filled */
+static void batch_add(Batch *b, const char *a, size_t alen, const char *s, size_t slen)
+{
+    if (b->stop)
+        return;
+    size_t need = alen + slen + 1;
+    if (b->n > 0 && b->len + need + (b->n + 1) * sizeof(char *) > b->limit)
+        batch_flush(b);
+    if (b->len + need > b->buf_cap)
+    {
+        size_t cap = b->buf_cap ? b->buf_cap * 2 : 64 * 1024;
+        while (cap < b->len + need)
+            cap *= 2;
+        char *nb = realloc(b->buf, cap);
+        if (!nb)
+        {
+            b->stop = 1;
+            return;
+        }
+        b->buf = nb;
+        b->buf_cap = cap;
+    }
+    if (b->n == b->off_cap)
+    {
+        size_t cap = b->off_cap ? b->off_cap * 2 : 1024;
+        size_t *no = realloc(b->off, cap * sizeof(size_t));
+        if (!no)
+        {
+            b->stop = 1;
+            return;
+        }
+        b->off = no;
+        b->off_cap = cap;
+    }
+    b->off[b->n++] = b->len;
+    memcpy(b->buf + b->len, a, alen);
+    memcpy(b->buf + b->len + alen, s, slen);
+    b->buf[b->len + alen + slen] = '\0';
+    b->len += need;
+}
+
+static void batch_emit(const char *path, size_t len, void *arg)
+{
+    batch_add(arg, path, len, "", 0);
+}
+
+/* stream pattern's matches into the batch. A pattern whose only wildcards are in its
+   last component is matched while its directory is read (unsorted); anything else,
+   braces, ** and escaped (quoted) characters included, goes through glob_expand().
+   Like expand_argv(), no match leaves the pattern itself. */
+static void batch_expand(Batch *b, const char *pattern)
+{
+    const char *slash = strrchr(pattern, '/');
+    const char *base = slash ? slash + 1 : pattern;
+    size_t dlen = (size_t)(base - pattern);
+    int simple = pattern[0] != '~' && !strpbrk(pattern, "{\\") && !strstr(base, "**") &&
+                 !memchr(pattern, '*', dlen) && !memchr(pattern, '?', dlen) && !memchr(pattern, '[', dlen);
+    size_t matches = 0;
+    if (simple)
+    {
+        char *dir = strndup(pattern, dlen);
+        int fd = dir ? openat(b->cwd_fd >= 0 ? b->cwd_fd : AT_FDCWD, dlen ? dir : ".",
+                              O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+                     : -1;
+        DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+        if (!d && fd >= 0)
+            close(fd);
+        struct dirent *de;
+        while (d && !b->stop && (de = readdir(d)))
+        {
+            if (fnmatch(base, de->d_name, FNM_PERIOD) != 0)
+                continue;
+            batch_add(b, pattern, dlen, de->d_name, strlen(de->d_name));
+            ++matches;
+        }
+        if (d)
+            closedir(d);
+        free(dir);
+    }
+    else
+        matches = (size_t)glob_expand(pattern, b->cwd_fd >= 0 ? b->cwd_fd : AT_FDCWD, batch_emit, b);
+    if (matches == 0)
+        batch_add(b, pattern, strlen(pattern), "", 0);
+}
+
+static void *batch_main(void *p)
+{
+    Batch *b = p;
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    for (int k = b->prefix; k < b->argc && !b->stop; ++k)
+    {
+        if (b->glob[k])
+            batch_expand(b, b->argv[k]);
+        else
+            batch_add(b, b->argv[k], strlen(b->argv[k]), "", 0);
+    }
+    /* the command runs at least once, as with a plain argv */
+    if (b->n > 0 || b->launched == 0)
+        batch_flush(b);
+    while (b->nrun > 0)
+        batch_reap_one(b);
+    if (b->leader && b->leader_done)
+        while (waitpid(b->leader, NULL, 0) < 0 && errno == EINTR)
+            ;
+    StageDone *done = b->done;
+    int status = b->status;
+    batch_free(b);
+    stage_thread_done((status & 0xff) << 8, done);
+    return NULL;
+}
+
+/* start b on its own thread; on failure b is freed and done is not called */
+static int batch_start(Batch *b)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    pthread_t thr;
+    int rc = pthread_create(&thr, &attr, batch_main, b);
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
+    {
+        batch_free(b);
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+/* -------------------- parallel: one command per input on a worker pool -------------------- */
+
+/* `parallel [-j N] [-u] [-t] cmd word... [::: input...]` runs cmd once per input: the
+   words after :::, or else the lines of the stage's stdin, read as they arrive. {} in
+   a word stands for the input, {.} for it without its extension and {/} for its last
+   path component; with none of them the input is appended as a last word. Up to N
+   commands run at once, by default one per CPU we may run on. Each command's stdout
+   and stderr are held back and passed on whole, in input order, as soon as the ones
+   before it are done (the oldest one streams); -u lets them interleave as written.
+   -t reports every command's exit status and time, and a summary. The children join
+   the pipeline's process group, so Ctrl+C or Ctrl+Z reach all of them; a command
+   killed by a signal stops any more from starting. The exit code is the number of
+   commands that failed (at most 101), as with GNU parallel, or 128 + the signal. */
+typedef struct ParJob
+{
+    unsigned long seq; /* input number */
+    char *input;
+    pid_t pid;
+    int pidfd;  /* -1 once it has exited */
+    int fd[2];  /* our ends of its stdout / stderr pipes, -1 at EOF or with -u */
+    char *held[2]; /* output held back while an earlier command is still going */
+    size_t held_len[2], held_cap[2];
+    int status;
+    struct timespec start;
+    double secs;
+    struct ParJob *next; /* finished, waiting for its turn */
+} ParJob;
+
+typedef struct Parallel
+{
+    Arena *arena;
+    atomic_int tab_idx;
+    TabLink link;
+    int jobs;
+    int ungrouped;       /* -u */
+    int timings;         /* -t */
+    char **tmpl;         /* the command words */
+    int ntmpl;
+    int has_slot;        /* some word has {}, {.} or {/} */
+    char **inputs;       /* after :::, or NULL to read lines from fds[0] */
+    int ninputs, next_input;
+    char *line;          /* stdin read so far and not yet used */
+    size_t line_len, line_cap;
+    int in_eof;
+    char **envp;
+    int fds[3];          /* -1 = inherit */
+    int null_fd;         /* the commands' stdin */
+    int cwd_fd;
+    pid_t pgid;          /* the pipeline's process group, 0 if it has none */
+    int background;
+    StageDone *done;
+
+    ParJob **running;
+    int nrun;
+    ParJob *finished;    /* by seq */
+    unsigned long launched, next_out, failed;
+    unsigned long unstarted; /* inputs whose command could not be started */
+    pid_t leader;
+    int leader_done;
+    int signaled;        /* a command's terminating signal */
+    int stop;
+    struct timespec start;
+    double busy, slowest;
+    char *slowest_input;
+} Parallel;
+
+static void par_job_free(ParJob *j)
+{
+    if (j->pidfd >= 0)
+        close(j->pidfd);
+    for (int k = 0; k < 2; ++k)
+    {
+        if (j->fd[k] >= 0)
+            close(j->fd[k]);
+        free(j->held[k]);
+    }
+    free(j->input);
+    free(j);
+}
+
+static void parallel_free(Parallel *p)
+{
+    for (int k = 0; k < 3; ++k)
+        if (p->fds[k] >= 0)
+            close(p->fds[k]);
+    if (p->null_fd >= 0)
+        close(p->null_fd);
+    if (p->cwd_fd >= 0)
+        close(p->cwd_fd);
+    for (int k = 0; k < p->nrun; ++k)
+        par_job_free(p->running[k]);
+    while (p->finished)
+    {
+        ParJob *j = p->finished;
+        p->finished = j->next;
+        par_job_free(j);
+    }
+    free(p->running);
+    free(p->line);
+    free(p->slowest_input);
+    tabs_unlink(&p->link);
+    arena_destroy(p->arena);
+    free(p);
+}
+
+/* argv is the stage's expanded `parallel ...`; fds are its 0-2 (duplicated here) */
+static Parallel *parallel_new(int tab_idx, char **argv, const int *fds, const char **err)
+{
+    static const char usage[] = "usage: parallel [-j N] [-u] [-t] command [word...] [::: input...]";
+    int i = 1, jobs = 0, ungrouped = 0, timings = 0;
+    *err = NULL;
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; ++i)
+    {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--") == 0)
+        {
+            ++i;
+            break;
+        }
+        if (strcmp(opt, "-u") == 0)
+            ungrouped = 1;
+        else if (strcmp(opt, "-k") == 0)
+            ungrouped = 0;
+        else if (strcmp(opt, "-t") == 0)
+            timings = 1;
+        else if (strncmp(opt, "-j", 2) == 0)
+        {
+            const char *num = opt[2] ? opt + 2 : (argv[i + 1] ? argv[++i] : "");
+            char *end;
+            long v = strtol(num, &end, 10);
+            if (!num[0] || *end || v < 0 || v > 1024)
+            {
+                *err = "-j takes a number of commands from 0 to 1024";
+                return NULL;
+            }
+            jobs = (int)v;
+        }
+        else
+        {
+            *err = usage;
+            return NULL;
+        }
+    }
+    int ntmpl = 0;
+    while (argv[i + ntmpl] && strcmp(argv[i + ntmpl], ":::") != 0)
+        ++ntmpl;
+    if (ntmpl == 0)
+    {
+        *err = usage;
+        return NULL;
+    }
+    char **inputs = argv[i + ntmpl] ? argv + i + ntmpl + 1 : NULL;
+    if (!inputs && fds[0] < 0)
+    {
+        *err = "no inputs: give them after ::: or on stdin";
+        return NULL;
+    }
+
+    Parallel *p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->fds[0] = p->fds[1] = p->fds[2] = p->null_fd = p->cwd_fd = -1;
+    p->arena = arena_create(4096);
+    p->tab_idx = tab_idx;
+    tabs_link(&p->link, &p->tab_idx);
+    p->jobs = jobs > 0 ? jobs : cpus_usable();
+    p->ungrouped = ungrouped;
+    p->timings = timings;
+    p->ntmpl = ntmpl;
+    p->running = calloc((size_t)p->jobs, sizeof(ParJob *));
+    if (!p->arena || !p->running)
+        goto fail;
+    p->tmpl = arena_alloc(p->arena, (size_t)ntmpl * sizeof(char *));
+    if (!p->tmpl)
+        goto fail;
+    for (int k = 0; k < ntmpl; ++k)
+    {
+        const char *w = argv[i + k];
+        if (!(p->tmpl[k] = arena_strndup(p->arena, w, strlen(w))))
+            goto fail;
+        p->has_slot |= strstr(w, "{}") || strstr(w, "{.}") || strstr(w, "{/}");
+    }
+    if (inputs)
+    {
+        while (inputs[p->ninputs])
+            p->ninputs++;
+        p->inputs = arena_alloc(p->arena, ((size_t)p->ninputs + 1) * sizeof(char *));
+        if (!p->inputs)
+            goto fail;
+        for (int k = 0; k < p->ninputs; ++k)
+            if (!(p->inputs[k] = arena_strndup(p->arena, inputs[k], strlen(inputs[k]))))
+                goto fail;
+    }
+    size_t used = 0;
+    if (copy_env(p->arena, tab_idx, &p->envp, &used) < 0)
+        goto fail;
+    for (int k = 0; k < 3; ++k)
+        if (fds[k] >= 0 && (p->fds[k] = fcntl(fds[k], F_DUPFD_CLOEXEC, 0)) < 0)
+            goto fail;
+    if ((p->null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) < 0)
+        goto fail;
+    int cwd = tabs_cwd_fd(tab_idx);
+    if (cwd != AT_FDCWD && (p->cwd_fd = fcntl(cwd, F_DUPFD_CLOEXEC, 0)) < 0)
+        goto fail;
+    return p;
+
+fail:
+    parallel_free(p);
+    return NULL;
+}
+
+/* w with {}, {.} and {/} replaced from in */
+static char *par_subst(const char *w, const char *in)
+{
+    const char *base = strrchr(in, '/');
+    base = base ? base + 1 : in;
+    const char *dot = strrchr(base, '.');
+    size_t in_len = strlen(in), noext = dot && dot != base ? (size_t)(dot - in) : in_len;
+    size_t cap = strlen(w) + 1, n = 0;
+    for (const char *c = w; (c = strchr(c, '{')); ++c)
+        cap += in_len;
+    char *out = malloc(cap);
+    if (!out)
+        return NULL;
+    while (*w)
+    {
+        if (strncmp(w, "{}", 2) == 0)
+        {
+            memcpy(out + n, in, in_len);
+            n += in_len;
+            w += 2;
+        }
+        else if (strncmp(w, "{.}", 3) == 0)
+        {
+            memcpy(out + n, in, noext);
+            n += noext;
+            w += 3;
+        }
+        else if (strncmp(w, "{/}", 3) == 0)
+        {
+            memcpy(out + n, base, strlen(base));
+            n += strlen(base);
+            w += 3;
+        }
+        else
+            out[n++] = *w++;
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return; /* the reader is gone: drop it, as the command would have */
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+/* pass on output a command holds back; it streams from now on */
+static void par_release(Parallel *p, ParJob *j)
 {
-    if (!s)
+    for (int k = 0; k < 2; ++k)
+    {
+        if (j->held_len[k] > 0 && p->fds[1 + k] >= 0)
+            write_all(p->fds[1 + k], j->held[k], j->held_len[k]);
+        j->held_len[k] = 0;
+    }
+}
+
+/* a command is done and its output passed on */
+static void par_retire(Parallel *p, ParJob *j)
+{
+    if (p->timings && p->fds[2] >= 0)
+    {
+        if (WIFSIGNALED(j->status))
+            dprintf(p->fds[2], "[parallel %lu: killed by signal %d, %.3fs] %s\n", j->seq + 1, WTERMSIG(j->status),
+                    j->secs, j->input);
+        else
+            dprintf(p->fds[2], "[parallel %lu: exit %d, %.3fs] %s\n", j->seq + 1, WEXITSTATUS(j->status), j->secs,
+                    j->input);
+    }
+    p->next_out = j->seq + 1;
+    par_job_free(j);
+}
+
+/* in order: retire the finished commands whose turn it is, then let the oldest
+   running one stream */
+static void par_advance(Parallel *p)
+{
+    while (p->finished && p->finished->seq == p->next_out)
+    {
+        ParJob *j = p->finished;
+        p->finished = j->next;
+        par_release(p, j);
+        par_retire(p, j);
+    }
+    for (int k = 0; k < p->nrun; ++k)
+        if (p->running[k]->seq == p->next_out)
+            par_release(p, p->running[k]);
+}
+
+/* running command k has exited and closed its output */
+static void par_complete(Parallel *p, int k)
+{
+    ParJob *j = p->running[k];
+    p->running[k] = p->running[--p->nrun];
+    p->busy += j->secs;
+    if (j->secs > p->slowest || !p->slowest_input)
+    {
+        free(p->slowest_input);
+        p->slowest = j->secs;
+        p->slowest_input = strdup(j->input);
+    }
+    if (WIFSIGNALED(j->status))
+    {
+        p->failed++;
+        p->signaled = WTERMSIG(j->status);
+        p->stop = 1;
+    }
+    else if (!WIFEXITED(j->status) || WEXITSTATUS(j->status) != 0)
+        p->failed++;
+    if (p->ungrouped)
+    {
+        par_retire(p, j);
+        return;
+    }
+    ParJob **at = &p->finished;
+    while (*at && (*at)->seq < j->seq)
+        at = &(*at)->next;
+    j->next = *at;
+    *at = j;
+    par_advance(p);
+}
+
+static void par_reaped(Parallel *p, ParJob *j)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    j->status = group_reap(j->pid, p->leader, &p->leader_done);
+    j->secs = (double)(now.tv_sec - j->start.tv_sec) + (double)(now.tv_nsec - j->start.tv_nsec) / 1e9;
+    if (j->pidfd >= 0)
+        close(j->pidfd);
+    j->pidfd = -1;
+    j->pid = 0;
+}
+
+/* start cmd over input (taken over) */
+static void par_launch(Parallel *p, char *input)
+{
+    ParJob *j = calloc(1, sizeof(*j));
+    char **argv = calloc((size_t)p->ntmpl + 2, sizeof(char *));
+    int pipes[2][2] = {{-1, -1}, {-1, -1}};
+    int ok = j && argv;
+    for (int k = 0; ok && k < p->ntmpl; ++k)
+        ok = (argv[k] = p->has_slot ? par_subst(p->tmpl[k], input) : strdup(p->tmpl[k])) != NULL;
+    if (ok && !p->has_slot)
+        ok = (argv[p->ntmpl] = strdup(input)) != NULL;
+    for (int k = 0; ok && !p->ungrouped && k < 2; ++k)
+        ok = pipe2(pipes[k], O_CLOEXEC) == 0;
+    pid_t pid = -1;
+    if (ok)
+    {
+        LaunchSpec ls;
+        memset(&ls, 0, sizeof(ls));
+        ls.argv = argv;
+        ls.fd_in = p->null_fd;
+        ls.fd_out = p->ungrouped ? p->fds[1] : pipes[0][1];
+        ls.fd_err = p->ungrouped ? p->fds[2] : pipes[1][1];
+        ls.cwd_fd = p->cwd_fd;
+        ls.envp = p->envp;
+        clock_gettime(CLOCK_MONOTONIC, &j->start);
+        pid = group_spawn(&ls, p->pgid, &p->leader, p->tab_idx, p->background);
+        if (pid < 0)
+        {
+            int e = errno;
+            report_at(&p->tab_idx, "parallel: %s: %s\n", argv[0], e == ENOENT ? "command not found" : strerror(e));
+            if (e == ENOENT || e == EACCES)
+                p->stop = 1; /* every other input would fail the same way */
+        }
+    }
+    else
+    {
+        report_at(&p->tab_idx, "parallel: %s\n", strerror(errno ? errno : ENOMEM));
+        p->stop = 1;
+    }
+    for (int k = 0; argv && argv[k]; ++k)
+        free(argv[k]);
+    free(argv);
+    for (int k = 0; k < 2; ++k)
+        if (pipes[k][1] >= 0)
+            close(pipes[k][1]);
+    if (pid < 0)
+    {
+        /* it takes no turn in the output order */
+        for (int k = 0; k < 2; ++k)
+            if (pipes[k][0] >= 0)
+                close(pipes[k][0]);
+        free(j);
+        free(input);
+        p->unstarted++;
+        return;
+    }
+    j->seq = p->launched++;
+    j->input = input;
+    j->pid = pid;
+    j->fd[0] = pipes[0][0];
+    j->fd[1] = pipes[1][0];
+    /* without pidfds (Linux < 5.3) a command is waited for in turn */
+    j->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    p->running[p->nrun++] = j;
+    if (j->pidfd < 0 && p->ungrouped)
+        par_reaped(p, j);
+}
+
+/* the next input, or NULL (with in_eof / stop telling why) */
+static char *par_next_input(Parallel *p)
+{
+    if (p->inputs)
+    {
+        if (p->next_input >= p->ninputs)
+        {
+            p->in_eof = 1;
+            return NULL;
+        }
+        return strdup(p->inputs[p->next_input++]);
+    }
+    for (;;)
+    {
+        char *nl = memchr(p->line, '\n', p->line_len);
+        if (!nl && !(p->in_eof && p->line_len > 0))
+            return NULL;
+        size_t n = nl ? (size_t)(nl - p->line) : p->line_len;
+        char *in = n > 0 ? strndup(p->line, n) : NULL;
+        size_t used = nl ? n + 1 : n;
+        memmove(p->line, p->line + used, p->line_len - used);
+        p->line_len -= used;
+        if (n > 0)
+            return in; /* empty lines are skipped */
+    }
+}
+
+/* take what the stage's stdin has now */
+static void par_read_input(Parallel *p)
+{
+    if (p->line_cap - p->line_len < 64 * 1024)
+    {
+        size_t cap = p->line_cap ? p->line_cap * 2 : 128 * 1024;
+        char *nl = realloc(p->line, cap);
+        if (!nl)
+        {
+            p->stop = 1;
+            return;
+        }
+        p->line = nl;
+        p->line_cap = cap;
+    }
+    ssize_t n = read(p->fds[0], p->line + p->line_len, p->line_cap - p->line_len);
+    if (n > 0)
+        p->line_len += (size_t)n;
+    else if (n == 0 || errno != EINTR)
+        p->in_eof = 1;
+}
+
+/* command j's output pipe k is readable */
+static void par_read_output(Parallel *p, ParJob *j, int k)
+{
+    char buf[64 * 1024];
+    ssize_t n = read(j->fd[k], buf, sizeof(buf));
+    if (n < 0 && errno == EINTR)
+        return;
+    if (n <= 0)
+    {
+        close(j->fd[k]);
+        j->fd[k] = -1;
+        return;
+    }
+    if (j->seq == p->next_out)
+    {
+        if (p->fds[1 + k] >= 0)
+            write_all(p->fds[1 + k], buf, (size_t)n);
+        return;
+    }
+    if (j->held_len[k] + (size_t)n > j->held_cap[k])
+    {
+        size_t cap = j->held_cap[k] ? j->held_cap[k] * 2 : 64 * 1024;
+        while (cap < j->held_len[k] + (size_t)n)
+            cap *= 2;
+        char *nb = realloc(j->held[k], cap);
+        if (!nb)
+            return; /* lost; the command goes on */
+        j->held[k] = nb;
+        j->held_cap[k] = cap;
+    }
+    memcpy(j->held[k] + j->held_len[k], buf, (size_t)n);
+    j->held_len[k] += (size_t)n;
+}
+
+static void *parallel_main(void *arg)
+{
+    Parallel *p = arg;
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &p->start);
+    /* per running command: its pidfd and two pipes; then stdin */
+    size_t cap = (size_t)p->jobs * 3 + 1;
+    struct pollfd *pfd = malloc(cap * sizeof(*pfd));
+    int *who = malloc(cap * sizeof(int));
+    if (!pfd || !who)
+        report_at(&p->tab_idx, "parallel: %s\n", strerror(ENOMEM));
+    while (pfd && who)
+    {
+        while (!p->stop && p->nrun < p->jobs)
+        {
+            char *in = par_next_input(p);
+            if (!in)
+                break;
+            par_launch(p, in);
+        }
+        int more = !p->stop && (!p->in_eof || p->line_len > 0);
+        if (p->nrun == 0 && !more)
+            break;
+        int n = 0;
+        for (int k = 0; k < p->nrun; ++k)
+        {
+            ParJob *j = p->running[k];
+            if (j->pidfd >= 0)
+            {
+                pfd[n] = (struct pollfd){j->pidfd, POLLIN, 0};
+                who[n++] = k * 3;
+            }
+            for (int f = 0; f < 2; ++f)
+                if (j->fd[f] >= 0)
+                {
+                    pfd[n] = (struct pollfd){j->fd[f], POLLIN, 0};
+                    who[n++] = k * 3 + 1 + f;
+                }
+        }
+        if (!p->inputs && !p->in_eof && !p->stop && p->nrun < p->jobs)
+        {
+            pfd[n] = (struct pollfd){p->fds[0], POLLIN, 0};
+            who[n++] = -1;
+        }
+        if (n > 0 && poll(pfd, (nfds_t)n, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            p->stop = 1;
+            break;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            if (!pfd[i].revents)
+                continue;
+            if (who[i] < 0)
+            {
+                par_read_input(p);
+                continue;
+            }
+            ParJob *j = p->running[who[i] / 3];
+            if (who[i] % 3 == 0)
+                par_reaped(p, j);
+            else
+                par_read_output(p, j, who[i] % 3 - 1);
+        }
+        /* done: exited and output drained; from the end, as completion reorders. Without
+           a pidfd, a command is waited for once it has closed its output. */
+        for (int k = p->nrun - 1; k >= 0; --k)
+        {
+            ParJob *j = p->running[k];
+            if (j->pid > 0 && j->pidfd < 0 && j->fd[0] < 0 && j->fd[1] < 0)
+                par_reaped(p, j);
+            if (j->pid == 0 && j->fd[0] < 0 && j->fd[1] < 0)
+                par_complete(p, k);
+        }
+    }
+    free(pfd);
+    free(who);
+    /* poll() failed: finish the commands one by one */
+    while (p->nrun > 0)
+    {
+        ParJob *j = p->running[p->nrun - 1];
+        for (int f = 0; f < 2; ++f)
+            while (j->fd[f] >= 0)
+                par_read_output(p, j, f);
+        if (j->pid > 0)
+            par_reaped(p, j);
+        par_complete(p, p->nrun - 1);
+    }
+    if (p->leader && p->leader_done)
+        while (waitpid(p->leader, NULL, 0) < 0 && errno == EINTR)
+            ;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wall = (double)(now.tv_sec - p->start.tv_sec) + (double)(now.tv_nsec - p->start.tv_nsec) / 1e9;
+    if (p->fds[2] >= 0 && (p->timings || p->failed + p->unstarted > 0))
+    {
+        dprintf(p->fds[2], "[parallel: %lu command%s, %lu failed, %d at a time; wall %.3fs, busy %.3fs",
+                p->launched + p->unstarted, p->launched + p->unstarted == 1 ? "" : "s", p->failed + p->unstarted,
+                p->jobs, wall, p->busy);
+        if (p->slowest_input)
+            dprintf(p->fds[2], ", slowest %.3fs: %s", p->slowest, p->slowest_input);
+        dprintf(p->fds[2], "]\n");
+    }
+    unsigned long failed = p->failed + p->unstarted;
+    int status = p->signaled ? 128 + p->signaled : failed > 101 ? 101 : (int)failed;
+    StageDone *done = p->done;
+    parallel_free(p);
+    stage_thread_done((status & 0xff) << 8, done);
+    return NULL;
+}
+
+/* start p on its own thread; on failure p is freed and done is not called */
+static int parallel_start(Parallel *p)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    /* par_read_output's buffer lives on this stack */
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+    pthread_t thr;
+    int rc = pthread_create(&thr, &attr, parallel_main, p);
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
+    {
+        parallel_free(p);
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+/* where one of a stage's descriptors 0-2 goes: an opened file, or wherever the
+   stage's descriptor `deflt` goes by default (pipe, capture pipe, the tab) */
+typedef struct Target
+{
+    int fd;
+    int deflt;
+} Target;
+
+/* apply c's redirections in order into tg[0..2]; opened files are added to opened[].
+   Returns 0, or -1 after reporting the failure */
+static int stage_redirect(int tab_idx, const ShCommand *c, Target *tg, int *opened, int *nopened)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        tg[k].fd = -1;
+        tg[k].deflt = k;
+    }
+    for (const ShRedir *r = c->redirs; r; r = r->next)
+    {
+        if (r->fd > 2 || (r->kind == SH_REDIR_DUP && r->dup_fd > 2))
+        {
+            report(tab_idx, "%d: only descriptors 0, 1 and 2 can be redirected\n",
+                   r->fd > 2 ? r->fd : r->dup_fd);
+            return -1;
+        }
+        if (r->kind == SH_REDIR_DUP)
+        {
+            tg[r->fd] = tg[r->dup_fd];
+            continue;
+        }
+        int flags = r->kind == SH_REDIR_IN ? O_RDONLY
+                                           : O_WRONLY | O_CREAT | (r->kind == SH_REDIR_APPEND ? O_APPEND : O_TRUNC);
+        int fd = openat(tabs_cwd_fd(tab_idx), r->target, flags | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            report(tab_idx, "cannot open '%s' for %s: %s\n", r->target,
+                   r->kind == SH_REDIR_IN ? "reading" : "writing", strerror(errno));
+            return -1;
+        }
+        opened[(*nopened)++] = fd;
+        tg[r->fd].fd = fd;
+    }
+    return 0;
+}
+
+static int resolve_fd(const Target *tg, int k, const int *deflt)
+{
+    return tg[k].fd >= 0 ? tg[k].fd : deflt[tg[k].deflt];
+}
+
+static void close_all(const int *fds, int n)
+{
+    for (int i = 0; i < n; ++i)
+        close(fds[i]);
+}
+
+/* the pipeline as the job table shows it: its words as typed, unexpanded */
+static char *job_text(const ShNode *pl)
+{
+    size_t len = 1;
+    for (int i = 0; i < pl->ncmds; ++i)
+    {
+        const ShCommand *c = &pl->cmds[i];
+        len += 3 + (c->body ? strlen(c->source) + 2 : 0);
+        for (int k = 0; k < c->argc; ++k)
+            len += strlen(c->argv[k]) + 1;
+    }
+    char *t = malloc(len), *o = t;
+    if (!t)
+        return NULL;
+    for (int i = 0; i < pl->ncmds; ++i)
+    {
+        const ShCommand *c = &pl->cmds[i];
+        if (i > 0)
+            o = stpcpy(o, " | ");
+        if (c->body)
+            o += sprintf(o, "(%s)", c->source);
+        for (int k = 0; k < c->argc; ++k)
+            o += sprintf(o, k ? " %s" : "%s", c->argv[k]);
+    }
+    *o = '\0';
+    return t;
+}
+
+/* Run one pipeline of r. With wait set, a launched job hands r back through
+   run_post() and 1 is returned; otherwise (or when nothing was launched) the result
+   is 0, with r->status set if it is known. */
+static int run_pipeline(Run *r, const RunStep *step, int wait)
+{
+    const ShNode *pl = step->pipeline;
+    int tab_idx = r->tab_idx;
+    int ncmds = pl->ncmds;
+    Arena *a = r->arena;
+
+    int nredir = 0;
+    for (int i = 0; i < ncmds; ++i)
+        for (const ShRedir *rd = pl->cmds[i].redirs; rd; rd = rd->next)
+            ++nredir;
+    Target *tg = arena_alloc(a, (size_t)ncmds * 3 * sizeof(Target));
+    int *opened = arena_alloc(a, (size_t)(nredir + 1) * sizeof(int));
+    char ***argvs = arena_alloc(a, (size_t)ncmds * sizeof(char **));
+    int nopened = 0;
+    r->status = 1;
+    if (!tg || !opened || !argvs)
         return 0;
-    for (; *s; ++s)
+
+    /* open redirections and expand words before anything starts */
+    for (int i = 0; i < ncmds; ++i)
+    {
+        const ShCommand *c = &pl->cmds[i];
+        if (stage_redirect(tab_idx, c, &tg[3 * i], opened, &nopened) < 0)
+        {
+            close_all(opened, nopened);
+            return 0;
+        }
+        if (c->body)
+        {
+            /* a subshell is a separate process, as in any shell */
+            char **sv = arena_alloc(a, 4 * sizeof(char *));
+            if (sv)
+            {
+                sv[0] = "sh";
+                sv[1] = "-c";
+                sv[2] = (char *)c->source;
+            }
+            argvs[i] = sv;
+        }
+        else if (runs(c, "batch"))
+            argvs[i] = c->argv; /* its patterns are expanded as it runs */
+        else
+            argvs[i] = expand_argv(a, c, tabs_cwd_fd(tab_idx));
+        if (!argvs[i])
+        {
+            close_all(opened, nopened);
+            return 0;
+        }
+    }
+
+    /* redirections alone: the files are created, nothing runs */
+    if (ncmds == 1 && !argvs[0][0])
+    {
+        close_all(opened, nopened);
+        r->status = 0;
+        return 0;
+    }
+
+    /* a builtin forming the whole command runs right here; its output goes to the
+       redirect target or straight into the tab */
+    const Builtin *whole = (ncmds == 1 && !pl->cmds[0].body) ? builtin_lookup(argvs[0][0]) : NULL;
+    if (whole)
+    {
+        static const int to_tab[3] = {-1, -1, -1};
+        BuiltinIO io = {tab_idx, resolve_fd(tg, 1, to_tab), resolve_fd(tg, 2, to_tab)};
+        int argc = 0;
+        while (argvs[0][argc])
+            ++argc;
+        /* a builtin runs on this thread, so that is what gets measured */
+        int timed = pl->timed || timing_all;
+        struct rusage ru0, ru1;
+        struct timespec t0, t1;
+        if (timed)
+        {
+            getrusage(RUSAGE_THREAD, &ru0);
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+        }
+        r->status = whole->fn(argc, argvs[0], &io);
+        close_all(opened, nopened);
+        if (timed)
+        {
+            getrusage(RUSAGE_THREAD, &ru1);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            HistUsage u;
+            u.real = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+            u.user = tv_sec(ru1.ru_utime) - tv_sec(ru0.ru_utime);
+            u.sys = tv_sec(ru1.ru_stime) - tv_sec(ru0.ru_stime);
+            u.maxrss_kb = 0; /* the terminal's own, not the builtin's */
+            u.nvcsw = ru1.ru_nvcsw - ru0.ru_nvcsw;
+            u.nivcsw = ru1.ru_nivcsw - ru0.ru_nivcsw;
+            report_usage(&r->tab_idx, &u);
+        }
+        return 0;
+    }
+
+    /* create chain pipes and capture pipe */
+    int chain_cnt = (ncmds > 1) ? ncmds - 1 : 0;
+    int (*chain)[2] = NULL;
+    if (chain_cnt > 0)
+    {
+        chain = malloc(sizeof(int[2]) * chain_cnt);
+        if (!chain)
+        {
+            close_all(opened, nopened);
+            return 0;
+        }
+        for (int i = 0; i < chain_cnt; ++i)
+        {
+            if (pipe2(chain[i], O_CLOEXEC) < 0)
+            {
+                for (int k = 0; k < i; ++k)
+                {
+                    close(chain[k][0]);
+                    close(chain[k][1]);
+                }
+                free(chain);
+                close_all(opened, nopened);
+                return 0;
+            }
+        }
+    }
+
+    int capture_pipe[2];
+    if (pipe2(capture_pipe, O_CLOEXEC) == 0)
+        tabs_tune_pipe(capture_pipe[0]);
+    else
+    {
+        for (int i = 0; i < chain_cnt; ++i)
+        {
+            close(chain[i][0]);
+            close(chain[i][1]);
+        }
+        free(chain);
+        close_all(opened, nopened);
+        return 0;
+    }
+
+    pid_t *pids = calloc(ncmds, sizeof(pid_t));
+    char **names = calloc(ncmds, sizeof(char *));
+    /* builtin stages are started once the job is registered, see below */
+    PendingStage *stages = calloc(ncmds, sizeof(PendingStage));
+    if (!pids || !names || !stages)
+    {
+        free(pids);
+        free(names);
+        free(stages);
+        for (int i = 0; i < chain_cnt; ++i)
+        {
+            close(chain[i][0]);
+            close(chain[i][1]);
+        }
+        close(capture_pipe[0]);
+        close(capture_pipe[1]);
+        free(chain);
+        close_all(opened, nopened);
+        return 0;
+    }
+
+    /* a foreground pipeline's first stage reads what is typed into the tab */
+    int in_pipe[2] = {-1, -1};
+    if (!pl->background && tab_idx >= 0 && tab_idx < CMD_MAX_TABS && pipe2(in_pipe, O_CLOEXEC) < 0)
+        in_pipe[0] = in_pipe[1] = -1;
+
+    /* pprof: a relay goes into each stage's stdout pipe; the last stage's gets a
+       descriptor of its own, the capture pipe also carrying everyone's stderr */
+    PipeProf *prof = NULL;
+    int tail[2] = {-1, capture_pipe[1]};
+    if (step->profile)
+    {
+        char **pnames = arena_alloc(a, (size_t)ncmds * sizeof(char *));
+        for (int i = 0; pnames && i < ncmds; ++i)
+            pnames[i] = pl->cmds[i].body ? "(subshell)" : argvs[i][0];
+        prof = pnames ? pipeprof_new(ncmds, pnames) : NULL;
+        int failed = !prof;
+        for (int i = 0; prof && i < chain_cnt; ++i)
+            failed |= pipeprof_splice_in(prof, i, chain[i]) < 0;
+        if (prof)
+        {
+            tail[1] = fcntl(capture_pipe[1], F_DUPFD_CLOEXEC, 0);
+            if (tail[1] < 0 || pipeprof_splice_in(prof, ncmds - 1, tail) < 0)
+            {
+                if (tail[1] >= 0)
+                    close(tail[1]);
+                tail[1] = capture_pipe[1];
+                failed = 1;
+            }
+        }
+        if (failed)
+            report(tab_idx, "pprof: %s\n", prof ? "some stages are not measured" : strerror(errno ? errno : ENOMEM));
+    }
+
+    /* Spawn each command in the pipeline. posix_spawn does not copy the GUI's page
+       tables, so spawn cost does not grow with scrollback. All our pipe/redirect fds are
+       O_CLOEXEC; the file actions dup2 the right ones onto 0/1/2. The first stage that
+       starts becomes the process group leader and the others join its group. */
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int nspawned = 0;
+    int last = -1;       /* job slot of the last stage, if it started */
+    int last_status = 0; /* exit code of the last stage otherwise */
+    pid_t pgid = 0;
+    for (int i = 0; i < ncmds; ++i)
+    {
+        char **argv = argvs[i];
+        if (!argv[0])
+            continue;
+        const int deflt[3] = {i > 0 ? chain[i - 1][0] : in_pipe[0], i < ncmds - 1 ? chain[i][1] : tail[1],
+                              capture_pipe[1]};
+        LaunchSpec ls;
+        memset(&ls, 0, sizeof(ls));
+        ls.argv = argv;
+        ls.fd_in = resolve_fd(&tg[3 * i], 0, deflt);
+        ls.fd_out = resolve_fd(&tg[3 * i], 1, deflt);
+        ls.fd_err = resolve_fd(&tg[3 * i], 2, deflt);
+        ls.pgid = pgid;
+        ls.cwd_fd = tabs_cwd_fd(tab_idx);
+        ls.envp = tabs_env(tab_idx);
+
+        if (runs(&pl->cmds[i], "batch"))
+        {
+            PendingStage *ps = &stages[nspawned];
+            const int fds[3] = {ls.fd_in, ls.fd_out, ls.fd_err};
+            const char *why = NULL;
+            errno = 0;
+            ps->batch = batch_new(tab_idx, &pl->cmds[i], fds, &why);
+            ps->done = ps->batch ? calloc(1, sizeof(StageDone)) : NULL;
+            names[nspawned] = ps->done ? strdup("batch") : NULL;
+            if (!names[nspawned])
+            {
+                report(tab_idx, "batch: %s\n", why ? why : strerror(errno ? errno : ENOMEM));
+                if (ps->batch)
+                    batch_free(ps->batch);
+                free(ps->done);
+                memset(ps, 0, sizeof(*ps));
+                if (i == ncmds - 1)
+                    last_status = 2;
+                continue;
+            }
+            if (i == ncmds - 1)
+                last = nspawned;
+            pids[nspawned++] = 0;
+            continue;
+        }
+        if (runs(&pl->cmds[i], "parallel"))
+        {
+            PendingStage *ps = &stages[nspawned];
+            const int fds[3] = {ls.fd_in, ls.fd_out, ls.fd_err};
+            const char *why = NULL;
+            errno = 0;
+            ps->par = parallel_new(tab_idx, argv, fds, &why);
+            ps->done = ps->par ? calloc(1, sizeof(StageDone)) : NULL;
+            names[nspawned] = ps->done ? strdup("parallel") : NULL;
+            if (!names[nspawned])
+            {
+                report(tab_idx, "parallel: %s\n", why ? why : strerror(errno ? errno : ENOMEM));
+                if (ps->par)
+                    parallel_free(ps->par);
+                free(ps->done);
+                memset(ps, 0, sizeof(*ps));
+                if (i == ncmds - 1)
+                    last_status = 2;
+                continue;
+            }
+            if (i == ncmds - 1)
+                last = nspawned;
+            pids[nspawned++] = 0;
+            continue;
+        }
+
+        /* cheap builtins run on a thread instead of a child; the ones that touch the
+           terminal's own state would only change a subshell, so they are refused */
+        const Builtin *bi = pl->cmds[i].body ? NULL : builtin_lookup(argv[0]);
+        if (bi)
+        {
+            PendingStage *ps = &stages[nspawned];
+            const char *why = NULL;
+            if (bi->flags & BUILTIN_SPECIAL)
+                why = "not supported in a pipeline";
+            else
+            {
+                /* the stage keeps its own copies: ours are closed below */
+                errno = 0;
+                ps->fd_out = fcntl(ls.fd_out, F_DUPFD_CLOEXEC, 0);
+                ps->fd_err = fcntl(ls.fd_err, F_DUPFD_CLOEXEC, 0);
+                ps->done = calloc(1, sizeof(StageDone));
+                names[nspawned] = strdup(argv[0]);
+                if (ps->fd_out < 0 || ps->fd_err < 0 || !ps->done || !names[nspawned])
+                {
+                    why = strerror(errno ? errno : ENOMEM);
+                    if (ps->fd_out >= 0)
+                        close(ps->fd_out);
+                    if (ps->fd_err >= 0)
+                        close(ps->fd_err);
+                    free(ps->done);
+                    free(names[nspawned]);
+                    names[nspawned] = NULL;
+                    memset(ps, 0, sizeof(*ps));
+                }
+            }
+            if (why)
+            {
+                report(tab_idx, "%s: %s\n", argv[0], why);
+                if (i == ncmds - 1)
+                    last_status = 1;
+                continue;
+            }
+            ps->b = bi;
+            ps->argv = argv;
+            if (i == ncmds - 1)
+                last = nspawned;
+            pids[nspawned++] = 0;
+            continue;
+        }
+
+        pid_t pid = launch_spawn(&ls);
+        if (pid < 0)
+        {
+            /* exec failures are reported here rather than by a child; the stage's pipe
+               ends are closed below, so its neighbours see EOF / EPIPE as before */
+            int e = errno;
+            if (i == ncmds - 1)
+                last_status = e == ENOENT ? 127 : 126;
+            report(tab_idx, "%s: %s\n", argv[0], e == ENOENT ? "command not found" : strerror(e));
+            continue;
+        }
+        if (pgid == 0)
+            pgid = pid;
+        if (i == ncmds - 1)
+            last = nspawned;
+        pids[nspawned++] = pid;
+        if (prof)
+            pipeprof_set_pid(prof, i, pid);
+    }
+
+    /* Parent: close chain fds and capture write end */
+    for (int k = 0; k < chain_cnt; ++k)
+    {
+        close(chain[k][0]);
+        close(chain[k][1]);
+    }
+    free(chain);
+    close(capture_pipe[1]);
+    if (tail[1] != capture_pipe[1])
+        close(tail[1]);
+    close_all(opened, nopened);
+    if (in_pipe[0] >= 0)
+    {
+        close(in_pipe[0]);
+        /* typed lines are queued, never waited on */
+        if (pgid > 0 && fcntl(in_pipe[1], F_SETFL, O_NONBLOCK) == 0)
+        {
+            tabs_set_job_input(tab_idx, in_pipe[1]);
+            tab_input_pgid[tab_idx] = pgid;
+        }
+        else
+            close(in_pipe[1]);
+    }
+
+    /* set the tab PGID to the pipeline leader so main can send signals; a background
+       job only goes into the job table */
+    if (tab_idx >= 0 && tab_idx < CMD_MAX_TABS && pgid > 0 && !pl->background)
+    {
+        set_tab_pgid(tab_idx, pgid);
+    }
+
+    /* hand the capture pipe and the children to the reactor */
+    Job *job = calloc(1, sizeof(*job));
+    int *st = calloc(nspawned > 0 ? nspawned : 1, sizeof(int));
+    char *stopped = calloc(nspawned > 0 ? nspawned : 1, 1);
+    if (!job || !st || !stopped)
+    {
+        /* nothing can report for this job: drain nothing, just let the children run */
+        free(job);
+        free(st);
+        free(stopped);
+        free(pids);
+        for (int i = 0; i < nspawned; ++i)
+        {
+            if (!stages[i].done)
+                continue;
+            if (stages[i].batch)
+                batch_free(stages[i].batch);
+            else if (stages[i].par)
+                parallel_free(stages[i].par);
+            else
+            {
+                close(stages[i].fd_out);
+                close(stages[i].fd_err);
+            }
+            free(stages[i].done);
+            free(names[i]);
+        }
+        free(names);
+        free(stages);
+        close(capture_pipe[0]);
+        if (prof && pipeprof_start(prof, prof_discard, prof) < 0)
+            report(tab_idx, "pprof: %s\n", strerror(errno));
+        if (!pl->background)
+            clear_tab_pgid(tab_idx);
+        r->status = 0;
+        return 0;
+    }
+    job->tab_idx = tab_idx;
+    tabs_link(&job->link, &job->tab_idx);
+    job->stopped = stopped;
+    job->timed = pl->timed || timing_all;
+    job->hist = r->hist;
+    job->start = start;
+    job->background = pl->background;
+    for (int i = 0; i < nspawned; ++i)
+        job->procs_live += pids[i] > 0;
+    if (pgid > 0)
     {
-        if (*s == '*' || *s == '?' || *s == '[')
-            return 1;
+        job->tj = tabjob_new(tab_idx, pgid, pl->background, job_text(pl));
+        if (job->tj && pl->background)
+            report(tab_idx, "[%d] %d\n", job->tj->id, (int)pgid);
     }
-    return 0;
-}
-static char **expand_tokens_with_glob(char **tokens, int ntoks, int *out_ntoks)
-{
-    if (!tokens || ntoks <= 0)
+    job->children = pids;
+    job->names = names;
+    job->status = st;
+    job->child_count = nspawned;
+    job->live = nspawned;
+    job->run = wait ? r : NULL;
+    job->last = last;
+    job->last_status = last_status;
+    job->prof = prof;
+    job->prof_live = prof != NULL;
+    /* the children are registered first: reactor posts run in order, so the job
+       cannot finish before every child is being watched */
+    for (int i = 0; i < nspawned; ++i)
+        if (pids[i] > 0)
+            reactor_watch_child(pids[i], job_on_child, job);
+    int rc = (strcmp(reactor_backend(), "io_uring") == 0)
+                 ? reactor_add_reader(capture_pipe[0], tab_idx, job_on_data, job_on_eof, job)
+                 : reactor_add_drain(capture_pipe[0], tab_idx, job_on_readable, job_on_eof, job);
+    if (rc < 0)
     {
-        *out_ntoks = 0;
-        return NULL;
+        close(capture_pipe[0]);
+        reactor_post(job_on_eof, job);
     }
-    int cap = ntoks * 4 + 16;
-    char **newt = malloc(sizeof(char *) * cap);
-    if (!newt)
+    if (prof)
     {
-        *out_ntoks = 0;
-        return NULL;
+        if (pipeprof_start(prof, prof_threads_done, job) < 0)
+            report(tab_idx, "pprof: %s\n", strerror(errno));
     }
-    int n = 0;
-    for (int i = 0; i < ntoks; ++i)
+
+    /* builtin stages last: their completions are posted after the registrations above */
+    for (int i = 0; i < nspawned; ++i)
     {
-        char *tk = tokens[i];
-        if (!tk)
+        PendingStage *ps = &stages[i];
+        if (!ps->done)
             continue;
-        if (is_operator_token(tk) || !contains_glob_chars(tk))
+        ps->done->job = job;
+        ps->done->idx = i;
+        if (ps->batch)
         {
-            newt[n++] = strdup(tk);
+            ps->batch->done = ps->done;
+            ps->batch->pgid = pgid;
+            ps->batch->background = pl->background;
+            if (batch_start(ps->batch) != 0)
+            {
+                report(tab_idx, "batch: cannot start: %s\n", strerror(errno));
+                stage_thread_done(1 << 8, ps->done);
+            }
             continue;
         }
-        glob_t g;
-        memset(&g, 0, sizeof(g));
-        int flags = GLOB_NOCHECK | GLOB_TILDE;
-        int rc = glob(tk, flags, NULL, &g);
-        if (rc == 0)
+        if (ps->par)
         {
-            for (size_t j = 0; j < g.gl_pathc; ++j)
+            ps->par->done = ps->done;
+            ps->par->pgid = pgid;
+            ps->par->background = pl->background;
+            if (parallel_start(ps->par) != 0)
             {
-                if (n + 1 >= cap)
-                {
-                    cap *= 2;
-                    char **tmp = realloc(newt, sizeof(char *) * cap);
-                    if (!tmp)
-                        break;
-                    newt = tmp;
-                }
-                newt[n++] = strdup(g.gl_pathv[j]);
+                report(tab_idx, "parallel: cannot start: %s\n", strerror(errno));
+                stage_thread_done(1 << 8, ps->done);
             }
+            continue;
         }
-        else
+        if (builtin_start_stage(ps->b, ps->argv, tab_idx, ps->fd_out, ps->fd_err,
+                                stage_thread_done, ps->done) != 0)
         {
-            newt[n++] = strdup(tk);
+            report(tab_idx, "%s: cannot start: %s\n", names[i], strerror(errno));
+            stage_thread_done(1 << 8, ps->done);
         }
-        globfree(&g);
-    }
-    *out_ntoks = n;
-    char **final = realloc(newt, sizeof(char *) * (n + 1));
-    if (!final)
-        final = newt;
-    final[n] = NULL;
-    return final;
-}
-static void free_tokens(char **tokens, int ntoks)
-{
-    if (!tokens)
-        return;
-    for (int i = 0; i < ntoks; ++i)
-        if (tokens[i])
-            free(tokens[i]);
-    free(tokens);
-}
-
-/* -------------------- command parse/execution -------------------- */
-
-/* Simple Cmd structure */
-typedef struct
-{
-    char **argv; /* NULL-terminated */
-    int argc;
-    char *infile;  /* optional (malloc'd) */
-    char *outfile; /* optional (malloc'd) */
-    int append;    /* for outfile: append if 1 */
-} Cmd;
-static void free_cmd(Cmd *c)
-{
-    if (!c)
-        return;
-    if (c->argv)
-    {
-        for (int i = 0; i < c->argc; ++i)
-            if (c->argv[i])
-                free(c->argv[i]);
-        free(c->argv);
     }
-    if (c->infile)
-        free(c->infile);
-    if (c->outfile)
-        free(c->outfile);
-    c->argv = NULL;
-    c->argc = 0;
-    c->infile = NULL;
-    c->outfile = NULL;
-    c->append = 0;
+    free(stages);
+    return wait;
 }
 
-static void sanitize_filename(char *s)
+/* main thread: run r's pipelines until one has to be waited for, or the end */
+static void run_continue(Run *r)
 {
-    if (!s)
-        return;
-    char *start = s;
-    while (*start && isspace((unsigned char)*start))
-        ++start;
-    if (start != s)
-        memmove(s, start, strlen(start) + 1);
-    size_t L = strlen(s);
-    while (L > 0 && (isspace((unsigned char)s[L - 1]) || s[L - 1] == '\r'))
+    while (r->next < r->nsteps && !r->interrupted)
     {
-        s[L - 1] = '\0';
-        --L;
+        const RunStep *s = &r->steps[r->next++];
+        if ((s->op == SH_AND && r->status != 0) || (s->op == SH_OR && r->status == 0))
+            continue;
+        /* a background job is not waited for and counts as a success */
+        if (s->pipeline->background)
+        {
+            run_pipeline(r, s, 0);
+            r->status = 0;
+            continue;
+        }
+        /* the last pipeline's status matters to nobody: the run ends when it starts */
+        if (run_pipeline(r, s, r->next < r->nsteps))
+            return;
     }
+    run_free(r);
 }
 
-/* parse tokens into Cmds (handles | and < > >>) */
-static int parse_tokens_into_cmds(char **tokens, int ntoks, Cmd *cmds, int max_cmds)
+void cmd_exec_dispatch(void)
 {
-    int cmd_idx = 0;
-    if (max_cmds < 1)
-        return -1;
-    for (int z = 0; z < max_cmds; ++z)
-    {
-        cmds[z].argv = NULL;
-        cmds[z].argc = 0;
-        cmds[z].infile = NULL;
-        cmds[z].outfile = NULL;
-        cmds[z].append = 0;
-    }
-    cmds[cmd_idx].argc = 0;
-    cmds[cmd_idx].argv = malloc(sizeof(char *) * 128);
-    if (!cmds[cmd_idx].argv)
-        return -1;
-    int argcap = 128;
-    for (int i = 0; i < ntoks; ++i)
+    input_reap();
+    pthread_mutex_lock(&ready_lock);
+    Run *r = ready_head;
+    ready_head = NULL;
+    ready_tail = &ready_head;
+    pthread_mutex_unlock(&ready_lock);
+    while (r)
     {
-        char *tk = tokens[i];
-        if (!tk)
-            continue;
-        if (strcmp(tk, "|") == 0)
-        {
-            cmds[cmd_idx].argv[cmds[cmd_idx].argc] = NULL;
-            cmd_idx++;
-            if (cmd_idx >= max_cmds)
-                return -1;
-            cmds[cmd_idx].argc = 0;
-            cmds[cmd_idx].argv = malloc(sizeof(char *) * 128);
-            if (!cmds[cmd_idx].argv)
-                return -1;
-            argcap = 128;
-            continue;
-        }
-        if (strcmp(tk, "<") == 0)
-        {
-            if (i + 1 >= ntoks)
-                return -1;
-            if (cmds[cmd_idx].infile)
-                free(cmds[cmd_idx].infile);
-            cmds[cmd_idx].infile = strdup(tokens[++i]);
-            if (cmds[cmd_idx].infile)
-                sanitize_filename(cmds[cmd_idx].infile);
-            continue;
-        }
-        else if (tk[0] == '<' && tk[1] != '\0')
-        {
-            if (cmds[cmd_idx].infile)
-                free(cmds[cmd_idx].infile);
-            cmds[cmd_idx].infile = strdup(tk + 1);
-            if (cmds[cmd_idx].infile)
-                sanitize_filename(cmds[cmd_idx].infile);
-            continue;
-        }
-        else if (strcmp(tk, ">>") == 0)
-        {
-            if (i + 1 >= ntoks)
-                return -1;
-            if (cmds[cmd_idx].outfile)
-                free(cmds[cmd_idx].outfile);
-            cmds[cmd_idx].outfile = strdup(tokens[++i]);
-            cmds[cmd_idx].append = 1;
-            if (cmds[cmd_idx].outfile)
-                sanitize_filename(cmds[cmd_idx].outfile);
-            continue;
-        }
-        else if (strncmp(tk, ">>", 2) == 0)
-        {
-            if (cmds[cmd_idx].outfile)
-                free(cmds[cmd_idx].outfile);
-            cmds[cmd_idx].outfile = strdup(tk + 2);
-            cmds[cmd_idx].append = 1;
-            if (cmds[cmd_idx].outfile)
-                sanitize_filename(cmds[cmd_idx].outfile);
-            continue;
-        }
-        else if (strcmp(tk, ">") == 0)
-        {
-            if (i + 1 >= ntoks)
-                return -1;
-            if (cmds[cmd_idx].outfile)
-                free(cmds[cmd_idx].outfile);
-            cmds[cmd_idx].outfile = strdup(tokens[++i]);
-            cmds[cmd_idx].append = 0;
-            if (cmds[cmd_idx].outfile)
-                sanitize_filename(cmds[cmd_idx].outfile);
-            continue;
-        }
-        else if (tk[0] == '>' && tk[1] != '\0')
-        {
-            if (cmds[cmd_idx].outfile)
-                free(cmds[cmd_idx].outfile);
-            cmds[cmd_idx].outfile = strdup(tk + 1);
-            cmds[cmd_idx].append = 0;
-            if (cmds[cmd_idx].outfile)
-                sanitize_filename(cmds[cmd_idx].outfile);
-            continue;
-        }
-        if (cmds[cmd_idx].argc + 2 >= argcap)
-        {
-            argcap *= 2;
-            char **newv = realloc(cmds[cmd_idx].argv, sizeof(char *) * argcap);
-            if (!newv)
-                return -1;
-            cmds[cmd_idx].argv = newv;
-        }
-        cmds[cmd_idx].argv[cmds[cmd_idx].argc++] = strdup(tk);
+        Run *n = r->ready_next;
+        run_continue(r);
+        r = n;
     }
-    cmds[cmd_idx].argv[cmds[cmd_idx].argc] = NULL;
-    return cmd_idx + 1;
 }
 
 /* -------------------- Public: run command line -------------------- */
@@ -531,11 +2625,7 @@ int cmd_exec_run_in_tab(int tab_idx, const char *cmdline)
     if (!cmdline)
         return -1;
 
-    history_add(cmdline);
-
-    char *pre = preprocess_pipes(cmdline);
-    if (!pre)
-        return -1;
+    unsigned long hist = history_add(cmdline);
 
     /* ---- Special parsing for multiwatch array syntax:
     Accept commands like:
@@ -657,387 +2747,51 @@ int cmd_exec_run_in_tab(int tab_idx, const char *cmdline)
         }
     } while (0);
 
-    char *tokens_raw[512];
-    int ntoks_raw = tokenize_quoted(pre, tokens_raw, (int)(sizeof(tokens_raw) / sizeof(tokens_raw[0])));
-    free(pre);
-    if (ntoks_raw <= 0)
-    {
-        for (int i = 0; i < ntoks_raw; ++i)
-            if (tokens_raw[i])
-                free(tokens_raw[i]);
-        return -1;
-    }
-
-    int ntoks = 0;
-    char **tokens = expand_tokens_with_glob(tokens_raw, ntoks_raw, &ntoks);
-    for (int i = 0; i < ntoks_raw; ++i)
-        if (tokens_raw[i])
-            free(tokens_raw[i]);
-
-    if (!tokens || ntoks <= 0)
-    {
-        if (tokens)
-            free_tokens(tokens, ntoks);
-        return -1;
-    }
-
-    const int MAX_CMDS = 64;
-    Cmd cmds[MAX_CMDS];
-    memset(cmds, 0, sizeof(cmds));
-    int ncmds = parse_tokens_into_cmds(tokens, ntoks, cmds, MAX_CMDS);
-    free_tokens(tokens, ntoks);
-    if (ncmds <= 0)
-    {
-        for (int i = 0; i < MAX_CMDS; ++i)
-            free_cmd(&cmds[i]);
-        return -1;
-    }
-
-    /* builtin: cd */
-    if (ncmds == 1 && cmds[0].argc > 0)
-    {
-        if (strcmp(cmds[0].argv[0], "cd") == 0)
-        {
-            const char *target = NULL;
-            if (cmds[0].argc >= 2)
-                target = cmds[0].argv[1];
-            if (!target || strlen(target) == 0)
-                target = getenv("HOME");
-            if (!target)
-            {
-                const char *msg = "cd: no $HOME set\n";
-                tabs_append_output(tab_idx, msg, strlen(msg));
-                for (int i = 0; i < ncmds; ++i)
-                    free_cmd(&cmds[i]);
-                return -1;
-            }
-            if (chdir(target) == 0)
-            {
-                char msg[256];
-                int n = snprintf(msg, sizeof(msg), "changed directory to %s\n", target);
-                tabs_append_output(tab_idx, msg, n);
-                for (int i = 0; i < ncmds; ++i)
-                    free_cmd(&cmds[i]);
-                return 0;
-            }
-            else
-            {
-                char err[256];
-                int n = snprintf(err, sizeof(err), "cd: %s: %s\n", target, strerror(errno));
-                tabs_append_output(tab_idx, err, n);
-                for (int i = 0; i < ncmds; ++i)
-                    free_cmd(&cmds[i]);
-                return -1;
-            }
-        }
-        else if (strcmp(cmds[0].argv[0], "history") == 0)
-        {
-            history_show_recent(tab_idx, 1000);
-            return 0;
-        }
-    }
-
-    /* open redirections early */
-    int *in_fds = calloc(ncmds, sizeof(int));
-    int *out_fds = calloc(ncmds, sizeof(int));
-    if (!in_fds || !out_fds)
+    /* the AST and everything derived from it come from one arena */
+    Run *r = calloc(1, sizeof(*r));
+    Arena *a = arena_create(strlen(cmdline) * 2 + 256);
+    if (!r || !a)
     {
-        free(in_fds);
-        free(out_fds);
-        for (int i = 0; i < ncmds; ++i)
-            free_cmd(&cmds[i]);
+        free(r);
+        arena_destroy(a);
         return -1;
     }
-    for (int i = 0; i < ncmds; ++i)
-    {
-        in_fds[i] = -1;
-        out_fds[i] = -1;
-        if (cmds[i].infile)
-        {
-            in_fds[i] = open(cmds[i].infile, O_RDONLY);
-            if (in_fds[i] < 0)
-            {
-                char err[256];
-                int m = snprintf(err, sizeof(err), "cannot open '%s' for reading: %s\n", cmds[i].infile, strerror(errno));
-                tabs_append_output(tab_idx, err, m);
-                for (int j = 0; j < ncmds; ++j)
-                {
-                    if (in_fds[j] >= 0)
-                        close(in_fds[j]);
-                    if (out_fds[j] >= 0)
-                        close(out_fds[j]);
-                    free_cmd(&cmds[j]);
-                }
-                free(in_fds);
-                free(out_fds);
-                return -1;
-            }
-        }
-        if (cmds[i].outfile)
-        {
-            int flags = O_WRONLY | O_CREAT | (cmds[i].append ? O_APPEND : O_TRUNC);
-            out_fds[i] = open(cmds[i].outfile, flags, 0644);
-            if (out_fds[i] < 0)
-            {
-                char err[256];
-                int m = snprintf(err, sizeof(err), "cannot open '%s' for writing: %s\n", cmds[i].outfile, strerror(errno));
-                tabs_append_output(tab_idx, err, m);
-                for (int j = 0; j < ncmds; ++j)
-                {
-                    if (in_fds[j] >= 0)
-                        close(in_fds[j]);
-                    if (out_fds[j] >= 0)
-                        close(out_fds[j]);
-                    free_cmd(&cmds[j]);
-                }
-                free(in_fds);
-                free(out_fds);
-                return -1;
-            }
-        }
-    }
-
-    /* create chain pipes and capture pipe */
-    int chain_cnt = (ncmds > 1) ? ncmds - 1 : 0;
-    int (*chain)[2] = NULL;
-    if (chain_cnt > 0)
-    {
-        chain = malloc(sizeof(int[2]) * chain_cnt);
-        if (!chain)
-        {
-            for (int j = 0; j < ncmds; ++j)
-                free_cmd(&cmds[j]);
-            free(in_fds);
-            free(out_fds);
-            return -1;
-        }
-        for (int i = 0; i < chain_cnt; ++i)
-        {
-            if (pipe(chain[i]) < 0)
-            {
-                for (int k = 0; k < i; ++k)
-                {
-                    close(chain[k][0]);
-                    close(chain[k][1]);
-                }
-                free(chain);
-                for (int j = 0; j < ncmds; ++j)
-                    free_cmd(&cmds[j]);
-                free(in_fds);
-                free(out_fds);
-                return -1;
-            }
-        }
-    }
-
-    int capture_pipe[2];
-    if (pipe(capture_pipe) < 0)
+    r->tab_idx = tab_idx;
+    tabs_link(&r->link, &r->tab_idx);
+    r->arena = a;
+    r->hist = hist;
+    const char *err;
+    ShNode *root = sh_parse(a, cmdline, &err);
+    if (root)
     {
-        for (int i = 0; i < chain_cnt; ++i)
-        {
-            close(chain[i][0]);
-            close(chain[i][1]);
-        }
-        free(chain);
-        for (int j = 0; j < ncmds; ++j)
-            free_cmd(&cmds[j]);
-        free(in_fds);
-        free(out_fds);
-        return -1;
+        r->nsteps = count_pipelines(root);
+        r->steps = arena_alloc(a, (size_t)r->nsteps * sizeof(RunStep));
     }
-
-    pid_t *pids = calloc(ncmds, sizeof(pid_t));
-    if (!pids)
+    if (!root || !r->steps)
     {
-        for (int i = 0; i < chain_cnt; ++i)
-        {
-            close(chain[i][0]);
-            close(chain[i][1]);
-        }
-        close(capture_pipe[0]);
-        close(capture_pipe[1]);
-        free(chain);
-        for (int j = 0; j < ncmds; ++j)
-            free_cmd(&cmds[j]);
-        free(in_fds);
-        free(out_fds);
+        if (err)
+            report(tab_idx, "%s\n", err);
+        run_free(r);
         return -1;
     }
-
-    /* Fork each command in the pipeline */
-    for (int i = 0; i < ncmds; ++i)
+    int k = 0;
+    flatten(root, SH_SEQ, r->steps, &k);
+    for (k = 0; k < r->nsteps; ++k)
     {
-        pid_t pid = fork();
-        if (pid < 0)
-        {
-            for (int k = 0; k < i; ++k)
-                kill(pids[k], SIGTERM);
-            for (int k = 0; k < chain_cnt; ++k)
-            {
-                close(chain[k][0]);
-                close(chain[k][1]);
-            }
-            close(capture_pipe[0]);
-            close(capture_pipe[1]);
-            free(chain);
-            free(pids);
-            for (int j = 0; j < ncmds; ++j)
-                free_cmd(&cmds[j]);
-            for (int j = 0; j < ncmds; ++j)
-            {
-                if (in_fds[j] >= 0)
-                    close(in_fds[j]);
-                if (out_fds[j] >= 0)
-                    close(out_fds[j]);
-            }
-            free(in_fds);
-            free(out_fds);
-            return -1;
-        }
-
-        if (pid == 0)
-        {
-            /* child */
-            /* setpgid: make every child in the same process group.
-               We set child's pgid in parent too, but setting here is safe:
-               leader will set its pgid to its pid (see parent code too) */
-            if (i == 0)
-            {
-                /* leader - setpgid to own pid */
-                setpgid(0, 0); /* setpgid(0,0) sets pgid = pid */
-            }
-            else
-            {
-                /* for other children, attempt to join leader later (parent also sets) */
-            }
-
-            if (in_fds[i] >= 0)
-            {
-                if (dup2(in_fds[i], STDIN_FILENO) < 0)
-                    _exit(127);
-            }
-            else if (i > 0)
-            {
-                if (dup2(chain[i - 1][0], STDIN_FILENO) < 0)
-                    _exit(127);
-            }
-            if (out_fds[i] >= 0)
-            {
-                if (dup2(out_fds[i], STDOUT_FILENO) < 0)
-                    _exit(127);
-            }
-            else if (i < ncmds - 1)
-            {
-                if (dup2(chain[i][1], STDOUT_FILENO) < 0)
-                    _exit(127);
-            }
-            else
-            {
-                if (dup2(capture_pipe[1], STDOUT_FILENO) < 0)
-                    _exit(127);
-            }
-            if (dup2(capture_pipe[1], STDERR_FILENO) < 0)
-                _exit(127);
-
-            for (int k = 0; k < chain_cnt; ++k)
-            {
-                close(chain[k][0]);
-                close(chain[k][1]);
-            }
-            close(capture_pipe[0]);
-            close(capture_pipe[1]);
-
-            for (int j = 0; j < ncmds; ++j)
-            {
-                if (in_fds[j] >= 0)
-                    close(in_fds[j]);
-                if (out_fds[j] >= 0)
-                    close(out_fds[j]);
-            }
-
-            execvp(cmds[i].argv[0], cmds[i].argv);
-            dprintf(STDERR_FILENO, "execvp failed: %s\n", strerror(errno));
-            _exit(127);
-        }
-
-        /* parent records pid */
-        pids[i] = pid;
-
-        /* parent sets pgid for children so that all are in same group, leader = pids[0] */
-        if (i == 0)
-        {
-            /* set leader pgid to leader pid */
-            if (setpgid(pid, pid) < 0)
-            {
-                /* ignore error in typical race; try again */
-                setpgid(pid, pid);
-            }
-        }
-        else
+        r->steps[k].profile = profile_prefix(r->steps[k].pipeline);
+        if (!peephole_on || r->steps[k].profile)
+            continue;
+        int status_used = k + 1 < r->nsteps && r->steps[k + 1].op != SH_SEQ;
+        int n = peephole(a, r->steps[k].pipeline, status_used);
+        if (n > 0)
         {
-            if (setpgid(pid, pids[0]) < 0)
-            {
-                /* ignore */
-                setpgid(pid, pids[0]);
-            }
+            peephole_pipelines++;
+            peephole_stages += (unsigned long)n;
         }
     }
-
-    /* Parent: close chain fds and capture write end */
-    for (int k = 0; k < chain_cnt; ++k)
-    {
-        close(chain[k][0]);
-        close(chain[k][1]);
-    }
-    free(chain);
-    close(capture_pipe[1]);
-
-    for (int j = 0; j < ncmds; ++j)
-    {
-        if (in_fds[j] >= 0)
-            close(in_fds[j]);
-        if (out_fds[j] >= 0)
-            close(out_fds[j]);
-    }
-    free(in_fds);
-    free(out_fds);
-
-    /* set the tab PGID to the pipeline leader (pids[0]) so main can send signals */
-    if (tab_idx >= 0 && tab_idx < CMD_MAX_TABS && pids[0] > 0)
-    {
-        set_tab_pgid(tab_idx, pids[0]);
-    }
-
-    /* Spawn reader thread */
-    struct reader_args *ra = malloc(sizeof(*ra));
-    if (!ra)
-    {
-        free(pids);
-        close(capture_pipe[0]);
-        for (int j = 0; j < ncmds; ++j)
-            free_cmd(&cmds[j]);
-        return 0;
-    }
-    ra->tab_idx = tab_idx;
-    ra->fd = capture_pipe[0];
-    ra->children = pids;
-    ra->child_count = ncmds;
-
-    pthread_t thr;
-    if (pthread_create(&thr, NULL, reader_thread, ra) != 0)
-    {
-        close(capture_pipe[0]);
-        free(ra->children);
-        free(ra);
-        for (int j = 0; j < ncmds; ++j)
-            free_cmd(&cmds[j]);
-        return 0;
-    }
-    pthread_detach(thr);
-
-    for (int j = 0; j < ncmds; ++j)
-        free_cmd(&cmds[j]);
-
+    if (tab_idx >= 0 && tab_idx < CMD_MAX_TABS)
+        tab_run[tab_idx] = r;
+    run_continue(r);
     return 0;
 }
 
@@ -1045,9 +2799,16 @@ int cmd_exec_run_in_tab(int tab_idx, const char *cmdline)
 
 int cmd_exec_interrupt_tab(int tab_idx)
 {
+    /* a command list stops after the job running now */
+    int stopped = 0;
+    if (tab_idx >= 0 && tab_idx < CMD_MAX_TABS && tab_run[tab_idx])
+    {
+        tab_run[tab_idx]->interrupted = 1;
+        stopped = 1;
+    }
     pid_t pg = get_tab_pgid(tab_idx);
     if (pg <= 0)
-        return -1;
+        return stopped ? 0 : -1;
     /* send SIGINT to process group (negative pid) */
     if (kill(-pg, SIGINT) < 0)
     {
@@ -1065,6 +2826,51 @@ int cmd_exec_suspend_tab(int tab_idx)
     {
         return -1;
     }
-    /* note: PGID remains mapped — reader thread will detect stopped/exit later and clear mapping */
+    /* the PGID stays mapped until the reactor's child watch sees every process stop
+       (job_check_stopped) and moves the job out of the foreground */
     return 0;
 }
+
+int cmd_exec_has_foreground(int tab_idx)
+{
+    return get_tab_pgid(tab_idx) > 0;
+}
+
+void cmd_exec_on_tab_closed(int tab_idx)
+{
+    if (tab_idx < 0 || tab_idx >= CMD_MAX_TABS)
+        return;
+
+    /* the tab's jobs lose their terminal: hang them up, as a shell does on exit. Their
+       entries stay until they end (a Job may still point at one), but no tab names them */
+    pthread_mutex_lock(&jobs_lock);
+    for (TabJob *tj = jobs_head; tj; tj = tj->next)
+    {
+        if (tj->tab_idx == tab_idx)
+        {
+            killpg(tj->pgid, SIGHUP);
+            if (tj->state == JOB_STOPPED)
+                killpg(tj->pgid, SIGCONT);
+            tj->tab_idx = -1;
+        }
+        else if (tj->tab_idx > tab_idx)
+            tj->tab_idx--;
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    pthread_mutex_lock(&pgid_lock);
+    memmove(&tab_pgid[tab_idx], &tab_pgid[tab_idx + 1], (size_t)(CMD_MAX_TABS - 1 - tab_idx) * sizeof(pid_t));
+    tab_pgid[CMD_MAX_TABS - 1] = 0;
+    pthread_mutex_unlock(&pgid_lock);
+
+    /* the closed tab's job stdin goes with the tab (tabs_close() closes the pipe) */
+    memmove(&tab_input_pgid[tab_idx], &tab_input_pgid[tab_idx + 1],
+            (size_t)(CMD_MAX_TABS - 1 - tab_idx) * sizeof(pid_t));
+    tab_input_pgid[CMD_MAX_TABS - 1] = 0;
+
+    /* its command list starts nothing more */
+    if (tab_run[tab_idx])
+        tab_run[tab_idx]->interrupted = 1;
+    memmove(&tab_run[tab_idx], &tab_run[tab_idx + 1], (size_t)(CMD_MAX_TABS - 1 - tab_idx) * sizeof(Run *));
+    tab_run[CMD_MAX_TABS - 1] = NULL;
+}
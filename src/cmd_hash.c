@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include "cmd_hash.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct
+{
+    char *name; /* NULL = empty slot */
+    char *path;
+    int dir; /* index into path_dirs of the directory it was found in */
+    unsigned hits;
+} HashEntry;
+
+typedef struct
+{
+    char *dir;
+    struct timespec mtime;
+    int exists;
+} PathDir;
+
+static pthread_mutex_t hash_lock = PTHREAD_MUTEX_INITIALIZER;
+static HashEntry *entries; /* open addressing, linear probing */
+static size_t cap, count;  /* cap is 0 or a power of two */
+static char *path_str;     /* PATH the snapshot below was taken of */
+static PathDir *path_dirs;
+static int n_dirs;
+
+static uint32_t fnv1a(const char *s)
+{
+    uint32_t h = 2166136261u;
+    for (; *s; ++s)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void dir_stat(PathDir *d)
+{
+    struct stat st;
+    d->exists = stat(d->dir, &st) == 0;
+    if (d->exists)
+        d->mtime = st.st_mtim;
+    else
+        memset(&d->mtime, 0, sizeof(d->mtime));
+}
+
+static int dir_changed(const PathDir *d)
+{
+    struct stat st;
+    if (stat(d->dir, &st) != 0)
+        return d->exists;
+    return !d->exists || st.st_mtim.tv_sec != d->mtime.tv_sec ||
+           st.st_mtim.tv_nsec != d->mtime.tv_nsec;
+}
+
+static void flush_entries_locked(void)
+{
+    if (cap == 0)
+        return;
+    for (size_t i = 0; i < cap; ++i)
+    {
+        free(entries[i].name);
+        free(entries[i].path);
+    }
+    memset(entries, 0, cap * sizeof(*entries));
+    count = 0;
+}
+
+static void restat_dirs_locked(void)
+{
+    for (int i = 0; i < n_dirs; ++i)
+        dir_stat(&path_dirs[i]);
+}
+
+/* forget everything and split path into a fresh directory snapshot */
+static void reset_path_locked(const char *path)
+{
+    flush_entries_locked();
+    for (int i = 0; i < n_dirs; ++i)
+        free(path_dirs[i].dir);
+    free(path_dirs);
+    free(path_str);
+    path_dirs = NULL;
+    n_dirs = 0;
+    path_str = strdup(path);
+    if (!path_str)
+        return;
+
+    int n = 1;
+    for (const char *p = path; *p; ++p)
+        n += *p == ':';
+    path_dirs = calloc((size_t)n, sizeof(*path_dirs));
+    if (!path_dirs)
+        return;
+    for (const char *p = path;; ++p)
+    {
+        const char *e = strchrnul(p, ':');
+        /* an empty entry means the current directory, as for execvp() */
+        path_dirs[n_dirs].dir = e == p ? strdup(".") : strndup(p, (size_t)(e - p));
+        if (!path_dirs[n_dirs].dir)
+            break;
+        dir_stat(&path_dirs[n_dirs++]);
+        if (!*e)
+            break;
+        p = e;
+    }
+}
+
+static HashEntry *find_locked(const char *name)
+{
+    if (cap == 0)
+        return NULL;
+    for (size_t i = fnv1a(name) & (cap - 1);; i = (i + 1) & (cap - 1))
+    {
+        if (!entries[i].name)
+            return NULL;
+        if (strcmp(entries[i].name, name) == 0)
+            return &entries[i];
+    }
+}
+
+static int grow_locked(void)
+{
+    size_t ncap = cap ? cap * 2 : 64;
+    HashEntry *n = calloc(ncap, sizeof(*n));
+    if (!n)
+        return -1;
+    for (size_t i = 0; i < cap; ++i)
+    {
+        if (!entries[i].name)
+            continue;
+        size_t j = fnv1a(entries[i].name) & (ncap - 1);
+        while (n[j].name)
+            j = (j + 1) & (ncap - 1);
+        n[j] = entries[i];
+    }
+    free(entries);
+    entries = n;
+    cap = ncap;
+    return 0;
+}
+
+static void insert_locked(const char *name, const char *path, int dir)
+{
+    if ((count + 1) * 4 > cap * 3 && grow_locked() < 0)
+        return;
+    size_t i = fnv1a(name) & (cap - 1);
+    while (entries[i].name)
+        i = (i + 1) & (cap - 1);
+    char *n = strdup(name), *p = strdup(path);
+    if (!n || !p)
+    {
+        free(n);
+        free(p);
+        return;
+    }
+    entries[i] = (HashEntry){n, p, dir, 1};
+    ++count;
+}
+
+/* remove with backward-shift, so probe chains stay intact */
+static void remove_locked(HashEntry *e)
+{
+    size_t i = (size_t)(e - entries);
+    free(entries[i].name);
+    free(entries[i].path);
+    entries[i].name = entries[i].path = NULL;
+    --count;
+    for (size_t j = (i + 1) & (cap - 1); entries[j].name; j = (j + 1) & (cap - 1))
+    {
+        size_t home = fnv1a(entries[j].name) & (cap - 1);
+        /* entry j may move into the hole at i unless its home lies cyclically in (i, j] */
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j))
+        {
+            entries[i] = entries[j];
+            entries[j].name = entries[j].path = NULL;
+            i = j;
+        }
+    }
+}
+
+/* 0 if path (relative to dirfd) is an executable file, else the errno execve() would
+   give: EACCES for a file we may not execute, ENOENT for no file at all */
+static int exec_check(int dirfd, const char *path)
+{
+    struct stat st;
+    if (fstatat(dirfd, path, &st, 0) != 0)
+        return ENOENT;
+    if (!S_ISREG(st.st_mode) || faccessat(dirfd, path, X_OK, 0) != 0)
+        return EACCES;
+    return 0;
+}
+
+const char *cmd_hash_lookup(const char *name, const char *path_var, int dirfd, char *out, size_t outlen)
+{
+    if (!name || !*name || strchr(name, '/'))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!path_var)
+        path_var = getenv("PATH");
+    if (!path_var)
+        path_var = CMD_HASH_DEFAULT_PATH;
+
+    pthread_mutex_lock(&hash_lock);
+    if (!path_str || strcmp(path_str, path_var) != 0)
+        reset_path_locked(path_var);
+
+    HashEntry *e = find_locked(name);
+    if (e)
+    {
+        /* a match in an earlier directory, or the file going away, changes an mtime */
+        for (int i = 0; i <= e->dir && i < n_dirs; ++i)
+        {
+            if (dir_changed(&path_dirs[i]))
+            {
+                flush_entries_locked();
+                restat_dirs_locked();
+                e = NULL;
+                break;
+            }
+        }
+    }
+    if (e)
+    {
+        ++e->hits;
+        size_t n = strlen(e->path);
+        if (n >= outlen)
+        {
+            pthread_mutex_unlock(&hash_lock);
+            errno = ENAMETOOLONG;
+            return NULL;
+        }
+        memcpy(out, e->path, n + 1);
+        pthread_mutex_unlock(&hash_lock);
+        return out;
+    }
+
+    int err = ENOENT;
+    for (int i = 0; i < n_dirs; ++i)
+    {
+        int n = snprintf(out, outlen, "%s/%s", path_dirs[i].dir, name);
+        if (n < 0 || (size_t)n >= outlen)
+        {
+            err = ENAMETOOLONG;
+            continue;
+        }
+        int e = exec_check(path_dirs[i].dir[0] == '/' ? AT_FDCWD : dirfd, out);
+        if (e != 0)
+        {
+            /* like execvp(): keep looking, but a file we could not run beats "not found" */
+            if (e == EACCES)
+                err = EACCES;
+            continue;
+        }
+        /* a relative directory means something else after the next cd */
+        if (path_dirs[i].dir[0] == '/')
+            insert_locked(name, out, i);
+        pthread_mutex_unlock(&hash_lock);
+        return out;
+    }
+    pthread_mutex_unlock(&hash_lock);
+    errno = err;
+    return NULL;
+}
+
+void cmd_hash_forget(const char *name)
+{
+    pthread_mutex_lock(&hash_lock);
+    HashEntry *e = find_locked(name);
+    if (e)
+        remove_locked(e);
+    pthread_mutex_unlock(&hash_lock);
+}
+
+void cmd_hash_clear(void)
+{
+    pthread_mutex_lock(&hash_lock);
+    flush_entries_locked();
+    restat_dirs_locked();
+    pthread_mutex_unlock(&hash_lock);
+}
+
+int cmd_hash_each(void (*fn)(const char *name, const char *path, unsigned hits, void *arg), void *arg)
+{
+    pthread_mutex_lock(&hash_lock);
+    int n = 0;
+    for (size_t i = 0; i < cap; ++i)
+    {
+        if (!entries[i].name)
+            continue;
+        fn(entries[i].name, entries[i].path, entries[i].hits, arg);
+        ++n;
+    }
+    pthread_mutex_unlock(&hash_lock);
+    return n;
+}
@@ -0,0 +1,658 @@
+#define _GNU_SOURCE
+#include "glob_expand.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define GX_MAX_THREADS 8 /* the calling thread included */
+#define GX_DENTS_BUF (32 * 1024)
+#define GX_HELPER_STACK (128 * 1024)
+
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* -------------------- per-thread results -------------------- */
+
+/* strings packed in one buffer; each thread fills its own, so no locking */
+typedef struct
+{
+    char *buf;
+    size_t len, cap;
+    size_t *off;
+    size_t n, off_cap;
+} StrList;
+
+/* add dir + '/' + name (+ '/' with trail); 0, or -1 when out of memory */
+static int strlist_add(StrList *l, const char *dir, const char *name, size_t nlen, int trail)
+{
+    size_t dlen = strlen(dir);
+    int sep = dlen > 0 && dir[dlen - 1] != '/';
+    size_t need = dlen + (size_t)sep + nlen + (size_t)trail + 1;
+    if (l->len + need > l->cap)
+    {
+        size_t cap = l->cap ? l->cap * 2 : 4096;
+        while (cap < l->len + need)
+            cap *= 2;
+        char *nb = realloc(l->buf, cap);
+        if (!nb)
+            return -1;
+        l->buf = nb;
+        l->cap = cap;
+    }
+    if (l->n == l->off_cap)
+    {
+        size_t cap = l->off_cap ? l->off_cap * 2 : 256;
+        size_t *no = realloc(l->off, cap * sizeof(size_t));
+        if (!no)
+            return -1;
+        l->off = no;
+        l->off_cap = cap;
+    }
+    char *p = l->buf + l->len;
+    l->off[l->n++] = l->len;
+    memcpy(p, dir, dlen);
+    p += dlen;
+    if (sep)
+        *p++ = '/';
+    memcpy(p, name, nlen);
+    p += nlen;
+    if (trail)
+        *p++ = '/';
+    *p = '\0';
+    l->len += need;
+    return 0;
+}
+
+/* -------------------- work queues -------------------- */
+
+/* a directory still to be read: path (as it will be printed, "" for the start
+   directory) and the pattern component its entries are matched against */
+typedef struct
+{
+    char *path;
+    int comp;
+    int below; /* reached by descending through ** */
+} Item;
+
+/* the owner pushes and pops at the tail (depth first), thieves take from the head
+   (the oldest items, nearest the root, so the biggest subtrees move) */
+typedef struct
+{
+    pthread_mutex_t lock;
+    Item *items;
+    size_t head, tail, cap;
+} Deque;
+
+typedef struct
+{
+    int dirfd;
+    char **comps; /* the pattern's components, as written */
+    char **lits;  /* the same with their escapes removed, for literal use */
+    int ncomps;
+    int dirs_only;        /* the pattern ended in '/' */
+    atomic_long pending;  /* items queued or being visited */
+    atomic_int oom;
+    int shared;           /* the helpers have been called in */
+    Deque q[GX_MAX_THREADS];
+    StrList out[GX_MAX_THREADS];
+} Walk;
+
+static int deque_push(Deque *d, Item it)
+{
+    pthread_mutex_lock(&d->lock);
+    if (d->tail == d->cap)
+    {
+        if (d->head > 0)
+        {
+            memmove(d->items, d->items + d->head, (d->tail - d->head) * sizeof(Item));
+            d->tail -= d->head;
+            d->head = 0;
+        }
+        if (d->tail == d->cap)
+        {
+            size_t cap = d->cap ? d->cap * 2 : 64;
+            Item *ni = realloc(d->items, cap * sizeof(Item));
+            if (!ni)
+            {
+                pthread_mutex_unlock(&d->lock);
+                return -1;
+            }
+            d->items = ni;
+            d->cap = cap;
+        }
+    }
+    d->items[d->tail++] = it;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+static int deque_take(Deque *d, Item *it, int from_head)
+{
+    int got = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail)
+    {
+        *it = from_head ? d->items[d->head++] : d->items[--d->tail];
+        if (d->head == d->tail)
+            d->head = d->tail = 0;
+        got = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return got;
+}
+
+/* -------------------- the helper pool -------------------- */
+
+static pthread_mutex_t expand_lock = PTHREAD_MUTEX_INITIALIZER; /* one walk on the pool at a time */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static Walk *pool_walk;   /* the walk helpers should join, or NULL */
+static unsigned pool_gen; /* bumped for every walk handed out */
+static int pool_threads;  /* helpers started */
+static int pool_active;   /* helpers inside pool_walk */
+
+static void walk_work(Walk *w, int me);
+
+static void *helper_main(void *p)
+{
+    int me = (int)(intptr_t)p;
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool_lock);
+    for (;;)
+    {
+        while (!pool_walk || pool_gen == seen)
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        seen = pool_gen;
+        Walk *w = pool_walk;
+        pool_active++;
+        pthread_mutex_unlock(&pool_lock);
+        walk_work(w, me);
+        pthread_mutex_lock(&pool_lock);
+        if (--pool_active == 0)
+            pthread_cond_broadcast(&pool_cond);
+    }
+    return NULL;
+}
+
+/* called from the walking thread once the walk has fanned out; the helpers are
+   started on first use */
+static void pool_share(Walk *w)
+{
+    w->shared = 1;
+    pthread_mutex_lock(&pool_lock);
+    if (pool_threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int want = cpus > GX_MAX_THREADS ? GX_MAX_THREADS - 1 : (int)cpus - 1;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_attr_setstacksize(&attr, GX_HELPER_STACK);
+        for (int i = 1; i <= want; ++i)
+        {
+            pthread_t thr;
+            if (pthread_create(&thr, &attr, helper_main, (void *)(intptr_t)i) != 0)
+                break;
+            pool_threads++;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    pool_walk = w;
+    pool_gen++;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* the walk is over: wait until no helper still looks at it */
+static void pool_release(Walk *w)
+{
+    if (!w->shared)
+        return;
+    pthread_mutex_lock(&pool_lock);
+    pool_walk = NULL;
+    while (pool_active > 0)
+        pthread_cond_wait(&pool_cond, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* -------------------- walking -------------------- */
+
+/* an unescaped *, ? or [ */
+static int has_magic(const char *s)
+{
+    for (; *s; ++s)
+    {
+        if (*s == '\\' && s[1])
+            ++s;
+        else if (*s == '*' || *s == '?' || *s == '[')
+            return 1;
+    }
+    return 0;
+}
+
+/* remove backslash escapes in place */
+static void unescape(char *s)
+{
+    char *o = s;
+    for (; *s; ++s)
+    {
+        if (*s == '\\' && s[1])
+            ++s;
+        *o++ = *s;
+    }
+    *o = '\0';
+}
+
+static void walk_push(Walk *w, int me, char *path, int comp, int below)
+{
+    if (!path)
+    {
+        w->oom = 1;
+        return;
+    }
+    w->pending++;
+    if (deque_push(&w->q[me], (Item){path, comp, below}) < 0)
+    {
+        w->pending--;
+        w->oom = 1;
+        free(path);
+        return;
+    }
+    if (!w->shared && me == 0 && w->pending > 1)
+        pool_share(w);
+}
+
+static char *path_join(const char *dir, const char *name, size_t nlen)
+{
+    size_t dlen = strlen(dir);
+    int sep = dlen > 0 && dir[dlen - 1] != '/';
+    char *p = malloc(dlen + (size_t)sep + nlen + 1);
+    if (!p)
+        return NULL;
+    memcpy(p, dir, dlen);
+    if (sep)
+        p[dlen] = '/';
+    memcpy(p + dlen + sep, name, nlen);
+    p[dlen + sep + nlen] = '\0';
+    return p;
+}
+
+static void emit_match(Walk *w, int me, const char *dir, const char *name, size_t nlen)
+{
+    if (strlist_add(&w->out[me], dir, name, nlen, w->dirs_only) < 0)
+        w->oom = 1;
+}
+
+/* entry `name` of the open directory dfd is (or, following symlinks, leads to) a directory */
+static int entry_is_dir(int dfd, const char *name, unsigned char type, int follow)
+{
+    if (type == DT_DIR)
+        return 1;
+    if (type != DT_UNKNOWN && !(type == DT_LNK && follow))
+        return 0;
+    struct stat st;
+    return fstatat(dfd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* match the entries of directory `path` against component k; takes path */
+static void walk_visit(Walk *w, int me, char *path, int k, int below)
+{
+    /* literal components are joined on without reading anything */
+    while (k < w->ncomps - 1 && !has_magic(w->comps[k]))
+    {
+        char *next = path_join(path, w->lits[k], strlen(w->lits[k]));
+        free(path);
+        if (!(path = next))
+        {
+            w->oom = 1;
+            return;
+        }
+        ++k;
+    }
+    const char *comp = w->comps[k];
+    int last = k == w->ncomps - 1;
+    if (!has_magic(comp))
+    {
+        /* a literal last component: it only has to exist */
+        const char *lit = w->lits[k];
+        char *full = path_join(path, lit, strlen(lit));
+        struct stat st;
+        if (full && fstatat(w->dirfd, full, &st, 0) == 0 && (!w->dirs_only || S_ISDIR(st.st_mode)))
+            emit_match(w, me, path, lit, strlen(lit));
+        free(full);
+        free(path);
+        return;
+    }
+    int globstar = strcmp(comp, "**") == 0;
+    int dfd = openat(w->dirfd, path[0] ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0)
+    {
+        free(path);
+        return;
+    }
+    /* ** standing for no directory at all; as the last component that makes the
+       directory itself a match, written with its '/' */
+    if (globstar && !last)
+        walk_push(w, me, strdup(path), k + 1, 0);
+    else if (globstar && !below && path[0] && strlist_add(&w->out[me], path, "", 0, 0) < 0)
+        w->oom = 1;
+    char buf[GX_DENTS_BUF];
+    long n;
+    while ((n = syscall(SYS_getdents64, dfd, buf, sizeof(buf))) > 0)
+    {
+        for (long pos = 0; pos < n;)
+        {
+            struct linux_dirent64 *de = (struct linux_dirent64 *)(buf + pos);
+            pos += de->d_reclen;
+            const char *name = de->d_name;
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+                continue;
+            size_t nlen = strlen(name);
+            if (globstar)
+            {
+                if (name[0] == '.')
+                    continue;
+                int dir = entry_is_dir(dfd, name, de->d_type, 0);
+                if (last && (!w->dirs_only || dir))
+                    emit_match(w, me, path, name, nlen);
+                if (dir)
+                    walk_push(w, me, path_join(path, name, nlen), k, 1);
+                continue;
+            }
+            if (fnmatch(comp, name, FNM_PERIOD) != 0)
+                continue;
+            if (last)
+            {
+                if (!w->dirs_only || entry_is_dir(dfd, name, de->d_type, 1))
+                    emit_match(w, me, path, name, nlen);
+            }
+            else if (entry_is_dir(dfd, name, de->d_type, 1))
+                walk_push(w, me, path_join(path, name, nlen), k + 1, 0);
+        }
+    }
+    close(dfd);
+    free(path);
+}
+
+static void walk_work(Walk *w, int me)
+{
+    for (;;)
+    {
+        Item it;
+        int got = deque_take(&w->q[me], &it, 0);
+        for (int i = 1; !got && i < GX_MAX_THREADS; ++i)
+            got = deque_take(&w->q[(me + i) % GX_MAX_THREADS], &it, 1);
+        if (got)
+        {
+            walk_visit(w, me, it.path, it.comp, it.below);
+            w->pending--;
+            continue;
+        }
+        if (w->pending == 0)
+            return;
+        sched_yield();
+    }
+}
+
+/* -------------------- one brace alternative -------------------- */
+
+typedef struct
+{
+    int dirfd;
+    glob_emit_fn emit;
+    void *arg;
+    long count;
+    int oom;
+} Expand;
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* ~ and ~user at the start of pat; malloc'd, or NULL when there is nothing to replace.
+   The directory is escaped, as it is not a pattern. */
+static char *expand_tilde(const char *pat)
+{
+    if (pat[0] != '~')
+        return NULL;
+    const char *rest = strchrnul(pat, '/');
+    const char *home = NULL;
+    struct passwd pw, *res = NULL;
+    char pwbuf[4096];
+    if (rest == pat + 1)
+    {
+        home = getenv("HOME");
+        if (!home && getpwuid_r(getuid(), &pw, pwbuf, sizeof(pwbuf), &res) == 0 && res)
+            home = res->pw_dir;
+    }
+    else
+    {
+        char *user = strndup(pat + 1, (size_t)(rest - pat - 1));
+        if (user && getpwnam_r(user, &pw, pwbuf, sizeof(pwbuf), &res) == 0 && res)
+            home = res->pw_dir;
+        free(user);
+    }
+    if (!home)
+        return NULL;
+    size_t hlen = strlen(home), rlen = strlen(rest);
+    char *out = malloc(2 * hlen + rlen + 1), *o = out;
+    if (out)
+    {
+        for (const char *h = home; *h; ++h)
+        {
+            if (strchr("*?[]\\", *h))
+                *o++ = '\\';
+            *o++ = *h;
+        }
+        memcpy(o, rest, rlen + 1);
+    }
+    return out;
+}
+
+/* walk one pattern and emit its matches sorted; returns how many there were */
+static long expand_pattern(Expand *x, const char *pat)
+{
+    Walk *w = calloc(1, sizeof(*w));
+    char *tilde = expand_tilde(pat);
+    const char *p = tilde ? tilde : pat;
+    const char *root = "";
+    if (*p == '/')
+        root = "/";
+    while (*p == '/')
+        ++p;
+    char *split = strdup(p), *lsplit = strdup(p);
+    size_t ncap = 1;
+    for (const char *c = p; *c; ++c)
+        ncap += *c == '/';
+    if (w)
+    {
+        w->comps = malloc(ncap * sizeof(char *));
+        w->lits = malloc(ncap * sizeof(char *));
+    }
+    if (!w || !split || !lsplit || !w->comps || !w->lits)
+    {
+        x->oom = 1;
+        if (w)
+        {
+            free(w->comps);
+            free(w->lits);
+        }
+        free(w);
+        free(split);
+        free(lsplit);
+        free(tilde);
+        return 0;
+    }
+    size_t plen = strlen(split);
+    w->dirs_only = plen > 0 && split[plen - 1] == '/';
+    for (char *save = NULL, *c = strtok_r(split, "/", &save); c; c = strtok_r(NULL, "/", &save))
+        w->comps[w->ncomps++] = c;
+    int nl = 0;
+    for (char *save = NULL, *c = strtok_r(lsplit, "/", &save); c; c = strtok_r(NULL, "/", &save))
+    {
+        unescape(c);
+        w->lits[nl++] = c;
+    }
+    w->dirfd = x->dirfd;
+    for (int i = 0; i < GX_MAX_THREADS; ++i)
+        pthread_mutex_init(&w->q[i].lock, NULL);
+
+    long found = 0;
+    if (w->ncomps > 0)
+    {
+        pthread_mutex_lock(&expand_lock);
+        walk_push(w, 0, strdup(root), 0, 0);
+        walk_work(w, 0);
+        pool_release(w);
+        pthread_mutex_unlock(&expand_lock);
+
+        size_t total = 0;
+        for (int i = 0; i < GX_MAX_THREADS; ++i)
+            total += w->out[i].n;
+        char **all = malloc((total ? total : 1) * sizeof(char *));
+        if (!all)
+            x->oom = 1;
+        else
+        {
+            size_t k = 0;
+            for (int i = 0; i < GX_MAX_THREADS; ++i)
+                for (size_t j = 0; j < w->out[i].n; ++j)
+                    all[k++] = w->out[i].buf + w->out[i].off[j];
+            qsort(all, total, sizeof(char *), cmp_str);
+            for (size_t j = 0; j < total; ++j)
+                x->emit(all[j], strlen(all[j]), x->arg);
+            found = (long)total;
+            free(all);
+        }
+        if (w->oom)
+            x->oom = 1;
+    }
+
+    for (int i = 0; i < GX_MAX_THREADS; ++i)
+    {
+        free(w->q[i].items);
+        pthread_mutex_destroy(&w->q[i].lock);
+        free(w->out[i].buf);
+        free(w->out[i].off);
+    }
+    free(w->comps);
+    free(w->lits);
+    free(w);
+    free(split);
+    free(lsplit);
+    free(tilde);
+    return found;
+}
+
+static void expand_alternative(Expand *x, const char *alt)
+{
+    long found = has_magic(alt) ? expand_pattern(x, alt) : 0;
+    if (found == 0)
+    {
+        /* as written, less the escapes */
+        char *lit = strdup(alt);
+        if (!lit)
+        {
+            x->oom = 1;
+            return;
+        }
+        unescape(lit);
+        x->emit(lit, strlen(lit), x->arg);
+        free(lit);
+    }
+    x->count += found > 0 ? found : 1;
+}
+
+/* -------------------- braces -------------------- */
+
+/* the '}' closing the '{' at s[open], if the group has a top-level ',' */
+static const char *brace_close(const char *open)
+{
+    int depth = 0, comma = 0;
+    for (const char *c = open; *c; ++c)
+    {
+        if (*c == '\\' && c[1])
+            ++c;
+        else if (*c == '{')
+            ++depth;
+        else if (*c == '}' && --depth == 0)
+            return comma ? c : NULL;
+        else if (*c == ',' && depth == 1)
+            comma = 1;
+    }
+    return NULL;
+}
+
+static void expand_braces(Expand *x, const char *word)
+{
+    const char *open = word, *close = NULL;
+    for (; *open; ++open)
+    {
+        if (*open == '\\' && open[1])
+            ++open;
+        else if (*open == '{' && (close = brace_close(open)))
+            break;
+    }
+    if (!*open)
+    {
+        expand_alternative(x, word);
+        return;
+    }
+    size_t pre = (size_t)(open - word), suf = strlen(close + 1);
+    const char *alt = open + 1;
+    int depth = 0;
+    for (const char *c = alt; c <= close && !x->oom; ++c)
+    {
+        if (*c == '\\' && c < close)
+            ++c;
+        else if (*c == '{')
+            ++depth;
+        else if (*c == '}' && depth > 0)
+            --depth;
+        else if ((*c == ',' && depth == 0) || c == close)
+        {
+            size_t alen = (size_t)(c - alt);
+            char *s = malloc(pre + alen + suf + 1);
+            if (!s)
+            {
+                x->oom = 1;
+                return;
+            }
+            memcpy(s, word, pre);
+            memcpy(s + pre, alt, alen);
+            memcpy(s + pre + alen, close + 1, suf + 1);
+            expand_braces(x, s);
+            free(s);
+            alt = c + 1;
+        }
+    }
+}
+
+long glob_expand(const char *word, int dirfd, glob_emit_fn emit, void *arg)
+{
+    Expand x = {dirfd, emit, arg, 0, 0};
+    expand_braces(&x, word);
+    return x.oom ? -1 : x.count;
+}
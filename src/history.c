@@ -10,6 +10,7 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>     // for open(), O_CREAT, O_RDONLY, etc.  // for close(), fsync(), rename()
+#include <pthread.h>
 #include <sys/stat.h> 
 
 #ifndef HIST_MAX
@@ -24,6 +25,13 @@ static int hist_start = 0;   /* index of oldest entry in buffer (valid only when
 static char history_path[PATH_MAX] = {0};
 static int hist_pos = -1;
 
+/* Usage per entry, parallel to hist_buf (NULL until something is recorded). Jobs end
+   on the reactor thread, so entries are found by serial number and usage_lock
+   guards this array along with hist_start/hist_count/hist_serial. */
+static HistUsage *hist_usage[HIST_MAX];
+static unsigned long hist_serial = 0; /* serial of the newest entry */
+static pthread_mutex_t usage_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 // static void free_all_hist(void) {
 //     for (int i = 0; i < HIST_MAX; ++i) {
@@ -33,11 +41,11 @@ static int hist_pos = -1;
 //     hist_start = 0;
 // }
 
-/* internal: push strdup'd line (assumes cmd is non-null) */
-static void hist_push_str(const char *s) {
-    if (!s) return;
+/* internal: push strdup'd line (assumes cmd is non-null); returns its slot or -1 */
+static int hist_push_str(const char *s) {
+    if (!s) return -1;
     char *line = strdup(s);
-    if (!line) return;
+    if (!line) return -1;
     /* trim trailing newline/carriage */
     size_t L = strlen(line);
     while (L > 0 && (line[L-1] == '\n' || line[L-1] == '\r')) { line[--L] = '\0'; }
@@ -45,18 +53,108 @@ static void hist_push_str(const char *s) {
     /* skip empty/whitespace-only */
     int only_space = 1;
     for (size_t i = 0; i < L; ++i) if (!isspace((unsigned char)line[i])) { only_space = 0; break; }
-    if (only_space) { free(line); return; }
+    if (only_space) { free(line); return -1; }
 
+    int idx;
+    pthread_mutex_lock(&usage_lock);
     if (hist_count < HIST_MAX) {
-        int idx = (hist_start + hist_count) % HIST_MAX;
+        idx = (hist_start + hist_count) % HIST_MAX;
         hist_buf[idx] = line;
         hist_count++;
     } else {
         /* overwrite oldest */
+        idx = hist_start;
         free(hist_buf[hist_start]);
         hist_buf[hist_start] = line;
         hist_start = (hist_start + 1) % HIST_MAX;
     }
+    free(hist_usage[idx]);
+    hist_usage[idx] = NULL;
+    hist_serial++;
+    pthread_mutex_unlock(&usage_lock);
+    return idx;
+}
+
+/* usage record as saved: "real user sys maxrss nvcsw nivcsw runs", or "-" */
+static void usage_format(const HistUsage *u, char *out, size_t outlen) {
+    if (!u) { snprintf(out, outlen, "-"); return; }
+    snprintf(out, outlen, "%.6f %.6f %.6f %ld %ld %ld %d", u->real, u->user, u->sys,
+             u->maxrss_kb, u->nvcsw, u->nivcsw, u->runs);
+}
+
+static HistUsage *usage_parse(const char *line) {
+    HistUsage u;
+    if (sscanf(line, "%lf %lf %lf %ld %ld %ld %d", &u.real, &u.user, &u.sys,
+               &u.maxrss_kb, &u.nvcsw, &u.nivcsw, &u.runs) != 7) return NULL;
+    HistUsage *p = malloc(sizeof(*p));
+    if (p) *p = u;
+    return p;
+}
+
+/* On-disk formats. The history file starts with HIST_HEADER and holds one entry per
+   line, with '\\', '\n' and '\r' escaped, so entries spanning lines (pasted heredocs,
+   newline lists) come back whole; a file without the header is read the old way, a
+   line per entry, unescaped. The usage file starts with USAGE_HEADER and the number
+   of entries it describes, then one record per history entry, in the same order, as
+   "<hash of the entry> <usage>". It is only trusted if the count and every hash match
+   the history file, since the two are written one after the other. */
+#define HIST_HEADER "#myterm-history 2"
+#define USAGE_HEADER "#myterm-usage 2"
+
+static unsigned long long entry_hash(const char *s) {
+    unsigned long long h = 14695981039346656037ull;
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 1099511628211ull;
+    return h;
+}
+
+static void write_escaped(FILE *f, const char *s) {
+    for (; *s; ++s) {
+        if (*s == '\\') fputs("\\\\", f);
+        else if (*s == '\n') fputs("\\n", f);
+        else if (*s == '\r') fputs("\\r", f);
+        else fputc(*s, f);
+    }
+    fputc('\n', f);
+}
+
+/* undo write_escaped() in place */
+static void unescape_line(char *s) {
+    char *o = s;
+    for (; *s; ++s) {
+        if (*s == '\\' && s[1]) {
+            ++s;
+            *o++ = *s == 'n' ? '\n' : *s == 'r' ? '\r' : *s;
+        } else {
+            *o++ = *s;
+        }
+    }
+    *o = '\0';
+}
+
+/* the entries, oldest first, and their usage records (under usage_lock) */
+static void write_history(FILE *f) {
+    fprintf(f, "%s\n", HIST_HEADER);
+    for (int i = 0; i < hist_count; ++i) {
+        int idx = (hist_start + i) % HIST_MAX;
+        if (hist_buf[idx]) write_escaped(f, hist_buf[idx]);
+    }
+}
+
+static void write_usage(FILE *f) {
+    int n = 0;
+    for (int i = 0; i < hist_count; ++i) n += hist_buf[(hist_start + i) % HIST_MAX] != NULL;
+    fprintf(f, "%s %d\n", USAGE_HEADER, n);
+    for (int i = 0; i < hist_count; ++i) {
+        int idx = (hist_start + i) % HIST_MAX;
+        if (!hist_buf[idx]) continue;
+        char ub[160];
+        usage_format(hist_usage[idx], ub, sizeof(ub));
+        fprintf(f, "%016llx %s\n", entry_hash(hist_buf[idx]), ub);
+    }
+}
+
+static void usage_path(char *out, size_t outlen) {
+    snprintf(out, outlen, "%s.usage", history_path);
 }
 
 /* Expand ~/ to $HOME */
@@ -103,64 +201,166 @@ int history_init(const char *path) {
         /* missing history file is not fatal; start with empty history */
         return 0;
     }
+    /* all entries first, so the usage file can be checked against them before any
+       record is attached */
+    char **ents = NULL;
+    size_t n = 0, ecap = 0;
     char *line = NULL;
     size_t cap = 0;
     ssize_t r;
-    /* read all lines, but only keep last HIST_MAX */
+    int escaped = 0, first = 1;
     while ((r = getline(&line, &cap, f)) != -1) {
         /* strip newline */
         while (r > 0 && (line[r-1] == '\n' || line[r-1] == '\r')) { line[--r] = '\0'; }
-        hist_push_str(line);
+        if (first) {
+            first = 0;
+            if (strcmp(line, HIST_HEADER) == 0) { escaped = 1; continue; }
+        }
+        if (escaped) unescape_line(line);
+        if (n == ecap) {
+            size_t nc = ecap ? ecap * 2 : 256;
+            char **ne = realloc(ents, nc * sizeof(*ne));
+            if (!ne) break;
+            ents = ne;
+            ecap = nc;
+        }
+        if (!(ents[n] = strdup(line))) break;
+        ++n;
     }
-    free(line);
     fclose(f);
+
+    HistUsage **usage = NULL;
+    char upath[PATH_MAX + 8];
+    usage_path(upath, sizeof(upath));
+    FILE *uf = escaped ? fopen(upath, "r") : NULL;
+    if (uf && n > 0 && (usage = calloc(n, sizeof(*usage)))) {
+        int count = -1, ok = 0;
+        if (getline(&line, &cap, uf) != -1 && sscanf(line, USAGE_HEADER " %d", &count) == 1 &&
+            count == (int)n) {
+            size_t i = 0;
+            unsigned long long h;
+            int off;
+            while (i < n && getline(&line, &cap, uf) != -1 &&
+                   sscanf(line, "%llx %n", &h, &off) == 1 && h == entry_hash(ents[i])) {
+                usage[i++] = usage_parse(line + off);
+            }
+            ok = i == n;
+        }
+        if (!ok) {
+            /* stale (or damaged): not one record can be trusted */
+            for (size_t i = 0; i < n; ++i) free(usage[i]);
+            free(usage);
+            usage = NULL;
+        }
+    }
+    if (uf) fclose(uf);
+    free(line);
+
+    /* only the last HIST_MAX are kept */
+    for (size_t i = 0; i < n; ++i) {
+        int idx = hist_push_str(ents[i]);
+        if (idx >= 0 && usage) {
+            hist_usage[idx] = usage[i];
+            usage[i] = NULL;
+        }
+        if (usage) free(usage[i]);
+        free(ents[i]);
+    }
+    free(usage);
+    free(ents);
     return 0;
 }
 
 void history_save(void) {
     if (history_path[0] == '\0') return;
 
+    char upath[PATH_MAX + 8];
+    usage_path(upath, sizeof(upath));
+
     /* write to a temp file then rename to avoid corruption */
-    char tmp_path[PATH_MAX];
+    char tmp_path[PATH_MAX], utmp[PATH_MAX + 32];
     snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", history_path, (int)getpid());
+    snprintf(utmp, sizeof(utmp), "%s.tmp.%d", upath, (int)getpid());
 
+    pthread_mutex_lock(&usage_lock);
     int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) {
-        /* can't open temporary - try direct write as a fallback */
-        FILE *f = fopen(history_path, "w");
-        if (!f) return;
-        for (int i = 0; i < hist_count; ++i) {
-            int idx = (hist_start + i) % HIST_MAX;
-            if (hist_buf[idx]) fprintf(f, "%s\n", hist_buf[idx]);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!f) {
+        if (fd >= 0) { close(fd); unlink(tmp_path); }
+        /* can't open temporary - try direct writes as a fallback; the usage file is
+           rewritten too, or removed, so it never describes another history */
+        f = fopen(history_path, "w");
+        if (f) {
+            write_history(f);
+            fclose(f);
         }
-        fclose(f);
+        FILE *uf = fopen(upath, "w");
+        if (uf) {
+            write_usage(uf);
+            if (fclose(uf) != 0) unlink(upath);
+        } else {
+            unlink(upath);
+        }
+        pthread_mutex_unlock(&usage_lock);
         return;
     }
 
-    /* write from oldest to newest */
-    for (int i = 0; i < hist_count; ++i) {
-        int idx = (hist_start + i) % HIST_MAX;
-        if (hist_buf[idx]) {
-            size_t len = strlen(hist_buf[idx]);
-            ssize_t w = write(fd, hist_buf[idx], len);
-            if (w < 0) { /* ignore and continue */ }
-            write(fd, "\n", 1);
-        }
+    /* write from oldest to newest, then flush to disk (best-effort) */
+    write_history(f);
+    fflush(f);
+    fsync(fileno(f));
+    int failed = ferror(f);
+    if (fclose(f) != 0 || failed) {
+        unlink(tmp_path);
+        pthread_mutex_unlock(&usage_lock);
+        return;
     }
 
-    /* flush to disk (best-effort) */
-    fsync(fd);
-    close(fd);
-
     /* atomically rename into place */
     rename(tmp_path, history_path);
+
+    /* usage, record for entry; if it cannot be replaced the old one would be stale */
+    FILE *uf = fopen(utmp, "w");
+    if (uf) {
+        write_usage(uf);
+        if (fclose(uf) == 0) rename(utmp, upath);
+        else { unlink(utmp); unlink(upath); }
+    } else {
+        unlink(upath);
+    }
+    pthread_mutex_unlock(&usage_lock);
 }
 
-void history_add(const char *cmd) {
-    if (!cmd || cmd[0] == '\0') return;
-    hist_push_str(cmd);
+unsigned long history_add(const char *cmd) {
+    if (!cmd || cmd[0] == '\0') return 0;
+    if (hist_push_str(cmd) < 0) return 0;
     /* reset hist_pos so subsequent history navigation starts at most-recent entry */
     hist_pos = -1;
+    pthread_mutex_lock(&usage_lock);
+    unsigned long serial = hist_serial;
+    pthread_mutex_unlock(&usage_lock);
+    return serial;
+}
+
+void history_add_usage(unsigned long serial, const HistUsage *u) {
+    if (serial == 0 || !u) return;
+    pthread_mutex_lock(&usage_lock);
+    unsigned long back = hist_serial - serial;
+    if (serial <= hist_serial && back < (unsigned long)hist_count) {
+        int idx = (hist_start + hist_count - 1 - (int)back) % HIST_MAX;
+        HistUsage *h = hist_usage[idx];
+        if (!h && (h = calloc(1, sizeof(*h)))) hist_usage[idx] = h;
+        if (h) {
+            h->real += u->real;
+            h->user += u->user;
+            h->sys += u->sys;
+            if (u->maxrss_kb > h->maxrss_kb) h->maxrss_kb = u->maxrss_kb;
+            h->nvcsw += u->nvcsw;
+            h->nivcsw += u->nivcsw;
+            h->runs += u->runs;
+        }
+    }
+    pthread_mutex_unlock(&usage_lock);
 }
 
 /* internal helper: get index of entry i where i=0 is oldest, i=hist_count-1 most recent */
@@ -190,6 +390,33 @@ void history_show_recent(int tab_idx, int max) {
     }
 }
 
+void history_show_usage(int tab_idx, int max) {
+    if (max <= 0) max = 1000;
+    if (hist_count == 0) {
+        const char *msg = "history: no entries\n";
+        tabs_append_output(tab_idx, msg, (ssize_t)strlen(msg));
+        return;
+    }
+    const char *hdr = "    real     user      sys   maxrss  command\n";
+    tabs_append_output(tab_idx, hdr, (ssize_t)strlen(hdr));
+    for (int i = 0; i < hist_count && i < max; ++i) {
+        int idx = (hist_start + hist_count - 1 - i) % HIST_MAX;
+        if (!hist_buf[idx]) continue;
+        char line[4096];
+        int L;
+        pthread_mutex_lock(&usage_lock);
+        const HistUsage *u = hist_usage[idx];
+        if (u)
+            L = snprintf(line, sizeof(line), "%7.3fs %7.3fs %7.3fs %6ldMB  %s\n", u->real, u->user, u->sys,
+                         (u->maxrss_kb + 1023) / 1024, hist_buf[idx]);
+        else
+            L = snprintf(line, sizeof(line), "%8s %8s %8s %8s  %s\n", "-", "-", "-", "-", hist_buf[idx]);
+        pthread_mutex_unlock(&usage_lock);
+        if (L >= (int)sizeof(line)) L = (int)sizeof(line) - 1;
+        tabs_append_output(tab_idx, line, L);
+    }
+}
+
 /* longest common substring length between a and b */
 static int lcs_len(const char *a, const char *b) {
     if (!a || !b) return 0;
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include "launch.h"
+#include "cmd_hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/* signals the GUI handles or ignores; children always get the defaults back */
+static const int reset_signals[] = {SIGPIPE, SIGINT, SIGTSTP, SIGCHLD};
+#define N_RESET_SIGNALS (int)(sizeof(reset_signals) / sizeof(reset_signals[0]))
+
+/* -------------------- posix_spawn path -------------------- */
+
+/* exe: argv[0] already resolved through the command hash, or argv[0] itself */
+static pid_t spawn_posix(const LaunchSpec *spec, const char *exe)
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    int rc = posix_spawn_file_actions_init(&fa);
+    if (rc != 0)
+    {
+        errno = rc;
+        return -1;
+    }
+    rc = posix_spawnattr_init(&attr);
+    if (rc != 0)
+    {
+        posix_spawn_file_actions_destroy(&fa);
+        errno = rc;
+        return -1;
+    }
+
+    /* the dup2 chain the fork()ed child used to do by hand */
+    if (spec->fd_in >= 0 && spec->fd_in != STDIN_FILENO)
+        rc = rc ? rc : posix_spawn_file_actions_adddup2(&fa, spec->fd_in, STDIN_FILENO);
+    if (spec->fd_out >= 0 && spec->fd_out != STDOUT_FILENO)
+        rc = rc ? rc : posix_spawn_file_actions_adddup2(&fa, spec->fd_out, STDOUT_FILENO);
+    if (spec->fd_err >= 0 && spec->fd_err != STDERR_FILENO)
+        rc = rc ? rc : posix_spawn_file_actions_adddup2(&fa, spec->fd_err, STDERR_FILENO);
+    if (spec->cwd_fd >= 0)
+        rc = rc ? rc : posix_spawn_file_actions_addfchdir_np(&fa, spec->cwd_fd);
+    else if (spec->cwd)
+        rc = rc ? rc : posix_spawn_file_actions_addchdir_np(&fa, spec->cwd);
+
+    /* process group is set before exec, so there is no setpgid race with the parent */
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_USEVFORK;
+    if (spec->pgid >= 0)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        rc = rc ? rc : posix_spawnattr_setpgroup(&attr, spec->pgid);
+    }
+
+    /* the GUI ignores SIGPIPE and may block signals in its threads; children get defaults */
+    sigset_t def, empty;
+    sigemptyset(&def);
+    for (int i = 0; i < N_RESET_SIGNALS; ++i)
+        sigaddset(&def, reset_signals[i]);
+    sigemptyset(&empty);
+    rc = rc ? rc : posix_spawnattr_setsigdefault(&attr, &def);
+    rc = rc ? rc : posix_spawnattr_setsigmask(&attr, &empty);
+    rc = rc ? rc : posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid = -1;
+    if (rc == 0)
+        rc = posix_spawn(&pid, exe, &fa, &attr, spec->argv, spec->envp ? spec->envp : environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&fa);
+    if (rc != 0)
+    {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+/* the PATH the child will see */
+static const char *spec_path(const LaunchSpec *spec)
+{
+    if (!spec->envp)
+        return NULL;
+    for (char *const *e = spec->envp; *e; ++e)
+        if (strncmp(*e, "PATH=", 5) == 0)
+            return *e + 5;
+    return CMD_HASH_DEFAULT_PATH;
+}
+
+/* where the child's relative PATH entries point: its working directory, which may be
+   given as a path only (*tmp is then an fd to close afterwards) */
+static int spec_dirfd(const LaunchSpec *spec, int *tmp)
+{
+    *tmp = -1;
+    if (spec->cwd_fd >= 0)
+        return spec->cwd_fd;
+    if (spec->cwd && (*tmp = open(spec->cwd, O_PATH | O_DIRECTORY | O_CLOEXEC)) >= 0)
+        return *tmp;
+    return AT_FDCWD;
+}
+
+pid_t launch_spawn(const LaunchSpec *spec)
+{
+    if (!spec || !spec->argv || !spec->argv[0])
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    const char *name = spec->argv[0];
+    if (strchr(name, '/'))
+        return spawn_posix(spec, name);
+
+    /* resolve here, once, instead of every child walking PATH with failing execve()s */
+    char exe[PATH_MAX];
+    int tmp, dirfd = spec_dirfd(spec, &tmp);
+    pid_t pid = -1;
+    if (cmd_hash_lookup(name, spec_path(spec), dirfd, exe, sizeof(exe)))
+    {
+        pid = spawn_posix(spec, exe);
+        if (pid < 0 && (errno == ENOENT || errno == EACCES))
+        {
+            /* the binary went away without its directory's mtime telling us: look it up afresh */
+            int err = errno;
+            char again[PATH_MAX];
+            cmd_hash_forget(name);
+            if (cmd_hash_lookup(name, spec_path(spec), dirfd, again, sizeof(again)) && strcmp(again, exe) != 0)
+                pid = spawn_posix(spec, again);
+            else
+                errno = err;
+        }
+    }
+    if (tmp >= 0)
+    {
+        int e = errno;
+        close(tmp);
+        errno = e;
+    }
+    return pid;
+}
@@ -7,16 +7,35 @@
 #include <stdio.h>
 #include <stdint.h>
 
-/* LineEditor stores UTF-8 bytes. Cursor/index are byte indices.
-   For deletion we avoid splitting UTF-8 code points by removing continuation bytes
-   (0x80..0xBF) until we reach a non-continuation byte. This is a simple, robust
-   strategy used elsewhere in your codebase. */
+/* LineEditor stores UTF-8 bytes in a gap buffer: the text is buf[0..gap_start)
+   followed by buf[gap_end..cap). Edits happen at the gap, so inserting or deleting
+   at the cursor is O(1) amortized; the gap is only moved when an edit happens at a
+   different position than the previous one. Cursor/index are logical byte indices.
+   Movement and deletion step over whole code points by skipping continuation bytes
+   (0x80..0xBF). There is no fixed size limit: the buffer doubles when the gap fills. */
+
+#define LE_INITIAL_CAP 256
+/* le_reset() gives memory back once a paste has grown the buffer beyond these */
+#define LE_SHRINK_CAP (64 * 1024)
+#define LE_SHRINK_LINES 1024
 
 struct LineEditor {
     char prompt[LE_MAX_PROMPT];
-    char buf[LE_MAX_INPUT];
-    size_t len;        /* bytes filled */
-    size_t cursor;     /* byte index where next insertion happens (0..len) */
+
+    char *buf;
+    size_t cap;        /* allocated bytes */
+    size_t gap_start;  /* logical index where the gap sits */
+    size_t gap_end;    /* physical index of first byte after the gap */
+    size_t cursor;     /* logical byte index where next insertion happens (0..len) */
+
+    /* cached layout, kept in sync by every edit so the GUI never re-splits the buffer:
+       byte length of each '\n'-separated line (the '\n' itself is not counted) and
+       the cursor's row / byte column within that row. nlines is always >= 1. */
+    size_t *line_lens;
+    size_t nlines;
+    size_t lines_cap;
+    size_t cur_row;
+    size_t cur_col;
 
     int term_mode;     /* if 1: terminal-mode redraws (write to stdout);
                           if 0: GUI mode (no stdout writes) */
@@ -36,66 +55,191 @@ static ssize_t safe_write(const void *p, size_t n) {
     return total;
 }
 
+/* ---------- gap buffer helpers ---------- */
+
+static size_t gap_len(const LineEditor *le) {
+    return le->gap_end - le->gap_start;
+}
+
+static size_t text_len(const LineEditor *le) {
+    return le->cap - gap_len(le);
+}
+
+/* byte at logical index i (caller guarantees i < text_len) */
+static unsigned char byte_at(const LineEditor *le, size_t i) {
+    if (i < le->gap_start) return (unsigned char)le->buf[i];
+    return (unsigned char)le->buf[i + gap_len(le)];
+}
+
+/* move the gap so that it starts at logical index pos */
+static void gap_move(LineEditor *le, size_t pos) {
+    if (pos < le->gap_start) {
+        size_t n = le->gap_start - pos;
+        memmove(le->buf + le->gap_end - n, le->buf + pos, n);
+        le->gap_start -= n;
+        le->gap_end -= n;
+    } else if (pos > le->gap_start) {
+        size_t n = pos - le->gap_start;
+        memmove(le->buf + le->gap_start, le->buf + le->gap_end, n);
+        le->gap_start += n;
+        le->gap_end += n;
+    }
+}
+
+/* ensure the gap can take `need` bytes plus one spare byte (used for NUL termination) */
+static int gap_reserve(LineEditor *le, size_t need) {
+    if (gap_len(le) >= need + 1) return 0;
+    size_t len = text_len(le);
+    size_t nc = le->cap ? le->cap * 2 : LE_INITIAL_CAP;
+    while (nc < len + need + 1) nc *= 2;
+    char *p = realloc(le->buf, nc);
+    if (!p) return -1;
+    size_t tail = le->cap - le->gap_end;
+    memmove(p + nc - tail, p + le->gap_end, tail);
+    le->buf = p;
+    le->gap_end = nc - tail;
+    le->cap = nc;
+    return 0;
+}
+
+/* ---------- layout cache helpers ---------- */
+
+static void layout_clear(LineEditor *le) {
+    le->nlines = 1;
+    le->line_lens[0] = 0;
+    le->cur_row = 0;
+    le->cur_col = 0;
+}
+
+/* make room for `extra` more rows; returns 0 on success */
+static int layout_reserve(LineEditor *le, size_t extra) {
+    if (le->nlines + extra <= le->lines_cap) return 0;
+    size_t nc = le->lines_cap ? le->lines_cap * 2 : 8;
+    while (nc < le->nlines + extra) nc *= 2;
+    size_t *p = realloc(le->line_lens, nc * sizeof(*p));
+    if (!p) return -1;
+    le->line_lens = p;
+    le->lines_cap = nc;
+    return 0;
+}
+
+/* account for `n` bytes of `data` inserted at the cursor (before cursor advances).
+   Work is O(n) for the inserted bytes; rows are only shifted when newlines are inserted. */
+static int layout_insert(LineEditor *le, const char *data, size_t n) {
+    size_t nl = 0;
+    const char *last_nl = NULL;
+    for (const char *p = data; p < data + n; ++p) {
+        if (*p == '\n') { nl++; last_nl = p; }
+    }
+    if (nl == 0) {
+        le->line_lens[le->cur_row] += n;
+        le->cur_col += n;
+        return 0;
+    }
+    if (layout_reserve(le, nl) != 0) return -1;
+
+    size_t row = le->cur_row;
+    size_t tail = le->line_lens[row] - le->cur_col;
+    memmove(&le->line_lens[row + 1 + nl], &le->line_lens[row + 1],
+            (le->nlines - row - 1) * sizeof(size_t));
+    le->nlines += nl;
+
+    /* first row keeps its head, middle rows are whole segments, last row gets the old tail */
+    const char *seg = data;
+    size_t r = row;
+    for (const char *p = data; p < data + n; ++p) {
+        if (*p != '\n') continue;
+        size_t seglen = (size_t)(p - seg);
+        le->line_lens[r] = (r == row) ? le->cur_col + seglen : seglen;
+        r++;
+        seg = p + 1;
+    }
+    size_t last_len = (size_t)(data + n - (last_nl + 1));
+    le->line_lens[r] = last_len + tail;
+    le->cur_row = r;
+    le->cur_col = last_len;
+    return 0;
+}
+
+/* account for the `n` bytes at `data` ending exactly at the cursor being removed */
+static void layout_delete_before_cursor(LineEditor *le, const char *data, size_t n) {
+    size_t nl = 0;
+    const char *first_nl = NULL;
+    for (const char *p = data; p < data + n; ++p) {
+        if (*p == '\n') { if (!first_nl) first_nl = p; nl++; }
+    }
+    if (nl == 0) {
+        le->line_lens[le->cur_row] -= n;
+        le->cur_col -= n;
+        return;
+    }
+    size_t top = le->cur_row - nl;
+    size_t tail = le->line_lens[le->cur_row] - le->cur_col;
+    size_t head = le->line_lens[top] - (size_t)(first_nl - data);
+    le->line_lens[top] = head + tail;
+    memmove(&le->line_lens[top + 1], &le->line_lens[le->cur_row + 1],
+            (le->nlines - le->cur_row - 1) * sizeof(size_t));
+    le->nlines -= nl;
+    le->cur_row = top;
+    le->cur_col = head;
+}
+
+/* account for the `n` bytes at `data` starting exactly at the cursor being removed */
+static void layout_delete_after_cursor(LineEditor *le, const char *data, size_t n) {
+    size_t nl = 0;
+    const char *last_nl = NULL;
+    for (const char *p = data; p < data + n; ++p) {
+        if (*p == '\n') { nl++; last_nl = p; }
+    }
+    size_t row = le->cur_row;
+    if (nl == 0) {
+        le->line_lens[row] -= n;
+        return;
+    }
+    size_t consumed = (size_t)(data + n - (last_nl + 1));
+    le->line_lens[row] = le->cur_col + (le->line_lens[row + nl] - consumed);
+    memmove(&le->line_lens[row + 1], &le->line_lens[row + nl + 1],
+            (le->nlines - row - nl - 1) * sizeof(size_t));
+    le->nlines -= nl;
+}
+
+static void layout_cursor_home(LineEditor *le) {
+    le->cur_row = 0;
+    le->cur_col = 0;
+}
+
+static void layout_cursor_end(LineEditor *le) {
+    le->cur_row = le->nlines - 1;
+    le->cur_col = le->line_lens[le->cur_row];
+}
+
 LineEditor *le_create(const char *prompt) {
     LineEditor *le = calloc(1, sizeof(*le));
     if (!le) return NULL;
-    le->len = 0;
     le->cursor = 0;
+    if (gap_reserve(le, 0) != 0 || layout_reserve(le, 1) != 0) {
+        free(le->buf);
+        free(le);
+        return NULL;
+    }
+    layout_clear(le);
     if (prompt) {
         strncpy(le->prompt, prompt, LE_MAX_PROMPT-1);
         le->prompt[LE_MAX_PROMPT-1] = '\0';
     } else {
         le->prompt[0] = '\0';
     }
-    le->buf[0] = '\0';
     le->term_mode = 1; /* default: terminal mode enabled */
     return le;
 }
 
 void le_destroy(LineEditor *le) {
-    free(le);
-}
-
-/* UTF-8 aware backspace helper for LineEditor.
-   Uses fields: le->buf (char[] or char*), le->len (size_t), le->cursor (size_t).
-   Adjust names only if your struct uses different identifiers. */
-void le_backspace(LineEditor *le)
-{
     if (!le) return;
-
-    /* If cursor is zero, nothing to delete */
-    if (le->cursor == 0) return;
-
-    /* Determine byte index of previous codepoint start (UTF-8 aware) */
-    size_t idx = le->cursor;
-
-    /* Move back at least one byte */
-    if (idx > 0) idx--;
-
-    /* If we're in the middle of a UTF-8 continuation byte (10xxxxxx),
-       back up until we reach the start byte (not a continuation). */
-    while (idx > 0 && ((unsigned char)le->buf[idx] & 0xC0) == 0x80) {
-        idx--;
-    }
-
-    /* Number of bytes to remove */
-    size_t remove_bytes = le->cursor - idx;
-    if (remove_bytes == 0) return;
-
-    /* Shift the remainder of the buffer left */
-    size_t tail_start = le->cursor;
-    size_t tail_len = (le->len > tail_start) ? (le->len - tail_start) : 0;
-
-    memmove(&le->buf[idx], &le->buf[tail_start], tail_len + 1); /* include NUL */
-    le->len -= remove_bytes;
-    le->cursor = idx;
-
-    /* Ensure NUL terminated */
-    if (le->len < (size_t)-1) le->buf[le->len] = '\0';
+    free(le->buf);
+    free(le->line_lens);
+    free(le);
 }
 
-
-
 void le_set_prompt(LineEditor *le, const char *prompt) {
     if (!le) return;
     if (prompt) {
@@ -112,51 +256,185 @@ void le_set_term_mode(LineEditor *le, int enabled) {
     le->term_mode = enabled ? 1 : 0;
 }
 
+/* Contiguous view: closes the gap by moving it to the end, which costs
+   O(bytes after the gap). Prefer le_get_spans() on hot paths. */
 const char *le_get_buffer(LineEditor *le) {
-    return le ? le->buf : NULL;
+    if (!le) return NULL;
+    gap_move(le, text_len(le));
+    le->buf[le->gap_start] = '\0'; /* gap always has at least one spare byte */
+    return le->buf;
+}
+
+char *le_dup_buffer(LineEditor *le) {
+    if (!le) return NULL;
+    size_t len = text_len(le);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, le->buf, le->gap_start);
+    memcpy(out + le->gap_start, le->buf + le->gap_end, len - le->gap_start);
+    out[len] = '\0';
+    return out;
+}
+
+int le_get_spans(LineEditor *le, size_t off, size_t n,
+                 const char **a, size_t *alen, const char **b, size_t *blen) {
+    *a = *b = NULL;
+    *alen = *blen = 0;
+    if (!le) return 0;
+    size_t len = text_len(le);
+    if (off > len) off = len;
+    if (n > len - off) n = len - off;
+    if (n == 0) return 0;
+    int count = 0;
+    if (off < le->gap_start) {
+        size_t first = le->gap_start - off;
+        if (first > n) first = n;
+        *a = le->buf + off;
+        *alen = first;
+        count = 1;
+        off += first;
+        n -= first;
+    }
+    if (n > 0) {
+        const char *p = le->buf + off + gap_len(le);
+        if (count == 0) { *a = p; *alen = n; }
+        else { *b = p; *blen = n; }
+        count++;
+    }
+    return count;
 }
 
 size_t le_get_length(LineEditor *le) {
-    return le ? le->len : 0;
+    return le ? text_len(le) : 0;
 }
 
 size_t le_get_cursor(LineEditor *le) {
     return le ? le->cursor : 0;
 }
 
+size_t le_get_line_count(LineEditor *le) {
+    return le ? le->nlines : 1;
+}
+
+size_t le_get_line_length(LineEditor *le, size_t row) {
+    if (!le || row >= le->nlines) return 0;
+    return le->line_lens[row];
+}
+
+void le_get_cursor_rowcol(LineEditor *le, size_t *row, size_t *col) {
+    if (row) *row = le ? le->cur_row : 0;
+    if (col) *col = le ? le->cur_col : 0;
+}
+
 void le_reset(LineEditor *le) {
     if (!le) return;
-    le->len = 0;
+    /* the buffer is empty from here on, so nothing needs to move; if realloc fails
+       the larger block is simply kept */
+    if (le->cap > LE_SHRINK_CAP) {
+        char *p = realloc(le->buf, LE_INITIAL_CAP);
+        if (p) {
+            le->buf = p;
+            le->cap = LE_INITIAL_CAP;
+        }
+    }
+    if (le->lines_cap > LE_SHRINK_LINES) {
+        size_t *p = realloc(le->line_lens, 8 * sizeof(*p));
+        if (p) {
+            le->line_lens = p;
+            le->lines_cap = 8;
+        }
+    }
+    le->gap_start = 0;
+    le->gap_end = le->cap;
     le->cursor = 0;
-    le->buf[0] = '\0';
+    layout_clear(le);
 }
 
 /* internal: insert bytes at cursor */
 static void insert_bytes_at(LineEditor *le, const char *data, size_t n) {
     if (!le || n == 0) return;
-    if (le->len + n >= LE_MAX_INPUT - 1) {
-        /* truncate to fit */
-        n = (LE_MAX_INPUT - 1) - le->len;
-        if (n == 0) return;
-    }
-    /* shift tail right */
-    memmove(le->buf + le->cursor + n, le->buf + le->cursor, le->len - le->cursor + 1); /* +1 for '\0' */
-    memcpy(le->buf + le->cursor, data, n);
+    if (gap_reserve(le, n) != 0) return;
+    if (layout_insert(le, data, n) != 0) return;
+    gap_move(le, le->cursor);
+    memcpy(le->buf + le->gap_start, data, n);
+    le->gap_start += n;
     le->cursor += n;
-    le->len += n;
+}
+
+/* internal: delete the `n` bytes ending at the cursor */
+static void delete_before_cursor(LineEditor *le, size_t n) {
+    if (n == 0 || n > le->cursor) return;
+    gap_move(le, le->cursor);
+    layout_delete_before_cursor(le, le->buf + le->gap_start - n, n);
+    le->gap_start -= n;
+    le->cursor -= n;
+}
+
+/* internal: byte length of the code point ending at the cursor */
+static size_t prev_codepoint_len(const LineEditor *le) {
+    if (le->cursor == 0) return 0;
+    size_t i = le->cursor - 1;
+    /* skip continuation bytes */
+    while (i > 0 && (byte_at(le, i) & 0xC0) == 0x80) --i;
+    return le->cursor - i;
+}
+
+/* internal: byte length of the code point starting at the cursor */
+static size_t next_codepoint_len(const LineEditor *le) {
+    size_t len = text_len(le);
+    if (le->cursor >= len) return 0;
+    size_t i = le->cursor + 1;
+    while (i < len && (byte_at(le, i) & 0xC0) == 0x80) ++i;
+    return i - le->cursor;
 }
 
 /* internal: delete previous UTF-8 codepoint before cursor */
 static void delete_prev_codepoint(LineEditor *le) {
     if (!le || le->cursor == 0) return;
-    int i = (int)le->cursor - 1;
-    /* skip continuation bytes */
-    while (i > 0 && (le->buf[i] & 0xC0) == 0x80) --i;
-    int remove_from = i;
-    int remove_len = (int)le->cursor - remove_from;
-    memmove(le->buf + remove_from, le->buf + le->cursor, le->len - le->cursor + 1);
-    le->cursor = remove_from;
-    le->len -= remove_len;
+    delete_before_cursor(le, prev_codepoint_len(le));
+}
+
+/* UTF-8 aware backspace (used by GUI prompts that bypass le_feed_byte) */
+void le_backspace(LineEditor *le) {
+    delete_prev_codepoint(le);
+}
+
+void le_delete_forward(LineEditor *le) {
+    if (!le) return;
+    size_t n = next_codepoint_len(le);
+    if (n == 0) return;
+    gap_move(le, le->cursor);
+    layout_delete_after_cursor(le, le->buf + le->gap_end, n);
+    le->gap_end += n;
+    if (le->term_mode) le_redraw_terminal(le);
+}
+
+void le_move_left(LineEditor *le) {
+    if (!le || le->cursor == 0) return;
+    size_t n = prev_codepoint_len(le);
+    le->cursor -= n;
+    if (le->cur_col == 0) {
+        /* stepped back over the '\n' that ends the previous row */
+        le->cur_row--;
+        le->cur_col = le->line_lens[le->cur_row];
+    } else {
+        le->cur_col -= n;
+    }
+    if (le->term_mode) le_redraw_terminal(le);
+}
+
+void le_move_right(LineEditor *le) {
+    if (!le) return;
+    size_t n = next_codepoint_len(le);
+    if (n == 0) return;
+    if (byte_at(le, le->cursor) == '\n') {
+        le->cur_row++;
+        le->cur_col = 0;
+    } else {
+        le->cur_col += n;
+    }
+    le->cursor += n;
+    if (le->term_mode) le_redraw_terminal(le);
 }
 
 /* forward declaration - redraw only to terminal */
@@ -168,11 +446,13 @@ void le_feed_byte(LineEditor *le, unsigned char b) {
     /* control characters */
     if (b == 0x01) { /* Ctrl-A: go to start */
         le->cursor = 0;
+        layout_cursor_home(le);
         if (le->term_mode) le_redraw_terminal(le);
         return;
     }
     if (b == 0x05) { /* Ctrl-E: go to end */
-        le->cursor = le->len;
+        le->cursor = text_len(le);
+        layout_cursor_end(le);
         if (le->term_mode) le_redraw_terminal(le);
         return;
     }
@@ -212,8 +492,9 @@ void le_redraw_terminal(LineEditor *le) {
     int plen = snprintf(head, sizeof(head), "\r%s", le->prompt);
     safe_write(head, (size_t)plen);
 
-    /* write the whole buffer */
-    safe_write(le->buf, le->len);
+    /* write the whole buffer (both sides of the gap) */
+    safe_write(le->buf, le->gap_start);
+    safe_write(le->buf + le->gap_end, le->cap - le->gap_end);
 
     /* clear to end of line */
     safe_write("\x1b[K", 3);
@@ -233,43 +514,12 @@ void le_redraw_terminal(LineEditor *le) {
 void le_replace_last_word(LineEditor *le, const char *s) {
     if (!le || !s) return;
 
-    /* find token start: scan backwards from cursor-1 until whitespace or start */
-    ssize_t cur = (ssize_t)le->cursor;
-    ssize_t i = cur - 1;
-    if (i < 0) i = cur - 1; /* if at 0, will handle below */
+    /* Move back from the cursor until whitespace (space, tab, newline) or beginning */
+    size_t token_start = le->cursor;
+    while (token_start > 0 && byte_at(le, token_start - 1) > ' ')
+        --token_start;
 
-    /* If buffer empty, just insert */
-    if (le->len == 0) {
-        insert_bytes_at(le, s, strlen(s));
-        return;
-    }
-
-    /* Clamp i within buffer */
-    if (i >= (ssize_t)le->len) i = (ssize_t)le->len - 1;
-    if (i < 0) {
-        /* nothing before cursor */
-        insert_bytes_at(le, s, strlen(s));
-        return;
-    }
-
-    /* Move back until whitespace (space, tab, newline) or beginning */
-    while (i >= 0 && (unsigned char)le->buf[i] > ' ')
-        --i;
-    ssize_t token_start = i + 1;
-    if (token_start < 0) token_start = 0;
-    if (token_start > (ssize_t)le->len) token_start = (ssize_t)le->len;
-
-    /* Delete original token (from token_start to cursor) */
-    ssize_t rem = (ssize_t)le->cursor - token_start;
-    if (rem > 0) {
-        memmove(le->buf + token_start, le->buf + le->cursor, le->len - le->cursor + 1);
-        le->len -= rem;
-        le->cursor = (size_t)token_start;
-    }
-
-    /* Now insert new string at token_start */
-    size_t s_len = strlen(s);
-    insert_bytes_at(le, s, s_len);
+    /* Delete original token (from token_start to cursor), then insert s there */
+    delete_before_cursor(le, le->cursor - token_start);
+    insert_bytes_at(le, s, strlen(s));
 }
-
-
@@ -10,6 +10,8 @@
 #include <sys/select.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
@@ -23,8 +25,12 @@
 #include "line_edit.h"
 #include "history.h"
 #include "autocomplete.h"
+#include "reactor.h"
 
 #define PROMPT "rounak@goatedterm> "
+/* longest prefix of one input line that is drawn/measured, so a huge pasted line
+   does not make every redraw walk megabytes of text */
+#define INPUT_DRAW_MAX 4096
 static Display *dpy = NULL;
 static Window win;
 static GC gc;
@@ -39,6 +45,28 @@ static int active = -1;
 /* background reader threads set this to request a GUI redraw */
 volatile sig_atomic_t need_redraw = 0;
 
+/* output arriving for the active tab is drawn at most once per frame; input and
+   window events still redraw immediately through need_redraw */
+#define FRAME_MS 16
+static int output_dirty = 0;
+static long last_frame_ms = 0;
+
+static long monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* switch tabs: the ingest scheduler favours the tab on screen, and only its output
+   is indexed and redrawn as it arrives */
+static void set_active(int idx)
+{
+    active = idx;
+    tabs_set_active(idx);
+    reactor_set_foreground(idx);
+}
+
 // ✅ Add this safe signal flag (used instead of calling multiwatch directly)
 volatile sig_atomic_t interrupt_flag = 0;
 
@@ -57,6 +85,10 @@ static void setup_signal_handlers(void)
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
+
+    /* writes to a child that exited must fail with EPIPE instead of killing the GUI;
+       launch_spawn() restores SIG_DFL in every child */
+    signal(SIGPIPE, SIG_IGN);
 }
 
 /* We keep notify_pipe local t#ifndef GLOB_TILDE
@@ -91,6 +123,17 @@ static void die(const char *s)
     exit(EXIT_FAILURE);
 }
 
+/* selection requestors may disappear mid-transfer; their BadWindow errors are harmless */
+static int x_error_handler(Display *d, XErrorEvent *e)
+{
+    if (e->error_code == BadWindow)
+        return 0;
+    char msg[128];
+    XGetErrorText(d, e->error_code, msg, sizeof(msg));
+    fprintf(stderr, "X error: %s (request %d)\n", msg, e->request_code);
+    return 0;
+}
+
 /* ---------- helper: detect if input has an unclosed quote ---------- */
 static int input_has_unclosed_quote_buf(const char *s, size_t n)
 {
@@ -108,101 +151,722 @@ static int input_has_unclosed_quote_buf(const char *s, size_t n)
     return (in_single || in_double);
 }
 
-/* ---------- helper: get clipboard text via X11 selection (synchronous) ---------- */
-static char *get_clipboard_text(Display *d)
+/* ---------- clipboard paste: asynchronous state machine driven by the event loop ----------
+   Ctrl+V only asks the selection owner to convert; the data then arrives through
+   SelectionNotify (small selections, read in one go) or, for large selections, through
+   the INCR protocol: the owner writes one chunk at a time into our property and we
+   delete it after each PropertyNotify to request the next. Every chunk is handed to
+   paste_deliver() as it arrives, so rendering keeps going while tens of MB stream in. */
+#define PASTE_TIMEOUT_SEC 3
+#define PASTE_READ_LONGS (64 * 1024) /* property read size, in 32-bit units */
+
+enum
+{
+    PASTE_IDLE,
+    PASTE_WAIT_NOTIFY, /* XConvertSelection sent, waiting for SelectionNotify */
+    PASTE_INCR         /* INCR transfer in progress, waiting for PropertyNotify */
+};
+
+static struct
+{
+    int state;
+    int tab;        /* tab the pasted bytes go to */
+    Atom selection; /* CLIPBOARD or PRIMARY */
+    Atom target;    /* UTF8_STRING, falling back to STRING */
+    time_t last_activity;
+    size_t received;
+} paste = {PASTE_IDLE, -1, None, None, 0, 0};
+
+static Atom atom_clipboard = None;
+static Atom atom_utf8 = None;
+static Atom atom_incr = None;
+static Atom atom_paste_prop = None;
+
+static void paste_init_atoms(void)
+{
+    atom_clipboard = XInternAtom(dpy, "CLIPBOARD", False);
+    atom_utf8 = XInternAtom(dpy, "UTF8_STRING", False);
+    atom_incr = XInternAtom(dpy, "INCR", False);
+    atom_paste_prop = XInternAtom(dpy, "MY_TERM_CLIP", False);
+}
+
+/* hand one chunk to the tab: a running foreground job gets it on its stdin pipe;
+   with no such pipe (no job, or one that does not read the tab) it is inserted into
+   the line editor. Pasted text never goes to the tab's shell. */
+static void paste_deliver(int tab_idx, const char *data, size_t n)
 {
-    if (!d)
-        return NULL;
-    Atom clip = XInternAtom(d, "CLIPBOARD", False);
-    Atom utf8 = XInternAtom(d, "UTF8_STRING", False);
-    Atom prop = XInternAtom(d, "MY_TERM_CLIP", False);
-    Window owner = XGetSelectionOwner(d, clip);
-    if (owner == None)
+    Tab *t = tabs_get(tab_idx);
+    if (!t || n == 0)
+        return;
+    if (cmd_exec_send_input(tab_idx, data, n) != 0)
+        le_feed_bytes(t->editor, data, n);
+    paste.received += n;
+    need_redraw = 1;
+}
+
+static void paste_finish(void)
+{
+    paste.state = PASTE_IDLE;
+    paste.tab = -1;
+    XDeleteProperty(dpy, win, atom_paste_prop);
+}
+
+/* begin a paste into tab_idx (no-op if one is already in flight) */
+static void paste_begin(int tab_idx)
+{
+    if (paste.state != PASTE_IDLE)
+        return;
+    Atom sel = atom_clipboard;
+    if (XGetSelectionOwner(dpy, sel) == None)
     {
-        owner = XGetSelectionOwner(d, XA_PRIMARY);
-        if (owner == None)
-            return NULL;
+        sel = XA_PRIMARY;
+        if (XGetSelectionOwner(dpy, sel) == None)
+            return;
     }
+    paste.state = PASTE_WAIT_NOTIFY;
+    paste.tab = tab_idx;
+    paste.selection = sel;
+    paste.target = atom_utf8;
+    paste.received = 0;
+    paste.last_activity = time(NULL);
+    XDeleteProperty(dpy, win, atom_paste_prop);
+    XConvertSelection(dpy, sel, atom_utf8, atom_paste_prop, win, CurrentTime);
+    XFlush(dpy);
+}
 
-    XConvertSelection(d, clip, utf8, prop, win, CurrentTime);
-
-    XEvent ev;
-    time_t start = time(NULL);
-    while (1)
+/* read and delete our property, delivering its contents piecewise.
+   Returns the number of bytes read, or -1 on error. *type_out gets the property type. */
+static long paste_drain_property(Atom *type_out)
+{
+    long offset = 0;
+    long total = 0;
+    *type_out = None;
+    for (;;)
     {
-        if (XCheckTypedWindowEvent(d, win, SelectionNotify, &ev))
+        Atom actual_type;
+        int actual_format;
+        unsigned long nitems, bytes_after;
+        unsigned char *data = NULL;
+        int rc = XGetWindowProperty(dpy, win, atom_paste_prop, offset, PASTE_READ_LONGS, False,
+                                    AnyPropertyType, &actual_type, &actual_format,
+                                    &nitems, &bytes_after, &data);
+        if (rc != Success)
+            return -1;
+        *type_out = actual_type;
+        if (actual_type == atom_incr)
         {
-            XSelectionEvent *sev = (XSelectionEvent *)&ev;
-            if (sev->property == None)
-            {
-                return NULL;
-            }
-            Atom actual_type;
-            int actual_format;
-            unsigned long nitems, bytes_after;
-            unsigned char *data = NULL;
-            int rc = XGetWindowProperty(d, win, prop, 0, (~0L), False, AnyPropertyType,
-                                        &actual_type, &actual_format, &nitems, &bytes_after, &data);
-            if (rc != Success || data == NULL)
-                return NULL;
-            char *out = malloc(nitems + 1);
-            if (!out)
-            {
+            /* INCR announcement: payload is only a size hint */
+            if (data)
                 XFree(data);
-                return NULL;
-            }
-            memcpy(out, data, nitems);
-            out[nitems] = '\0';
+            break;
+        }
+        size_t nbytes = nitems * (size_t)(actual_format / 8);
+        if (data && nbytes > 0 && actual_format == 8)
+            paste_deliver(paste.tab, (const char *)data, nbytes);
+        if (data)
             XFree(data);
-            XDeleteProperty(d, win, prop);
-            return out;
+        total += (long)nbytes;
+        offset += (long)(nbytes / 4);
+        if (bytes_after == 0 || nbytes == 0)
+            break;
+    }
+    /* deleting the property is also the INCR "send next chunk" signal */
+    XDeleteProperty(dpy, win, atom_paste_prop);
+    return total;
+}
+
+static void paste_on_selection_notify(XSelectionEvent *sev)
+{
+    if (paste.state != PASTE_WAIT_NOTIFY || sev->requestor != win || sev->selection != paste.selection)
+        return;
+    if (sev->property == None)
+    {
+        /* owner refused UTF8_STRING: retry once with plain STRING */
+        if (paste.target == atom_utf8)
+        {
+            paste.target = XA_STRING;
+            paste.last_activity = time(NULL);
+            XConvertSelection(dpy, paste.selection, XA_STRING, atom_paste_prop, win, CurrentTime);
+            XFlush(dpy);
+            return;
         }
-        if (time(NULL) - start > 1)
-            return NULL;
-        usleep(5000);
+        paste_finish();
+        return;
+    }
+    Atom type;
+    if (paste_drain_property(&type) < 0)
+    {
+        paste_finish();
+        return;
+    }
+    if (type == atom_incr)
+    {
+        paste.state = PASTE_INCR;
+        paste.last_activity = time(NULL);
+        XFlush(dpy);
+        return;
+    }
+    paste_finish();
+}
+
+static void paste_on_property_notify(XPropertyEvent *pev)
+{
+    if (paste.state != PASTE_INCR || pev->window != win || pev->atom != atom_paste_prop ||
+        pev->state != PropertyNewValue)
+        return;
+    Atom type;
+    long got = paste_drain_property(&type);
+    paste.last_activity = time(NULL);
+    /* a zero-length chunk terminates the INCR transfer */
+    if (got <= 0)
+        paste_finish();
+    else
+        XFlush(dpy);
+}
+
+/* keep the paste target index valid when a tab is closed */
+static void paste_on_tab_closed(int idx)
+{
+    if (paste.state == PASTE_IDLE)
+        return;
+    if (paste.tab == idx)
+        paste_finish();
+    else if (paste.tab > idx)
+        paste.tab--;
+}
+
+/* Ctrl+C while a paste is being fetched or fed to the child: stop the clipboard
+   transfer and drop whatever is still queued. Returns 1 if there was anything to cancel. */
+static int paste_cancel(int tab_idx)
+{
+    int cancelled = 0;
+    if (paste.state != PASTE_IDLE && paste.tab == tab_idx)
+    {
+        paste_finish();
+        cancelled = 1;
+    }
+    size_t dropped = tabs_cancel_input(tab_idx);
+    if (cancelled || dropped > 0)
+    {
+        char msg[128];
+        int L = snprintf(msg, sizeof(msg), "\n[paste cancelled: %zu queued bytes not sent]\n", dropped);
+        tabs_append_output(tab_idx, msg, (ssize_t)L);
+        return 1;
+    }
+    return 0;
+}
+
+/* called once per loop iteration: drop transfers whose owner went silent */
+static void paste_check_timeout(void)
+{
+    if (paste.state != PASTE_IDLE && time(NULL) - paste.last_activity > PASTE_TIMEOUT_SEC)
+        paste_finish();
+}
+
+/* ---------- helper: draw `len` bytes of a UTF-8 string using fontset (multibyte) ---------- */
+static void draw_utf8_n(const char *s, size_t len, int x, int y)
+{
+    if (!s || len == 0)
+        return;
+    if (!fontset || !dpy)
+    {
+        XDrawString(dpy, win, gc, x, y, s, (int)len);
+    }
+    else
+    {
+        XmbDrawString(dpy, win, fontset, gc, x, y, s, (int)len);
     }
 }
 
-/* ---------- helper: draw a single UTF-8 string using fontset (multibyte) ---------- */
 static void draw_utf8(const char *s, int x, int y)
 {
     if (!s)
         return;
+    draw_utf8_n(s, strlen(s), x, y);
+}
+
+/* ---------- helper: width in pixels of the first `len` bytes of a UTF-8 string ---------- */
+static int utf8_width_n(const char *s, size_t len)
+{
+    if (!s || len == 0)
+        return 0;
     if (!fontset || !dpy)
     {
-        XDrawString(dpy, win, gc, x, y, s, (int)strlen(s));
+        return XTextWidth(fontinfo, s, (int)len);
     }
     else
     {
-        XmbDrawString(dpy, win, fontset, gc, x, y, s, (int)strlen(s));
+        return XmbTextEscapement(fontset, s, (int)len);
     }
 }
 
-/* ---------- helper: width of a UTF-8 string in pixels ---------- */
 static int utf8_width(const char *s)
 {
     if (!s)
         return 0;
-    if (!fontset || !dpy)
+    return utf8_width_n(s, strlen(s));
+}
+
+/* ---------- output view geometry (written by redraw, read by mouse handling) ---------- */
+static struct
+{
+    int tab;           /* tab the geometry belongs to (-1: nothing drawn) */
+    size_t first_line; /* index of the top visible output line */
+    size_t rows;       /* visible output lines */
+    int top;           /* y of the top of the first row */
+} view = {-1, 0, 0, 0};
+
+/* longest prefix of one output line that is drawn/hit-tested */
+#define OUTPUT_DRAW_MAX 4096
+
+/* largest n <= max such that s[0..n) ends on a code point boundary */
+static size_t utf8_clamp(const char *s, size_t len, size_t max)
+{
+    if (len <= max)
+        return len;
+    size_t n = max;
+    while (n > 0 && ((unsigned char)s[n] & 0xC0) == 0x80)
+        n--;
+    return n;
+}
+
+static size_t utf8_cplen(const char *s, size_t len)
+{
+    unsigned char c = (unsigned char)s[0];
+    size_t n = 1;
+    if (c >= 0xF0)
+        n = 4;
+    else if (c >= 0xE0)
+        n = 3;
+    else if (c >= 0xC0)
+        n = 2;
+    return n < len ? n : len;
+}
+
+/* ---------- mouse selection over the output, served to other clients on demand ----------
+   A selection is a byte range [lo, hi) of a tab's out_buf. The buffer only ever grows, so
+   offsets stay valid and nothing is copied when the selection is made: we take ownership
+   of PRIMARY (on release) or CLIPBOARD (Ctrl+Shift+C) and copy bytes out of out_buf only
+   when a SelectionRequest arrives. Anything larger than one request goes through INCR,
+   one chunk per PropertyDelete from the requestor. */
+#define SEL_MULTICLICK_MS 400
+#define SEL_CHUNK (256 * 1024)
+#define SEL_MAX_XFERS 8
+
+enum
+{
+    SEL_UNIT_CHAR = 1,
+    SEL_UNIT_WORD,
+    SEL_UNIT_LINE
+};
+
+static struct
+{
+    int tab;          /* -1: no selection */
+    size_t lo, hi;    /* current selection */
+    size_t alo, ahi;  /* unit (char/word/line) under the initial click */
+    int unit;
+    int dragging;
+    Time last_click;
+    int clicks;
+    int click_x, click_y;
+} sel = {-1, 0, 0, 0, 0, SEL_UNIT_CHAR, 0, 0, 0, 0, 0};
+
+/* what we advertise as PRIMARY / CLIPBOARD; tab == -1 when not owned */
+typedef struct
+{
+    int tab;
+    size_t lo, hi;
+} OwnedSel;
+static OwnedSel owned_primary = {-1, 0, 0};
+static OwnedSel owned_clipboard = {-1, 0, 0};
+
+/* an INCR transfer in flight towards one requestor */
+typedef struct
+{
+    int used;
+    Window requestor;
+    Atom property;
+    Atom type;
+    int tab;
+    size_t pos, end;
+    time_t last_activity;
+} SelXfer;
+static SelXfer xfers[SEL_MAX_XFERS];
+
+static Atom atom_targets = None;
+static size_t sel_chunk = SEL_CHUNK;
+
+static void sel_init(void)
+{
+    atom_targets = XInternAtom(dpy, "TARGETS", False);
+    /* one property write must fit in a single request */
+    long maxreq = XExtendedMaxRequestSize(dpy);
+    if (maxreq == 0)
+        maxreq = XMaxRequestSize(dpy);
+    size_t limit = (size_t)maxreq * 4 - 256;
+    if (sel_chunk > limit)
+        sel_chunk = limit;
+}
+
+static OwnedSel *sel_owned_for(Atom selection)
+{
+    if (selection == XA_PRIMARY)
+        return &owned_primary;
+    if (selection == atom_clipboard)
+        return &owned_clipboard;
+    return NULL;
+}
+
+static int is_word_byte(unsigned char c)
+{
+    return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || strchr("_-./~:@%+=,", c) != NULL;
+}
+
+/* expand off to the selection unit around it; caller holds t->lock */
+static void sel_unit_at(Tab *t, size_t off, int unit, size_t *lo, size_t *hi)
+{
+    *lo = *hi = off;
+    if (unit == SEL_UNIT_CHAR || off > t->out_len)
+        return;
+    size_t ls, le;
+    if (tabs_line_span_locked(t, tabs_line_of_offset_locked(t, off), &ls, &le) != 0)
+        return;
+    if (unit == SEL_UNIT_LINE)
+    {
+        *lo = ls;
+        *hi = le < t->out_len ? le + 1 : le; /* include the newline */
+        return;
+    }
+    const unsigned char *b = (const unsigned char *)t->out_buf;
+    if (off >= le || !is_word_byte(b[off]))
+    {
+        *hi = off < le ? off + utf8_cplen(t->out_buf + off, le - off) : off;
+        return;
+    }
+    size_t s = off, e = off;
+    while (s > ls && is_word_byte(b[s - 1]))
+        s--;
+    while (e < le && is_word_byte(b[e]))
+        e++;
+    *lo = s;
+    *hi = e;
+}
+
+/* byte offset in the active tab's out_buf under window position (mx, my); the row is
+   clamped into the visible range. Returns -1 if no output is shown. Caller holds t->lock. */
+static int output_offset_at_locked(Tab *t, int mx, int my, size_t *off_out)
+{
+    if (view.tab != active || view.rows == 0)
+        return -1;
+    int row = (my - view.top) / line_height;
+    if (my < view.top)
+        row = 0;
+    if (row >= (int)view.rows)
+        row = (int)view.rows - 1;
+    size_t ls, le;
+    if (tabs_line_span_locked(t, view.first_line + (size_t)row, &ls, &le) != 0)
+        return -1;
+    const char *s = t->out_buf + ls;
+    size_t n = utf8_clamp(s, le - ls, OUTPUT_DRAW_MAX);
+    int x = 6;
+    size_t p = 0;
+    while (p < n)
     {
-        return XTextWidth(fontinfo, s, (int)strlen(s));
+        size_t cl = utf8_cplen(s + p, n - p);
+        int w = utf8_width_n(s + p, cl);
+        if (mx < x + w / 2)
+            break;
+        x += w;
+        p += cl;
     }
+    *off_out = ls + (p < n ? p : le - ls);
+    return 0;
+}
+
+static void sel_update(size_t off)
+{
+    Tab *t = tabs_get(sel.tab);
+    if (!t)
+        return;
+    size_t lo, hi;
+    pthread_mutex_lock(&t->lock);
+    sel_unit_at(t, off, sel.unit, &lo, &hi);
+    pthread_mutex_unlock(&t->lock);
+    sel.lo = lo < sel.alo ? lo : sel.alo;
+    sel.hi = hi > sel.ahi ? hi : sel.ahi;
+}
+
+static void sel_on_button_press(XButtonEvent *bev)
+{
+    Tab *t = tabs_get(active);
+    if (!t)
+        return;
+    if (bev->button == Button4 || bev->button == Button5)
+    {
+        /* wheel: three lines per notch; redraw clamps at the top */
+        if (bev->button == Button4)
+            t->view_scroll += 3;
+        else
+            t->view_scroll = t->view_scroll > 3 ? t->view_scroll - 3 : 0;
+        need_redraw = 1;
+        return;
+    }
+    if (bev->button != Button1)
+        return;
+
+    int near = abs(bev->x - sel.click_x) < 4 && abs(bev->y - sel.click_y) < 4;
+    if (near && sel.tab == active && bev->time - sel.last_click < SEL_MULTICLICK_MS)
+        sel.clicks = sel.clicks % 3 + 1;
     else
+        sel.clicks = 1;
+    sel.last_click = bev->time;
+    sel.click_x = bev->x;
+    sel.click_y = bev->y;
+
+    size_t off;
+    pthread_mutex_lock(&t->lock);
+    int rc = output_offset_at_locked(t, bev->x, bev->y, &off);
+    if (rc == 0)
+        sel_unit_at(t, off, sel.clicks, &sel.alo, &sel.ahi);
+    pthread_mutex_unlock(&t->lock);
+    if (rc != 0 || bev->y < view.top || bev->y >= view.top + (int)view.rows * line_height)
     {
-        return XmbTextEscapement(fontset, s, (int)strlen(s));
+        sel.tab = -1;
+        need_redraw = 1;
+        return;
     }
+    sel.tab = active;
+    sel.unit = sel.clicks;
+    sel.lo = sel.alo;
+    sel.hi = sel.ahi;
+    sel.dragging = 1;
+    need_redraw = 1;
 }
 
-/* compute pixel width of first `bytes` bytes of utf8 string `s` */
-static int utf8_prefix_width(const char *s, size_t bytes)
+static void sel_on_motion(XMotionEvent *mev)
 {
-    if (!s || bytes == 0)
-        return 0;
-    char tmp[8192];
-    size_t cp = bytes < sizeof(tmp) - 1 ? bytes : (sizeof(tmp) - 1);
-    memcpy(tmp, s, cp);
-    tmp[cp] = '\0';
-    return utf8_width(tmp);
+    /* only the latest position matters */
+    XEvent next;
+    while (XCheckTypedWindowEvent(dpy, win, MotionNotify, &next))
+        mev = &next.xmotion;
+    if (!sel.dragging || sel.tab != active)
+        return;
+    Tab *t = tabs_get(active);
+    if (!t)
+        return;
+    /* dragging past the top/bottom edge scrolls one line per event */
+    if (mev->y < view.top && view.first_line > 0)
+    {
+        t->view_scroll++;
+        view.first_line--;
+    }
+    else if (mev->y > view.top + (int)view.rows * line_height && t->view_scroll > 0)
+    {
+        t->view_scroll--;
+        view.first_line++;
+    }
+    size_t off;
+    pthread_mutex_lock(&t->lock);
+    int rc = output_offset_at_locked(t, mev->x, mev->y, &off);
+    pthread_mutex_unlock(&t->lock);
+    if (rc == 0)
+        sel_update(off);
+    need_redraw = 1;
+}
+
+static void sel_take(Atom selection, Time when)
+{
+    OwnedSel *o = sel_owned_for(selection);
+    if (!o || sel.tab < 0 || sel.lo >= sel.hi)
+        return;
+    XSetSelectionOwner(dpy, selection, win, when);
+    if (XGetSelectionOwner(dpy, selection) != win)
+        return;
+    o->tab = sel.tab;
+    o->lo = sel.lo;
+    o->hi = sel.hi;
+}
+
+static void sel_on_button_release(XButtonEvent *bev)
+{
+    if (bev->button != Button1 || !sel.dragging)
+        return;
+    sel.dragging = 0;
+    sel_take(XA_PRIMARY, bev->time);
+}
+
+/* Ctrl+Shift+C */
+static void sel_copy_clipboard(Time when)
+{
+    sel_take(atom_clipboard, when);
+}
+
+static void sel_on_clear(XSelectionClearEvent *cev)
+{
+    OwnedSel *o = sel_owned_for(cev->selection);
+    if (o)
+        o->tab = -1;
+    /* another client took PRIMARY: drop the highlight like other terminals do */
+    if (cev->selection == XA_PRIMARY && !sel.dragging)
+    {
+        sel.tab = -1;
+        need_redraw = 1;
+    }
+}
+
+static void xfer_end(SelXfer *x)
+{
+    if (x->requestor != win)
+        XSelectInput(dpy, x->requestor, NoEventMask);
+    x->used = 0;
+}
+
+/* write out_buf[lo, lo+n) of tab into the property; a vanished tab yields n == 0 */
+static void sel_put_bytes(Window w, Atom prop, Atom type, int tab, size_t lo, size_t n)
+{
+    Tab *t = tabs_get(tab);
+    if (!t)
+    {
+        XChangeProperty(dpy, w, prop, type, 8, PropModeReplace, (const unsigned char *)"", 0);
+        return;
+    }
+    /* Xlib copies the bytes into its request buffer, so out_buf can be passed directly */
+    pthread_mutex_lock(&t->lock);
+    if (lo > t->out_len)
+        n = 0;
+    else if (n > t->out_len - lo)
+        n = t->out_len - lo;
+    XChangeProperty(dpy, w, prop, type, 8, PropModeReplace,
+                    (const unsigned char *)t->out_buf + lo, (int)n);
+    pthread_mutex_unlock(&t->lock);
+}
+
+static void sel_on_request(XSelectionRequestEvent *req)
+{
+    XSelectionEvent resp;
+    memset(&resp, 0, sizeof(resp));
+    resp.type = SelectionNotify;
+    resp.display = req->display;
+    resp.requestor = req->requestor;
+    resp.selection = req->selection;
+    resp.target = req->target;
+    resp.time = req->time;
+    resp.property = None;
+
+    /* obsolete clients pass None: use the target atom as the property */
+    Atom prop = req->property != None ? req->property : req->target;
+    OwnedSel *o = sel_owned_for(req->selection);
+    if (o && o->tab >= 0)
+    {
+        if (req->target == atom_targets)
+        {
+            Atom targets[3] = {atom_targets, atom_utf8, XA_STRING};
+            XChangeProperty(dpy, req->requestor, prop, XA_ATOM, 32, PropModeReplace,
+                            (const unsigned char *)targets, 3);
+            resp.property = prop;
+        }
+        else if (req->target == atom_utf8 || req->target == XA_STRING)
+        {
+            size_t len = o->hi - o->lo;
+            if (len <= sel_chunk)
+            {
+                sel_put_bytes(req->requestor, prop, req->target, o->tab, o->lo, len);
+                resp.property = prop;
+            }
+            else
+            {
+                SelXfer *x = NULL;
+                for (int i = 0; i < SEL_MAX_XFERS && !x; ++i)
+                    if (!xfers[i].used)
+                        x = &xfers[i];
+                if (x)
+                {
+                    /* announce INCR; the requestor deleting it asks for the first chunk */
+                    x->used = 1;
+                    x->requestor = req->requestor;
+                    x->property = prop;
+                    x->type = req->target;
+                    x->tab = o->tab;
+                    x->pos = o->lo;
+                    x->end = o->hi;
+                    x->last_activity = time(NULL);
+                    if (x->requestor != win)
+                        XSelectInput(dpy, x->requestor, PropertyChangeMask);
+                    long hint = len > LONG_MAX ? LONG_MAX : (long)len;
+                    XChangeProperty(dpy, req->requestor, prop, atom_incr, 32, PropModeReplace,
+                                    (const unsigned char *)&hint, 1);
+                    resp.property = prop;
+                }
+            }
+        }
+    }
+    XSendEvent(dpy, req->requestor, False, NoEventMask, (XEvent *)&resp);
+    XFlush(dpy);
+}
+
+static void sel_on_property_notify(XPropertyEvent *pev)
+{
+    if (pev->state != PropertyDelete)
+        return;
+    for (int i = 0; i < SEL_MAX_XFERS; ++i)
+    {
+        SelXfer *x = &xfers[i];
+        if (!x->used || x->requestor != pev->window || x->property != pev->atom)
+            continue;
+        size_t n = x->end - x->pos;
+        if (n > sel_chunk)
+            n = sel_chunk;
+        /* the zero-length write after the last chunk ends the transfer */
+        sel_put_bytes(x->requestor, x->property, x->type, x->tab, x->pos, n);
+        if (n == 0)
+            xfer_end(x);
+        else
+        {
+            x->pos += n;
+            x->last_activity = time(NULL);
+        }
+        XFlush(dpy);
+        return;
+    }
+}
+
+/* requestors that stop deleting the property (or went away) are dropped */
+static void sel_check_timeout(void)
+{
+    time_t now = time(NULL);
+    for (int i = 0; i < SEL_MAX_XFERS; ++i)
+        if (xfers[i].used && now - xfers[i].last_activity > PASTE_TIMEOUT_SEC)
+            xfer_end(&xfers[i]);
+}
+
+/* keep tab indices valid when a tab is closed; transfers from it finish empty */
+static void sel_on_tab_closed(int idx)
+{
+    OwnedSel *os[2] = {&owned_primary, &owned_clipboard};
+    for (int i = 0; i < 2; ++i)
+    {
+        if (os[i]->tab == idx)
+            os[i]->tab = -1;
+        else if (os[i]->tab > idx)
+            os[i]->tab--;
+    }
+    for (int i = 0; i < SEL_MAX_XFERS; ++i)
+    {
+        if (!xfers[i].used)
+            continue;
+        if (xfers[i].tab == idx)
+            xfers[i].tab = -1;
+        else if (xfers[i].tab > idx)
+            xfers[i].tab--;
+    }
+    if (sel.tab == idx)
+        sel.tab = -1;
+    else if (sel.tab > idx)
+        sel.tab--;
+    sel.dragging = 0;
+    view.tab = -1;
 }
 
 /* ---------- redraw main window (output first, prompt after output) ---------- */
@@ -242,6 +906,17 @@ static void redraw(void)
         x += w + 6;
     }
 
+    /* progress of a paste still being fed to the active tab's child */
+    size_t sent = 0, total = 0;
+    if (active >= 0 && tabs_input_progress(active, &sent, &total))
+    {
+        char prog[96];
+        snprintf(prog, sizeof(prog), "paste %.2f / %.2f MB  (Ctrl+C cancels)",
+                 sent / 1048576.0, total / 1048576.0);
+        XSetForeground(dpy, gc, WhitePixel(dpy, DefaultScreen(dpy)));
+        draw_utf8(prog, x + 12, 4 + fontinfo->ascent + 2);
+    }
+
     /* layout: output area begins below tab bar, prompt+input appears after output */
     int top = tab_h + 12;
     int bottom = win_h - 12;
@@ -260,290 +935,138 @@ static void redraw(void)
         /* read any available child output */
         tabs_read_once(active);
 
-        /* --- split output buffer into lines (outcopy + array of pointers) --- */
-        int total_lines = 0;
-        char *outcopy = NULL;
-        char **out_lines = NULL;
-        if (t->out_len > 0 && t->out_buf)
-        {
-            outcopy = malloc(t->out_len + 1);
-            if (outcopy)
-            {
-                memcpy(outcopy, t->out_buf, t->out_len);
-                outcopy[t->out_len] = '\0';
-                /* worst case number of lines <= out_len+1, but allocate modestly for memory */
-                /* We'll first count lines */
-                size_t cap = 64;
-                out_lines = malloc(sizeof(char *) * cap);
-                if (out_lines)
-                {
-                    char *p = outcopy;
-                    out_lines[total_lines++] = p;
-                    for (size_t i = 0; i < (size_t)t->out_len; ++i)
-                    {
-                        if (outcopy[i] == '\n')
-                        {
-                            outcopy[i] = '\0';
-                            if (i + 1 < (size_t)t->out_len)
-                            {
-                                if (total_lines >= (int)cap)
-                                {
-                                    cap *= 2;
-                                    char **tmp = realloc(out_lines, sizeof(char *) * cap);
-                                    if (!tmp)
-                                        break;
-                                    out_lines = tmp;
-                                }
-                                out_lines[total_lines++] = outcopy + i + 1;
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    free(outcopy);
-                    outcopy = NULL;
-                }
-            }
-        }
+        /* index this frame's share of new output; further frames follow while a
+           backlog remains (the reader is paused if it grows past the high mark) */
+        if (tabs_catch_up(active, TABS_INDEX_PER_FRAME))
+            output_dirty = 1;
 
         /* decide how many output lines to display, reserve rows for prompt+at least one input line */
         int reserve_for_input = 1;
         int can_show = max_lines - reserve_for_input;
         if (can_show < 0)
             can_show = 0;
-        int show_lines = 0;
-        if (out_lines && total_lines > 0)
-        {
-            show_lines = (total_lines <= can_show) ? total_lines : can_show;
-        }
 
         /* Starting y for first displayed output line (top-down) */
         int y = top + line_height;
 
-        /* If there are more total_lines than show_lines, display last show_lines */
-        int start_idx = (total_lines > show_lines) ? (total_lines - show_lines) : 0;
-        XSetForeground(dpy, gc, WhitePixel(dpy, DefaultScreen(dpy)));
-        for (int i = start_idx; out_lines && i < total_lines; ++i)
-        {
-            draw_utf8(out_lines[i], 6, y);
-            y += line_height;
-        }
-
-        /* --- Now draw the prompt at y (immediately after output) --- */
-        draw_utf8(PROMPT, 6, y);
-
-        /* --- prepare input buffer and cursor --- */
-        const char *buf = "";
-        size_t buflen = 0;
-        size_t cursor = 0; /* byte offset from buffer start */
-        if (t->editor)
-        {
-            buf = le_get_buffer(t->editor);
-            buflen = le_get_length(t->editor);
-            cursor = le_get_cursor(t->editor);
-        }
-        else
-        {
-            buf = t->input;
-            buflen = (size_t)t->input_len;
-            cursor = (size_t)t->input_pos;
-        }
-        if (!buf)
+        /* only the visible window of lines is touched, found through the line index;
+           view_scroll counts lines back from the bottom */
+        pthread_mutex_lock(&t->lock);
+        size_t total_lines = tabs_line_count_locked(t);
+        size_t show_lines = total_lines < (size_t)can_show ? total_lines : (size_t)can_show;
+        if (t->view_scroll > total_lines - show_lines)
+            t->view_scroll = total_lines - show_lines;
+        size_t start_idx = total_lines - show_lines - t->view_scroll;
+        view.tab = active;
+        view.first_line = start_idx;
+        view.rows = show_lines;
+        view.top = top + line_height - fontinfo->ascent;
+
+        int have_sel = (sel.tab == active && sel.lo < sel.hi);
+        unsigned long white = WhitePixel(dpy, DefaultScreen(dpy));
+        unsigned long black = BlackPixel(dpy, DefaultScreen(dpy));
+        XSetForeground(dpy, gc, white);
+        for (size_t i = start_idx; i < start_idx + show_lines; ++i)
         {
-            buf = "";
-            buflen = 0;
-            cursor = 0;
-        }
-
-        /* Split input buffer into lines (inplace using a copy) */
-        char *bufcopy = NULL;
-        char **in_lines = NULL;
-        int in_lines_count = 0;
-        if (buflen > 0)
-        {
-            bufcopy = malloc(buflen + 1);
-            if (bufcopy)
+            size_t ls, le;
+            tabs_line_span_locked(t, i, &ls, &le);
+            const char *s = t->out_buf + ls;
+            size_t n = utf8_clamp(s, le - ls, OUTPUT_DRAW_MAX);
+            draw_utf8_n(s, n, 6, y);
+            /* selection highlight: white box with the selected text redrawn in black;
+               a selected newline shows as one extra cell */
+            if (have_sel && sel.lo <= ls + n && sel.hi > ls)
             {
-                memcpy(bufcopy, buf, buflen);
-                bufcopy[buflen] = '\0';
-                /* allocate small array for input lines */
-                int cap = 8;
-                in_lines = malloc(sizeof(char *) * cap);
-                if (in_lines)
-                {
-                    char *p = bufcopy;
-                    in_lines[in_lines_count++] = p;
-                    for (size_t i = 0; i < buflen; ++i)
-                    {
-                        if (bufcopy[i] == '\n')
-                        {
-                            bufcopy[i] = '\0';
-                            if (i + 1 <= buflen)
-                            {
-                                if (in_lines_count >= cap)
-                                {
-                                    cap *= 2;
-                                    char **tmp = realloc(in_lines, sizeof(char *) * cap);
-                                    if (!tmp)
-                                        break;
-                                    in_lines = tmp;
-                                }
-                                in_lines[in_lines_count++] = bufcopy + i + 1;
-                            }
-                        }
-                    }
-                }
-                else
+                size_t a = sel.lo > ls ? sel.lo - ls : 0;
+                size_t b = sel.hi - ls < n ? sel.hi - ls : n;
+                if (a > n)
+                    a = n;
+                int x0 = 6 + utf8_width_n(s, a);
+                int x1 = x0 + utf8_width_n(s + a, b - a);
+                if (sel.hi > le)
+                    x1 += utf8_width_n(" ", 1);
+                if (x1 > x0)
                 {
-                    free(bufcopy);
-                    bufcopy = NULL;
+                    XFillRectangle(dpy, win, gc, x0, y - fontinfo->ascent, x1 - x0, line_height);
+                    XSetForeground(dpy, gc, black);
+                    draw_utf8_n(s + a, b - a, x0, y);
+                    XSetForeground(dpy, gc, white);
                 }
             }
+            y += line_height;
         }
+        size_t scrolled = t->view_scroll;
+        pthread_mutex_unlock(&t->lock);
 
-        /* Draw first input line on same baseline as prompt */
-        int prompt_w = utf8_width(PROMPT);
-        int input_x = 6 + prompt_w;
-        if (in_lines_count > 0)
-        {
-            draw_utf8(in_lines[0], input_x, y);
-        }
-        else if (buflen == 0)
-        {
-            /* nothing to draw */
-        }
-        else
-        {
-            /* buffer present but splitting failed; draw whole buffer */
-            draw_utf8(buf, input_x, y);
-        }
-
-        /* Draw subsequent input lines below */
-        int in_y = y + line_height;
-        for (int i = 1; in_lines && i < in_lines_count; ++i)
+        if (scrolled > 0)
         {
-            draw_utf8(in_lines[i], 6 + utf8_width(PROMPT), in_y);
-            in_y += line_height;
+            char ind[48];
+            snprintf(ind, sizeof(ind), "[-%zu lines]", scrolled);
+            draw_utf8(ind, win_w - utf8_width(ind) - 8, 4 + fontinfo->ascent + 2);
         }
 
-        /* --- compute cursor position in rendered coordinates (robust, from raw bytes) --- */
-        int cur_line = 0;
-        size_t byte_into_line = 0;
+        /* --- Now draw the prompt at y (immediately after output) --- */
+        draw_utf8(PROMPT, 6, y);
 
-        if (buflen == 0)
-        {
-            cur_line = 0;
-            byte_into_line = 0;
-        }
-        else if (in_lines && in_lines_count > 0 && bufcopy)
+        /* --- input lines: walk the editor's cached layout (no copy, no re-splitting).
+           A line may straddle the editor's gap, so it is drawn as up to two spans. --- */
+        int prompt_w = utf8_width(PROMPT);
+        int input_x = 6 + prompt_w;
+        int cursor_screen_y = y;
+        int px = 0;
         {
-            /* Walk line-by-line using the splitted lines to find which line contains the cursor */
-            size_t seen = 0;
-            int found = 0;
-            for (int i = 0; i < in_lines_count; ++i)
+            size_t nlines = le_get_line_count(t->editor);
+            size_t cur_row = 0, cur_col = 0;
+            le_get_cursor_rowcol(t->editor, &cur_row, &cur_col);
+
+            /* continuation lines share the first line's x so text and cursor align;
+               rows below the window are not drawn */
+            size_t off = 0;
+            int in_y = y;
+            for (size_t i = 0; i < nlines; ++i)
             {
-                size_t llen = strlen(in_lines[i]);
-                if (cursor <= seen + llen)
-                {
-                    cur_line = i;
-                    byte_into_line = cursor - seen;
-                    found = 1;
+                size_t llen = le_get_line_length(t->editor, i);
+                if (in_y - line_height > win_h && i > cur_row)
                     break;
-                }
-                seen += llen;
-                /* account for the removed newline in copy */
-                if (i < in_lines_count - 1)
-                    seen += 1;
-            }
-            if (!found)
-            {
-                /* cursor may be at end */
-                if (cursor == buflen)
+                if (in_y - line_height <= win_h)
                 {
-                    if (buflen > 0 && buf[buflen - 1] == '\n')
+                    size_t dlen = llen;
+                    if (dlen > INPUT_DRAW_MAX)
                     {
-                        /* new empty line after trailing newline */
-                        cur_line = in_lines_count;
-                        byte_into_line = 0;
-                    }
-                    else
-                    {
-                        /* last character of last line */
-                        cur_line = in_lines_count - 1;
-                        size_t sum = 0;
-                        for (int i = 0; i < cur_line; ++i)
+                        /* back off to a code point boundary */
+                        dlen = INPUT_DRAW_MAX;
+                        const char *sa, *sb;
+                        size_t la, lb;
+                        while (dlen > 0)
                         {
-                            sum += strlen(in_lines[i]);
-                            sum += 1;
+                            le_get_spans(t->editor, off + dlen, 1, &sa, &la, &sb, &lb);
+                            if (la == 0 || ((unsigned char)sa[0] & 0xC0) != 0x80)
+                                break;
+                            dlen--;
                         }
-                        byte_into_line = cursor - sum;
                     }
-                }
-                else
-                {
-                    /* fallback: put cursor on last line */
-                    cur_line = in_lines_count - 1;
-                    size_t sum = 0;
-                    for (int i = 0; i < cur_line; ++i)
+                    const char *sa, *sb;
+                    size_t la, lb;
+                    le_get_spans(t->editor, off, dlen, &sa, &la, &sb, &lb);
+                    draw_utf8_n(sa, la, input_x, in_y);
+                    draw_utf8_n(sb, lb, input_x + utf8_width_n(sa, la), in_y);
+                    if (i == cur_row)
                     {
-                        sum += strlen(in_lines[i]);
-                        sum += 1;
+                        /* the cursor prefix may also straddle the gap */
+                        size_t col = cur_col < dlen ? cur_col : dlen;
+                        size_t ca = col < la ? col : la;
+                        px = utf8_width_n(sa, ca) + utf8_width_n(sb, col - ca);
                     }
-                    if (cursor >= sum)
-                        byte_into_line = cursor - sum;
-                    else
-                        byte_into_line = 0;
-                }
-            }
-        }
-        else
-        {
-            /* no split available — fall back to naive scan for newlines in original buffer */
-            size_t last_nl = 0;
-            int lines_seen = 0;
-            for (size_t i = 0; i < cursor; ++i)
-            {
-                if (buf[i] == '\n')
-                {
-                    lines_seen++;
-                    last_nl = i + 1;
                 }
+                if (i == cur_row)
+                    cursor_screen_y = in_y;
+                off += llen + 1;
+                in_y += line_height;
             }
-            cur_line = lines_seen;
-            byte_into_line = cursor - last_nl;
         }
 
-        /* Map cur_line to screen coords */
-        int cursor_screen_y;
-        if (cur_line <= 0)
-            cursor_screen_y = y;
-        else
-            cursor_screen_y = y + cur_line * line_height;
-
-        /* compute x offset in pixels for the cursor by measuring bytes up to cursor in that line */
-        int px = 0;
-        if (cur_line < in_lines_count && in_lines && bufcopy)
-        {
-            const char *line_ptr = in_lines[cur_line];
-            size_t line_len = strlen(line_ptr);
-            size_t safe_bytes = byte_into_line <= line_len ? byte_into_line : line_len;
-            px = utf8_prefix_width(line_ptr, safe_bytes);
-        }
-        else if (cur_line == in_lines_count && (buflen > 0 && buf[buflen - 1] == '\n'))
-        {
-            /* cursor on new empty line after a trailing newline */
-            px = 0;
-        }
-        else
-        {
-            /* fallback: measure entire buffer prefix up to cursor */
-            px = utf8_prefix_width(buf, cursor);
-        }
-
-        /* final cursor x: use a single base_x for the line so text drawing and cursor position align */
-        int base_x = (cur_line == 0) ? input_x : (6 + utf8_width(PROMPT));
-        int cursor_screen_x = base_x + px;
+        /* final cursor x: every input line starts at input_x, so text drawing and cursor align */
+        int cursor_screen_x = input_x + px;
 
         /* small visual nudge: X font drawing and the pixel measurement sometimes differ by 1px;
            subtract 1 px when px > 0 so the cursor lines up visually (guard to not go negative). */
@@ -557,19 +1080,10 @@ static void redraw(void)
         int cursor_h = line_height;
         XSetForeground(dpy, gc, WhitePixel(dpy, DefaultScreen(dpy)));
         XFillRectangle(dpy, win, gc, cursor_screen_x, cursor_top, 2, cursor_h);
-
-        /* cleanup temporaries */
-        if (out_lines)
-            free(out_lines);
-        if (outcopy)
-            free(outcopy);
-        if (in_lines)
-            free(in_lines);
-        if (bufcopy)
-            free(bufcopy);
     }
     else
     {
+        view.tab = -1;
         /* no active tab - draw prompt at top area */
         int y = top + line_height;
         draw_utf8(PROMPT, 6, y);
@@ -726,6 +1240,11 @@ int main(void)
         xm = "";
     XSetLocaleModifiers(xm);
 
+    /* the I/O thread for command output, child reaping and multiwatch polling;
+       started before any other thread so SIGCHLD stays blocked everywhere */
+    if (reactor_start() != 0)
+        die("reactor_start");
+
     /* initialize history (~/.myterm_history) */
     if (history_init(NULL) != 0)
     {
@@ -735,6 +1254,39 @@ int main(void)
 
     tabs_init();
 
+    /* MYTERM_PASTE_CHUNK: bytes written to a child per writable event when pasting */
+    {
+        const char *cs = getenv("MYTERM_PASTE_CHUNK");
+        if (cs && *cs)
+            tabs_set_write_chunk((size_t)strtoul(cs, NULL, 10));
+        /* MYTERM_PIPE_SIZE: capacity of capture pipes (bytes, up to 1 MB) */
+        const char *ps = getenv("MYTERM_PIPE_SIZE");
+        if (ps && *ps)
+            tabs_set_pipe_size((size_t)strtoul(ps, NULL, 10));
+        /* MYTERM_SCROLLBACK: per-tab scrollback limit in MB (1 .. 16384, default 1024) */
+        const char *sb = getenv("MYTERM_SCROLLBACK");
+        if (sb && *sb)
+            tabs_set_scrollback_max((size_t)strtoull(sb, NULL, 10) << 20);
+        /* MYTERM_INGEST_BUDGET: KB a background tab may ingest per scheduler tick */
+        const char *bs = getenv("MYTERM_INGEST_BUDGET");
+        if (bs && *bs)
+            reactor_set_budgets(0, (size_t)strtoul(bs, NULL, 10) * 1024);
+        /* MYTERM_FLOW_HIGH / MYTERM_FLOW_LOW: flow control watermarks in KB */
+        const char *fh = getenv("MYTERM_FLOW_HIGH");
+        const char *fl = getenv("MYTERM_FLOW_LOW");
+        if ((fh && *fh) || (fl && *fl))
+            tabs_set_flow_defaults(fh && *fh ? (size_t)strtoul(fh, NULL, 10) * 1024 : TABS_FLOW_HIGH,
+                                   fl && *fl ? (size_t)strtoul(fl, NULL, 10) * 1024 : TABS_FLOW_LOW);
+        /* MYTERM_PEEPHOLE=0: run pipelines exactly as typed */
+        const char *ph = getenv("MYTERM_PEEPHOLE");
+        if (ph && strcmp(ph, "0") == 0)
+            cmd_exec_set_peephole(0);
+        /* MYTERM_TIME=1: report resource usage after every pipeline */
+        const char *tm = getenv("MYTERM_TIME");
+        if (tm && strcmp(tm, "1") == 0)
+            cmd_exec_set_timing(1);
+    }
+
     /* create notify pipe BEFORE opening X so app can signal main loop */
     notify_pipe_read = notify_pipe_write = -1;
     {
@@ -743,10 +1295,14 @@ int main(void)
         {
             notify_pipe_read = p[0];
             notify_pipe_write = p[1];
-            /* make read end non-blocking for safe draining in select() */
+            /* make read end non-blocking for safe draining in select(), and the write end
+               too: a full pipe already means a redraw is pending, so the reactor must not block */
             int flags = fcntl(notify_pipe_read, F_GETFL, 0);
             if (flags >= 0)
                 fcntl(notify_pipe_read, F_SETFL, flags | O_NONBLOCK);
+            flags = fcntl(notify_pipe_write, F_GETFL, 0);
+            if (flags >= 0)
+                fcntl(notify_pipe_write, F_SETFL, flags | O_NONBLOCK);
             tabs_set_notify_fd(notify_pipe_write);
         }
         else
@@ -760,6 +1316,7 @@ int main(void)
     dpy = XOpenDisplay(NULL);
     if (!dpy)
         die("XOpenDisplay");
+    XSetErrorHandler(x_error_handler);
     int scr = DefaultScreen(dpy);
 
     /* create window with black background */
@@ -769,7 +1326,9 @@ int main(void)
                               BlackPixel(dpy, scr) /* background = black */);
 
     XStoreName(dpy, win, "MyTerm");
-    XSelectInput(dpy, win, ExposureMask | KeyPressMask | StructureNotifyMask | SelectionClear);
+    /* PropertyChangeMask drives INCR clipboard transfers; Selection* events are always delivered */
+    XSelectInput(dpy, win, ExposureMask | KeyPressMask | StructureNotifyMask | PropertyChangeMask |
+                               ButtonPressMask | ButtonReleaseMask | Button1MotionMask);
 
     /* ensure background is black for XClearWindow */
     XSetWindowBackground(dpy, win, BlackPixel(dpy, scr));
@@ -777,6 +1336,9 @@ int main(void)
     XMapWindow(dpy, win);
 
     /* create GC and set default drawing color to white */
+    paste_init_atoms();
+    sel_init();
+
     gc = XCreateGC(dpy, win, 0, NULL);
     XSetForeground(dpy, gc, WhitePixel(dpy, scr));
 
@@ -813,7 +1375,7 @@ int main(void)
     int id = tabs_create();
     if (id < 0)
         die("tabs_create");
-    active = id;
+    set_active(id);
     /* ensure prompt is set in editor if present, and disable terminal-mode redraw (GUI mode) */
     Tab *t0 = tabs_get(active);
     if (t0 && t0->editor)
@@ -833,6 +1395,23 @@ int main(void)
             XNextEvent(dpy, &ev);
             if (ev.type == Expose)
                 redraw();
+            else if (ev.type == SelectionNotify)
+                paste_on_selection_notify(&ev.xselection);
+            else if (ev.type == PropertyNotify)
+            {
+                paste_on_property_notify(&ev.xproperty);
+                sel_on_property_notify(&ev.xproperty);
+            }
+            else if (ev.type == SelectionRequest)
+                sel_on_request(&ev.xselectionrequest);
+            else if (ev.type == SelectionClear)
+                sel_on_clear(&ev.xselectionclear);
+            else if (ev.type == ButtonPress)
+                sel_on_button_press(&ev.xbutton);
+            else if (ev.type == ButtonRelease)
+                sel_on_button_release(&ev.xbutton);
+            else if (ev.type == MotionNotify)
+                sel_on_motion(&ev.xmotion);
             else if (ev.type == ConfigureNotify)
             {
                 win_w = ev.xconfigure.width;
@@ -902,7 +1481,7 @@ int main(void)
                                 {
                                     /* build full insertion (prefix dir + filename) */
                                     const char *name = t->comp_matches[idx];
-                                    char ins[INPUT_MAX];
+                                    char ins[PATH_MAX];
                                     /* Only prepend comp_dir if it is non-NULL and not the special "./" marker.
                                     This prevents inserting "./" when the user didn't type any directory. */
                                     if (t->comp_dir && strcmp(t->comp_dir, "./") != 0)
@@ -914,31 +1493,8 @@ int main(void)
                                         snprintf(ins, sizeof(ins), "%s", name);
                                     }
 
-                                    /* Insert/replace at saved token start */
-                                    int start = t->comp_token_start;
-                                    int orig_len = t->comp_token_len;
-                                    int tail_start = start + orig_len;
-                                    int tail_len = t->input_len - tail_start;
-                                    int ins_len = (int)strlen(ins);
-                                    if (start + ins_len + tail_len >= INPUT_MAX - 1)
-                                    {
-                                        ins_len = (INPUT_MAX - 1) - start - tail_len;
-                                    }
-
-                                    if (t->editor)
-                                    {
-                                        /* use editor helper (make sure le_replace_last_word exists) */
-                                        le_replace_last_word(t->editor, ins);
-                                    }
-                                    else
-                                    {
-                                        /* replace in t->input */
-                                        memmove(t->input + start + ins_len, t->input + tail_start, tail_len + 1);
-                                        memcpy(t->input + start, ins, (size_t)ins_len);
-                                        t->input_len = start + ins_len + tail_len;
-                                        t->input[t->input_len] = '\0';
-                                        t->input_pos = start + ins_len;
-                                    }
+                                    /* replace the token before the cursor */
+                                    le_replace_last_word(t->editor, ins);
 
                                     /* clear comp state and free memory */
                                     for (int j = 0; j < t->comp_count; ++j)
@@ -974,13 +1530,38 @@ int main(void)
                     }
                 }
 
+                /* Ctrl+Shift+C copies the selection (checked before Ctrl+C, which produces the same byte) */
+                if ((ev.xkey.state & ControlMask) && (ev.xkey.state & ShiftMask) && (ks == XK_c || ks == XK_C))
+                {
+                    sel_copy_clipboard(ev.xkey.time);
+                    continue;
+                }
+
+                /* Shift+PageUp / Shift+PageDown scroll the output a page at a time */
+                if ((ev.xkey.state & ShiftMask) && (ks == XK_Prior || ks == XK_Next) && active >= 0)
+                {
+                    Tab *t = tabs_get(active);
+                    size_t page = view.rows > 1 ? view.rows - 1 : 1;
+                    if (ks == XK_Prior)
+                        t->view_scroll += page;
+                    else
+                        t->view_scroll = t->view_scroll > page ? t->view_scroll - page : 0;
+                    need_redraw = 1;
+                    continue;
+                }
+
                 /* Early: handle single-byte control codes (Ctrl-A / Ctrl-E / Ctrl-C / Ctrl-Z / Ctrl-R) */
                 if (len == 1)
                 {
                     unsigned char c = (unsigned char)buf[0];
-                    /* Ctrl-C (ETX) */
+                    /* Ctrl-C (ETX): a pending paste is cancelled first; the next press interrupts */
                     if (c == 0x03)
                     {
+                        if (active >= 0 && paste_cancel(active))
+                        {
+                            need_redraw = 1;
+                            continue;
+                        }
                         if (active >= 0)
                         {
                             multiwatch_interrupt(active);
@@ -989,7 +1570,12 @@ int main(void)
                         }
                         continue;
                     }
-                    /* Ctrl-Z (suspend) */
+                    /* Ctrl-D: EOF for the foreground job's stdin */
+                    if (c == 0x04 && active >= 0 && cmd_exec_has_foreground(active))
+                    {
+                        cmd_exec_end_input(active);
+                        continue;
+                    }
                     /* Ctrl-Z (suspend) */
                     if (c == 0x1A)
                     {
@@ -1001,17 +1587,8 @@ int main(void)
                             /* Ask cmd_exec to suspend (sends SIGTSTP to the process group). */
                             int rc = cmd_exec_suspend_tab(active);
 
-                            /* Provide user-visible confirmation in the terminal output */
-                            if (rc == 0)
-                            {
-                                char msg[128];
-                                /* Using tab index is simpler than trying to obtain a PID here.
-                                   If you later add a getter to cmd_exec to return PGID/PID,
-                                   you can include the PID in this message. */
-                                int L = snprintf(msg, sizeof(msg), "\n[process in tab %d stopped by Ctrl+Z]\n", active + 1);
-                                tabs_append_output(active, msg, (ssize_t)L);
-                            }
-                            else
+                            /* the job table reports "[n] Stopped" once the job has stopped */
+                            if (rc != 0)
                             {
                                 const char *err = "\n[no foreground process to stop]\n";
                                 tabs_append_output(active, err, (ssize_t)strlen(err));
@@ -1030,10 +1607,7 @@ int main(void)
                             Tab *t = tabs_get(active);
                             if (t)
                             {
-                                if (t->editor)
-                                    le_feed_byte(t->editor, 0x01);
-                                else
-                                    t->input_pos = 0;
+                                le_feed_byte(t->editor, 0x01);
                                 need_redraw = 1;
                             }
                         }
@@ -1047,10 +1621,7 @@ int main(void)
                             Tab *t = tabs_get(active);
                             if (t)
                             {
-                                if (t->editor)
-                                    le_feed_byte(t->editor, 0x05);
-                                else
-                                    t->input_pos = t->input_len;
+                                le_feed_byte(t->editor, 0x05);
                                 need_redraw = 1;
                             }
                         }
@@ -1074,35 +1645,8 @@ int main(void)
                 /* Paste: Ctrl+V or Shift+Insert */
                 if ((ctrl && (ks == XK_v || ks == XK_V)) || (ks == XK_Insert && shift))
                 {
-                    char *clip = get_clipboard_text(dpy);
-                    if (clip && active >= 0)
-                    {
-                        Tab *t = tabs_get(active);
-                        if (t->editor)
-                        {
-                            size_t clen = strlen(clip);
-                            size_t avail = LE_MAX_INPUT - 1 - le_get_length(t->editor);
-                            if (clen > avail)
-                                clen = avail;
-                            le_feed_bytes(t->editor, clip, clen);
-                        }
-                        else
-                        {
-                            size_t clen = strlen(clip);
-                            if (t->input_len + (int)clen < INPUT_MAX - 1)
-                            {
-                                /* append clip */
-                                memcpy(t->input + t->input_len, clip, clen);
-                                t->input_len += (int)clen;
-                                t->input[t->input_len] = '\0';
-                                t->input_pos = t->input_len;
-                            }
-                        }
-                        free(clip);
-                        need_redraw = 1;
-                    }
-                    else if (clip)
-                        free(clip);
+                    if (active >= 0)
+                        paste_begin(active);
                     continue;
                 }
 
@@ -1112,7 +1656,7 @@ int main(void)
                     int nid = tabs_create();
                     if (nid >= 0)
                     {
-                        active = nid;
+                        set_active(nid);
                         Tab *nt = tabs_get(active);
                         if (nt && nt->editor)
                         {
@@ -1127,7 +1671,7 @@ int main(void)
                     int c = tabs_count();
                     if (c > 0)
                     {
-                        active = (active + 1) % c;
+                        set_active((active + 1) % c);
                         Tab *nt = tabs_get(active);
                         if (nt && nt->editor)
                         {
@@ -1141,11 +1685,14 @@ int main(void)
                 {
                     if (active >= 0)
                     {
+                        paste_on_tab_closed(active);
+                        sel_on_tab_closed(active);
+                        cmd_exec_on_tab_closed(active);
                         tabs_close(active);
                         if (tabs_count() > 0)
-                            active = (active - 1 < 0) ? 0 : active - 1;
+                            set_active((active - 1 < 0) ? 0 : active - 1);
                         else
-                            active = -1;
+                            set_active(-1);
                     }
                     need_redraw = 1;
                 }
@@ -1154,28 +1701,31 @@ int main(void)
                     if (active >= 0)
                     {
                         Tab *t = tabs_get(active);
-                        if (t->editor)
-                            le_feed_byte(t->editor, 0x7f);
-                        else
-                        {
-                            if (t->input_len > 0)
-                            {
-                                int i = t->input_len - 1;
-                                while (i >= 0 && (t->input[i] & 0xC0) == 0x80)
-                                    --i;
-                                if (i < 0)
-                                {
-                                    t->input_len = 0;
-                                    t->input[0] = '\0';
-                                }
-                                else
-                                {
-                                    t->input_len = i;
-                                    t->input[t->input_len] = '\0';
-                                }
-                                t->input_pos = t->input_len;
-                            }
-                        }
+                        le_feed_byte(t->editor, 0x7f);
+                        need_redraw = 1;
+                    }
+                }
+                else if (ks == XK_Delete || ks == XK_KP_Delete)
+                {
+                    if (active >= 0)
+                    {
+                        le_delete_forward(tabs_get(active)->editor);
+                        need_redraw = 1;
+                    }
+                }
+                else if (ks == XK_Left || ks == XK_KP_Left)
+                {
+                    if (active >= 0)
+                    {
+                        le_move_left(tabs_get(active)->editor);
+                        need_redraw = 1;
+                    }
+                }
+                else if (ks == XK_Right || ks == XK_KP_Right)
+                {
+                    if (active >= 0)
+                    {
+                        le_move_right(tabs_get(active)->editor);
                         need_redraw = 1;
                     }
                 }
@@ -1185,21 +1735,33 @@ int main(void)
                 else if ((ks == XK_Return || ks == XK_KP_Enter) ||
                          (len == 1 && ((unsigned char)buf[0] == '\r' || (unsigned char)buf[0] == '\n')))
                 {
-                    if (active >= 0)
+                    if (active >= 0 && cmd_exec_has_foreground(active))
                     {
+                        /* a job is running: the line is its input, echoed as a terminal would */
                         Tab *t = tabs_get(active);
-                        const char *bufptr = NULL;
-                        size_t blen = 0;
-                        if (t->editor)
-                        {
-                            bufptr = le_get_buffer(t->editor);
-                            blen = le_get_length(t->editor);
-                        }
-                        else
+                        size_t blen = le_get_length(t->editor);
+                        char *line = malloc(blen + 1);
+                        if (line)
                         {
-                            bufptr = t->input;
-                            blen = t->input_len;
+                            memcpy(line, le_get_buffer(t->editor), blen);
+                            line[blen] = '\n';
+                            t->view_scroll = 0;
+                            tabs_append_output(active, line, (ssize_t)blen + 1);
+                            if (cmd_exec_send_input(active, line, blen + 1) != 0)
+                            {
+                                const char *msg = "[the running job does not read typed input]\n";
+                                tabs_append_output(active, msg, (ssize_t)strlen(msg));
+                            }
+                            free(line);
                         }
+                        le_reset(t->editor);
+                        need_redraw = 1;
+                    }
+                    else if (active >= 0)
+                    {
+                        Tab *t = tabs_get(active);
+                        const char *bufptr = le_get_buffer(t->editor);
+                        size_t blen = le_get_length(t->editor);
 
                         /* If buffer is empty, do nothing */
                         if (blen > 0)
@@ -1208,38 +1770,26 @@ int main(void)
                                rather than submitting the command */
                             if (input_has_unclosed_quote_buf(bufptr, blen))
                             {
-                                if (t->editor)
-                                    le_feed_bytes(t->editor, "\n", 1); /* insert newline (use multibyte API) */
-                                else
-                                {
-                                    if (t->input_len + 1 < INPUT_MAX - 1)
-                                    {
-                                        t->input[t->input_len++] = '\n';
-                                        t->input[t->input_len] = '\0';
-                                    }
-                                }
+                                le_feed_bytes(t->editor, "\n", 1); /* insert newline (use multibyte API) */
                                 need_redraw = 1;
                             }
                             else
                             {
                                 /* No unclosed quotes -> submit the line */
-                                char cmdline[INPUT_MAX];
-                                size_t copylen = blen < sizeof(cmdline) - 1 ? blen : sizeof(cmdline) - 1;
-                                memcpy(cmdline, bufptr, copylen);
-                                cmdline[copylen] = '\0';
-
-                                char echo_line[INPUT_MAX + 64];
-                                int L = snprintf(echo_line, sizeof(echo_line), "%s%s\n", PROMPT, cmdline);
-                                tabs_append_output(active, echo_line, L);
-                                need_redraw = 1;
+                                char *cmdline = le_dup_buffer(t->editor);
+                                if (cmdline)
+                                {
+                                    t->view_scroll = 0; /* submitting jumps back to the bottom */
+                                    tabs_append_output(active, PROMPT, (ssize_t)strlen(PROMPT));
+                                    tabs_append_output(active, cmdline, (ssize_t)blen);
+                                    tabs_append_output(active, "\n", 1);
+                                    need_redraw = 1;
 
-                                cmd_exec_run_in_tab(active, cmdline);
+                                    cmd_exec_run_in_tab(active, cmdline);
+                                    free(cmdline);
+                                }
 
-                                if (t->editor)
-                                    le_reset(t->editor);
-                                t->input_len = 0;
-                                t->input[0] = '\0';
-                                t->input_pos = 0;
+                                le_reset(t->editor);
                                 need_redraw = 1;
                             }
                         }
@@ -1262,20 +1812,7 @@ int main(void)
                     if (len > 0 && active >= 0)
                     {
                         Tab *t = tabs_get(active);
-                        if (t->editor)
-                        {
-                            le_feed_bytes(t->editor, buf, (size_t)len);
-                        }
-                        else
-                        {
-                            if (t->input_len + len < INPUT_MAX - 1)
-                            {
-                                memcpy(t->input + t->input_len, buf, len);
-                                t->input_len += len;
-                                t->input[t->input_len] = '\0';
-                                t->input_pos = t->input_len;
-                            }
-                        }
+                        le_feed_bytes(t->editor, buf, (size_t)len);
                         need_redraw = 1;
                     }
                 }
@@ -1294,16 +1831,36 @@ int main(void)
             interrupt_flag = 0; // Reset flag
         }
 
-        if (need_redraw)
+        paste_check_timeout();
+        sel_check_timeout();
+
+        long now_ms = monotonic_ms();
+        if (need_redraw || (output_dirty && now_ms - last_frame_ms >= FRAME_MS))
         {
-            redraw();
             need_redraw = 0;
+            output_dirty = 0;
+            redraw();
+            last_frame_ms = now_ms;
         }
 
-        /* select on persistent shell fds (from_child_fd) + notify pipe */
-        fd_set rfds;
+        /* select on the X connection, persistent shell fds (from_child_fd) + notify pipe;
+           watching the X fd lets selection/INCR events wake us without waiting for the timeout */
+        fd_set rfds, wfds;
         FD_ZERO(&rfds);
-        int maxfd = -1;
+        FD_ZERO(&wfds);
+        int maxfd = ConnectionNumber(dpy);
+        FD_SET(maxfd, &rfds);
+        /* tabs with queued input (large pastes) wait for their child's stdin to drain */
+        for (int i = 0; i < tabs_count(); ++i)
+        {
+            int fd = tabs_get_write_fd(i);
+            if (fd >= 0)
+            {
+                FD_SET(fd, &wfds);
+                if (fd > maxfd)
+                    maxfd = fd;
+            }
+        }
         for (int i = 0; i < tabs_count(); ++i)
         {
             int fd = tabs_get_fd(i);
@@ -1324,11 +1881,28 @@ int main(void)
         struct timeval tv;
         tv.tv_sec = 0;
         tv.tv_usec = 20000; /* 20ms */
+        if (output_dirty)
+        {
+            /* wake up in time for the next frame */
+            long wait_ms = FRAME_MS - (now_ms - last_frame_ms);
+            tv.tv_usec = wait_ms > 0 ? wait_ms * 1000 : 0;
+        }
         if (maxfd >= 0)
         {
-            int ready = select(maxfd + 1, &rfds, NULL, NULL, &tv);
+            int ready = select(maxfd + 1, &rfds, &wfds, NULL, &tv);
             if (ready > 0)
             {
+                for (int i = 0; i < tabs_count(); ++i)
+                {
+                    int fd = tabs_get_write_fd(i);
+                    if (fd >= 0 && FD_ISSET(fd, &wfds))
+                    {
+                        tabs_flush_input(i);
+                        if (i == active)
+                            need_redraw = 1;
+                    }
+                }
+
                 /* drain notify pipe first (if any) */
                 if (notify_pipe_read >= 0 && FD_ISSET(notify_pipe_read, &rfds))
                 {
@@ -1337,8 +1911,10 @@ int main(void)
                     while (read(notify_pipe_read, drain, sizeof(drain)) > 0)
                     { /* discard */
                     }
-                    /* output was already appended by writer — request redraw */
-                    need_redraw = 1;
+                    /* output was already appended by writer — draw it with the next frame */
+                    output_dirty = 1;
+                    /* a job that ended may let the rest of its command line run */
+                    cmd_exec_dispatch();
                 }
 
                 for (int i = 0; i < tabs_count(); ++i)
@@ -1348,7 +1924,7 @@ int main(void)
                     {
                         tabs_read_once(i);
                         if (i == active)
-                            need_redraw = 1;
+                            output_dirty = 1;
                     }
                 }
             }
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include "pipe_prof.h"
+#include "shell_tab.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define PP_CHUNK (1 << 20)       /* most one splice() moves; a pipe's contents in practice */
+#define PP_SAMPLE_NS 10000000L  /* /proc sampling period: 10 ms */
+#define PP_THREAD_STACK (64 * 1024)
+
+/* one stage's output link */
+typedef struct
+{
+    PipeProf *p;
+    int in;  /* read end of the pipe the stage writes, -1 for no relay */
+    int out; /* write end of the pipe its reader reads */
+    unsigned long long bytes;
+    double wait_in;  /* in poll(): the stage had written nothing new */
+    double wait_out; /* in splice(): the reader's pipe was full */
+    double active;   /* relay start to EOF */
+} Relay;
+
+typedef struct
+{
+    char *name;
+    pid_t pid; /* 0 for a builtin stage */
+    int gone;                     /* sampler: exited (a zombie will do) */
+    unsigned long samples, oncpu; /* samples while not stopped; those in state R */
+    struct timeval cpu;           /* user + sys, once reaped */
+    int reaped;
+} Stage;
+
+struct PipeProf
+{
+    int n;
+    Relay *relay;
+    Stage *stage;
+    atomic_int threads; /* started and not yet finished */
+    void (*done)(void *arg);
+    void *arg;
+};
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+PipeProf *pipeprof_new(int n, char *const *names)
+{
+    PipeProf *p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->n = n;
+    p->relay = calloc((size_t)n, sizeof(Relay));
+    p->stage = calloc((size_t)n, sizeof(Stage));
+    if (!p->relay || !p->stage)
+    {
+        pipeprof_free(p);
+        return NULL;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        p->relay[i].p = p;
+        p->relay[i].in = p->relay[i].out = -1;
+        p->stage[i].name = strdup(names[i] ? names[i] : "?");
+        if (!p->stage[i].name)
+        {
+            pipeprof_free(p);
+            return NULL;
+        }
+    }
+    return p;
+}
+
+void pipeprof_free(PipeProf *p)
+{
+    if (!p)
+        return;
+    for (int i = 0; p->relay && i < p->n; ++i)
+    {
+        if (p->relay[i].in >= 0)
+            close(p->relay[i].in);
+        if (p->relay[i].out >= 0)
+            close(p->relay[i].out);
+    }
+    for (int i = 0; p->stage && i < p->n; ++i)
+        free(p->stage[i].name);
+    free(p->relay);
+    free(p->stage);
+    free(p);
+}
+
+int pipeprof_splice_in(PipeProf *p, int i, int fds[2])
+{
+    int np[2];
+    if (i < 0 || i >= p->n || p->relay[i].in >= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pipe2(np, O_CLOEXEC) < 0)
+        return -1;
+    p->relay[i].in = np[0];
+    p->relay[i].out = fds[1];
+    fds[1] = np[1];
+    return 0;
+}
+
+void pipeprof_set_pid(PipeProf *p, int i, pid_t pid)
+{
+    if (i >= 0 && i < p->n)
+        p->stage[i].pid = pid;
+}
+
+void pipeprof_add_usage(PipeProf *p, pid_t pid, const struct rusage *ru)
+{
+    for (int i = 0; i < p->n; ++i)
+        if (p->stage[i].pid == pid && !p->stage[i].reaped)
+        {
+            timeradd(&ru->ru_utime, &ru->ru_stime, &p->stage[i].cpu);
+            p->stage[i].reaped = 1;
+            return;
+        }
+}
+
+/* -------------------- threads -------------------- */
+
+static void thread_finished(PipeProf *p)
+{
+    if (atomic_fetch_sub(&p->threads, 1) == 1)
+        p->done(p->arg);
+}
+
+static void block_signals(void)
+{
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+}
+
+/* Wait for the stage to write, then splice it on. The stage sees the reader's EPIPE
+   (as SIGPIPE) on its next write after the relay's read end is closed. */
+static void *relay_main(void *arg)
+{
+    Relay *rl = arg;
+    block_signals();
+    double start = now_sec();
+    for (;;)
+    {
+        struct pollfd pfd = {rl->in, POLLIN, 0};
+        double t0 = now_sec();
+        int pr = poll(&pfd, 1, -1);
+        double t1 = now_sec();
+        rl->wait_in += t1 - t0;
+        if (pr < 0 && errno != EINTR)
+            break;
+        if (pr <= 0)
+            continue;
+        ssize_t n = splice(rl->in, NULL, rl->out, NULL, PP_CHUNK, SPLICE_F_MOVE);
+        rl->wait_out += now_sec() - t1;
+        if (n > 0)
+            rl->bytes += (unsigned long long)n;
+        else if (n == 0 || errno != EINTR)
+            break; /* EOF, or the reader has gone (EPIPE) */
+    }
+    rl->active = now_sec() - start;
+    close(rl->in);
+    close(rl->out);
+    rl->in = rl->out = -1;
+    thread_finished(rl->p);
+    return NULL;
+}
+
+/* the state letter from /proc/<pid>/stat, 0 once the process is gone */
+static char proc_state(pid_t pid)
+{
+    char path[64], buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    /* comm may contain anything, so the state follows the last ')' */
+    char *e = strrchr(buf, ')');
+    return e && e[1] == ' ' ? e[2] : 0;
+}
+
+/* sample every stage process until all of them have exited (zombies count) */
+static void *sampler_main(void *arg)
+{
+    PipeProf *p = arg;
+    block_signals();
+    for (;;)
+    {
+        int live = 0;
+        for (int i = 0; i < p->n; ++i)
+        {
+            Stage *s = &p->stage[i];
+            if (s->pid <= 0 || s->gone)
+                continue;
+            char st = proc_state(s->pid);
+            if (!st || st == 'Z' || st == 'X')
+            {
+                s->gone = 1;
+                continue;
+            }
+            ++live;
+            if (st == 'T' || st == 't')
+                continue;
+            s->samples++;
+            if (st == 'R')
+                s->oncpu++;
+        }
+        if (live == 0)
+            break;
+        struct timespec ts = {0, PP_SAMPLE_NS};
+        nanosleep(&ts, NULL);
+    }
+    thread_finished(p);
+    return NULL;
+}
+
+static int spawn(void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, PP_THREAD_STACK);
+    pthread_t thr;
+    int rc = pthread_create(&thr, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    return rc;
+}
+
+int pipeprof_start(PipeProf *p, void (*done)(void *arg), void *arg)
+{
+    p->done = done;
+    p->arg = arg;
+    /* one count held for ourselves, so done cannot run before every thread has started */
+    atomic_store(&p->threads, 1);
+    int err = 0;
+    for (int i = 0; i < p->n; ++i)
+    {
+        Relay *rl = &p->relay[i];
+        if (rl->in < 0)
+            continue;
+        atomic_fetch_add(&p->threads, 1);
+        int rc = spawn(relay_main, rl);
+        if (rc != 0)
+        {
+            err = rc;
+            close(rl->in);
+            close(rl->out);
+            rl->in = rl->out = -1;
+            atomic_fetch_sub(&p->threads, 1);
+        }
+    }
+    atomic_fetch_add(&p->threads, 1);
+    if (spawn(sampler_main, p) != 0)
+        atomic_fetch_sub(&p->threads, 1);
+    thread_finished(p);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* -------------------- the report -------------------- */
+
+static const char *fmt_bytes(char *buf, size_t cap, double b)
+{
+    static const char units[] = "BKMGT";
+    int u = 0;
+    while (b >= 1024 && u < 4)
+    {
+        b /= 1024;
+        ++u;
+    }
+    if (u == 0)
+        snprintf(buf, cap, "%.0f", b);
+    else
+        snprintf(buf, cap, "%.1f%c", b, units[u]);
+    return buf;
+}
+
+static double pct(double part, double whole)
+{
+    double v = whole > 0 ? 100.0 * part / whole : 0;
+    return v > 100 ? 100 : v;
+}
+
+/* Per stage: bytes written and their rate while the link was open; "held" is the time
+   its output pipe was full (the next stage, or the tab, was slower), "starved" the
+   time no input was arriving from the previous stage. The stage that spent the least
+   time held or starved is the one the others were waiting for. */
+void pipeprof_report(PipeProf *p, int tab_idx, double real)
+{
+    char line[256], b1[32], b2[32];
+    int m = snprintf(line, sizeof(line), "[pprof: %d stage%s, real %.3fs]\n%3s  %-16s %9s %11s %7s %8s %8s %7s\n",
+                     p->n, p->n == 1 ? "" : "s", real, "#", "command", "out", "rate/s", "held", "starved", "cpu",
+                     "on-cpu");
+    tabs_append_output(tab_idx, line, m);
+    int worst = -1;
+    double worst_busy = -1;
+    for (int i = 0; i < p->n; ++i)
+    {
+        const Relay *rl = &p->relay[i];
+        const Stage *s = &p->stage[i];
+        double held = pct(rl->wait_out, real);
+        double starved = i > 0 ? pct(p->relay[i - 1].wait_in, real) : 0;
+        char rate[32] = "-", starv[16] = "-", cpu[16] = "-", oncpu[16] = "-";
+        if (rl->active > 0 && rl->bytes > 0)
+            fmt_bytes(rate, sizeof(rate), (double)rl->bytes / rl->active);
+        if (i > 0)
+            snprintf(starv, sizeof(starv), "%.1f%%", starved);
+        if (s->reaped)
+            snprintf(cpu, sizeof(cpu), "%.2fs", (double)s->cpu.tv_sec + (double)s->cpu.tv_usec / 1e6);
+        if (s->samples > 0)
+            snprintf(oncpu, sizeof(oncpu), "%.0f%%", pct((double)s->oncpu, (double)s->samples));
+        snprintf(b2, sizeof(b2), "%.1f%%", held);
+        m = snprintf(line, sizeof(line), "%3d  %-16.16s %9s %11s %7s %8s %8s %7s\n", i + 1, s->name,
+                     fmt_bytes(b1, sizeof(b1), (double)rl->bytes), rate, b2, starv, cpu, oncpu);
+        tabs_append_output(tab_idx, line, m);
+        double busy = 100 - held - starved;
+        if ((s->pid > 0 || rl->bytes > 0) && busy > worst_busy)
+        {
+            worst_busy = busy;
+            worst = i;
+        }
+    }
+    if (p->n > 1 && worst >= 0)
+    {
+        m = snprintf(line, sizeof(line), "bottleneck: stage %d (%s)\n", worst + 1, p->stage[worst].name);
+        tabs_append_output(tab_idx, line, m);
+    }
+}
@@ -0,0 +1,1014 @@
+#define _GNU_SOURCE
+#include "reactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#define REACTOR_MAX_EVENTS 64
+#define REACTOR_READ_BUF (64 * 1024)
+/* reads per readiness event, so one chatty pipe cannot starve the others */
+#define REACTOR_READS_PER_EVENT 4
+
+enum
+{
+    SRC_WAKE,
+    SRC_SIGNAL,
+    SRC_READER,
+    SRC_TIMER,
+    SRC_URING,
+    SRC_TICK
+};
+
+typedef struct Source
+{
+    int kind;
+    int fd;
+    int dead; /* removed during the current batch; freed after it */
+    reactor_data_cb data_cb;
+    reactor_drain_cb drain_cb;
+    reactor_eof_cb eof_cb;
+    reactor_timer_cb timer_cb;
+    void *arg;
+    struct Source *next_dead;
+    /* ingest scheduling (readers) */
+    int group;     /* -1: unmetered */
+    int parked;    /* out of the poll set until the next tick */
+    int in_uring;  /* served by a multishot read rather than epoll */
+    int armed;     /* a multishot read is outstanding */
+    struct Source *next_parked;
+    struct Source *next_rearm; /* uring_ready(): read ended, to be queued again */
+} Source;
+
+typedef struct ChildWatch
+{
+    pid_t pid;
+    reactor_child_cb cb;
+    void *arg;
+    struct ChildWatch *next;
+} ChildWatch;
+
+typedef struct Post
+{
+    void (*fn)(void *);
+    void *arg;
+    struct Post *next;
+} Post;
+
+static int epfd = -1;
+static int wake_fd = -1;
+static int sig_fd = -1;
+static pthread_t reactor_thr;
+
+/* cross-thread post queue, drained on the reactor thread */
+static pthread_mutex_t post_lock = PTHREAD_MUTEX_INITIALIZER;
+static Post *post_head = NULL, *post_tail = NULL;
+
+/* reactor-thread-only state */
+static ChildWatch *watches = NULL;
+static Source *dead_list = NULL;
+static char read_buf[REACTOR_READ_BUF];
+static Source wake_src = {.kind = SRC_WAKE, .fd = -1};
+static Source sig_src = {.kind = SRC_SIGNAL, .fd = -1};
+
+/* -------------------- ingest groups --------------------
+   Byte budgets per group and tick; the counters below the marker are read by other
+   threads (reactor_ingest_stats) and published under stats_lock. */
+
+typedef struct IngestGroup
+{
+    uint64_t tick_start; /* ns; start of the current budget tick */
+    size_t used;         /* bytes charged in the current tick */
+    uint64_t park_start; /* ns; when the group was parked, 0 if it is not */
+    uint64_t win_start;  /* ns; start of the current one-second stats window */
+    uint64_t win_bytes;
+    unsigned win_lag_ms;
+    /* published */
+    uint64_t bytes;
+    double rate;
+    unsigned lag_ms;
+    uint64_t rate_at; /* ns; when rate/lag_ms were last published */
+    int parked;
+    int held; /* atomic; set by reactor_hold_group() */
+} IngestGroup;
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+static IngestGroup groups[REACTOR_MAX_GROUPS];
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static int fg_group = -1;
+static size_t budget_fg = REACTOR_BUDGET_FG;
+static size_t budget_bg = REACTOR_BUDGET_BG;
+static Source *parked_head = NULL;
+static int tick_fd = -1;
+static int tick_armed = 0;
+static Source tick_src = {.kind = SRC_TICK, .fd = -1};
+
+/* -------------------- posting -------------------- */
+
+int reactor_post(void (*fn)(void *), void *arg)
+{
+    Post *p = malloc(sizeof(*p));
+    if (!p)
+        return -1;
+    p->fn = fn;
+    p->arg = arg;
+    p->next = NULL;
+    pthread_mutex_lock(&post_lock);
+    if (post_tail)
+        post_tail->next = p;
+    else
+        post_head = p;
+    post_tail = p;
+    pthread_mutex_unlock(&post_lock);
+    uint64_t one = 1;
+    ssize_t w = write(wake_fd, &one, sizeof(one));
+    (void)w;
+    return 0;
+}
+
+static void run_posts(void)
+{
+    uint64_t v;
+    ssize_t r = read(wake_fd, &v, sizeof(v));
+    (void)r;
+    pthread_mutex_lock(&post_lock);
+    Post *p = post_head;
+    post_head = post_tail = NULL;
+    pthread_mutex_unlock(&post_lock);
+    while (p)
+    {
+        Post *next = p->next;
+        p->fn(p->arg);
+        free(p);
+        p = next;
+    }
+}
+
+/* -------------------- sources -------------------- */
+
+static void source_remove(Source *s)
+{
+    if (s->dead)
+        return;
+    s->dead = 1;
+    if (s->parked)
+    {
+        Source **pp = &parked_head;
+        while (*pp && *pp != s)
+            pp = &(*pp)->next_parked;
+        if (*pp)
+            *pp = s->next_parked;
+        s->parked = 0;
+        pthread_mutex_lock(&stats_lock);
+        groups[s->group].parked--;
+        pthread_mutex_unlock(&stats_lock);
+    }
+    /* io_uring readers were never in the epoll set; the DEL just fails for them */
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    s->fd = -1;
+    /* events for s may still be pending in the current batch */
+    s->next_dead = dead_list;
+    dead_list = s;
+}
+
+static void free_dead_sources(void)
+{
+    while (dead_list)
+    {
+        Source *s = dead_list;
+        dead_list = s->next_dead;
+        free(s);
+    }
+}
+
+/* -------------------- io_uring ingest backend (MYTERM_INGEST=uring) --------------------
+   Capture pipes get one multishot read each; the kernel picks a buffer from a
+   provided-buffer ring for every chunk, so steady output costs no syscall per read.
+   The ring fd sits in the epoll set and completions are handled on this thread.
+   Raw syscalls, no liburing. Anything missing at startup (io_uring disabled, kernel
+   without multishot read or buffer rings) leaves the epoll path in charge. Off by
+   default: every chunk is still copied out of the ring buffer (see reactor_backend()
+   in reactor.h for the numbers). */
+
+#define URING_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+#define URING_NBUFS 64 /* power of two */
+#define URING_BUF_SIZE (64 * 1024)
+#define URING_BGID 0
+/* not in older uapi headers; value from Linux 6.7 */
+#define URING_OP_READ_MULTISHOT 49
+
+static struct
+{
+    int fd;
+    /* submission ring */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_pending;
+    /* completion ring */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* provided buffers */
+    struct io_uring_buf_ring *br;
+    char *bufs;
+    unsigned short br_tail;
+} uring = {.fd = -1};
+
+static Source uring_src = {.kind = SRC_URING, .fd = -1};
+
+static int uring_enter(unsigned to_submit, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, uring.fd, to_submit, 0, flags, NULL, 0);
+}
+
+static void uring_buf_add(unsigned short bid)
+{
+    struct io_uring_buf *b = &uring.br->bufs[uring.br_tail & (URING_NBUFS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(uring.bufs + (size_t)bid * URING_BUF_SIZE);
+    b->len = URING_BUF_SIZE;
+    b->bid = bid;
+    uring.br_tail++;
+}
+
+static void uring_buf_publish(void)
+{
+    __atomic_store_n(&uring.br->tail, uring.br_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_submit(void)
+{
+    if (uring.sq_pending == 0)
+        return;
+    int r;
+    do
+        r = uring_enter(uring.sq_pending, 0);
+    while (r < 0 && errno == EINTR);
+    if (r > 0)
+        uring.sq_pending -= (unsigned)r;
+}
+
+/* queue a multishot read on s->fd */
+static int uring_arm(Source *s)
+{
+    unsigned tail = *uring.sq_tail;
+    if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= URING_ENTRIES)
+    {
+        uring_submit();
+        if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= URING_ENTRIES)
+            return -1;
+    }
+    unsigned idx = tail & *uring.sq_mask;
+    struct io_uring_sqe *sqe = &uring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = URING_OP_READ_MULTISHOT;
+    sqe->fd = s->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = (uint64_t)(uintptr_t)s;
+    uring.sq_array[idx] = idx;
+    __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring.sq_pending++;
+    uring_submit();
+    s->in_uring = 1;
+    s->armed = 1;
+    return 0;
+}
+
+/* stop s's multishot read; its final completion (-ECANCELED) arrives later */
+static void uring_cancel(Source *s)
+{
+    unsigned tail = *uring.sq_tail;
+    if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= URING_ENTRIES)
+    {
+        uring_submit();
+        if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= URING_ENTRIES)
+            return; /* the read keeps going; only the budget is overrun */
+    }
+    unsigned idx = tail & *uring.sq_mask;
+    struct io_uring_sqe *sqe = &uring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)s;
+    sqe->user_data = 0; /* completions without a source are ignored */
+    uring.sq_array[idx] = idx;
+    __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring.sq_pending++;
+    uring_submit();
+}
+
+static int ingest_charge(Source *s, size_t n);
+static void source_park(Source *s);
+
+/* queue s's multishot read again; with the submission queue full the reader moves
+   over to epoll rather than being dropped */
+static void uring_rearm(Source *s)
+{
+    if (uring_arm(s) == 0)
+        return;
+    s->in_uring = 0;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0)
+    {
+        if (s->eof_cb)
+            s->eof_cb(s->arg);
+        source_remove(s);
+    }
+}
+
+static void uring_ready(void)
+{
+    /* every reader has at most one read outstanding, so it is listed at most once */
+    Source *rearm = NULL, **rearm_tail = &rearm;
+    unsigned head = *uring.cq_head;
+    unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &uring.cqes[head & *uring.cq_mask];
+        Source *s = (Source *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        head++;
+        if (!s)
+            continue; /* a cancel request */
+
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            unsigned short bid = (unsigned short)(flags >> IORING_CQE_BUFFER_SHIFT);
+            if (res > 0 && !s->dead)
+            {
+                s->data_cb(uring.bufs + (size_t)bid * URING_BUF_SIZE, (size_t)res, s->arg);
+                if (ingest_charge(s, (size_t)res))
+                    source_park(s);
+            }
+            uring_buf_add(bid);
+        }
+        if (flags & IORING_CQE_F_MORE)
+            continue;
+        /* the multishot read ended: out of buffers, cancelled (a park that was undone
+           before its cancel completed) or a final chunk without F_MORE all mean keep
+           reading; only 0 and real errors are EOF. A parked reader was cancelled on
+           purpose and is re-armed when it is resumed. */
+        s->armed = 0;
+        if (s->dead || s->parked)
+            continue;
+        if (res > 0 || res == -ENOBUFS || res == -ECANCELED)
+        {
+            /* armed only once the buffers returned above are published */
+            s->next_rearm = NULL;
+            *rearm_tail = s;
+            rearm_tail = &s->next_rearm;
+        }
+        else
+        {
+            if (s->eof_cb)
+                s->eof_cb(s->arg);
+            source_remove(s);
+        }
+    }
+    __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+    uring_buf_publish();
+    while (rearm)
+    {
+        Source *s = rearm;
+        rearm = s->next_rearm;
+        if (!s->dead)
+            uring_rearm(s);
+    }
+}
+
+static int uring_setup(void)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+    int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0)
+        return -1;
+    uring.fd = fd;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+        goto fail;
+
+    /* multishot read must be supported */
+    size_t probe_sz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_sz);
+    if (!probe)
+        goto fail;
+    int ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+             probe->last_op >= URING_OP_READ_MULTISHOT &&
+             (probe->ops[URING_OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!ok)
+        goto fail;
+
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+    char *ring = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+        goto fail;
+    uring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (uring.sqes == MAP_FAILED)
+        goto fail;
+    uring.sq_head = (unsigned *)(ring + p.sq_off.head);
+    uring.sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    uring.sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    uring.sq_array = (unsigned *)(ring + p.sq_off.array);
+    uring.cq_head = (unsigned *)(ring + p.cq_off.head);
+    uring.cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    uring.cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    /* provided buffer ring: page-aligned ring of descriptors plus the buffers themselves */
+    uring.br = mmap(NULL, URING_NBUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uring.bufs = mmap(NULL, (size_t)URING_NBUFS * URING_BUF_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (uring.br == MAP_FAILED || uring.bufs == MAP_FAILED)
+        goto fail;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)uring.br;
+    reg.ring_entries = URING_NBUFS;
+    reg.bgid = URING_BGID;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+        goto fail;
+    for (unsigned short i = 0; i < URING_NBUFS; ++i)
+        uring_buf_add(i);
+    uring_buf_publish();
+
+    uring_src.fd = fd;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &uring_src;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        goto fail;
+    return 0;
+
+fail:
+    /* mappings are left as they are; this only happens once, at startup */
+    close(fd);
+    uring.fd = -1;
+    return -1;
+}
+
+const char *reactor_backend(void)
+{
+    return uring.fd >= 0 ? "io_uring" : "epoll";
+}
+
+/* -------------------- ingest scheduling -------------------- */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static size_t group_budget(int group)
+{
+    return group == __atomic_load_n(&fg_group, __ATOMIC_RELAXED)
+               ? __atomic_load_n(&budget_fg, __ATOMIC_RELAXED)
+               : __atomic_load_n(&budget_bg, __ATOMIC_RELAXED);
+}
+
+/* charge n bytes read by s to its group; returns 1 once the group's budget for the
+   current tick is used up while another group also has output to move */
+static int ingest_charge(Source *s, size_t n)
+{
+    if (s->group < 0)
+        return 0;
+    IngestGroup *g = &groups[s->group];
+    uint64_t now = now_ns();
+    g->win_bytes += n;
+    if (now - g->win_start >= NS_PER_SEC)
+    {
+        pthread_mutex_lock(&stats_lock);
+        g->rate = g->win_start ? (double)g->win_bytes * NS_PER_SEC / (double)(now - g->win_start) : 0;
+        g->lag_ms = g->win_lag_ms;
+        g->rate_at = now;
+        pthread_mutex_unlock(&stats_lock);
+        g->win_start = now;
+        g->win_bytes = 0;
+        g->win_lag_ms = 0;
+    }
+    __atomic_add_fetch(&g->bytes, n, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&g->held, __ATOMIC_ACQUIRE))
+        return 1;
+    if (now - g->tick_start >= REACTOR_TICK_MS * NS_PER_MS)
+    {
+        g->tick_start = now;
+        g->used = 0;
+    }
+    g->used += n;
+    if (g->used < group_budget(s->group))
+        return 0;
+    /* budgets only matter under contention: a group flooding on its own keeps going */
+    for (int i = 0; i < REACTOR_MAX_GROUPS; ++i)
+    {
+        IngestGroup *o = &groups[i];
+        if (i != s->group && (o->park_start || (o->used && now - o->tick_start < REACTOR_TICK_MS * NS_PER_MS)))
+            return 1;
+    }
+    g->used = 0;
+    return 0;
+}
+
+static void tick_arm(void)
+{
+    if (tick_armed)
+        return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = (long)(REACTOR_TICK_MS * NS_PER_MS);
+    if (timerfd_settime(tick_fd, 0, &its, NULL) == 0)
+        tick_armed = 1;
+}
+
+/* take s out of the poll set; the data stays in its pipe, so the producer blocks
+   once the pipe is full */
+static void source_park(Source *s)
+{
+    if (s->parked || s->dead)
+        return;
+    s->parked = 1;
+    if (s->in_uring)
+        uring_cancel(s);
+    else
+        epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    s->next_parked = parked_head;
+    parked_head = s;
+    IngestGroup *g = &groups[s->group];
+    if (!g->park_start)
+        g->park_start = now_ns();
+    pthread_mutex_lock(&stats_lock);
+    g->parked++;
+    pthread_mutex_unlock(&stats_lock);
+    tick_arm();
+}
+
+static void source_unpark(Source *s)
+{
+    s->parked = 0;
+    pthread_mutex_lock(&stats_lock);
+    groups[s->group].parked--;
+    pthread_mutex_unlock(&stats_lock);
+    if (s->in_uring)
+    {
+        /* still armed if the cancel has not completed yet; its completion re-arms */
+        if (!s->armed)
+            uring_rearm(s);
+        return;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0)
+    {
+        if (s->eof_cb)
+            s->eof_cb(s->arg);
+        source_remove(s);
+    }
+}
+
+/* resume the parked readers of group (all groups if group < 0) with a fresh budget;
+   held groups stay parked */
+static void unpark_groups(int group)
+{
+    uint64_t now = now_ns();
+    int skip[REACTOR_MAX_GROUPS];
+    for (int i = 0; i < REACTOR_MAX_GROUPS; ++i)
+    {
+        IngestGroup *g = &groups[i];
+        skip[i] = (group >= 0 && i != group) || __atomic_load_n(&g->held, __ATOMIC_ACQUIRE);
+        if (skip[i] || !g->park_start)
+            continue;
+        unsigned lag = (unsigned)((now - g->park_start) / NS_PER_MS);
+        if (lag > g->win_lag_ms)
+            g->win_lag_ms = lag;
+        g->park_start = 0;
+        g->tick_start = now;
+        g->used = 0;
+    }
+    Source **pp = &parked_head;
+    while (*pp)
+    {
+        Source *s = *pp;
+        if (skip[s->group])
+        {
+            pp = &s->next_parked;
+            continue;
+        }
+        *pp = s->next_parked;
+        source_unpark(s);
+    }
+}
+
+static void tick_ready(void)
+{
+    uint64_t expirations;
+    ssize_t r = read(tick_fd, &expirations, sizeof(expirations));
+    (void)r;
+    tick_armed = 0;
+    unpark_groups(-1);
+}
+
+static void post_unpark_group(void *arg)
+{
+    unpark_groups((int)(intptr_t)arg);
+}
+
+void reactor_set_foreground(int group)
+{
+    if (group >= REACTOR_MAX_GROUPS)
+        group = -1;
+    /* the newly focused tab should not wait out the rest of a background tick */
+    if (__atomic_exchange_n(&fg_group, group, __ATOMIC_RELAXED) != group && group >= 0)
+        reactor_post(post_unpark_group, (void *)(intptr_t)group);
+}
+
+void reactor_hold_group(int group, int hold)
+{
+    if (group < 0 || group >= REACTOR_MAX_GROUPS)
+        return;
+    /* readers notice a hold in ingest_charge(); a release has to resume them here */
+    if (__atomic_exchange_n(&groups[group].held, hold ? 1 : 0, __ATOMIC_ACQ_REL) && !hold)
+        reactor_post(post_unpark_group, (void *)(intptr_t)group);
+}
+
+void reactor_set_budgets(size_t fg_bytes, size_t bg_bytes)
+{
+    if (fg_bytes)
+        __atomic_store_n(&budget_fg, fg_bytes, __ATOMIC_RELAXED);
+    if (bg_bytes)
+        __atomic_store_n(&budget_bg, bg_bytes, __ATOMIC_RELAXED);
+}
+
+int reactor_ingest_stats(int group, ReactorIngestStats *out)
+{
+    if (group < 0 || group >= REACTOR_MAX_GROUPS)
+        return -1;
+    IngestGroup *g = &groups[group];
+    uint64_t now = now_ns();
+    out->bytes = __atomic_load_n(&g->bytes, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&stats_lock);
+    /* rates are published as bytes arrive; a group that went quiet reports zero */
+    int fresh = g->rate_at && now - g->rate_at < 2 * NS_PER_SEC;
+    out->bytes_per_sec = fresh ? g->rate : 0;
+    out->lag_ms = fresh ? g->lag_ms : 0;
+    out->parked = g->parked;
+    pthread_mutex_unlock(&stats_lock);
+    out->held = __atomic_load_n(&g->held, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+static void source_register(Source *s)
+{
+    if (s->kind == SRC_READER && !s->drain_cb && uring.fd >= 0)
+    {
+        if (uring_arm(s) == 0)
+            return;
+        /* submission queue full: this reader falls back to epoll */
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0)
+    {
+        /* not pollable: report EOF so the owner can clean up */
+        if (s->kind == SRC_READER && s->eof_cb)
+            s->eof_cb(s->arg);
+        close(s->fd);
+        free(s);
+    }
+}
+
+static void post_register(void *arg)
+{
+    source_register(arg);
+}
+
+int reactor_add_reader(int fd, int group, reactor_data_cb data_cb, reactor_eof_cb eof_cb, void *arg)
+{
+    Source *s = calloc(1, sizeof(*s));
+    if (!s)
+        return -1;
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0)
+        fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    s->kind = SRC_READER;
+    s->fd = fd;
+    s->group = (group >= 0 && group < REACTOR_MAX_GROUPS) ? group : -1;
+    s->data_cb = data_cb;
+    s->eof_cb = eof_cb;
+    s->arg = arg;
+    if (reactor_post(post_register, s) < 0)
+    {
+        free(s);
+        return -1;
+    }
+    return 0;
+}
+
+int reactor_add_drain(int fd, int group, reactor_drain_cb drain_cb, reactor_eof_cb eof_cb, void *arg)
+{
+    Source *s = calloc(1, sizeof(*s));
+    if (!s)
+        return -1;
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0)
+        fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    s->kind = SRC_READER;
+    s->fd = fd;
+    s->group = (group >= 0 && group < REACTOR_MAX_GROUPS) ? group : -1;
+    s->drain_cb = drain_cb;
+    s->eof_cb = eof_cb;
+    s->arg = arg;
+    if (reactor_post(post_register, s) < 0)
+    {
+        free(s);
+        return -1;
+    }
+    return 0;
+}
+
+static void reader_ready(Source *s)
+{
+    for (int i = 0; i < REACTOR_READS_PER_EVENT; ++i)
+    {
+        ssize_t r;
+        if (s->drain_cb)
+            r = s->drain_cb(s->fd, s->arg);
+        else
+        {
+            r = read(s->fd, read_buf, sizeof(read_buf));
+            if (r > 0)
+                s->data_cb(read_buf, (size_t)r, s->arg);
+        }
+        if (r > 0)
+        {
+            if (ingest_charge(s, (size_t)r))
+            {
+                source_park(s);
+                return;
+            }
+            continue;
+        }
+        if (r < 0 && (errno == EAGAIN || errno == EINTR))
+            return;
+        /* EOF or a hard error */
+        if (s->eof_cb)
+            s->eof_cb(s->arg);
+        source_remove(s);
+        return;
+    }
+}
+
+ReactorTimer *reactor_add_timer(unsigned interval_ms, reactor_timer_cb cb, void *arg)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct itimerspec its;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    Source *s = calloc(1, sizeof(*s));
+    if (!s || timerfd_settime(fd, 0, &its, NULL) < 0)
+    {
+        free(s);
+        close(fd);
+        return NULL;
+    }
+    s->kind = SRC_TIMER;
+    s->fd = fd;
+    s->timer_cb = cb;
+    s->arg = arg;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        free(s);
+        close(fd);
+        return NULL;
+    }
+    return (ReactorTimer *)s;
+}
+
+void reactor_cancel_timer(ReactorTimer *t)
+{
+    if (t)
+        source_remove((Source *)t);
+}
+
+static void timer_ready(Source *s)
+{
+    uint64_t expirations;
+    if (read(s->fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+        s->timer_cb(s->arg);
+}
+
+/* -------------------- children -------------------- */
+
+/* poll one watch; returns 1 if the watch is finished */
+static int watch_poll(ChildWatch *w)
+{
+    for (;;)
+    {
+        int status = 0;
+        struct rusage ru;
+        memset(&ru, 0, sizeof(ru));
+        pid_t r = wait4(w->pid, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru);
+        if (r == 0)
+            return 0;
+        if (r < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            /* reaped elsewhere or not our child: nothing more will come */
+            return 1;
+        }
+        w->cb(w->pid, status, &ru, w->arg);
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+            return 1;
+    }
+}
+
+static void post_watch(void *arg)
+{
+    ChildWatch *w = arg;
+    /* the child may have exited before we got here: check right away */
+    if (watch_poll(w))
+    {
+        free(w);
+        return;
+    }
+    w->next = watches;
+    watches = w;
+}
+
+int reactor_watch_child(pid_t pid, reactor_child_cb cb, void *arg)
+{
+    ChildWatch *w = calloc(1, sizeof(*w));
+    if (!w)
+        return -1;
+    w->pid = pid;
+    w->cb = cb;
+    w->arg = arg;
+    if (reactor_post(post_watch, w) < 0)
+    {
+        free(w);
+        return -1;
+    }
+    return 0;
+}
+
+/* SIGCHLD does not say which child changed state (and several may coalesce),
+   so every watched pid is polled; other code keeps using waitpid() on its own pids */
+static void sigchld_ready(void)
+{
+    struct signalfd_siginfo si;
+    while (read(sig_fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+    {
+    }
+    ChildWatch **pp = &watches;
+    while (*pp)
+    {
+        ChildWatch *w = *pp;
+        if (watch_poll(w))
+        {
+            *pp = w->next;
+            free(w);
+        }
+        else
+            pp = &w->next;
+    }
+}
+
+/* -------------------- loop -------------------- */
+
+static void *reactor_main(void *unused)
+{
+    (void)unused;
+    struct epoll_event evs[REACTOR_MAX_EVENTS];
+    for (;;)
+    {
+        int n = epoll_wait(epfd, evs, REACTOR_MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        /* the foreground group's readers go first */
+        int fg = __atomic_load_n(&fg_group, __ATOMIC_RELAXED);
+        if (fg >= 0)
+            for (int i = 0; i < n; ++i)
+            {
+                Source *s = evs[i].data.ptr;
+                if (s->kind == SRC_READER && s->group == fg)
+                {
+                    if (!s->dead && !s->parked)
+                        reader_ready(s);
+                    evs[i].data.ptr = NULL;
+                }
+            }
+        for (int i = 0; i < n; ++i)
+        {
+            Source *s = evs[i].data.ptr;
+            if (!s || s->dead || s->parked)
+                continue;
+            switch (s->kind)
+            {
+            case SRC_WAKE:
+                run_posts();
+                break;
+            case SRC_SIGNAL:
+                sigchld_ready();
+                break;
+            case SRC_READER:
+                reader_ready(s);
+                break;
+            case SRC_TIMER:
+                timer_ready(s);
+                break;
+            case SRC_URING:
+                uring_ready();
+                break;
+            case SRC_TICK:
+                tick_ready();
+                break;
+            }
+        }
+        free_dead_sources();
+    }
+    return NULL;
+}
+
+int reactor_start(void)
+{
+    /* SIGCHLD goes to the signalfd only; threads created later inherit the mask,
+       launch_spawn() gives children an empty one */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0)
+        return -1;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epfd < 0 || wake_fd < 0 || sig_fd < 0 || tick_fd < 0)
+        return -1;
+    wake_src.fd = wake_fd;
+    sig_src.fd = sig_fd;
+    tick_src.fd = tick_fd;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_src;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev) < 0)
+        return -1;
+    ev.data.ptr = &sig_src;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sig_fd, &ev) < 0)
+        return -1;
+    ev.data.ptr = &tick_src;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, tick_fd, &ev) < 0)
+        return -1;
+    const char *be = getenv("MYTERM_INGEST");
+    if (be && strcmp(be, "uring") == 0 && uring_setup() != 0)
+        fprintf(stderr, "MYTERM_INGEST=uring: io_uring unavailable, using epoll\n");
+    if (pthread_create(&reactor_thr, NULL, reactor_main, NULL) != 0)
+        return -1;
+    pthread_detach(reactor_thr);
+    return 0;
+}
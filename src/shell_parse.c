@@ -0,0 +1,570 @@
+#define _GNU_SOURCE
+#include "shell_parse.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef enum
+{
+    T_EOF,
+    T_WORD,
+    T_NEWLINE,
+    T_SEMI,
+    T_AMP,
+    T_PIPE,
+    T_OR_IF,
+    T_AND_IF,
+    T_LPAREN,
+    T_RPAREN,
+    T_REDIR
+} TokKind;
+
+typedef struct
+{
+    TokKind kind;
+    const char *start; /* source span, for messages */
+    size_t len;
+    char *word;        /* T_WORD, decoded */
+    int glob;
+    ShRedirKind rkind; /* T_REDIR */
+    int fd;
+} Tok;
+
+typedef struct
+{
+    Arena *a;
+    const char *p; /* next unread byte */
+    Tok tok;       /* current token */
+    const char *err;
+} Parser;
+
+static void fail(Parser *ps, const char *fmt, ...)
+{
+    if (ps->err)
+        return;
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    ps->err = arena_strndup(ps->a, buf, strlen(buf));
+    if (!ps->err)
+        ps->err = "out of memory";
+}
+
+static void fail_unexpected(Parser *ps)
+{
+    if (ps->tok.kind == T_EOF)
+        fail(ps, "syntax error: unexpected end of line");
+    else if (ps->tok.kind == T_NEWLINE)
+        fail(ps, "syntax error near unexpected newline");
+    else
+        fail(ps, "syntax error near unexpected token `%.*s'", (int)ps->tok.len, ps->tok.start);
+}
+
+static int ends_word(char c)
+{
+    return c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == '|' || c == '&' || c == ';' ||
+           c == '(' || c == ')' || c == '<' || c == '>';
+}
+
+static char unescape(char c)
+{
+    return c == 'n' ? '\n' : c == 't' ? '\t' : c;
+}
+
+/* characters glob_expand() treats as special, so a quoted one must reach it escaped */
+static int glob_special(char c)
+{
+    return c && strchr("*?[]{},~\\", c) != NULL;
+}
+
+/* a quoted or escaped character of the word being decoded: in a word that will be
+   globbed it gets a backslash in front if glob_expand() would take it as special */
+static char *put_quoted(char *o, char c, int glob)
+{
+    if (glob && glob_special(c))
+        *o++ = '\\';
+    *o++ = c;
+    return o;
+}
+
+/* undo put_quoted() for a glob word that is used as is (a redirection target) */
+static void strip_escapes(char *w)
+{
+    char *o = w;
+    for (; *w; ++w)
+    {
+        if (*w == '\\' && w[1])
+            ++w;
+        *o++ = *w;
+    }
+    *o = '\0';
+}
+
+/* a word runs to the first unquoted blank or operator character: find its end, then
+   decode it into a string of at most that length (twice that for a glob word, whose
+   quoted special characters are escaped for glob_expand()) */
+static int lex_word(Parser *ps, Tok *t)
+{
+    const char *s = ps->p, *q = s;
+    int glob = 0;
+    while (!ends_word(*q))
+    {
+        if (*q == '\'')
+        {
+            const char *e = strchr(q + 1, '\'');
+            if (!e)
+                goto unterminated;
+            q = e + 1;
+        }
+        else if (*q == '"')
+        {
+            for (++q; *q && *q != '"'; ++q)
+                if (*q == '\\' && q[1])
+                    ++q;
+            if (!*q)
+                goto unterminated;
+            ++q;
+        }
+        else if (*q == '\\')
+            q += q[1] ? 2 : 1;
+        else
+        {
+            glob |= *q == '*' || *q == '?' || *q == '[' || *q == '{';
+            ++q;
+        }
+    }
+
+    char *w = arena_alloc(ps->a, (size_t)(q - s) * (glob ? 2 : 1) + 1), *o = w;
+    if (!w)
+    {
+        fail(ps, "out of memory");
+        return -1;
+    }
+    for (const char *c = s; c < q;)
+    {
+        if (*c == '\'')
+        {
+            for (++c; *c != '\''; ++c)
+                o = put_quoted(o, *c, glob);
+            ++c;
+        }
+        else if (*c == '"')
+        {
+            for (++c; *c != '"'; ++c)
+                o = put_quoted(o, (*c == '\\' && c[1]) ? unescape(*++c) : *c, glob);
+            ++c;
+        }
+        else if (*c == '\\')
+        {
+            if (++c < q)
+                o = put_quoted(o, unescape(*c++), glob);
+        }
+        else
+            *o++ = *c++;
+    }
+    *o = '\0';
+    t->kind = T_WORD;
+    t->word = w;
+    t->glob = glob;
+    t->len = (size_t)(q - s);
+    ps->p = q;
+    return 0;
+
+unterminated:
+    fail(ps, "syntax error: unterminated quote");
+    return -1;
+}
+
+/* read the next token into ps->tok; -1 on error */
+static int lex(Parser *ps)
+{
+    Tok *t = &ps->tok;
+    const char *c = ps->p;
+    for (;;)
+    {
+        while (*c == ' ' || *c == '\t' || *c == '\r')
+            ++c;
+        if (*c != '#')
+            break;
+        while (*c && *c != '\n')
+            ++c;
+    }
+    memset(t, 0, sizeof(*t));
+    t->start = c;
+    ps->p = c;
+
+    int fd = -1;
+    if (isdigit((unsigned char)c[0]) && (c[1] == '<' || c[1] == '>'))
+        fd = *c++ - '0';
+    size_t n = 1;
+    switch (*c)
+    {
+    case '\0':
+        t->kind = T_EOF;
+        n = 0;
+        break;
+    case '\n':
+        t->kind = T_NEWLINE;
+        break;
+    case ';':
+        t->kind = T_SEMI;
+        break;
+    case '(':
+        t->kind = T_LPAREN;
+        break;
+    case ')':
+        t->kind = T_RPAREN;
+        break;
+    case '|':
+        t->kind = c[1] == '|' ? T_OR_IF : T_PIPE;
+        n = c[1] == '|' ? 2 : 1;
+        break;
+    case '&':
+        t->kind = c[1] == '&' ? T_AND_IF : T_AMP;
+        n = c[1] == '&' ? 2 : 1;
+        break;
+    case '<':
+        t->kind = T_REDIR;
+        t->fd = fd >= 0 ? fd : 0;
+        if (c[1] == '<')
+        {
+            ps->p = c + 2;
+            t->len = (size_t)(ps->p - t->start);
+            fail(ps, "here-documents are not supported");
+            return -1;
+        }
+        t->rkind = c[1] == '&' ? SH_REDIR_DUP : SH_REDIR_IN;
+        n = c[1] == '&' ? 2 : 1;
+        break;
+    case '>':
+        t->kind = T_REDIR;
+        t->fd = fd >= 0 ? fd : 1;
+        t->rkind = c[1] == '>' ? SH_REDIR_APPEND : c[1] == '&' ? SH_REDIR_DUP : SH_REDIR_OUT;
+        n = (c[1] == '>' || c[1] == '&' || c[1] == '|') ? 2 : 1;
+        break;
+    default:
+        return lex_word(ps, t) < 0 ? -1 : 0;
+    }
+    ps->p = c + n;
+    t->len = (size_t)(ps->p - t->start);
+    return 0;
+}
+
+static int next(Parser *ps)
+{
+    return ps->err ? -1 : lex(ps);
+}
+
+static int skip_newlines(Parser *ps)
+{
+    while (ps->tok.kind == T_NEWLINE)
+        if (next(ps) < 0)
+            return -1;
+    return 0;
+}
+
+static ShNode *new_node(Parser *ps, ShKind kind, ShNode *left, ShNode *right)
+{
+    ShNode *n = arena_alloc(ps->a, sizeof(*n));
+    if (!n)
+    {
+        fail(ps, "out of memory");
+        return NULL;
+    }
+    n->kind = kind;
+    n->left = left;
+    n->right = right;
+    return n;
+}
+
+static ShNode *parse_list(Parser *ps, TokKind end);
+
+/* current token is T_REDIR: append it, with its operand, to *tail */
+static int parse_redirect(Parser *ps, ShRedir ***tail)
+{
+    ShRedir *r = arena_alloc(ps->a, sizeof(*r));
+    if (!r)
+    {
+        fail(ps, "out of memory");
+        return -1;
+    }
+    r->kind = ps->tok.rkind;
+    r->fd = ps->tok.fd;
+    if (next(ps) < 0)
+        return -1;
+    if (ps->tok.kind != T_WORD)
+    {
+        fail_unexpected(ps);
+        return -1;
+    }
+    if (r->kind == SH_REDIR_DUP)
+    {
+        const char *w = ps->tok.word;
+        if (!isdigit((unsigned char)w[0]) || w[1])
+        {
+            fail(ps, "%s: bad file descriptor for duplication", w);
+            return -1;
+        }
+        r->dup_fd = w[0] - '0';
+    }
+    else
+    {
+        /* targets are not globbed */
+        if (ps->tok.glob)
+            strip_escapes(ps->tok.word);
+        r->target = ps->tok.word;
+    }
+    **tail = r;
+    *tail = &r->next;
+    return next(ps);
+}
+
+typedef struct WordLink
+{
+    char *word;
+    int glob;
+    struct WordLink *next;
+} WordLink;
+
+static int parse_command(Parser *ps, ShCommand *cmd)
+{
+    ShRedir **rtail = &cmd->redirs;
+    if (ps->tok.kind == T_LPAREN)
+    {
+        const char *inner = ps->p;
+        if (next(ps) < 0)
+            return -1;
+        cmd->body = parse_list(ps, T_RPAREN);
+        if (!cmd->body)
+        {
+            if (!ps->err)
+                fail_unexpected(ps);
+            return -1;
+        }
+        cmd->source = arena_strndup(ps->a, inner, (size_t)(ps->tok.start - inner));
+        cmd->argv = arena_alloc(ps->a, sizeof(char *));
+        if (!cmd->source || !cmd->argv)
+        {
+            fail(ps, "out of memory");
+            return -1;
+        }
+        if (next(ps) < 0)
+            return -1;
+        while (ps->tok.kind == T_REDIR)
+            if (parse_redirect(ps, &rtail) < 0)
+                return -1;
+        return 0;
+    }
+
+    /* words are collected in a list, then laid out as argv once their number is known */
+    WordLink *head = NULL, **wtail = &head;
+    int argc = 0;
+    while (ps->tok.kind == T_WORD || ps->tok.kind == T_REDIR)
+    {
+        if (ps->tok.kind == T_REDIR)
+        {
+            if (parse_redirect(ps, &rtail) < 0)
+                return -1;
+            continue;
+        }
+        WordLink *l = arena_alloc(ps->a, sizeof(*l));
+        if (!l)
+        {
+            fail(ps, "out of memory");
+            return -1;
+        }
+        l->word = ps->tok.word;
+        l->glob = ps->tok.glob;
+        *wtail = l;
+        wtail = &l->next;
+        ++argc;
+        if (next(ps) < 0)
+            return -1;
+    }
+    if (argc == 0 && !cmd->redirs)
+    {
+        fail_unexpected(ps);
+        return -1;
+    }
+    cmd->argc = argc;
+    cmd->argv = arena_alloc(ps->a, (size_t)(argc + 1) * sizeof(char *));
+    cmd->glob = arena_alloc(ps->a, (size_t)argc + 1);
+    if (!cmd->argv || !cmd->glob)
+    {
+        fail(ps, "out of memory");
+        return -1;
+    }
+    int i = 0;
+    for (WordLink *l = head; l; l = l->next, ++i)
+    {
+        cmd->argv[i] = l->word;
+        cmd->glob[i] = (unsigned char)l->glob;
+    }
+    return 0;
+}
+
+typedef struct CmdLink
+{
+    ShCommand cmd;
+    struct CmdLink *next;
+} CmdLink;
+
+/* `time` is a keyword only unquoted, in front of a command */
+static int parse_time(Parser *ps)
+{
+    if (ps->tok.kind != T_WORD || ps->tok.len != 4 || memcmp(ps->tok.start, "time", 4) != 0)
+        return 0;
+    Parser saved = *ps;
+    if (next(ps) < 0)
+        return -1;
+    if (ps->tok.kind == T_WORD || ps->tok.kind == T_LPAREN || ps->tok.kind == T_REDIR)
+        return 1;
+    *ps = saved; /* `time` alone is just a command name */
+    return 0;
+}
+
+static ShNode *parse_pipeline(Parser *ps)
+{
+    CmdLink *head = NULL, **tail = &head;
+    int n = 0;
+    int timed = parse_time(ps);
+    if (timed < 0)
+        return NULL;
+    for (;;)
+    {
+        CmdLink *l = arena_alloc(ps->a, sizeof(*l));
+        if (!l)
+        {
+            fail(ps, "out of memory");
+            return NULL;
+        }
+        if (parse_command(ps, &l->cmd) < 0)
+            return NULL;
+        *tail = l;
+        tail = &l->next;
+        ++n;
+        if (ps->tok.kind != T_PIPE)
+            break;
+        if (next(ps) < 0 || skip_newlines(ps) < 0)
+            return NULL;
+    }
+    ShNode *node = new_node(ps, SH_PIPELINE, NULL, NULL);
+    if (!node)
+        return NULL;
+    node->cmds = arena_alloc(ps->a, (size_t)n * sizeof(ShCommand));
+    if (!node->cmds)
+    {
+        fail(ps, "out of memory");
+        return NULL;
+    }
+    node->ncmds = n;
+    node->timed = timed;
+    int i = 0;
+    for (CmdLink *l = head; l; l = l->next)
+        node->cmds[i++] = l->cmd;
+    return node;
+}
+
+static ShNode *parse_and_or(Parser *ps)
+{
+    ShNode *left = parse_pipeline(ps);
+    while (left && (ps->tok.kind == T_AND_IF || ps->tok.kind == T_OR_IF))
+    {
+        ShKind kind = ps->tok.kind == T_AND_IF ? SH_AND : SH_OR;
+        if (next(ps) < 0 || skip_newlines(ps) < 0)
+            return NULL;
+        ShNode *right = parse_pipeline(ps);
+        left = right ? new_node(ps, kind, left, right) : NULL;
+    }
+    return left;
+}
+
+/* `item &`: a pipeline is marked to run in the background; a longer and-or chain
+   becomes a background subshell of its own text (start .. the '&') */
+static ShNode *make_background(Parser *ps, ShNode *item, const char *start)
+{
+    if (item->kind == SH_PIPELINE)
+    {
+        item->background = 1;
+        return item;
+    }
+    ShNode *node = new_node(ps, SH_PIPELINE, NULL, NULL);
+    if (!node)
+        return NULL;
+    node->cmds = arena_alloc(ps->a, sizeof(ShCommand));
+    if (!node->cmds)
+    {
+        fail(ps, "out of memory");
+        return NULL;
+    }
+    node->ncmds = 1;
+    node->background = 1;
+    node->cmds[0].body = item;
+    const char *end = ps->tok.start;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+        --end;
+    node->cmds[0].source = arena_strndup(ps->a, start, (size_t)(end - start));
+    node->cmds[0].argv = arena_alloc(ps->a, sizeof(char *));
+    if (!node->cmds[0].source || !node->cmds[0].argv)
+    {
+        fail(ps, "out of memory");
+        return NULL;
+    }
+    return node;
+}
+
+/* and_or chains up to `end` (T_EOF or T_RPAREN), which is left as the current token */
+static ShNode *parse_list(Parser *ps, TokKind end)
+{
+    ShNode *list = NULL;
+    if (skip_newlines(ps) < 0)
+        return NULL;
+    while (ps->tok.kind != end)
+    {
+        const char *start = ps->tok.start;
+        ShNode *item = parse_and_or(ps);
+        if (item && ps->tok.kind == T_AMP)
+            item = make_background(ps, item, start);
+        if (!item)
+            return NULL;
+        list = list ? new_node(ps, SH_SEQ, list, item) : item;
+        if (!list)
+            return NULL;
+        if (ps->tok.kind == T_SEMI || ps->tok.kind == T_NEWLINE || ps->tok.kind == T_AMP)
+        {
+            if (next(ps) < 0 || skip_newlines(ps) < 0)
+                return NULL;
+        }
+        else if (ps->tok.kind != end)
+        {
+            fail_unexpected(ps);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+ShNode *sh_parse(Arena *a, const char *src, const char **err)
+{
+    Parser ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.a = a;
+    ps.p = src;
+    *err = NULL;
+    if (lex(&ps) < 0)
+    {
+        *err = ps.err;
+        return NULL;
+    }
+    ShNode *root = parse_list(&ps, T_EOF);
+    if (ps.err)
+    {
+        *err = ps.err;
+        return NULL;
+    }
+    return root;
+}
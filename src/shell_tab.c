@@ -1,6 +1,9 @@
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #include "shell_tab.h"
 #include "line_edit.h"
+#include "launch.h"
+#include "reactor.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,25 +14,237 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <limits.h>
 
 #define MAX_TABS 8
-#define INITIAL_CAP 16384
 
 /* Use pointer array so we can move pointers safely without copying mutex objects */
 static Tab *tabs[MAX_TABS];
 static int g_count = 0;
 
+/* tabs[] and g_count change on the main thread only, under the write side; other
+   threads resolve an index and use the Tab under the read side (tabs_append_output,
+   tabs_ingest_fd), so tabs_close() can neither free a tab under them nor move another
+   one into its slot. Registered indices (tabs_link) are renumbered under it too. */
+static pthread_rwlock_t g_tabs_lock = PTHREAD_RWLOCK_INITIALIZER;
+static TabLink g_links = {NULL, &g_links, &g_links};
+static pthread_mutex_t g_links_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* --- notify pipe write-end (optional) ---
    main() can call tabs_set_notify_fd(write_fd) to give us a write-end of a pipe.
    When we append new output we write one byte to wake the main loop's select().
 */
 static int g_notify_fd = -1;
 
+/* bytes handed to write() per flush of a tab's outbound queue */
+static size_t g_write_chunk = TABS_WRITE_CHUNK;
+
+/* scrollback limit given to new tabs */
+static size_t g_sb_max = TABS_SCROLLBACK_DEFAULT;
+
+/* requested capacity of capture pipes (F_SETPIPE_SZ) */
+static size_t g_pipe_size = TABS_PIPE_SIZE;
+
+/* watermarks given to new tabs */
+static size_t g_flow_high = TABS_FLOW_HIGH;
+static size_t g_flow_low = TABS_FLOW_LOW;
+
+/* index of the tab on screen (written by the main thread, read by the reactor) */
+static int g_active = -1;
+
+static void notify_main(void);
+
 /* Allow main.c to give us a notify pipe write-end so we can wake the UI */
 void tabs_set_notify_fd(int fd) {
     g_notify_fd = fd;
 }
 
+void tabs_wake_main(void) {
+    notify_main();
+}
+
+void tabs_set_active(int idx) {
+    int prev = __atomic_exchange_n(&g_active, idx, __ATOMIC_RELAXED);
+    /* a tab coming on screen may have been held while hidden: its backlog is
+       indexed (and the hold released) by the UI's tabs_catch_up() from the next
+       frame on, so make sure that frame comes */
+    Tab *t = tabs_get(idx);
+    if (prev == idx || !t) return;
+    pthread_mutex_lock(&t->lock);
+    int backlog = t->out_len > t->indexed_len;
+    pthread_mutex_unlock(&t->lock);
+    if (backlog) notify_main();
+}
+
+static int is_active(int idx) {
+    return idx == __atomic_load_n(&g_active, __ATOMIC_RELAXED);
+}
+
+
+/* scrollback memfd plus its read-only view; the view covers the whole limit even
+   though the file only grows as output arrives (pages past EOF are never touched) */
+static int sb_open(Tab *t) {
+    t->sb_fd = memfd_create("myterm-scrollback", MFD_CLOEXEC);
+    if (t->sb_fd < 0) return -1;
+    void *p = mmap(NULL, g_sb_max, PROT_READ, MAP_SHARED | MAP_NORESERVE, t->sb_fd, 0);
+    if (p == MAP_FAILED) {
+        close(t->sb_fd);
+        t->sb_fd = -1;
+        return -1;
+    }
+    t->out_buf = p;
+    t->out_cap = g_sb_max;
+    return 0;
+}
+
+static void sb_close(Tab *t) {
+    if (t->out_buf) munmap((void *)t->out_buf, t->out_cap);
+    if (t->sb_fd >= 0) close(t->sb_fd);
+    t->out_buf = NULL;
+    t->sb_fd = -1;
+}
+
+extern char **environ;
+
+/* --- per-tab execution context --- */
+
+static void ctx_free(Tab *t) {
+    if (t->cwd_fd >= 0) close(t->cwd_fd);
+    t->cwd_fd = -1;
+    free(t->cwd);
+    t->cwd = NULL;
+    for (size_t i = 0; i < t->env_len; ++i) free(t->env[i]);
+    free(t->env);
+    t->env = NULL;
+    t->env_len = t->env_cap = 0;
+}
+
+/* a new tab starts where the process is, with a copy of its environment */
+static int ctx_init(Tab *t) {
+    t->cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    t->cwd = getcwd(NULL, 0);
+    size_t n = 0;
+    while (environ && environ[n]) n++;
+    t->env_cap = n + 16;
+    t->env = calloc(t->env_cap, sizeof(char *));
+    if (!t->env) { ctx_free(t); return -1; }
+    for (; t->env_len < n; t->env_len++) {
+        t->env[t->env_len] = strdup(environ[t->env_len]);
+        if (!t->env[t->env_len]) { ctx_free(t); return -1; }
+    }
+    return 0;
+}
+
+/* slot of name in t->env, or -1; caller holds t->lock or is the main thread */
+static ssize_t env_find(const Tab *t, const char *name, size_t nlen) {
+    for (size_t i = 0; i < t->env_len; ++i)
+        if (strncmp(t->env[i], name, nlen) == 0 && t->env[i][nlen] == '=') return (ssize_t)i;
+    return -1;
+}
+
+int tabs_cwd_fd(int idx) {
+    Tab *t = tabs_get(idx);
+    return (t && t->cwd_fd >= 0) ? t->cwd_fd : AT_FDCWD;
+}
+
+char *const *tabs_env(int idx) {
+    Tab *t = tabs_get(idx);
+    return t ? t->env : NULL;
+}
+
+int tabs_getcwd(int idx, char *buf, size_t len) {
+    Tab *t = tabs_get(idx);
+    if (!t) { errno = EINVAL; return -1; }
+    pthread_mutex_lock(&t->lock);
+    int rc = 0;
+    if (!t->cwd) { errno = ENOENT; rc = -1; }
+    else if (strlen(t->cwd) >= len) { errno = ERANGE; rc = -1; }
+    else strcpy(buf, t->cwd);
+    pthread_mutex_unlock(&t->lock);
+    return rc;
+}
+
+char *tabs_getenv(int idx, const char *name) {
+    Tab *t = tabs_get(idx);
+    if (!t || !name) return NULL;
+    size_t nlen = strlen(name);
+    pthread_mutex_lock(&t->lock);
+    ssize_t i = env_find(t, name, nlen);
+    char *v = i >= 0 ? strdup(t->env[i] + nlen + 1) : NULL;
+    pthread_mutex_unlock(&t->lock);
+    return v;
+}
+
+int tabs_setenv(int idx, const char *name, const char *value) {
+    Tab *t = tabs_get(idx);
+    if (!t || !name || !*name || strchr(name, '=')) { errno = EINVAL; return -1; }
+    size_t nlen = strlen(name);
+    char *entry = NULL;
+    if (value) {
+        entry = malloc(nlen + strlen(value) + 2);
+        if (!entry) return -1;
+        sprintf(entry, "%s=%s", name, value);
+    }
+    pthread_mutex_lock(&t->lock);
+    ssize_t i = env_find(t, name, nlen);
+    char *old = NULL;
+    int rc = 0;
+    if (i >= 0 && entry) {
+        old = t->env[i];
+        t->env[i] = entry;
+    } else if (i >= 0) {
+        old = t->env[i];
+        memmove(&t->env[i], &t->env[i + 1], (t->env_len - (size_t)i) * sizeof(char *));
+        t->env_len--;
+    } else if (entry) {
+        if (t->env_len + 1 >= t->env_cap) {
+            size_t ncap = t->env_cap * 2 + 16;
+            char **ne = realloc(t->env, ncap * sizeof(char *));
+            if (!ne) { old = entry; rc = -1; errno = ENOMEM; }
+            else { t->env = ne; t->env_cap = ncap; }
+        }
+        if (rc == 0) {
+            t->env[t->env_len++] = entry;
+            t->env[t->env_len] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    free(old);
+    return rc;
+}
+
+/* physical path of a directory fd */
+static char *dirfd_path(int fd) {
+    char link[64], buf[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t n = readlink(link, buf, sizeof(buf) - 1);
+    if (n <= 0) return NULL;
+    buf[n] = '\0';
+    return strdup(buf);
+}
+
+int tabs_chdir(int idx, const char *path) {
+    Tab *t = tabs_get(idx);
+    if (!t || !path) { errno = EINVAL; return -1; }
+    int fd = openat(tabs_cwd_fd(idx), path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    /* O_PATH skips the search permission check chdir() would make */
+    if (faccessat(fd, ".", X_OK, 0) != 0) { int e = errno; close(fd); errno = e; return -1; }
+    char *p = dirfd_path(fd);
+
+    pthread_mutex_lock(&t->lock);
+    int old_fd = t->cwd_fd;
+    char *old = t->cwd;
+    t->cwd_fd = fd;
+    t->cwd = p;
+    pthread_mutex_unlock(&t->lock);
+    if (old_fd >= 0) close(old_fd);
+    if (old) tabs_setenv(idx, "OLDPWD", old);
+    if (p) tabs_setenv(idx, "PWD", p);
+    free(old);
+    return 0;
+}
 
 /* Helper: allocate and initialize a Tab object */
 static Tab *tab_alloc(int id) {
@@ -39,15 +254,26 @@ static Tab *tab_alloc(int id) {
     t->pid = -1;
     t->to_child_fd = -1;
     t->from_child_fd = -1;
-    t->input_len = 0;
-    t->input[0] = '\0';
-    t->input_pos = 0;        /* cursor index for line editing */
+    t->job_in_fd = -1;
     t->editor = NULL;        /* created when tab is made */
     t->out_buf = NULL;
     t->out_len = 0;
     t->out_cap = 0;
     t->alive = 0;
+    t->flow_high = g_flow_high;
+    t->flow_low = g_flow_low;
+    if (ctx_init(t) != 0) {
+        free(t);
+        return NULL;
+    }
+    if (sb_open(t) != 0) {
+        ctx_free(t);
+        free(t);
+        return NULL;
+    }
     if (pthread_mutex_init(&t->lock, NULL) != 0) {
+        sb_close(t);
+        ctx_free(t);
         free(t);
         return NULL;
     }
@@ -63,41 +289,290 @@ static void tab_free(Tab *t) {
         t->editor = NULL;
     }
     pthread_mutex_destroy(&t->lock);
-    if (t->out_buf) free(t->out_buf);
+    sb_close(t);
+    ctx_free(t);
+    free(t->line_starts);
+    free(t->inq);
+    if (t->job_in_fd >= 0) close(t->job_in_fd);
     free(t);
 }
 
-/* internal: ensure capacity for append; caller must hold lock */
-static void ensure_capacity_locked(Tab *t, size_t extra) {
-    if (!t) return;
-    if (t->out_len + extra + 1 >= t->out_cap) {
-        size_t nc = t->out_cap ? t->out_cap * 2 : INITIAL_CAP;
-        while (nc < t->out_len + extra + 1) nc *= 2;
-        char *p = realloc(t->out_buf, nc);
-        if (!p) return;
-        t->out_buf = p;
-        t->out_cap = nc;
+/* the tail of the scrollback kept for the "full" notice */
+#define SB_NOTE_ROOM 128
+
+/* internal: bytes of output the scrollback can still take; caller must hold lock */
+static size_t sb_room_locked(Tab *t) {
+    if (!t || !t->out_buf || t->sb_full || t->out_len + SB_NOTE_ROOM >= t->out_cap) return 0;
+    return t->out_cap - SB_NOTE_ROOM - t->out_len;
+}
+
+/* internal: once output no longer fits, say so at the end of the scrollback (once);
+   caller must hold lock */
+static void sb_mark_full_locked(Tab *t) {
+    if (t->sb_full || !t->out_buf) return;
+    char note[SB_NOTE_ROOM];
+    int m = snprintf(note, sizeof(note), "\n[scrollback limit of %zu MB reached: further output is discarded]\n",
+                     t->out_cap >> 20);
+    if (m > 0 && pwrite(t->sb_fd, note, (size_t)m, (off_t)t->out_len) == m) t->out_len += (size_t)m;
+    t->sb_full = 1;
+}
+
+/* internal: extend the line index over out_buf[indexed_len, indexed_len + max) (stopping
+   at out_len); caller must hold lock */
+static void index_lines_locked(Tab *t, size_t max) {
+    if (t->nlines == 0) {
+        if (!t->line_starts) {
+            t->line_starts = malloc(64 * sizeof(size_t));
+            if (!t->line_starts) return;
+            t->lines_cap = 64;
+        }
+        t->line_starts[0] = 0;
+        t->nlines = 1;
     }
+    size_t stop = t->out_len - t->indexed_len > max ? t->indexed_len + max : t->out_len;
+    const char *p = t->out_buf + t->indexed_len;
+    const char *end = t->out_buf + stop;
+    while (p < end && (p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        if (t->nlines >= t->lines_cap) {
+            size_t *np = realloc(t->line_starts, t->lines_cap * 2 * sizeof(size_t));
+            if (!np) {
+                t->indexed_len = (size_t)(p - t->out_buf);
+                return;
+            }
+            t->line_starts = np;
+            t->lines_cap *= 2;
+        }
+        t->line_starts[t->nlines++] = (size_t)(p - t->out_buf) + 1;
+        ++p;
+    }
+    t->indexed_len = stop;
 }
 
-/* thread-safe append exposed to other modules */
-void tabs_append_output(int idx, const char *buf, ssize_t n) {
+size_t tabs_line_count_locked(Tab *t) {
+    if (!t || t->nlines == 0) return 0;
+    /* an empty last line after a trailing newline is not shown */
+    if (t->line_starts[t->nlines - 1] >= t->indexed_len) return t->nlines - 1;
+    return t->nlines;
+}
+
+int tabs_line_span_locked(Tab *t, size_t i, size_t *start, size_t *end) {
+    if (!t || i >= t->nlines) return -1;
+    *start = t->line_starts[i];
+    *end = (i + 1 < t->nlines) ? t->line_starts[i + 1] - 1 : t->indexed_len;
+    return 0;
+}
+
+size_t tabs_line_of_offset_locked(Tab *t, size_t off) {
+    if (!t || t->nlines == 0) return 0;
+    /* binary search for the last line start <= off */
+    size_t lo = 0, hi = t->nlines;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (t->line_starts[mid] <= off) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* internal: after output was added to tab t. Output is only indexed by the UI,
+   for the tab on screen (tabs_catch_up); once any tab, hidden or not, is flow_high
+   ahead of its index, stop reading and let the pipe push back (returns 1 when the
+   caller must hold the tab's ingest group). A hidden tab stays held until it is
+   shown, so a flood there costs flow_high of scrollback, not all of it. Caller
+   holds lock. */
+static int flow_check_locked(Tab *t) {
+    if (t->out_len - t->indexed_len < t->flow_high) return 0;
+    if (t->flow_held) return 0;
+    t->flow_held = 1;
+    return 1;
+}
+
+/* internal: append to tab idx; caller holds g_tabs_lock (either side) */
+static void append_output(int idx, const char *buf, ssize_t n) {
     if (idx < 0 || idx >= g_count) return;
     Tab *t = tabs[idx];
     if (!t) return;
 
     /* append under lock */
+    int hold = 0;
+    pthread_mutex_lock(&t->lock);
+    if (n > 0 && sb_room_locked(t) < (size_t)n) {
+        sb_mark_full_locked(t);
+    } else if (n > 0) {
+        size_t done = 0;
+        while (done < (size_t)n) {
+            ssize_t w = pwrite(t->sb_fd, buf + done, (size_t)n - done, (off_t)(t->out_len + done));
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            done += (size_t)w;
+        }
+        t->out_len += done;
+        hold = flow_check_locked(t);
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    if (hold) reactor_hold_group(idx, 1);
+    if (is_active(idx)) notify_main();
+}
+
+/* thread-safe append exposed to other modules */
+void tabs_append_output(int idx, const char *buf, ssize_t n) {
+    pthread_rwlock_rdlock(&g_tabs_lock);
+    append_output(idx, buf, n);
+    pthread_rwlock_unlock(&g_tabs_lock);
+}
+
+void tabs_append_output_at(const atomic_int *idx, const char *buf, ssize_t n) {
+    pthread_rwlock_rdlock(&g_tabs_lock);
+    append_output(atomic_load(idx), buf, n);
+    pthread_rwlock_unlock(&g_tabs_lock);
+}
+
+/* internal: splice the pipe into the scrollback memfd at out_len; the pages then show
+   up in the read-only mapping, where the line index scans them. Caller holds
+   g_tabs_lock (either side). */
+static ssize_t ingest_fd(int idx, int fd) {
+    char spill[64 * 1024];
+    Tab *t = tabs_get(idx);
+    if (!t) {
+        /* the tab is gone: keep draining so the writer does not block */
+        return read(fd, spill, sizeof(spill));
+    }
+
     pthread_mutex_lock(&t->lock);
-    ensure_capacity_locked(t, (size_t)n);
-    if (t->out_buf && n > 0) {
-        memcpy(t->out_buf + t->out_len, buf, n);
-        t->out_len += n;
-        t->out_buf[t->out_len] = '\0';
+    ssize_t r = -1;
+    int hold = 0;
+    size_t room = sb_room_locked(t);
+    if (room > 0) {
+        size_t want = room < g_pipe_size ? room : g_pipe_size;
+        loff_t off = (loff_t)t->out_len;
+        do {
+            r = splice(fd, NULL, t->sb_fd, &off, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (r < 0 && errno == EINTR);
+        if (r < 0 && errno == EINVAL) {
+            /* not a pipe: plain read + pwrite */
+            r = read(fd, spill, want < sizeof(spill) ? want : sizeof(spill));
+            if (r > 0 && pwrite(t->sb_fd, spill, (size_t)r, (off_t)t->out_len) != r) r = -1;
+        }
+        if (r > 0) {
+            t->out_len += (size_t)r;
+            hold = flow_check_locked(t);
+        }
+    } else {
+        /* scrollback full: keep draining, drop the bytes */
+        r = read(fd, spill, sizeof(spill));
+        if (r > 0) {
+            sb_mark_full_locked(t);
+            hold = flow_check_locked(t);
+        }
     }
     pthread_mutex_unlock(&t->lock);
 
-    /* Best-effort notify: write one byte into notify pipe (non-blocking should be set by caller)
-       and otherwise rely on need_redraw flag in main loop to pull changes. */
+    if (hold) reactor_hold_group(idx, 1);
+    if (r > 0 && is_active(idx)) notify_main();
+    return r;
+}
+
+ssize_t tabs_ingest_fd(int idx, int fd) {
+    pthread_rwlock_rdlock(&g_tabs_lock);
+    ssize_t r = ingest_fd(idx, fd);
+    pthread_rwlock_unlock(&g_tabs_lock);
+    return r;
+}
+
+ssize_t tabs_ingest_fd_at(const atomic_int *idx, int fd) {
+    pthread_rwlock_rdlock(&g_tabs_lock);
+    ssize_t r = ingest_fd(atomic_load(idx), fd);
+    pthread_rwlock_unlock(&g_tabs_lock);
+    return r;
+}
+
+void tabs_link(TabLink *l, atomic_int *idx) {
+    pthread_mutex_lock(&g_links_lock);
+    l->idx = idx;
+    l->prev = g_links.prev;
+    l->next = &g_links;
+    g_links.prev->next = l;
+    g_links.prev = l;
+    pthread_mutex_unlock(&g_links_lock);
+}
+
+void tabs_unlink(TabLink *l) {
+    if (!l->next) return;
+    pthread_mutex_lock(&g_links_lock);
+    l->prev->next = l->next;
+    l->next->prev = l->prev;
+    l->next = l->prev = NULL;
+    pthread_mutex_unlock(&g_links_lock);
+}
+
+int tabs_catch_up(int idx, size_t max_bytes) {
+    Tab *t = tabs_get(idx);
+    if (!t) return 0;
+    pthread_mutex_lock(&t->lock);
+    index_lines_locked(t, max_bytes);
+    size_t backlog = t->out_len - t->indexed_len;
+    int release = t->flow_held && backlog <= t->flow_low;
+    if (release) t->flow_held = 0;
+    pthread_mutex_unlock(&t->lock);
+    if (release) reactor_hold_group(idx, 0);
+    return backlog > 0;
+}
+
+void tabs_set_flow_defaults(size_t high, size_t low) {
+    if (high == 0) high = TABS_FLOW_HIGH;
+    g_flow_high = high;
+    g_flow_low = low < high ? low : high;
+}
+
+int tabs_set_flow(int idx, size_t high, size_t low) {
+    Tab *t = tabs_get(idx);
+    if (!t || high == 0) return -1;
+    pthread_mutex_lock(&t->lock);
+    t->flow_high = high;
+    t->flow_low = low < high ? low : high;
+    pthread_mutex_unlock(&t->lock);
+    /* a held tab is re-checked against the new low mark on the next frame */
+    return 0;
+}
+
+int tabs_flow_info(int idx, size_t *high, size_t *low, size_t *backlog, int *held) {
+    Tab *t = tabs_get(idx);
+    if (!t) return -1;
+    pthread_mutex_lock(&t->lock);
+    *high = t->flow_high;
+    *low = t->flow_low;
+    *backlog = t->out_len - t->indexed_len;
+    *held = t->flow_held;
+    pthread_mutex_unlock(&t->lock);
+    return 0;
+}
+
+/* grow a capture pipe to the configured size; the kernel caps unprivileged users at
+   /proc/sys/fs/pipe-max-size (1 MB by default), so smaller sizes are tried on failure */
+void tabs_tune_pipe(int fd) {
+    for (size_t sz = g_pipe_size; sz >= 64 * 1024; sz /= 2) {
+        if (fcntl(fd, F_SETPIPE_SZ, (int)sz) >= 0) return;
+    }
+}
+
+void tabs_set_pipe_size(size_t bytes) {
+    if (bytes < 4096) bytes = 4096;
+    if (bytes > TABS_PIPE_SIZE_MAX) bytes = TABS_PIPE_SIZE_MAX;
+    g_pipe_size = bytes;
+}
+
+void tabs_set_scrollback_max(size_t bytes) {
+    long pg = sysconf(_SC_PAGESIZE);
+    size_t page = pg > 0 ? (size_t)pg : 4096;
+    if (bytes < TABS_SCROLLBACK_MIN) bytes = TABS_SCROLLBACK_MIN;
+    if (bytes > TABS_SCROLLBACK_MAX) bytes = TABS_SCROLLBACK_MAX;
+    g_sb_max = (bytes + page - 1) / page * page;
+}
+
+/* Best-effort notify: write one byte into notify pipe (non-blocking should be set by caller)
+   and otherwise rely on need_redraw flag in main loop to pull changes. */
+static void notify_main(void) {
     if (g_notify_fd >= 0) {
         ssize_t w;
         do {
@@ -115,49 +590,49 @@ int tabs_init(void) {
     return 0;
 }
 
-/* create a new tab using pipes and fork; child runs /bin/sh -s */
+/* create a new tab using pipes and launch_spawn; child runs /bin/sh -s */
 int tabs_create(void) {
     if (g_count >= MAX_TABS) return -1;
     int pipe_to[2];   /* parent -> child (stdin) */
     int pipe_from[2]; /* child -> parent (stdout+stderr) */
-    if (pipe(pipe_to) < 0) return -1;
-    if (pipe(pipe_from) < 0) { close(pipe_to[0]); close(pipe_to[1]); return -1; }
-
-    pid_t pid = fork();
-    if (pid < 0) {
+    /* O_CLOEXEC: neither this shell nor later pipeline children inherit other tabs' pipes */
+    if (pipe2(pipe_to, O_CLOEXEC) < 0) return -1;
+    if (pipe2(pipe_from, O_CLOEXEC) < 0) { close(pipe_to[0]); close(pipe_to[1]); return -1; }
+    tabs_tune_pipe(pipe_from[0]);
+
+    /* the line editor is the tab's only input buffer, so create it up front */
+    LineEditor *editor = le_create(NULL);
+    if (!editor) {
         close(pipe_to[0]); close(pipe_to[1]);
         close(pipe_from[0]); close(pipe_from[1]);
         return -1;
     }
 
-    if (pid == 0) {
-        /* child: connect pipes to stdin/stdout/stderr */
-        close(pipe_to[1]);   /* close parent write end */
-        close(pipe_from[0]); /* close parent read end */
-
-        if (dup2(pipe_to[0], STDIN_FILENO) < 0) _exit(127);
-        if (dup2(pipe_from[1], STDOUT_FILENO) < 0) _exit(127);
-        if (dup2(pipe_from[1], STDERR_FILENO) < 0) _exit(127);
-
-        /* close unused fds */
-        close(pipe_to[0]);
-        close(pipe_from[1]);
-
-        /* exec a simple shell */
-        execlp("sh", "sh", "-s", NULL);
-        _exit(127);
+    /* the shell stays in our process group, as it did when it was fork()ed */
+    char *argv[] = {"sh", "-s", NULL};
+    LaunchSpec ls = {argv, pipe_to[0], pipe_from[1], pipe_from[1], -1, NULL, -1, NULL};
+    pid_t pid = launch_spawn(&ls);
+    if (pid < 0) {
+        le_destroy(editor);
+        close(pipe_to[0]); close(pipe_to[1]);
+        close(pipe_from[0]); close(pipe_from[1]);
+        return -1;
     }
 
     /* parent */
     close(pipe_to[0]);   /* close child read end */
     close(pipe_from[1]); /* close child write end */
 
-    /* set non-blocking read on from-child fd so parent select/read is safe */
+    /* set non-blocking read on from-child fd so parent select/read is safe,
+       and non-blocking write on to-child fd so a slow reader never stalls the UI */
     int flags = fcntl(pipe_from[0], F_GETFL, 0);
     if (flags >= 0) fcntl(pipe_from[0], F_SETFL, flags | O_NONBLOCK);
+    flags = fcntl(pipe_to[1], F_GETFL, 0);
+    if (flags >= 0) fcntl(pipe_to[1], F_SETFL, flags | O_NONBLOCK);
 
     Tab *t = tab_alloc(g_count);
     if (!t) {
+        le_destroy(editor);
         close(pipe_to[1]);
         close(pipe_from[0]);
         /* ideally kill child */
@@ -169,21 +644,16 @@ int tabs_create(void) {
     t->pid = pid;
     t->to_child_fd = pipe_to[1];
     t->from_child_fd = pipe_from[0];
-    t->out_buf = malloc(INITIAL_CAP);
-    if (t->out_buf) t->out_cap = INITIAL_CAP; else t->out_cap = 0;
     t->out_len = 0;
     t->alive = 1;
 
-    /* create a LineEditor for the tab for GUI integration (prompt can be set by GUI later).
-       We pass NULL so the editor uses an empty prompt; GUI draws PROMPT itself. */
-    t->editor = le_create(NULL);
-    if (!t->editor) {
-        /* non-fatal: proceed without editor */
-        t->editor = NULL;
-    }
+    /* the editor was created with an empty prompt; GUI draws PROMPT itself */
+    t->editor = editor;
 
+    pthread_rwlock_wrlock(&g_tabs_lock);
     tabs[g_count] = t;
     g_count++;
+    pthread_rwlock_unlock(&g_tabs_lock);
     return t->id;
 }
 
@@ -204,11 +674,8 @@ int tabs_get_fd(int idx) {
 void tabs_read_once(int idx) {
     Tab *t = tabs_get(idx);
     if (!t || !t->alive) return;
-    char buf[4096];
     ssize_t r;
-    while ((r = read(t->from_child_fd, buf, sizeof(buf))) > 0) {
-        /* use tabs_append_output to be safe even if reader called elsewhere */
-        tabs_append_output(idx, buf, r);
+    while ((r = tabs_ingest_fd(idx, t->from_child_fd)) > 0) {
     }
     if (r == 0) {
         /* EOF: child closed its end */
@@ -227,11 +694,132 @@ void tabs_read_once(int idx) {
     }
 }
 
+void tabs_set_write_chunk(size_t bytes) {
+    g_write_chunk = bytes > 0 ? bytes : TABS_WRITE_CHUNK;
+}
+
+static void inq_clear(Tab *t) {
+    t->inq_len = 0;
+    t->inq_off = 0;
+    t->inq_total = 0;
+}
+
+/* where the outbound queue goes: only ever the foreground job's stdin, never the
+   shell's (-1 while there is no job pipe; the queue then just waits or is dropped) */
+static int inq_fd(Tab *t) {
+    return t->job_in_fd;
+}
+
+static void job_input_close(Tab *t) {
+    if (t->job_in_fd >= 0) close(t->job_in_fd);
+    t->job_in_fd = -1;
+    t->job_in_eof = 0;
+    inq_clear(t);
+}
+
+void tabs_set_job_input(int idx, int fd) {
+    Tab *t = tabs_get(idx);
+    if (!t) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    /* bytes queued for the old job are not the new one's */
+    if (t->job_in_fd >= 0 || fd >= 0) job_input_close(t);
+    t->job_in_fd = fd;
+}
+
+int tabs_job_input(int idx) {
+    Tab *t = tabs_get(idx);
+    return t ? t->job_in_fd : -1;
+}
+
+void tabs_end_job_input(int idx) {
+    Tab *t = tabs_get(idx);
+    if (!t || t->job_in_fd < 0) return;
+    if (t->inq_off >= t->inq_len) job_input_close(t);
+    else t->job_in_eof = 1;
+}
+
+/* queue bytes for the foreground job's stdin; they are written by tabs_flush_input()
+   as the pipe drains. The tab's own shell never gets them: it would run them as
+   commands. Returns len, or -1 if no job stdin is set (or it is being closed), the tab
+   is gone or memory is exhausted. */
 ssize_t tabs_write(int idx, const char *buf, size_t len) {
     Tab *t = tabs_get(idx);
-    if (!t || !t->alive) return -1;
-    ssize_t w = write(t->to_child_fd, buf, len);
-    return w;
+    if (!t || t->job_in_fd < 0 || t->job_in_eof) return -1;
+    if (len == 0) return 0;
+
+    /* drop the already-written prefix before growing */
+    if (t->inq_off > 0 && t->inq_off >= t->inq_len / 2) {
+        memmove(t->inq, t->inq + t->inq_off, t->inq_len - t->inq_off);
+        t->inq_len -= t->inq_off;
+        t->inq_off = 0;
+    }
+    if (t->inq_len + len > t->inq_cap) {
+        size_t nc = t->inq_cap ? t->inq_cap * 2 : g_write_chunk;
+        while (nc < t->inq_len + len) nc *= 2;
+        char *p = realloc(t->inq, nc);
+        if (!p) return -1;
+        t->inq = p;
+        t->inq_cap = nc;
+    }
+    memcpy(t->inq + t->inq_len, buf, len);
+    t->inq_len += len;
+    t->inq_total += len;
+
+    /* small writes (typed lines) go out immediately */
+    tabs_flush_input(idx);
+    return (ssize_t)len;
+}
+
+int tabs_get_write_fd(int idx) {
+    Tab *t = tabs_get(idx);
+    if (!t || t->inq_off >= t->inq_len) return -1;
+    return inq_fd(t);
+}
+
+/* write at most one chunk of the outbound queue without blocking */
+void tabs_flush_input(int idx) {
+    Tab *t = tabs_get(idx);
+    if (!t || inq_fd(t) < 0 || t->inq_off >= t->inq_len) return;
+    size_t n = t->inq_len - t->inq_off;
+    if (n > g_write_chunk) n = g_write_chunk;
+    ssize_t w;
+    do {
+        w = write(inq_fd(t), t->inq + t->inq_off, n);
+    } while (w < 0 && errno == EINTR);
+    if (w > 0) {
+        t->inq_off += (size_t)w;
+        if (t->inq_off >= t->inq_len) {
+            inq_clear(t);
+            if (t->job_in_eof) job_input_close(t);
+        }
+    } else if (w < 0 && errno == EPIPE) {
+        /* the job has stopped reading (or exited): what it did not take is dropped */
+        job_input_close(t);
+    } else if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        char em[128];
+        int m = snprintf(em, sizeof(em), "\n[write to job failed: %s; %zu bytes dropped]\n",
+                         strerror(errno), t->inq_len - t->inq_off);
+        job_input_close(t);
+        tabs_append_output(idx, em, m);
+    }
+}
+
+int tabs_input_progress(int idx, size_t *sent, size_t *total) {
+    Tab *t = tabs_get(idx);
+    if (!t || t->inq_off >= t->inq_len) return 0;
+    if (total) *total = t->inq_total;
+    if (sent) *sent = t->inq_total - (t->inq_len - t->inq_off);
+    return 1;
+}
+
+size_t tabs_cancel_input(int idx) {
+    Tab *t = tabs_get(idx);
+    if (!t || t->inq_off >= t->inq_len) return 0;
+    size_t dropped = t->inq_len - t->inq_off;
+    inq_clear(t);
+    return dropped;
 }
 
 /* close a tab gracefully */
@@ -255,16 +843,33 @@ void tabs_close(int idx) {
         t->alive = 0;
     }
 
-    /* free resources and destroy the tab object */
+    /* free resources and destroy the tab object; shift later tab pointers left and
+       update their ids, and move registered indices along in the same step */
+    pthread_rwlock_wrlock(&g_tabs_lock);
     tab_free(t);
-
-    /* shift later tab pointers left and update their ids */
     for (int i = idx + 1; i < g_count; ++i) {
         tabs[i-1] = tabs[i];
         if (tabs[i-1]) tabs[i-1]->id = i-1;
     }
     tabs[g_count-1] = NULL;
     g_count--;
+    pthread_mutex_lock(&g_links_lock);
+    for (TabLink *l = g_links.next; l != &g_links; l = l->next) {
+        int i = atomic_load(l->idx);
+        if (i == idx) atomic_store(l->idx, -1);
+        else if (i > idx) atomic_store(l->idx, i - 1);
+    }
+    pthread_mutex_unlock(&g_links_lock);
+    pthread_rwlock_unlock(&g_tabs_lock);
+    /* ingest groups follow tab indices: drop holds from idx on, the shifted tabs
+       hold again on their next read if they still need to */
+    for (int i = idx; i <= g_count; ++i) {
+        reactor_hold_group(i, 0);
+        if (i == g_count || !tabs[i]) continue;
+        pthread_mutex_lock(&tabs[i]->lock);
+        tabs[i]->flow_held = 0;
+        pthread_mutex_unlock(&tabs[i]->lock);
+    }
 }
 
 /* cleanup all tabs at exit */
@@ -279,8 +884,12 @@ void tabs_cleanup(void) {
             waitpid(t->pid, NULL, 0);
             t->alive = 0;
         }
+        pthread_rwlock_wrlock(&g_tabs_lock);
         tab_free(t);
         tabs[i] = NULL;
+        pthread_rwlock_unlock(&g_tabs_lock);
     }
+    pthread_rwlock_wrlock(&g_tabs_lock);
     g_count = 0;
+    pthread_rwlock_unlock(&g_tabs_lock);
 }
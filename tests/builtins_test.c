@@ -0,0 +1,92 @@
+/* builtin_lookup(): every builtin is found under its own name with the right flags,
+   and nothing else is, names that land in a builtin's slot included; a non-special
+   builtin also runs as a pipeline stage */
+#include "builtins.h"
+#include "test_util.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+volatile sig_atomic_t need_redraw;
+
+static const struct
+{
+    const char *name;
+    int special;
+} expected[] = {
+    {"[", 0},        {"bg", 1},     {"cd", 1},    {"echo", 0},   {"export", 1}, {"false", 0},
+    {"fg", 1},       {"flow", 1},   {"hash", 1},  {"history", 1}, {"ingest", 1}, {"jobs", 1},
+    {"kill", 1},     {"peephole", 1}, {"printf", 0}, {"pwd", 0},  {"test", 0},   {"timing", 1},
+    {"true", 0},     {"type", 0},   {"unset", 1},
+};
+
+static void test_lookup(void)
+{
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
+    {
+        const Builtin *b = builtin_lookup(expected[i].name);
+        CHECK(b != NULL);
+        if (!b)
+            continue;
+        CHECK(strcmp(b->name, expected[i].name) == 0);
+        CHECK(b->fn != NULL);
+        CHECK(!!(b->flags & BUILTIN_SPECIAL) == expected[i].special);
+    }
+    static const char *not_builtins[] = {
+        "", "ls", "cat", "ech", "echoo", "Echo", "ceho", "c", "cd ", "[[", "]", "tset", "truee",
+        "tru", "pwdd", "exports", "printf2", "hist", "histories", "kil", "ki11", "/bin/echo",
+    };
+    for (size_t i = 0; i < sizeof(not_builtins) / sizeof(not_builtins[0]); ++i)
+        CHECK(builtin_lookup(not_builtins[i]) == NULL);
+    CHECK(builtin_lookup(NULL) == NULL);
+
+    /* names sharing first, second and last byte and length with a builtin hash to its
+       slot: only the exact name may match */
+    CHECK(builtin_lookup("ecXo") == NULL);
+    CHECK(builtin_lookup("tXst") == NULL);
+    CHECK(builtin_lookup("hiXXXry") == NULL);
+}
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int done_status = -1;
+
+static void stage_done(int status, void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&done_lock);
+    done_status = status;
+    pthread_cond_signal(&done_cond);
+    pthread_mutex_unlock(&done_lock);
+}
+
+static void test_stage(void)
+{
+    int p[2];
+    CHECK(pipe(p) == 0);
+    char *argv[] = {"printf", "%s-%d\\n", "x", "42", NULL};
+    const Builtin *b = builtin_lookup("printf");
+    CHECK(b && builtin_start_stage(b, argv, -1, p[1], dup(2), stage_done, NULL) == 0);
+    char buf[64];
+    ssize_t n, got = 0;
+    while ((n = read(p[0], buf + got, sizeof(buf) - 1 - (size_t)got)) > 0)
+        got += n;
+    buf[got] = '\0';
+    close(p[0]);
+    CHECK(strcmp(buf, "x-42\n") == 0);
+    pthread_mutex_lock(&done_lock);
+    while (done_status < 0)
+        pthread_cond_wait(&done_cond, &done_lock);
+    pthread_mutex_unlock(&done_lock);
+    CHECK(done_status == 0);
+}
+
+int main(void)
+{
+    test_lookup();
+    test_stage();
+    return test_finish("builtins_test");
+}
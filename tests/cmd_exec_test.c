@@ -0,0 +1,465 @@
+/* cmd_exec: command lines run in a real tab, the way the main loop drives them, and
+   their output is read back from the tab's scrollback. The peephole pass must shorten
+   exactly the pipelines it documents and leave their output unchanged; flow control
+   holds a hidden tab as well as the one on screen, and output follows a tab that
+   moves down when an earlier one is closed. */
+#define _GNU_SOURCE
+#include "cmd_exec.h"
+#include "reactor.h"
+#include "shell_tab.h"
+#include "test_util.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+volatile sig_atomic_t need_redraw;
+
+#define MARK "@@cmd_exec_test@@"
+
+static int tab;
+static int notify[2];
+static char dir[] = "/tmp/cmd_exec_test.XXXXXX";
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* one turn of the main loop: wait up to 10 ms for a wakeup, then dispatch */
+static void pump(void)
+{
+    struct pollfd pfd = {notify[0], POLLIN, 0};
+    poll(&pfd, 1, 10);
+    char drain[256];
+    while (read(notify[0], drain, sizeof(drain)) > 0)
+        ;
+    cmd_exec_dispatch();
+}
+
+/* pump the main loop until cond() holds, for at most secs */
+static int pump_until(int (*cond)(void), double secs)
+{
+    double deadline = now_sec() + secs;
+    while (!cond() && now_sec() < deadline)
+        pump();
+    return cond();
+}
+
+/* Run line in the tab and return what it printed (malloc'd), exit lines included.
+   The builtin echo of MARK run after it is the end of its output. */
+static char *run(const char *line)
+{
+    Tab *t = tabs_get(tab);
+    pthread_mutex_lock(&t->lock);
+    size_t start = t->out_len;
+    pthread_mutex_unlock(&t->lock);
+
+    char cmd[4096];
+    snprintf(cmd, sizeof(cmd), "%s; echo " MARK, line);
+    if (cmd_exec_run_in_tab(tab, cmd) < 0)
+        return strdup("(parse error)");
+
+    char *out = NULL;
+    double deadline = now_sec() + 20;
+    while (!out && now_sec() < deadline)
+    {
+        pump();
+        pthread_mutex_lock(&t->lock);
+        const char *b = t->out_buf + start;
+        size_t n = t->out_len - start;
+        const char *m = memmem(b, n, MARK "\n", strlen(MARK) + 1);
+        if (m)
+            out = strndup(b, (size_t)(m - b));
+        pthread_mutex_unlock(&t->lock);
+    }
+    return out ? out : strdup("(timed out)");
+}
+
+static unsigned long pl_before, st_before;
+
+static void counters_mark(void)
+{
+    cmd_exec_peephole(&pl_before, &st_before);
+}
+
+/* pipelines and stages the pass has shortened since counters_mark() */
+static void counters_delta(unsigned long *pl, unsigned long *st)
+{
+    unsigned long p, s;
+    cmd_exec_peephole(&p, &s);
+    *pl = p - pl_before;
+    *st = s - st_before;
+}
+
+static int count(const char *s, const char *needle)
+{
+    int n = 0;
+    for (const char *p = s; (p = strstr(p, needle)); p += strlen(needle))
+        ++n;
+    return n;
+}
+
+static void test_peephole(void)
+{
+    char file[128], other[128], line[512];
+    unsigned long pl, st;
+    snprintf(file, sizeof(file), "%s/two_lines", dir);
+    snprintf(other, sizeof(other), "%s/three", dir);
+    test_write_file(AT_FDCWD, file, "hello\nworld\n", 0644);
+    test_write_file(AT_FDCWD, other, "abc", 0644);
+
+    CHECK(cmd_exec_peephole(NULL, NULL) == 1);
+
+    /* cat FILE | cmd -> cmd < FILE */
+    counters_mark();
+    snprintf(line, sizeof(line), "cat %s | wc -c", file);
+    char *out = run(line);
+    counters_delta(&pl, &st);
+    CHECK(strncmp(out, "12\n", 3) == 0);
+    CHECK(pl == 1 && st == 1);
+    free(out);
+
+    /* copying cats in the middle and at the end go */
+    counters_mark();
+    snprintf(line, sizeof(line), "cat %s | cat | cat", file);
+    out = run(line);
+    counters_delta(&pl, &st);
+    CHECK(strncmp(out, "hello\nworld\n", 12) == 0);
+    CHECK(pl == 1 && st == 2);
+    free(out);
+
+    /* both in one pipeline; each pipeline of a list is counted */
+    counters_mark();
+    snprintf(line, sizeof(line), "cat %s | cat | tr a-z A-Z | cat; cat %s | wc -c", file, other);
+    out = run(line);
+    counters_delta(&pl, &st);
+    CHECK(strstr(out, "HELLO\nWORLD\n") && strstr(out, "3\n"));
+    CHECK(pl == 2 && st == 4);
+    free(out);
+
+    /* kept: a trailing cat whose status && looks at, a cat with options or more than
+       one file, a leading cat reading stdin, and a first stage whose successor already
+       redirects its stdin */
+    counters_mark();
+    snprintf(line, sizeof(line), "echo x | cat && echo y");
+    out = run(line);
+    CHECK(strstr(out, "x\n") && strstr(out, "y\n"));
+    free(out);
+    snprintf(line, sizeof(line), "cat -n %s | wc -l", file);
+    out = run(line);
+    CHECK(strncmp(out, "2\n", 2) == 0);
+    free(out);
+    snprintf(line, sizeof(line), "cat %s %s | wc -c", file, other);
+    out = run(line);
+    CHECK(strncmp(out, "15\n", 3) == 0);
+    free(out);
+    snprintf(line, sizeof(line), "cat %s | wc -c < %s", file, other);
+    out = run(line);
+    CHECK(strncmp(out, "3\n", 2) == 0);
+    free(out);
+    snprintf(line, sizeof(line), "cat < %s | wc -c", other);
+    out = run(line);
+    CHECK(strncmp(out, "3\n", 2) == 0);
+    free(out);
+    counters_delta(&pl, &st);
+    CHECK(pl == 0 && st == 0);
+
+    /* redirections that change nothing are merged, which is not a removed stage */
+    counters_mark();
+    snprintf(line, sizeof(line), "echo merged 2>&2 > %s/m > %s/m; cat %s/m", dir, dir, dir);
+    out = run(line);
+    counters_delta(&pl, &st);
+    CHECK(strstr(out, "merged\n") != NULL);
+    CHECK(pl == 0 && st == 0);
+    free(out);
+
+    /* a rewritten pipeline still reports once, with its last stage's status */
+    snprintf(line, sizeof(line), "cat %s | cat | wc -l", file);
+    out = run(line);
+    CHECK(strncmp(out, "2\n", 2) == 0 && count(out, "exited with status 0]") == 1);
+    free(out);
+
+    /* off: nothing is rewritten, the output is the same */
+    cmd_exec_set_peephole(0);
+    CHECK(cmd_exec_peephole(NULL, NULL) == 0);
+    counters_mark();
+    snprintf(line, sizeof(line), "cat %s | cat | wc -c", file);
+    out = run(line);
+    counters_delta(&pl, &st);
+    CHECK(strncmp(out, "12\n", 3) == 0);
+    CHECK(pl == 0 && st == 0);
+    free(out);
+    cmd_exec_set_peephole(1);
+}
+
+static int has_foreground(void)
+{
+    return cmd_exec_has_foreground(tab);
+}
+
+static int no_foreground(void)
+{
+    return !cmd_exec_has_foreground(tab);
+}
+
+static void count_stopped(int id, int current, int stopped, const char *cmd, void *arg)
+{
+    (void)id;
+    (void)current;
+    (void)cmd;
+    *(int *)arg += stopped;
+}
+
+static int job_count(void)
+{
+    int stopped = 0;
+    return cmd_exec_jobs(tab, count_stopped, &stopped);
+}
+
+static int stopped_jobs(void)
+{
+    int stopped = 0;
+    cmd_exec_jobs(tab, count_stopped, &stopped);
+    return stopped;
+}
+
+static int no_jobs(void)
+{
+    return job_count() == 0;
+}
+
+/* Ctrl+Z: once the reactor has seen the job stop, the tab has no foreground job and
+   the job is in the table, stopped; killing it empties the table again */
+static void test_suspend(void)
+{
+    CHECK(cmd_exec_run_in_tab(tab, "sleep 30") == 0);
+    CHECK(pump_until(has_foreground, 5));
+    CHECK(cmd_exec_suspend_tab(tab) == 0);
+    CHECK(pump_until(no_foreground, 5));
+    CHECK(job_count() == 1 && stopped_jobs() == 1);
+    CHECK(cmd_exec_suspend_tab(tab) == -1);
+    CHECK(cmd_exec_job_kill(tab, 0, SIGKILL) >= 0);
+    CHECK(pump_until(no_jobs, 5));
+    char *out = run("true");
+    free(out);
+}
+
+static int hidden;
+
+static int hidden_held(void)
+{
+    size_t high, low, backlog;
+    int held = 0;
+    tabs_flow_info(hidden, &high, &low, &backlog, &held);
+    return held;
+}
+
+/* the UI's frame for the hidden tab once it is on screen */
+static int hidden_done(void)
+{
+    tabs_catch_up(hidden, TABS_INDEX_PER_FRAME);
+    return !cmd_exec_has_foreground(hidden);
+}
+
+/* a flood in a hidden tab is held at the high mark, not read into the scrollback,
+   until the tab is shown and indexed */
+static void test_hidden_flow(void)
+{
+    hidden = tabs_create();
+    CHECK(hidden >= 0);
+    if (hidden < 0)
+        return;
+    const size_t high = 256 * 1024;
+    CHECK(tabs_set_flow(hidden, high, high / 4) == 0);
+    CHECK(cmd_exec_run_in_tab(hidden, "head -c 8M /dev/zero") == 0);
+    CHECK(pump_until(hidden_held, 5));
+    for (int i = 0; i < 20; ++i)
+        pump();
+    Tab *t = tabs_get(hidden);
+    pthread_mutex_lock(&t->lock);
+    size_t len = t->out_len;
+    pthread_mutex_unlock(&t->lock);
+    /* at most one more pipeful is read after the hold */
+    CHECK(len >= high && len <= high + TABS_PIPE_SIZE_MAX + 64 * 1024);
+    CHECK(cmd_exec_has_foreground(hidden));
+
+    tabs_set_active(hidden);
+    CHECK(pump_until(hidden_done, 10));
+    pthread_mutex_lock(&t->lock);
+    CHECK(t->out_len > (size_t)8 << 20 && t->indexed_len == t->out_len);
+    pthread_mutex_unlock(&t->lock);
+    CHECK(!hidden_held());
+    tabs_set_active(tab);
+}
+
+static int busy_tab;
+
+static size_t busy_len(void)
+{
+    Tab *t = tabs_get(busy_tab);
+    pthread_mutex_lock(&t->lock);
+    size_t len = t->out_len;
+    pthread_mutex_unlock(&t->lock);
+    return len;
+}
+
+static int busy_half(void)
+{
+    return busy_len() >= (size_t)2 << 20;
+}
+
+static int busy_done(void)
+{
+    return busy_len() >= (size_t)4 << 20 && !cmd_exec_has_foreground(busy_tab);
+}
+
+/* closing a tab while a later one is taking output: the later tab moves down one,
+   and the rest of its output follows it there */
+static void test_close_while_busy(void)
+{
+    int gone = tabs_create();
+    busy_tab = tabs_create();
+    CHECK(gone >= 0 && busy_tab == gone + 1);
+    if (gone < 0 || busy_tab != gone + 1)
+        return;
+    CHECK(tabs_set_flow(busy_tab, (size_t)64 << 20, (size_t)16 << 20) == 0);
+    CHECK(cmd_exec_run_in_tab(busy_tab, "head -c 2M /dev/zero; sleep 0.2; head -c 2M /dev/zero") == 0);
+    CHECK(pump_until(busy_half, 5));
+    cmd_exec_on_tab_closed(gone);
+    tabs_close(gone);
+    busy_tab = gone;
+    CHECK(pump_until(busy_done, 10));
+    CHECK(busy_len() < ((size_t)4 << 20) + 4096);
+    cmd_exec_on_tab_closed(busy_tab);
+    tabs_close(busy_tab);
+}
+
+/* sum of the numbers printed one per line, and how many there were */
+static long sum_lines(const char *out, int *lines)
+{
+    long sum = 0;
+    *lines = 0;
+    for (const char *p = out; *p;)
+    {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end != p && *end == '\n')
+        {
+            sum += v;
+            ++*lines;
+        }
+        const char *nl = strchr(p, '\n');
+        if (!nl)
+            break;
+        p = nl + 1;
+    }
+    return sum;
+}
+
+/* more matches than one exec can take: batch has to split them, and every match must
+   be passed exactly once, in one exec or another */
+static void test_batch_split(void)
+{
+    enum { N = 12000, NAME = 200 };
+    char sub[128], name[NAME + 16], path[512], line[512];
+    snprintf(sub, sizeof(sub), "%s/many", dir);
+    CHECK(mkdir(sub, 0755) == 0);
+    memset(name, 'x', NAME);
+    for (int i = 0; i < N; ++i)
+    {
+        snprintf(name + NAME, sizeof(name) - NAME, "%05d", i);
+        snprintf(path, sizeof(path), "%s/%s", sub, name);
+        test_write_file(AT_FDCWD, path, NULL, 0644);
+    }
+
+    /* each exec prints its argument count, then the number of each match it got
+       (simple patterns are matched in directory order, so any order will do): there
+       must be more than one exec, and every match in exactly one of them */
+    snprintf(line, sizeof(line), "batch sh -c 'echo exec $#; for f; do echo ${f##*x}; done' sh %s/x*", sub);
+    char *out = run(line);
+    static unsigned char seen[N];
+    long total = 0;
+    int execs = 0, stray = 0;
+    for (const char *p = out; *p;)
+    {
+        char *end;
+        if (strncmp(p, "exec ", 5) == 0)
+        {
+            total += strtol(p + 5, NULL, 10);
+            ++execs;
+        }
+        else if (*p != '\n' && *p != '[')
+        {
+            long v = strtol(p, &end, 10);
+            if (end != p && *end == '\n' && v >= 0 && v < N)
+                seen[v]++;
+            else
+                ++stray;
+        }
+        const char *nl = strchr(p, '\n');
+        if (!nl)
+            break;
+        p = nl + 1;
+    }
+    CHECK(execs >= 2);
+    CHECK(total == N);
+    CHECK(stray == 0);
+    int once = 0;
+    for (int i = 0; i < N; ++i)
+        once += seen[i] == 1;
+    CHECK(once == N);
+    free(out);
+
+    /* the same split with execs running side by side */
+    int lines;
+    snprintf(line, sizeof(line), "batch -j 4 sh -c 'echo $#' sh %s/x*", sub);
+    out = run(line);
+    CHECK(sum_lines(out, &lines) == N);
+    CHECK(lines >= 2);
+    free(out);
+
+    /* few matches, one exec; words before the first pattern start every exec */
+    snprintf(line, sizeof(line), "batch sh -c 'echo $1 $#' sh first %s/x*0000?", sub);
+    out = run(line);
+    CHECK(strncmp(out, "first 11\n", 9) == 0);
+    free(out);
+}
+
+int main(void)
+{
+    signal(SIGPIPE, SIG_IGN);
+    test_tmpdir(dir);
+    if (pipe2(notify, O_NONBLOCK | O_CLOEXEC) < 0 || reactor_start() != 0)
+    {
+        perror("cmd_exec_test: setup");
+        return 1;
+    }
+    tabs_set_notify_fd(notify[1]);
+    tabs_init();
+    tab = tabs_create();
+    if (tab < 0)
+    {
+        perror("cmd_exec_test: tabs_create");
+        return 1;
+    }
+    tabs_set_active(tab);
+
+    test_peephole();
+    test_batch_split();
+    test_suspend();
+    test_hidden_flow();
+    test_close_while_busy();
+
+    tabs_cleanup();
+    test_rmtree(dir);
+    return test_finish("cmd_exec_test");
+}
@@ -0,0 +1,189 @@
+/* cmd_hash: lookups through a PATH of temporary directories are cached, a change to a
+   directory searched before the cached match (or a different PATH) drops the cache,
+   relative entries resolve under the given dirfd and are never cached, and misses
+   report EACCES / ENOENT as execvp() would */
+#define _GNU_SOURCE
+#include "cmd_hash.h"
+#include "test_util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char root[] = "/tmp/cmd_hash_test.XXXXXX";
+static char dir_a[64], dir_b[64], path_ab[160];
+
+static void make_file(const char *dir, const char *name, mode_t mode)
+{
+    char p[128];
+    snprintf(p, sizeof(p), "%s/%s", dir, name);
+    test_write_file(AT_FDCWD, p, NULL, mode);
+}
+
+/* backdate a directory, so the next entry made in it is sure to change its mtime
+   whatever the file system's timestamp granularity */
+static void backdate(const char *dir)
+{
+    struct timespec ts[2] = {{1000000000, 0}, {1000000000, 0}};
+    CHECK(utimensat(AT_FDCWD, dir, ts, 0) == 0);
+}
+
+static void count_entry(const char *name, const char *path, unsigned hits, void *arg)
+{
+    (void)name;
+    (void)path;
+    (void)hits;
+    ++*(int *)arg;
+}
+
+static int entries(void)
+{
+    int seen = 0;
+    int n = cmd_hash_each(count_entry, &seen);
+    CHECK(n == seen);
+    return n;
+}
+
+static const char *lookup(const char *name, const char *path, int dirfd, char *out)
+{
+    errno = 0;
+    return cmd_hash_lookup(name, path, dirfd, out, 256);
+}
+
+static void test_cache(void)
+{
+    char out[256], want[256];
+    make_file(dir_b, "tool", 0755);
+    backdate(dir_a);
+    backdate(dir_b);
+
+    cmd_hash_clear();
+    CHECK(entries() == 0);
+    snprintf(want, sizeof(want), "%s/tool", dir_b);
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) && strcmp(out, want) == 0);
+    CHECK(entries() == 1);
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) && strcmp(out, want) == 0);
+    CHECK(entries() == 1);
+
+    /* a new file in dir_b itself, after the match, changes nothing ahead of it */
+    make_file(dir_b, "other", 0755);
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) && strcmp(out, want) == 0);
+
+    /* a tool earlier in PATH shadows the cached one */
+    make_file(dir_a, "tool", 0755);
+    snprintf(want, sizeof(want), "%s/tool", dir_a);
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) && strcmp(out, want) == 0);
+    CHECK(entries() == 1);
+
+    /* and once it goes away, the later one is found again */
+    backdate(dir_a);
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) != NULL);
+    snprintf(want, sizeof(want), "%s/tool", dir_a);
+    CHECK(unlinkat(AT_FDCWD, want, 0) == 0);
+    snprintf(want, sizeof(want), "%s/tool", dir_b);
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) && strcmp(out, want) == 0);
+
+    /* forget and clear */
+    CHECK(lookup("other", path_ab, AT_FDCWD, out) != NULL);
+    CHECK(entries() == 2);
+    cmd_hash_forget("tool");
+    CHECK(entries() == 1);
+    cmd_hash_forget("tool");
+    CHECK(entries() == 1);
+    cmd_hash_clear();
+    CHECK(entries() == 0);
+
+    /* a different PATH starts over */
+    CHECK(lookup("tool", path_ab, AT_FDCWD, out) != NULL);
+    CHECK(entries() == 1);
+    CHECK(lookup("tool", dir_b, AT_FDCWD, out) && strcmp(out, want) == 0);
+    CHECK(entries() == 1);
+    CHECK(lookup("tool", dir_a, AT_FDCWD, out) == NULL && errno == ENOENT);
+    CHECK(entries() == 0);
+}
+
+/* enough names to make the table grow, then remove every other one: the rest must
+   still be found (removal keeps the probe chains intact) */
+static void test_many(void)
+{
+    char name[32], out[256], want[256];
+    enum { N = 300 };
+    for (int i = 0; i < N; ++i)
+    {
+        snprintf(name, sizeof(name), "cmd%03d", i);
+        make_file(dir_b, name, 0755);
+    }
+    cmd_hash_clear();
+    for (int i = 0; i < N; ++i)
+    {
+        snprintf(name, sizeof(name), "cmd%03d", i);
+        CHECK(lookup(name, dir_b, AT_FDCWD, out) != NULL);
+    }
+    CHECK(entries() == N);
+    for (int i = 0; i < N; i += 2)
+    {
+        snprintf(name, sizeof(name), "cmd%03d", i);
+        cmd_hash_forget(name);
+    }
+    CHECK(entries() == N / 2);
+    for (int i = 1; i < N; i += 2)
+    {
+        snprintf(name, sizeof(name), "cmd%03d", i);
+        snprintf(want, sizeof(want), "%s/%s", dir_b, name);
+        CHECK(lookup(name, dir_b, AT_FDCWD, out) && strcmp(out, want) == 0);
+    }
+    CHECK(entries() == N / 2);
+}
+
+static void test_relative(void)
+{
+    char out[256];
+    int fd = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    CHECK(fd >= 0);
+    cmd_hash_clear();
+    /* "a" and "" (the directory itself) resolve under fd, not our cwd */
+    CHECK(lookup("tool", "a:b", fd, out) && strcmp(out, "b/tool") == 0);
+    CHECK(lookup("tool", ":/nonexistent", fd, out) == NULL && errno == ENOENT);
+    make_file(root, "here", 0755);
+    CHECK(lookup("here", ":/nonexistent", fd, out) && strcmp(out, "./here") == 0);
+    CHECK(entries() == 0);
+    close(fd);
+}
+
+static void test_errors(void)
+{
+    char out[256];
+    make_file(dir_a, "noexec", 0644);
+    CHECK(lookup("noexec", path_ab, AT_FDCWD, out) == NULL && errno == EACCES);
+    /* a runnable match later in PATH still wins */
+    make_file(dir_b, "noexec", 0755);
+    CHECK(lookup("noexec", path_ab, AT_FDCWD, out) != NULL);
+    CHECK(lookup("missing", path_ab, AT_FDCWD, out) == NULL && errno == ENOENT);
+    /* a directory is not a command */
+    CHECK(mkdirat(AT_FDCWD, strcat(strcpy(out, dir_a), "/sub"), 0755) == 0);
+    CHECK(lookup("sub", dir_a, AT_FDCWD, out) == NULL && errno == EACCES);
+    CHECK(lookup("a/b", path_ab, AT_FDCWD, out) == NULL && errno == EINVAL);
+    CHECK(lookup("", path_ab, AT_FDCWD, out) == NULL && errno == EINVAL);
+    CHECK(cmd_hash_lookup("tool", path_ab, AT_FDCWD, out, 4) == NULL && errno == ENAMETOOLONG);
+}
+
+int main(void)
+{
+    test_tmpdir(root);
+    snprintf(dir_a, sizeof(dir_a), "%s/a", root);
+    snprintf(dir_b, sizeof(dir_b), "%s/b", root);
+    snprintf(path_ab, sizeof(path_ab), "%s:%s", dir_a, dir_b);
+    CHECK(mkdir(dir_a, 0755) == 0 && mkdir(dir_b, 0755) == 0);
+
+    test_cache();
+    test_many();
+    test_relative();
+    test_errors();
+
+    test_rmtree(root);
+    return test_finish("cmd_hash_test");
+}
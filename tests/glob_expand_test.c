@@ -0,0 +1,196 @@
+/* glob_expand(): wildcards, hidden files, trailing '/', **, braces (nested, in their
+   order), the as-written fallback and escapes, over a tree made in a temp directory;
+   then a tree wide enough for the walker threads, checked against a count and order */
+#define _GNU_SOURCE
+#include "glob_expand.h"
+#include "test_util.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char root[] = "/tmp/glob_expand_test.XXXXXX";
+static int root_fd;
+
+typedef struct
+{
+    char *buf; /* the words joined with ' ' */
+    size_t len, cap;
+    long n;
+} Words;
+
+static void collect(const char *path, size_t len, void *arg)
+{
+    Words *w = arg;
+    if (w->len + len + 2 > w->cap)
+    {
+        size_t cap = (w->len + len + 2) * 2;
+        char *nb = realloc(w->buf, cap);
+        if (!nb)
+            return;
+        w->buf = nb;
+        w->cap = cap;
+    }
+    if (w->n++)
+        w->buf[w->len++] = ' ';
+    memcpy(w->buf + w->len, path, len);
+    w->len += len;
+    w->buf[w->len] = '\0';
+}
+
+static void expect_glob(const char *word, const char *want, int line)
+{
+    Words w = {NULL, 0, 0, 0};
+    long n = glob_expand(word, root_fd, collect, &w);
+    const char *got = w.buf ? w.buf : "";
+    if (n != w.n || strcmp(got, want) != 0)
+    {
+        fprintf(stderr, "%s:%d: glob_expand(\"%s\") = %ld\n  got  %s\n  want %s\n", __FILE__, line, word, n, got,
+                want);
+        ++failures;
+    }
+    free(w.buf);
+}
+
+#define EXPECT_GLOB(word, want) expect_glob(word, want, __LINE__)
+
+static void touch(const char *rel)
+{
+    test_write_file(root_fd, rel, NULL, 0644);
+}
+
+static void make_dir(const char *rel)
+{
+    CHECK(mkdirat(root_fd, rel, 0755) == 0);
+}
+
+static void test_patterns(void)
+{
+    touch("a.c");
+    touch("b.c");
+    touch("c.h");
+    touch(".hidden.c");
+    touch("q*.txt");
+    touch("br{x}");
+    make_dir("dir1");
+    touch("dir1/x.c");
+    make_dir("dir1/sub");
+    touch("dir1/sub/y.c");
+    make_dir("dir1/sub/deep");
+    touch("dir1/sub/deep/z.c");
+    make_dir("dir2");
+    touch("dir2/w.c");
+    make_dir(".hd");
+    touch(".hd/h.c");
+    CHECK(symlinkat("dir1", root_fd, "lnk") == 0);
+
+    EXPECT_GLOB("*.c", "a.c b.c");
+    EXPECT_GLOB(".*.c", ".hidden.c");
+    EXPECT_GLOB("?.[ch]", "a.c b.c c.h");
+    EXPECT_GLOB("[!a].?", "b.c c.h");
+    EXPECT_GLOB("*/*.c", "dir1/x.c dir2/w.c lnk/x.c");
+    EXPECT_GLOB("d*/", "dir1/ dir2/");
+    EXPECT_GLOB("dir1/*", "dir1/sub dir1/x.c");
+    EXPECT_GLOB("dir1/*/", "dir1/sub/");
+
+    /* ** is zero or more directories, not hidden ones nor symlinks */
+    EXPECT_GLOB("**/*.c", "a.c b.c dir1/sub/deep/z.c dir1/sub/y.c dir1/x.c dir2/w.c");
+    EXPECT_GLOB("dir1/**/z.c", "dir1/sub/deep/z.c");
+    EXPECT_GLOB("dir1/**/x.c", "dir1/x.c");
+    EXPECT_GLOB("dir1/**", "dir1/ dir1/sub dir1/sub/deep dir1/sub/deep/z.c dir1/sub/y.c dir1/x.c");
+    EXPECT_GLOB("**/deep/", "dir1/sub/deep/");
+
+    /* braces first, alternatives in their order, each sorted on its own */
+    EXPECT_GLOB("{dir2,dir1}/*.c", "dir2/w.c dir1/x.c");
+    EXPECT_GLOB("{b,a}.c", "b.c a.c");
+    EXPECT_GLOB("{a,{c,b}}.*", "a.c c.h b.c");
+    EXPECT_GLOB("x{1,{2,3}y}z", "x1z x2yz x3yz");
+    EXPECT_GLOB("{a,zz,b}.c", "a.c zz.c b.c");
+    EXPECT_GLOB("{}", "{}");
+    EXPECT_GLOB("{a}.c", "{a}.c");
+
+    /* no match: the word as written */
+    EXPECT_GLOB("nothing*", "nothing*");
+    EXPECT_GLOB("{x,y}*.none", "x*.none y*.none");
+    EXPECT_GLOB("nodir/*.c", "nodir/*.c");
+
+    /* escaped characters are literal, and come out without their backslashes */
+    EXPECT_GLOB("q\\**", "q*.txt");
+    EXPECT_GLOB("\\*.c", "*.c");
+    EXPECT_GLOB("br\\{*", "br{x}");
+    EXPECT_GLOB("br\\{x\\}", "br{x}");
+    EXPECT_GLOB("\\{a,b\\}.c", "{a,b}.c");
+    EXPECT_GLOB("{a\\,b,c}.*", "a,b.* c.h");
+    EXPECT_GLOB("\\a.\\c", "a.c");
+
+    /* ~ is $HOME */
+    char want[256];
+    snprintf(want, sizeof(want), "%s/a.c %s/b.c", root, root);
+    CHECK(setenv("HOME", root, 1) == 0);
+    EXPECT_GLOB("~/*.c", want);
+    snprintf(want, sizeof(want), "%s/a.c", root);
+    EXPECT_GLOB("~/a.*", want);
+}
+
+/* 40 x 40 directories of 10 files each: fans out to the pool */
+static void test_wide(void)
+{
+    enum { TOP = 40, MID = 40, FILES = 10 };
+    char rel[128];
+    make_dir("wide");
+    for (int i = 0; i < TOP; ++i)
+    {
+        snprintf(rel, sizeof(rel), "wide/t%02d", i);
+        make_dir(rel);
+        for (int j = 0; j < MID; ++j)
+        {
+            snprintf(rel, sizeof(rel), "wide/t%02d/m%02d", i, j);
+            make_dir(rel);
+            for (int k = 0; k < FILES; ++k)
+            {
+                snprintf(rel, sizeof(rel), "wide/t%02d/m%02d/f%d.dat", i, j, k);
+                touch(rel);
+            }
+        }
+    }
+    for (int round = 0; round < 3; ++round)
+    {
+        Words w = {NULL, 0, 0, 0};
+        long n = glob_expand("wide/**/*.dat", root_fd, collect, &w);
+        CHECK(n == TOP * MID * FILES && w.n == n);
+        /* sorted, so the k-th word is known */
+        int sorted = 1;
+        char *save, *prev = NULL;
+        long k = 0;
+        for (char *p = strtok_r(w.buf, " ", &save); p; p = strtok_r(NULL, " ", &save), ++k)
+        {
+            snprintf(rel, sizeof(rel), "wide/t%02ld/m%02ld/f%ld.dat", k / (MID * FILES), k / FILES % MID, k % FILES);
+            sorted &= strcmp(p, rel) == 0 && (!prev || strcmp(prev, p) < 0);
+            prev = p;
+        }
+        CHECK(sorted && k == n);
+        free(w.buf);
+    }
+    Words w = {NULL, 0, 0, 0};
+    CHECK(glob_expand("wide/t0?/", root_fd, collect, &w) == 10);
+    free(w.buf);
+}
+
+int main(void)
+{
+    test_tmpdir(root);
+    if ((root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+    {
+        perror("glob_expand_test: setup");
+        return 1;
+    }
+    test_patterns();
+    test_wide();
+
+    close(root_fd);
+    test_rmtree(root);
+    return test_finish("glob_expand_test");
+}
@@ -0,0 +1,194 @@
+/* history: entries (multi-line ones included) and their usage survive a save and a
+   restart, each usage staying with its own entry; a usage file that no longer matches
+   the history is ignored, and the direct-write fallback keeps the two in step. Every
+   "session" runs in a child process, as history has no way to start over in-process. */
+#include "history.h"
+#include "shell_tab.h"
+#include "test_util.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+volatile sig_atomic_t need_redraw;
+
+static char dir[] = "/tmp/history_test.XXXXXX";
+static char hpath[128], upath[160];
+
+/* run fn in a child as one session; its failures count here */
+static void session(void (*fn)(void))
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        CHECK(history_init(hpath) == 0);
+        fn();
+        _exit(failures != 0);
+    }
+    int st;
+    CHECK(pid > 0 && waitpid(pid, &st, 0) == pid);
+    if (!WIFEXITED(st) || WEXITSTATUS(st) != 0)
+        ++failures;
+}
+
+static void add(const char *cmd, double real)
+{
+    unsigned long serial = history_add(cmd);
+    CHECK(serial != 0);
+    if (real > 0)
+    {
+        HistUsage u = {real, real / 2, real / 4, 1024, 1, 2, 1};
+        history_add_usage(serial, &u);
+    }
+}
+
+/* history_show_usage() into a fresh tab, most recent first */
+static char *usage_listing(void)
+{
+    static int tab = -1;
+    if (tab < 0)
+    {
+        tabs_init();
+        tab = tabs_create();
+        CHECK(tab >= 0);
+    }
+    Tab *t = tabs_get(tab);
+    pthread_mutex_lock(&t->lock);
+    size_t start = t->out_len;
+    pthread_mutex_unlock(&t->lock);
+    history_show_usage(tab, 100);
+    pthread_mutex_lock(&t->lock);
+    char *out = strndup(t->out_buf + start, t->out_len - start);
+    pthread_mutex_unlock(&t->lock);
+    return out;
+}
+
+static void write_first(void)
+{
+    add("echo one", 1.5);
+    add("cat <<EOF\nline a\nline b\nEOF", 0);
+    add("printf 'a\\nb'\nfalse\r\nx\\", 2.25);
+    add("echo last", 3.125);
+    history_save();
+}
+
+static void check_entries(void)
+{
+    char *e = history_find_exact("cat <<EOF\nline a\nline b\nEOF");
+    CHECK(e != NULL);
+    free(e);
+    e = history_find_exact("printf 'a\\nb'\nfalse\r\nx\\");
+    CHECK(e != NULL);
+    free(e);
+    CHECK((e = history_find_exact("line a")) == NULL);
+    free(e);
+    CHECK((e = history_find_exact("echo last")) != NULL);
+    free(e);
+}
+
+static void check_usage(void)
+{
+    check_entries();
+    char *out = usage_listing();
+    /* most recent first: each entry's own usage */
+    const char *last = strstr(out, "\n  3.125s");
+    const char *ml = strstr(out, "\n  2.250s");
+    const char *one = strstr(out, "\n  1.500s");
+    CHECK(last && ml && one && last < ml && ml < one);
+    CHECK(last && strncmp(strchr(last, 'M') + 4, "echo last\n", 10) == 0);
+    CHECK(ml && strncmp(strchr(ml, 'M') + 4, "printf 'a\\nb'\nfalse", 19) == 0);
+    CHECK(one && strncmp(strchr(one, 'M') + 4, "echo one\n", 9) == 0);
+    CHECK(strstr(out, "-  cat <<EOF\nline a") != NULL);
+    free(out);
+}
+
+static void check_no_usage(void)
+{
+    check_entries();
+    char *out = usage_listing();
+    CHECK(strstr(out, "3.125") == NULL && strstr(out, "1.500") == NULL);
+    free(out);
+}
+
+/* direct writes: both temp files are made impossible to create */
+static void save_without_temp(void)
+{
+    char p[256];
+    snprintf(p, sizeof(p), "%s.tmp.%d", hpath, (int)getpid());
+    CHECK(mkdir(p, 0755) == 0);
+    snprintf(p, sizeof(p), "%s.tmp.%d", upath, (int)getpid());
+    CHECK(mkdir(p, 0755) == 0);
+    add("echo fallback", 4.5);
+    history_save();
+}
+
+static void check_fallback(void)
+{
+    check_usage();
+    char *out = usage_listing();
+    CHECK(strstr(out, "\n  4.500s") != NULL);
+    free(out);
+}
+
+static void check_old(void)
+{
+    char *e = history_find_exact("echo old\\n");
+    CHECK(e != NULL);
+    free(e);
+    CHECK((e = history_find_exact("ls")) != NULL);
+    free(e);
+    char *out = usage_listing();
+    CHECK(strstr(out, "1.000") == NULL);
+    free(out);
+}
+
+int main(void)
+{
+    test_tmpdir(dir);
+    snprintf(hpath, sizeof(hpath), "%s/history", dir);
+    snprintf(upath, sizeof(upath), "%s.usage", hpath);
+
+    session(write_first);
+    session(check_usage);
+    /* saved again unchanged: still in step */
+    session(history_save);
+    session(check_usage);
+
+    /* the history changes behind the usage file's back: it is ignored as a whole */
+    FILE *f = fopen(hpath, "a");
+    CHECK(f && fputs("echo added\n", f) >= 0 && fclose(f) == 0);
+    session(check_no_usage);
+
+    /* an entry edited in place, same count: the hashes no longer match */
+    session(write_first);
+    char *text = NULL;
+    size_t len = 0;
+    f = fopen(hpath, "r");
+    CHECK(f && getdelim(&text, &len, '\0', f) > 0 && fclose(f) == 0);
+    char *p = text ? strstr(text, "echo one") : NULL;
+    CHECK(p != NULL);
+    if (p)
+        p[5] = 'O';
+    test_write_file(AT_FDCWD, hpath, text ? text : "", 0644);
+    free(text);
+    session(check_no_usage);
+
+    /* the fallback path writes both files */
+    test_write_file(AT_FDCWD, hpath, "", 0644);
+    unlink(upath);
+    session(write_first);
+    session(save_without_temp);
+    session(check_fallback);
+
+    /* an old-format file: a line per entry, no escapes, no usage */
+    test_write_file(AT_FDCWD, hpath, "echo old\\n\nls\n", 0644);
+    test_write_file(AT_FDCWD, upath, "1.0 1.0 1.0 1 1 1 1\n-\n", 0644);
+    session(check_old);
+
+    test_rmtree(dir);
+    return test_finish("history_test");
+}
@@ -0,0 +1,78 @@
+/* Capture throughput of the reactor's ingest backends: every tab runs
+   `head -c <MB>M /dev/zero` at once and the output is timed until the last job has
+   ended. Each backend runs in a child process of its own, since the backend is
+   chosen once, at reactor_start() (MYTERM_INGEST=uring or epoll).
+   usage: ingest_bench [tabs] [MB per tab] */
+#include "cmd_exec.h"
+#include "reactor.h"
+#include "shell_tab.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+volatile sig_atomic_t need_redraw;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int run(const char *want, int ntabs, long mb)
+{
+    signal(SIGPIPE, SIG_IGN);
+    setenv("MYTERM_INGEST", want, 1);
+    if (reactor_start() != 0 || tabs_init() != 0)
+        return 1;
+    int ids[16];
+    for (int i = 0; i < ntabs; ++i)
+        if ((ids[i] = tabs_create()) < 0)
+            return 1;
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "head -c %ldM /dev/zero", mb);
+    double t0 = now_sec();
+    for (int i = 0; i < ntabs; ++i)
+        cmd_exec_run_in_tab(ids[i], cmd);
+    /* every tab is indexed as if it were on screen: a tab nobody indexes is held
+       at its flow control high mark */
+    for (int busy = 1; busy;)
+    {
+        usleep(1000);
+        busy = 0;
+        for (int i = 0; i < ntabs; ++i)
+        {
+            tabs_catch_up(ids[i], (size_t)-1);
+            busy |= cmd_exec_has_foreground(ids[i]);
+        }
+    }
+    double dt = now_sec() - t0;
+    printf("%-8s %d tab%s x %ld MB: %7.0f MB/s\n", reactor_backend(), ntabs, ntabs == 1 ? "" : "s", mb,
+           (double)ntabs * (double)mb / dt);
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ntabs = argc > 1 ? atoi(argv[1]) : 4;
+    long mb = argc > 2 ? atol(argv[2]) : 256;
+    if (ntabs < 1 || ntabs > 16)
+        ntabs = 4;
+    static const char *backends[] = {"epoll", "uring"};
+    for (int b = 0; b < 2; ++b)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(run(backends[b], ntabs, mb));
+        int st = 0;
+        waitpid(pid, &st, 0);
+        if (!WIFEXITED(st) || WEXITSTATUS(st) != 0)
+            fprintf(stderr, "ingest_bench: the %s run failed\n", backends[b]);
+    }
+    return 0;
+}
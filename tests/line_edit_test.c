@@ -0,0 +1,227 @@
+/* LineEditor: the gap buffer must hold any amount of text and read back the same
+   through every accessor, and the cached layout (line count, line lengths, cursor
+   row/column) must match a layout recomputed from the buffer after every kind of edit */
+#include "line_edit.h"
+#include "test_util.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the layout of text with the cursor at byte cur, computed from scratch */
+static void expect_layout(LineEditor *le, const char *text, size_t cur)
+{
+    size_t len = strlen(text), rows = 1, row = 0, col = 0, line = 0;
+    CHECK(le_get_length(le) == len);
+    CHECK(le_get_cursor(le) == cur);
+    for (size_t i = 0; i <= len; ++i)
+    {
+        if (i == cur)
+        {
+            row = rows - 1;
+            col = line;
+        }
+        if (i == len || text[i] == '\n')
+        {
+            CHECK(le_get_line_length(le, rows - 1) == line);
+            if (i < len)
+                ++rows;
+            line = 0;
+        }
+        else
+            ++line;
+    }
+    CHECK(le_get_line_count(le) == rows);
+    size_t r, c;
+    le_get_cursor_rowcol(le, &r, &c);
+    CHECK(r == row && c == col);
+}
+
+static void test_edits(void)
+{
+    LineEditor *le = le_create(NULL);
+    le_set_term_mode(le, 0);
+    expect_layout(le, "", 0);
+
+    const char *text = "echo a\nsecond line\n\xc3\xa9t\xc3\xa9";
+    le_feed_bytes(le, text, strlen(text));
+    expect_layout(le, text, 24);
+
+    le_move_left(le); /* over a 2-byte code point */
+    expect_layout(le, text, 22);
+    le_feed_byte(le, 0x01); /* Ctrl+A */
+    expect_layout(le, text, 0);
+    le_feed_bytes(le, "x\n", 2);
+    expect_layout(le, "x\necho a\nsecond line\n\xc3\xa9t\xc3\xa9", 2);
+
+    le_feed_byte(le, 0x7f); /* backspace joins the first two lines */
+    expect_layout(le, "xecho a\nsecond line\n\xc3\xa9t\xc3\xa9", 1);
+    for (int i = 0; i < 6; ++i)
+        le_move_right(le);
+    le_delete_forward(le); /* the '\n' after "xecho a" */
+    expect_layout(le, "xecho asecond line\n\xc3\xa9t\xc3\xa9", 7);
+
+    le_feed_byte(le, 0x05); /* Ctrl+E */
+    le_replace_last_word(le, "word");
+    expect_layout(le, "xecho asecond line\nword", 23);
+
+    le_reset(le);
+    expect_layout(le, "", 0);
+    le_destroy(le);
+}
+
+/* random edits against a plain-array model */
+static void test_random(void)
+{
+    static char model[1 << 16];
+    size_t len = 0, cur = 0;
+    static const char *units[] = {"a", "\n", "\xc3\xa9", " ", "xy\nz\n"};
+    LineEditor *le = le_create(NULL);
+    le_set_term_mode(le, 0);
+    unsigned s = 1;
+    for (int it = 0; it < 20000 && !failures; ++it)
+    {
+        s = s * 1103515245u + 12345u;
+        int op = (int)((s >> 16) % 8);
+        if (op < 4 && len < sizeof(model) - 8)
+        {
+            const char *u = units[(s >> 4) % 5];
+            size_t n = strlen(u);
+            le_feed_bytes(le, u, n);
+            memmove(model + cur + n, model + cur, len - cur);
+            memcpy(model + cur, u, n);
+            len += n;
+            cur += n;
+        }
+        else if (op == 4 && cur > 0)
+        {
+            size_t n = 1;
+            while (cur - n > 0 && (model[cur - n] & 0xC0) == 0x80)
+                ++n;
+            le_feed_byte(le, 0x7f);
+            memmove(model + cur - n, model + cur, len - cur);
+            len -= n;
+            cur -= n;
+        }
+        else if (op == 5 && cur > 0)
+        {
+            le_move_left(le);
+            while (--cur > 0 && (model[cur] & 0xC0) == 0x80)
+                ;
+        }
+        else if (op == 6 && cur < len)
+        {
+            le_move_right(le);
+            while (++cur < len && (model[cur] & 0xC0) == 0x80)
+                ;
+        }
+        else if (op == 7)
+        {
+            le_feed_byte(le, (s >> 5) & 1 ? 0x01 : 0x05);
+            cur = (s >> 5) & 1 ? 0 : len;
+        }
+        model[len] = '\0';
+        expect_layout(le, model, cur);
+    }
+    le_destroy(le);
+}
+
+/* the editor's bytes [off, off+n) through le_get_spans() equal want */
+static int spans_equal(LineEditor *le, size_t off, size_t n, const char *want)
+{
+    const char *a, *b;
+    size_t alen = 0, blen = 0;
+    int k = le_get_spans(le, off, n, &a, &alen, &b, &blen);
+    if (alen + (k > 1 ? blen : 0) != n)
+        return 0;
+    return (alen == 0 || memcmp(a, want, alen) == 0) && (k < 2 || memcmp(b, want + alen, blen) == 0);
+}
+
+/* far past the old 4 KB limit, edited in the middle so the gap sits inside the text */
+static void test_gap_buffer(void)
+{
+    enum { N = 1 << 20 };
+    char *text = malloc(N + 1);
+    for (size_t i = 0; i < N; ++i)
+        text[i] = (char)('a' + i % 26);
+    text[N] = '\0';
+    LineEditor *le = le_create(NULL);
+    le_set_term_mode(le, 0);
+    le_feed_bytes(le, text, N);
+    CHECK(le_get_length(le) == N);
+    CHECK(spans_equal(le, 0, N, text));
+
+    /* move the cursor (and the gap) back to the middle and insert there */
+    for (size_t i = 0; i < N / 2; ++i)
+        le_move_left(le);
+    CHECK(le_get_cursor(le) == N / 2);
+    le_feed_bytes(le, "MID", 3);
+    char *want = malloc(N + 4);
+    memcpy(want, text, N / 2);
+    memcpy(want + N / 2, "MID", 3);
+    memcpy(want + N / 2 + 3, text + N / 2, N / 2 + 1);
+    CHECK(spans_equal(le, 0, N + 3, want));
+    CHECK(spans_equal(le, N / 2 - 10, 20, want + N / 2 - 10)); /* across the gap */
+    CHECK(spans_equal(le, N / 2 + 3, 100, want + N / 2 + 3));
+
+    char *dup = le_dup_buffer(le);
+    CHECK(dup && strcmp(dup, want) == 0);
+    free(dup);
+    const char *flat = le_get_buffer(le);
+    CHECK(strlen(flat) == N + 3 && strcmp(flat, want) == 0);
+
+    /* deleting at the gap still works after it has been closed by le_get_buffer() */
+    le_feed_byte(le, 0x7f);
+    le_delete_forward(le);
+    CHECK(le_get_length(le) == N + 1);
+    CHECK(le_get_cursor(le) == N / 2 + 2);
+    memmove(want + N / 2 + 2, want + N / 2 + 4, N / 2); /* the rest, NUL included */
+    CHECK(strcmp(le_get_buffer(le), want) == 0);
+
+    le_reset(le);
+    CHECK(le_get_length(le) == 0 && strcmp(le_get_buffer(le), "") == 0);
+    le_destroy(le);
+    free(want);
+    free(text);
+}
+
+/* heap bytes in use, mmapped blocks included */
+static size_t heap_in_use(void)
+{
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+/* le_reset() after a paste of many MB and lines hands the memory back, and the editor
+   carries on as new */
+static void test_reset_shrinks(void)
+{
+    enum { N = 4 << 20 };
+    char *text = malloc(N);
+    for (size_t i = 0; i < N; ++i)
+        text[i] = i % 8 == 7 ? '\n' : 'x';
+    LineEditor *le = le_create(NULL);
+    le_set_term_mode(le, 0);
+    le_feed_bytes(le, text, N);
+    CHECK(le_get_line_count(le) == N / 8 + 1);
+    free(text);
+
+    size_t before = heap_in_use();
+    le_reset(le);
+    size_t after = heap_in_use();
+    CHECK(before > after && before - after >= (size_t)N + N / 8 * sizeof(size_t));
+
+    le_feed_bytes(le, "ab\ncd", 5);
+    expect_layout(le, "ab\ncd", 5);
+    le_destroy(le);
+}
+
+int main(void)
+{
+    test_edits();
+    test_random();
+    test_gap_buffer();
+    test_reset_shrinks();
+    return test_finish("line_edit_test");
+}
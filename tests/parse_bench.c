@@ -0,0 +1,372 @@
+/* Command line parsing: sh_parse() (one pass into an arena) against the tokenizer
+   cmd_exec.c used before it (a copy of it follows: the pipe pre-pass, the quote-aware
+   splitter with its fixed token buffer, and the per-token strdup into Cmd structs;
+   it only understood pipes and redirections, so the lines below stay within that).
+   Each line is parsed and freed again many times; ns per line.
+   usage: parse_bench [iterations] */
+#define _GNU_SOURCE
+#include "shell_parse.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* -------------------- the old tokenizer -------------------- */
+
+static char *preprocess_pipes(const char *in)
+{
+    size_t n = strlen(in);
+    char *out = malloc(n * 3 + 1); /* generous */
+    if (!out)
+        return NULL;
+    const char *p = in;
+    char *q = out;
+    int in_single = 0, in_double = 0;
+    while (*p)
+    {
+        if (*p == '\'' && !in_double)
+        {
+            in_single = !in_single;
+            *q++ = *p++;
+            continue;
+        }
+        if (*p == '"' && !in_single)
+        {
+            in_double = !in_double;
+            *q++ = *p++;
+            continue;
+        }
+        if (!in_single && !in_double && *p == '|')
+        {
+            *q++ = ' ';
+            *q++ = '|';
+            *q++ = ' ';
+            ++p;
+            continue;
+        }
+        *q++ = *p++;
+    }
+    *q = '\0';
+    return out;
+}
+
+static int tokenize_quoted(const char *input, char **argv, int max_args)
+{
+    int argc = 0;
+    const char *p = input;
+    while (*p && argc < max_args - 1)
+    {
+        while (*p && (*p == ' ' || *p == '\t' || *p == '\n'))
+            ++p;
+        if (!*p)
+            break;
+        int in_single = 0, in_double = 0;
+        char tmp[8192];
+        int ti = 0;
+        while (*p)
+        {
+            if (!in_single && *p == '"')
+            {
+                in_double = !in_double;
+                ++p;
+                continue;
+            }
+            if (!in_double && *p == '\'')
+            {
+                in_single = !in_single;
+                ++p;
+                continue;
+            }
+            if (!in_single && !in_double && (*p == ' ' || *p == '\t' || *p == '\n'))
+                break;
+            if (*p == '\\')
+            {
+                ++p;
+                if (!*p)
+                    break;
+                if (*p == 'n')
+                    tmp[ti++] = '\n';
+                else if (*p == 't')
+                    tmp[ti++] = '\t';
+                else if (*p == '\\')
+                    tmp[ti++] = '\\';
+                else if (*p == '"')
+                    tmp[ti++] = '"';
+                else if (*p == '\'')
+                    tmp[ti++] = '\'';
+                else
+                    tmp[ti++] = *p;
+                ++p;
+                continue;
+            }
+            tmp[ti++] = *p++;
+            if (ti >= (int)sizeof(tmp) - 2)
+                break;
+        }
+        tmp[ti] = '\0';
+        argv[argc] = strdup(tmp);
+        if (!argv[argc])
+        {
+            for (int i = 0; i < argc; ++i)
+                free(argv[i]);
+            return -1;
+        }
+        argc++;
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+/* Simple Cmd structure */
+typedef struct
+{
+    char **argv; /* NULL-terminated */
+    int argc;
+    char *infile;  /* optional (malloc'd) */
+    char *outfile; /* optional (malloc'd) */
+    int append;    /* for outfile: append if 1 */
+} Cmd;
+
+static void free_cmd(Cmd *c)
+{
+    if (!c)
+        return;
+    if (c->argv)
+    {
+        for (int i = 0; i < c->argc; ++i)
+            if (c->argv[i])
+                free(c->argv[i]);
+        free(c->argv);
+    }
+    if (c->infile)
+        free(c->infile);
+    if (c->outfile)
+        free(c->outfile);
+    c->argv = NULL;
+    c->argc = 0;
+    c->infile = NULL;
+    c->outfile = NULL;
+    c->append = 0;
+}
+
+static void sanitize_filename(char *s)
+{
+    if (!s)
+        return;
+    char *start = s;
+    while (*start && isspace((unsigned char)*start))
+        ++start;
+    if (start != s)
+        memmove(s, start, strlen(start) + 1);
+    size_t L = strlen(s);
+    while (L > 0 && (isspace((unsigned char)s[L - 1]) || s[L - 1] == '\r'))
+    {
+        s[L - 1] = '\0';
+        --L;
+    }
+}
+
+static int parse_tokens_into_cmds(char **tokens, int ntoks, Cmd *cmds, int max_cmds)
+{
+    int cmd_idx = 0;
+    if (max_cmds < 1)
+        return -1;
+    for (int z = 0; z < max_cmds; ++z)
+    {
+        cmds[z].argv = NULL;
+        cmds[z].argc = 0;
+        cmds[z].infile = NULL;
+        cmds[z].outfile = NULL;
+        cmds[z].append = 0;
+    }
+    cmds[cmd_idx].argc = 0;
+    cmds[cmd_idx].argv = malloc(sizeof(char *) * 128);
+    if (!cmds[cmd_idx].argv)
+        return -1;
+    int argcap = 128;
+    for (int i = 0; i < ntoks; ++i)
+    {
+        char *tk = tokens[i];
+        if (!tk)
+            continue;
+        if (strcmp(tk, "|") == 0)
+        {
+            cmds[cmd_idx].argv[cmds[cmd_idx].argc] = NULL;
+            cmd_idx++;
+            if (cmd_idx >= max_cmds)
+                return -1;
+            cmds[cmd_idx].argc = 0;
+            cmds[cmd_idx].argv = malloc(sizeof(char *) * 128);
+            if (!cmds[cmd_idx].argv)
+                return -1;
+            argcap = 128;
+            continue;
+        }
+        if (strcmp(tk, "<") == 0)
+        {
+            if (i + 1 >= ntoks)
+                return -1;
+            if (cmds[cmd_idx].infile)
+                free(cmds[cmd_idx].infile);
+            cmds[cmd_idx].infile = strdup(tokens[++i]);
+            if (cmds[cmd_idx].infile)
+                sanitize_filename(cmds[cmd_idx].infile);
+            continue;
+        }
+        else if (tk[0] == '<' && tk[1] != '\0')
+        {
+            if (cmds[cmd_idx].infile)
+                free(cmds[cmd_idx].infile);
+            cmds[cmd_idx].infile = strdup(tk + 1);
+            if (cmds[cmd_idx].infile)
+                sanitize_filename(cmds[cmd_idx].infile);
+            continue;
+        }
+        else if (strcmp(tk, ">>") == 0)
+        {
+            if (i + 1 >= ntoks)
+                return -1;
+            if (cmds[cmd_idx].outfile)
+                free(cmds[cmd_idx].outfile);
+            cmds[cmd_idx].outfile = strdup(tokens[++i]);
+            cmds[cmd_idx].append = 1;
+            if (cmds[cmd_idx].outfile)
+                sanitize_filename(cmds[cmd_idx].outfile);
+            continue;
+        }
+        else if (strncmp(tk, ">>", 2) == 0)
+        {
+            if (cmds[cmd_idx].outfile)
+                free(cmds[cmd_idx].outfile);
+            cmds[cmd_idx].outfile = strdup(tk + 2);
+            cmds[cmd_idx].append = 1;
+            if (cmds[cmd_idx].outfile)
+                sanitize_filename(cmds[cmd_idx].outfile);
+            continue;
+        }
+        else if (strcmp(tk, ">") == 0)
+        {
+            if (i + 1 >= ntoks)
+                return -1;
+            if (cmds[cmd_idx].outfile)
+                free(cmds[cmd_idx].outfile);
+            cmds[cmd_idx].outfile = strdup(tokens[++i]);
+            cmds[cmd_idx].append = 0;
+            if (cmds[cmd_idx].outfile)
+                sanitize_filename(cmds[cmd_idx].outfile);
+            continue;
+        }
+        else if (tk[0] == '>' && tk[1] != '\0')
+        {
+            if (cmds[cmd_idx].outfile)
+                free(cmds[cmd_idx].outfile);
+            cmds[cmd_idx].outfile = strdup(tk + 1);
+            cmds[cmd_idx].append = 0;
+            if (cmds[cmd_idx].outfile)
+                sanitize_filename(cmds[cmd_idx].outfile);
+            continue;
+        }
+        if (cmds[cmd_idx].argc + 2 >= argcap)
+        {
+            argcap *= 2;
+            char **newv = realloc(cmds[cmd_idx].argv, sizeof(char *) * argcap);
+            if (!newv)
+                return -1;
+            cmds[cmd_idx].argv = newv;
+        }
+        cmds[cmd_idx].argv[cmds[cmd_idx].argc++] = strdup(tk);
+    }
+    cmds[cmd_idx].argv[cmds[cmd_idx].argc] = NULL;
+    return cmd_idx + 1;
+}
+
+/* -------------------- the benchmark -------------------- */
+
+#define MAX_TOKENS 512
+#define MAX_CMDS 64
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int parse_old(const char *line)
+{
+    char *pre = preprocess_pipes(line);
+    if (!pre)
+        return -1;
+    char *toks[MAX_TOKENS];
+    int n = tokenize_quoted(pre, toks, MAX_TOKENS);
+    free(pre);
+    if (n < 0)
+        return -1;
+    Cmd cmds[MAX_CMDS];
+    int nc = parse_tokens_into_cmds(toks, n, cmds, MAX_CMDS);
+    for (int i = 0; i < n; ++i)
+        free(toks[i]);
+    for (int i = 0; i < MAX_CMDS; ++i)
+        free_cmd(&cmds[i]);
+    return nc;
+}
+
+static int parse_new(const char *line)
+{
+    Arena *a = arena_create(0);
+    if (!a)
+        return -1;
+    const char *err;
+    ShNode *root = sh_parse(a, line, &err);
+    int n = root ? root->ncmds : -1;
+    arena_destroy(a);
+    return n;
+}
+
+/* ns per call of parse(line) */
+static double time_parse(int (*parse)(const char *), const char *line, long iters)
+{
+    volatile int sink = 0;
+    double t0 = now_sec();
+    for (long i = 0; i < iters; ++i)
+        sink += parse(line);
+    (void)sink;
+    return (now_sec() - t0) / (double)iters * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 200000;
+    if (iters <= 0)
+    {
+        fprintf(stderr, "usage: parse_bench [iterations]\n");
+        return 2;
+    }
+
+    /* 300 arguments, within the old tokenizer's 512 tokens */
+    char many[4096];
+    size_t m = (size_t)snprintf(many, sizeof(many), "printf");
+    for (int i = 0; i < 300 && m + 8 < sizeof(many); ++i)
+        m += (size_t)snprintf(many + m, sizeof(many) - m, " 'a %d'", i % 10);
+
+    static const char *names[] = {"simple", "pipeline", "quoting", "300 args"};
+    const char *lines[] = {
+        "ls -la /usr/bin",
+        "ls -la /usr/bin | grep foo | sort -r | wc -l > out.txt",
+        "echo \"hello world\" 'single q' a\\ b \"tab\\there\" | tr a-z A-Z >> log",
+        many,
+    };
+    printf("%-10s %12s %12s %8s\n", "line", "old ns", "sh_parse ns", "speedup");
+    for (size_t l = 0; l < sizeof(lines) / sizeof(lines[0]); ++l)
+    {
+        long n = l == 3 ? iters / 20 + 1 : iters;
+        if (parse_old(lines[l]) != parse_new(lines[l]))
+            fprintf(stderr, "%s: the parsers disagree on the number of stages\n", names[l]);
+        double o = time_parse(parse_old, lines[l], n);
+        double s = time_parse(parse_new, lines[l], n);
+        printf("%-10s %12.0f %12.0f %7.1fx\n", names[l], o, s, o / s);
+    }
+    return 0;
+}
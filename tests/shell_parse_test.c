@@ -0,0 +1,237 @@
+/* sh_parse(): the AST of each line, printed back in a bracketed form, is compared
+   with the expected one; then quoting, the glob flag and its escapes, and syntax
+   errors */
+#include "shell_parse.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    char buf[1024];
+    size_t len;
+} Out;
+
+static void put(Out *o, const char *s)
+{
+    size_t n = strlen(s);
+    if (o->len + n < sizeof(o->buf))
+    {
+        memcpy(o->buf + o->len, s, n + 1);
+        o->len += n;
+    }
+}
+
+/* a pipeline prints as [time cmd | cmd] &, a command as its words (a glob word with
+   a leading ~) then its redirections, a subshell as (body), and/or/seq as {l op r} */
+static void dump(Out *o, const ShNode *n)
+{
+    char tmp[32];
+    if (n->kind != SH_PIPELINE)
+    {
+        put(o, "{");
+        dump(o, n->left);
+        put(o, n->kind == SH_AND ? " && " : n->kind == SH_OR ? " || " : " ; ");
+        dump(o, n->right);
+        put(o, "}");
+        return;
+    }
+    put(o, n->timed ? "[time " : "[");
+    for (int i = 0; i < n->ncmds; ++i)
+    {
+        const ShCommand *c = &n->cmds[i];
+        if (i)
+            put(o, " | ");
+        if (c->body)
+        {
+            put(o, "(");
+            dump(o, c->body);
+            put(o, ")");
+        }
+        for (int k = 0; k < c->argc; ++k)
+        {
+            if (k)
+                put(o, " ");
+            if (c->glob[k])
+                put(o, "~");
+            put(o, c->argv[k]);
+        }
+        for (const ShRedir *r = c->redirs; r; r = r->next)
+        {
+            static const char *ops[] = {"<", ">", ">>", ">&"};
+            snprintf(tmp, sizeof(tmp), " %d%s", r->fd, ops[r->kind]);
+            put(o, tmp);
+            if (r->kind == SH_REDIR_DUP)
+            {
+                snprintf(tmp, sizeof(tmp), "%d", r->dup_fd);
+                put(o, tmp);
+            }
+            else
+                put(o, r->target);
+        }
+    }
+    put(o, n->background ? "] &" : "]");
+}
+
+static void expect_tree(const char *src, const char *want, int line)
+{
+    Arena *a = arena_create(0);
+    const char *err;
+    ShNode *root = sh_parse(a, src, &err);
+    Out o = {"", 0};
+    if (root)
+        dump(&o, root);
+    else
+        put(&o, err ? err : "(nothing)");
+    if (strcmp(o.buf, want) != 0)
+    {
+        fprintf(stderr, "%s:%d: parse of \"%s\"\n  got  %s\n  want %s\n", __FILE__, line, src, o.buf, want);
+        ++failures;
+    }
+    arena_destroy(a);
+}
+
+#define EXPECT_TREE(src, want) expect_tree(src, want, __LINE__)
+
+static void test_shapes(void)
+{
+    EXPECT_TREE("ls -l", "[ls -l]");
+    EXPECT_TREE("  a | b |c", "[a | b | c]");
+    EXPECT_TREE("a; b; c", "{{[a] ; [b]} ; [c]}");
+    EXPECT_TREE("a && b || c", "{{[a] && [b]} || [c]}");
+    EXPECT_TREE("a | b && c | d", "{[a | b] && [c | d]}");
+    EXPECT_TREE("a &&\n b", "{[a] && [b]}");
+    EXPECT_TREE("a |\n\n b", "[a | b]");
+    EXPECT_TREE("a\nb;", "{[a] ; [b]}");
+    EXPECT_TREE("(a; b) | c", "[({[a] ; [b]}) | c]");
+    EXPECT_TREE("(a && (b)) > out", "[({[a] && [([b])]}) 1>out]");
+    EXPECT_TREE("a < in > out 2>> log 2>&1", "[a 0<in 1>out 2>>log 2>&1]");
+    EXPECT_TREE("a<in>out", "[a 0<in 1>out]");
+    EXPECT_TREE("> empty", "[ 1>empty]");
+    EXPECT_TREE("a 3<&0", "[a 3>&0]");
+    EXPECT_TREE("a 12>x", "[a 12 1>x]");
+    EXPECT_TREE("sleep 1 & b", "{[sleep 1] & ; [b]}");
+    EXPECT_TREE("a && b &", "[({[a] && [b]})] &");
+    EXPECT_TREE("time a | b", "[time a | b]");
+    EXPECT_TREE("time", "[time]");
+    EXPECT_TREE("'time' a", "[time a]");
+    EXPECT_TREE("a # b | c", "[a]");
+    EXPECT_TREE("a#b", "[a#b]");
+    EXPECT_TREE("# only a comment", "(nothing)");
+    EXPECT_TREE("   \n ", "(nothing)");
+}
+
+static void test_background_source(void)
+{
+    Arena *a = arena_create(0);
+    const char *err;
+    ShNode *root = sh_parse(a, "x; a && b  & y", &err);
+    CHECK(root && root->kind == SH_SEQ && root->left->kind == SH_SEQ);
+    if (root && root->kind == SH_SEQ && root->left->kind == SH_SEQ)
+    {
+        const ShNode *bg = root->left->right;
+        CHECK(bg->kind == SH_PIPELINE && bg->background && bg->ncmds == 1);
+        CHECK(bg->cmds[0].body && strcmp(bg->cmds[0].source, "a && b") == 0);
+    }
+    root = sh_parse(a, "( echo hi ) ", &err);
+    CHECK(root && root->cmds[0].body && strcmp(root->cmds[0].source, " echo hi ") == 0);
+    CHECK(root && root->cmds[0].argc == 0 && root->cmds[0].argv[0] == NULL);
+    arena_destroy(a);
+}
+
+static void test_words(void)
+{
+    Arena *a = arena_create(0);
+    const char *err;
+    ShNode *root = sh_parse(a, "echo 'a b' \"c \\\"d\\\" $x\" e\\ f g\\tx 'it'\\''s' \"\" a'|'b", &err);
+    CHECK(root && root->ncmds == 1);
+    if (root && root->ncmds == 1)
+    {
+        static const char *want[] = {"echo", "a b", "c \"d\" $x", "e f", "g\tx", "it's", "", "a|b"};
+        const ShCommand *c = &root->cmds[0];
+        CHECK(c->argc == 8);
+        for (int i = 0; i < c->argc && i < 8; ++i)
+        {
+            CHECK(strcmp(c->argv[i], want[i]) == 0);
+            CHECK(!c->glob[i]);
+        }
+        CHECK(c->argv[c->argc] == NULL);
+    }
+
+    /* a word with any unquoted glob character is flagged, and its quoted or escaped
+       glob characters are escaped for glob_expand() */
+    root = sh_parse(a, "ls *.c 'a*'* \"[x]\"? \\{a,b} b{1,2} a\\\\* '*' \\? x", &err);
+    CHECK(root && root->ncmds == 1);
+    if (root && root->ncmds == 1)
+    {
+        static const char *want[] = {"ls", "*.c", "a\\**", "\\[x\\]?", "{a,b}", "b{1,2}",
+                                     "a\\\\*", "*", "?", "x"};
+        static const unsigned char glob[] = {0, 1, 1, 1, 0, 1, 1, 0, 0, 0};
+        const ShCommand *c = &root->cmds[0];
+        CHECK(c->argc == 10);
+        for (int i = 0; i < c->argc && i < 10; ++i)
+        {
+            CHECK(strcmp(c->argv[i], want[i]) == 0);
+            CHECK(c->glob[i] == glob[i]);
+        }
+    }
+
+    /* redirection targets are not globbed: no escapes left in them */
+    root = sh_parse(a, "cat < 'a*'b? > \"[o]\"*", &err);
+    CHECK(root && root->cmds[0].redirs && root->cmds[0].redirs->next);
+    if (root && root->cmds[0].redirs && root->cmds[0].redirs->next)
+    {
+        CHECK(strcmp(root->cmds[0].redirs->target, "a*b?") == 0);
+        CHECK(strcmp(root->cmds[0].redirs->next->target, "[o]*") == 0);
+    }
+
+    /* no size limits */
+    size_t n = 100000;
+    char *big = malloc(n * 2 + 8);
+    CHECK(big != NULL);
+    if (big)
+    {
+        char *p = big;
+        p += sprintf(p, "x");
+        for (size_t i = 0; i < n / 2; ++i)
+            p += sprintf(p, " y");
+        memset(p, 'z', n);
+        p[n] = '\0';
+        root = sh_parse(a, big, &err);
+        CHECK(root && root->cmds[0].argc == (int)(n / 2) + 1);
+        CHECK(root && strlen(root->cmds[0].argv[n / 2]) == n + 1);
+        free(big);
+    }
+    arena_destroy(a);
+}
+
+static void test_errors(void)
+{
+    EXPECT_TREE("a |", "syntax error: unexpected end of line");
+    EXPECT_TREE("| a", "syntax error near unexpected token `|'");
+    EXPECT_TREE("a && && b", "syntax error near unexpected token `&&'");
+    EXPECT_TREE("a ;; b", "syntax error near unexpected token `;'");
+    EXPECT_TREE("a >", "syntax error: unexpected end of line");
+    EXPECT_TREE("a > | b", "syntax error near unexpected token `|'");
+    EXPECT_TREE("a >\nb", "syntax error near unexpected newline");
+    EXPECT_TREE("(a", "syntax error: unexpected end of line");
+    EXPECT_TREE("a)", "syntax error near unexpected token `)'");
+    EXPECT_TREE("()", "syntax error near unexpected token `)'");
+    EXPECT_TREE("(a) b", "syntax error near unexpected token `b'");
+    EXPECT_TREE("echo 'abc", "syntax error: unterminated quote");
+    EXPECT_TREE("echo \"abc\\\"", "syntax error: unterminated quote");
+    EXPECT_TREE("cat << EOF", "here-documents are not supported");
+    EXPECT_TREE("a 2>&x", "x: bad file descriptor for duplication");
+    EXPECT_TREE("a >&12", "12: bad file descriptor for duplication");
+}
+
+int main(void)
+{
+    test_shapes();
+    test_background_source();
+    test_words();
+    test_errors();
+    return test_finish("shell_parse_test");
+}
@@ -0,0 +1,78 @@
+/* Spawn latency: fork() + execvp() in the child, as pipeline stages were started
+   before launch.c, against launch_spawn() (posix_spawn with a vfork-style clone).
+   Both are timed while the process has more and more
+   touched heap: fork() has to copy the page tables of all of it, the clone does not.
+   usage: spawn_bench [spawns per step] [heap MB per step] [steps] */
+#include "launch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static pid_t spawn_fork(char *const *argv)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t spawn_launch(char *const *argv)
+{
+    LaunchSpec ls = {argv, -1, -1, -1, 0, NULL, -1, NULL};
+    return launch_spawn(&ls);
+}
+
+/* microseconds per spawn + reap of `true` */
+static double time_spawns(pid_t (*spawn)(char *const *), int n)
+{
+    char *argv[] = {"true", NULL};
+    double t0 = now_us();
+    for (int i = 0; i < n; ++i)
+    {
+        pid_t pid = spawn(argv);
+        if (pid < 0)
+        {
+            perror("spawn");
+            exit(1);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (now_us() - t0) / n;
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 200;
+    size_t step_mb = argc > 2 ? (size_t)atol(argv[2]) : 256;
+    int steps = argc > 3 ? atoi(argv[3]) : 3;
+    printf("%10s %14s %14s\n", "heap", "fork+exec", "posix_spawn");
+    for (int s = 0; s < steps; ++s)
+    {
+        if (s > 0)
+        {
+            char *p = malloc(step_mb << 20);
+            if (!p)
+                break;
+            memset(p, 1, step_mb << 20); /* never freed: the heap keeps growing */
+        }
+        double f = time_spawns(spawn_fork, n);
+        double l = time_spawns(spawn_launch, n);
+        printf("%7zu MB %11.1f us %11.1f us\n", (size_t)s * step_mb, f, l);
+    }
+    return 0;
+}
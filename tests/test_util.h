@@ -0,0 +1,75 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+/* Shared by the unit tests under tests/ (one program each): CHECK() reports a failed
+   condition with its file and line and counts it, test_finish() prints the test's
+   "name: ok" / "name: FAILED" line and gives main() its exit code. The rest is
+   scratch-directory plumbing for tests that need files on disk. */
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int failures;
+
+#define CHECK(cond)                                                                    \
+    do                                                                                 \
+    {                                                                                  \
+        if (!(cond))                                                                   \
+        {                                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);   \
+            ++failures;                                                                \
+        }                                                                              \
+    } while (0)
+
+static inline int test_finish(const char *name)
+{
+    printf("%s: %s\n", name, failures ? "FAILED" : "ok");
+    return failures != 0;
+}
+
+/* mkdtemp() on tmpl ("/tmp/<name>.XXXXXX"); exits the test if that fails */
+static inline char *test_tmpdir(char *tmpl)
+{
+    if (!mkdtemp(tmpl))
+    {
+        perror(tmpl);
+        exit(1);
+    }
+    return tmpl;
+}
+
+static inline int test_rm_one(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+/* remove dir and everything below it (symlinks are removed, not followed) */
+static inline void test_rmtree(const char *dir)
+{
+    if (nftw(dir, test_rm_one, 16, FTW_DEPTH | FTW_PHYS) != 0)
+        fprintf(stderr, "could not remove %s\n", dir);
+}
+
+/* create or truncate path (relative to dirfd) holding data (NULL: empty), with
+   exactly mode whatever the umask */
+static inline void test_write_file(int dirfd, const char *path, const char *data, mode_t mode)
+{
+    int fd = openat(dirfd, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    size_t len = data ? strlen(data) : 0;
+    CHECK(write(fd, data ? data : "", len) == (ssize_t)len);
+    CHECK(fchmod(fd, mode) == 0);
+    close(fd);
+}
+
+#endif /* TEST_UTIL_H */